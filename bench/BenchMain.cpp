@@ -0,0 +1,303 @@
+// llshader-bench: microbenchmarks for the compiler pipeline over generated
+// .osl corpora. Results are printed as JSON unless another
+// --benchmark_format is requested, so runs can be archived and compared.
+//
+// Extra flags (everything else is passed to Google Benchmark):
+//   --corpus-max-bytes=N  largest corpus to benchmark (default 1 MiB,
+//                         up to 100 MiB)
+//   --corpus-seed=N       seed for the corpus generator
+//   --emit-corpus=N       write an N byte corpus to stdout and exit
+
+#include "BenchUtil.h"
+#include "CorpusGenerator.h"
+#include <llvm/Support/ErrorHandling.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+static std::atomic<uint64_t> AllocatedBytes{0};
+static std::atomic<int64_t> LiveBytes{0};
+
+static size_t usableSize(void *P)
+{
+#if defined(__GLIBC__)
+    return malloc_usable_size(P);
+#else
+    (void)P;
+    return 0;
+#endif
+}
+
+void *operator new(size_t Size)
+{
+    AllocatedBytes.fetch_add(Size, std::memory_order_relaxed);
+    void *P = std::malloc(Size ? Size : 1);
+    if (!P)
+        llvm::report_bad_alloc_error("llshader-bench: out of memory");
+    LiveBytes.fetch_add(usableSize(P), std::memory_order_relaxed);
+    return P;
+}
+
+void operator delete(void *P) noexcept
+{
+    if (P)
+        LiveBytes.fetch_sub(usableSize(P), std::memory_order_relaxed);
+    std::free(P);
+}
+void operator delete(void *P, size_t) noexcept { operator delete(P); }
+
+static uint64_t CorpusSeed = CorpusGenerator::DefaultSeed;
+static size_t CorpusMaxBytes = size_t(1) << 20;
+
+uint64_t bench::allocatedBytes()
+{
+    return AllocatedBytes.load(std::memory_order_relaxed);
+}
+
+int64_t bench::liveBytes() { return LiveBytes.load(std::memory_order_relaxed); }
+
+const std::string &bench::getCorpus(size_t Bytes)
+{
+    static std::map<size_t, std::unique_ptr<std::string>> Cache;
+    auto &Entry = Cache[Bytes];
+    if (!Entry)
+        Entry = std::make_unique<std::string>(
+            CorpusGenerator(CorpusSeed).generate(Bytes));
+    return *Entry;
+}
+
+const std::string &bench::getBakedCorpus(size_t Bytes)
+{
+    static std::map<size_t, std::unique_ptr<std::string>> Cache;
+    auto &Entry = Cache[Bytes];
+    if (!Entry)
+        Entry = std::make_unique<std::string>(
+            CorpusGenerator(CorpusSeed).generateBakedData(Bytes));
+    return *Entry;
+}
+
+const std::vector<size_t> &bench::getCorpusSizes()
+{
+    static const size_t Ladder[] = {size_t(1) << 10,  size_t(10) << 10,
+                                    size_t(100) << 10, size_t(1) << 20,
+                                    size_t(10) << 20,  size_t(100) << 20};
+    static std::vector<size_t> Sizes;
+    if (Sizes.empty())
+    {
+        for (size_t Size : Ladder)
+        {
+            if (Size <= CorpusMaxBytes)
+                Sizes.push_back(Size);
+        }
+    }
+    return Sizes;
+}
+
+namespace
+{
+class NodeCounter : public ASTVisitor
+{
+  public:
+    uint64_t Count = 0;
+
+    void visitAll(StmtList *SL)
+    {
+        if (SL)
+            for (auto S : *SL)
+                S->accept(*this);
+    }
+    void visitAll(ExprList *EL)
+    {
+        if (EL)
+            for (auto E : *EL)
+                E->accept(*this);
+    }
+    void visitOpt(AST *Node)
+    {
+        if (Node)
+            Node->accept(*this);
+    }
+
+    void visit(Program &Node) override
+    {
+        ++Count;
+        visitAll(Node.getSL());
+    }
+    void visit(CompoundSt &Node) override
+    {
+        ++Count;
+        visitAll(Node.getEL());
+    }
+    void visit(Scoped &Node) override
+    {
+        ++Count;
+        visitAll(Node.getSL());
+    }
+    void visit(DefExpr &Node) override
+    {
+        ++Count;
+        visitOpt(Node.getValue());
+    }
+    void visit(Declaration &Node) override
+    {
+        ++Count;
+        for (auto Def : *Node.getDefs())
+            Def->accept(*this);
+    }
+    void visit(Conditional &Node) override
+    {
+        ++Count;
+        visitOpt(Node.getCondition());
+        visitOpt(Node.getThen());
+        visitOpt(Node.getElse());
+    }
+    void visit(For &Node) override
+    {
+        ++Count;
+        visitOpt(Node.getInit());
+        visitOpt(Node.getCondition());
+        visitOpt(Node.getUpdate());
+        visitOpt(Node.getBody());
+    }
+    void visit(While &Node) override
+    {
+        ++Count;
+        visitOpt(Node.getCondition());
+        visitOpt(Node.getBody());
+    }
+    void visit(DoWhile &Node) override
+    {
+        ++Count;
+        visitOpt(Node.getCondition());
+        visitOpt(Node.getBody());
+    }
+    void visit(LoopMod &) override { ++Count; }
+    void visit(Literal &) override { ++Count; }
+    void visit(TypeConstructor &Node) override
+    {
+        ++Count;
+        visitAll(Node.getValues());
+    }
+    void visit(BinaryExpression &Node) override
+    {
+        ++Count;
+        visitOpt(Node.getE1());
+        visitOpt(Node.getE2());
+    }
+    void visit(UnaryExpression &Node) override
+    {
+        ++Count;
+        visitOpt(Node.getE());
+    }
+    void visit(LValue &Node) override
+    {
+        ++Count;
+        visitAll(Node.getIndices());
+    }
+    void visit(Assignment &Node) override
+    {
+        ++Count;
+        visitOpt(Node.getId());
+        visitOpt(Node.getValue());
+    }
+    void visit(VariableRef &Node) override
+    {
+        ++Count;
+        visitOpt(Node.getDeref());
+    }
+    void visit(IncDec &Node) override
+    {
+        ++Count;
+        visitOpt(Node.getId());
+    }
+    void visit(TypeCast &Node) override
+    {
+        ++Count;
+        visitOpt(Node.getE());
+    }
+    void visit(CompoundEx &Node) override
+    {
+        ++Count;
+        visitAll(Node.getEL());
+    }
+    void visit(Derivative &Node) override
+    {
+        ++Count;
+        visitOpt(Node.getE());
+    }
+};
+} // namespace
+
+uint64_t bench::countNodes(AST *Tree)
+{
+    NodeCounter Counter;
+    Tree->accept(Counter);
+    return Counter.Count;
+}
+
+void bench::destroyTree(AST *Tree) { delete Tree; }
+
+static bool consumeFlag(const char *Arg, const char *Name, uint64_t &Value)
+{
+    size_t Len = std::strlen(Name);
+    if (std::strncmp(Arg, Name, Len) != 0 || Arg[Len] != '=')
+        return false;
+    Value = std::strtoull(Arg + Len + 1, nullptr, 0);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<char *> Args;
+    bool HasFormat = false;
+    for (int I = 0; I < argc; ++I)
+    {
+        uint64_t Value;
+        if (I > 0 && consumeFlag(argv[I], "--corpus-max-bytes", Value))
+        {
+            CorpusMaxBytes = Value;
+            continue;
+        }
+        if (I > 0 && consumeFlag(argv[I], "--corpus-seed", Value))
+        {
+            CorpusSeed = Value;
+            continue;
+        }
+        if (I > 0 && consumeFlag(argv[I], "--emit-corpus", Value))
+        {
+            std::string Src = CorpusGenerator(CorpusSeed).generate(Value);
+            std::fwrite(Src.data(), 1, Src.size(), stdout);
+            return 0;
+        }
+        HasFormat |= std::strncmp(argv[I], "--benchmark_format", 18) == 0;
+        Args.push_back(argv[I]);
+    }
+    static char JsonFormat[] = "--benchmark_format=json";
+    if (!HasFormat)
+        Args.push_back(JsonFormat);
+
+    int NumArgs = static_cast<int>(Args.size());
+    benchmark::Initialize(&NumArgs, Args.data());
+    if (benchmark::ReportUnrecognizedArguments(NumArgs, Args.data()))
+        return 1;
+
+    bench::registerLexerBenchmarks();
+    bench::registerParserBenchmarks();
+    bench::registerSemaBenchmarks();
+    bench::registerCodeGenBenchmarks();
+    bench::registerFlatASTBenchmarks();
+    bench::registerRuntimeBenchmarks();
+    bench::registerInterpBenchmarks();
+    bench::registerOSOBenchmarks();
+    bench::registerFrontendBenchmarks();
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
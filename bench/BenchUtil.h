@@ -0,0 +1,59 @@
+#ifndef LLSHADER_BENCH_BENCHUTIL_H
+#define LLSHADER_BENCH_BENCHUTIL_H
+
+#include "llshader/AST/AST.h"
+#include <benchmark/benchmark.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace bench
+{
+
+// Corpus of (at least) Bytes bytes, generated once per size and cached for
+// the lifetime of the process.
+const std::string &getCorpus(size_t Bytes);
+
+// Like getCorpus, for a shader of baked numeric tables.
+const std::string &getBakedCorpus(size_t Bytes);
+
+// Sizes every corpus-driven benchmark is registered for.
+const std::vector<size_t> &getCorpusSizes();
+
+// Heap traffic counted by the global operator new in BenchMain.cpp.
+uint64_t allocatedBytes();
+
+// Heap bytes currently held through operator new, including malloc's
+// rounding; 0 where malloc cannot report block sizes.
+int64_t liveBytes();
+
+// Number of AST nodes reachable from Tree.
+uint64_t countNodes(AST *Tree);
+
+// Releases a tree returned by Parser::parse.
+void destroyTree(AST *Tree);
+
+// Publishes the counters shared by every benchmark in the suite.
+inline void setCounters(benchmark::State &State, uint64_t Bytes,
+                        uint64_t AllocBytes)
+{
+    State.SetBytesProcessed(static_cast<int64_t>(Bytes));
+    State.counters["bytes_allocated"] =
+        benchmark::Counter(static_cast<double>(AllocBytes),
+                           benchmark::Counter::kAvgIterations);
+}
+
+void registerLexerBenchmarks();
+void registerParserBenchmarks();
+void registerSemaBenchmarks();
+void registerCodeGenBenchmarks();
+void registerFlatASTBenchmarks();
+void registerRuntimeBenchmarks();
+void registerInterpBenchmarks();
+void registerOSOBenchmarks();
+void registerFrontendBenchmarks();
+
+} // namespace bench
+
+#endif
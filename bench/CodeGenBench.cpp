@@ -0,0 +1,78 @@
+#include "BenchUtil.h"
+#include "llshader/Basic/Diagnostic.h"
+#include "llshader/CodeGen/CodeGen.h"
+#include "llshader/Lexer/Lexer.h"
+#include "llshader/Parser/Parser.h"
+#include "llshader/Sema/Sema.h"
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+
+namespace
+{
+// Args: corpus size.
+void BM_CodeGenCompile(benchmark::State &State, size_t Size)
+{
+    const std::string &Src = bench::getCorpus(Size);
+    llvm::SourceMgr SrcMgr;
+    SrcMgr.AddNewSourceBuffer(
+        llvm::MemoryBuffer::getMemBuffer(Src, "corpus.osl"), llvm::SMLoc());
+    DiagnosticsEngine Diags(SrcMgr);
+    Lexer Lex(SrcMgr, Diags);
+    Parser P(Lex, Diags);
+    AST *Tree = P.parse();
+    if (!Tree)
+    {
+        State.SkipWithError("corpus failed to parse");
+        return;
+    }
+    Sema S;
+    if (!S.semantic(Tree))
+    {
+        bench::destroyTree(Tree);
+        State.SkipWithError("corpus failed semantic analysis");
+        return;
+    }
+    uint64_t NodesPerTree = bench::countNodes(Tree);
+
+    uint64_t Nodes = 0;
+    uint64_t Instructions = 0;
+    uint64_t Alloc = 0;
+    for (auto _ : State)
+    {
+        uint64_t Before = bench::allocatedBytes();
+        // A context of its own per shader, as the driver has; destroying it
+        // is part of the cost.
+        {
+            llvm::LLVMContext Ctx;
+            llvm::Module M("ShaderLLVM", Ctx);
+            CodeGen CG(&M, &Ctx);
+            if (!CG.compile(Tree))
+            {
+                State.SkipWithError("corpus failed code generation");
+                break;
+            }
+            for (const llvm::Function &F : M)
+                Instructions += F.getInstructionCount();
+        }
+        Alloc += bench::allocatedBytes() - Before;
+        Nodes += NodesPerTree;
+    }
+    bench::destroyTree(Tree);
+    bench::setCounters(State, State.iterations() * Src.size(), Alloc);
+    State.counters["nodes_per_second"] = benchmark::Counter(
+        static_cast<double>(Nodes), benchmark::Counter::kIsRate);
+    State.counters["instructions_per_second"] = benchmark::Counter(
+        static_cast<double>(Instructions), benchmark::Counter::kIsRate);
+}
+} // namespace
+
+void bench::registerCodeGenBenchmarks()
+{
+    for (size_t Size : getCorpusSizes())
+        benchmark::RegisterBenchmark("BM_CodeGenCompile", BM_CodeGenCompile,
+                                     Size)
+            ->Arg(static_cast<int64_t>(Size))
+            ->Unit(benchmark::kMicrosecond);
+}
@@ -0,0 +1,345 @@
+#include "CorpusGenerator.h"
+
+static const char *const FloatLiterals[] = {
+    "0.5", "1.0", "2.25", "0.125", "3.75", "0.75", "1.5e-2", "4.0e1", "0.001",
+};
+
+static const char *const FloatOps[] = {"+", "-", "*"};
+
+static const char *const CompOps[] = {"<", ">", "<=", ">="};
+
+// splitmix64; fixed arithmetic so the corpus does not depend on the standard
+// library's distribution implementations.
+uint64_t CorpusGenerator::next()
+{
+    uint64_t Z = (State += 0x9e3779b97f4a7c15ULL);
+    Z = (Z ^ (Z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    Z = (Z ^ (Z >> 27)) * 0x94d049bb133111ebULL;
+    return Z ^ (Z >> 31);
+}
+
+std::string CorpusGenerator::freshName(char Prefix)
+{
+    return Prefix + std::to_string(NextId++);
+}
+
+const std::string *CorpusGenerator::pickFloat()
+{
+    // Prefer the innermost scopes, like real shader code does.
+    for (auto It = Scopes.rbegin(); It != Scopes.rend(); ++It)
+    {
+        if (!It->Floats.empty() && (chance(70) || It + 1 == Scopes.rend()))
+            return &It->Floats[below(It->Floats.size())];
+    }
+    return nullptr;
+}
+
+const std::string *CorpusGenerator::pickColor()
+{
+    for (auto It = Scopes.rbegin(); It != Scopes.rend(); ++It)
+    {
+        if (!It->Colors.empty())
+            return &It->Colors[below(It->Colors.size())];
+    }
+    return nullptr;
+}
+
+void CorpusGenerator::indent(unsigned Depth) { Out.append(2 * Depth, ' '); }
+
+void CorpusGenerator::emitFloatLiteral()
+{
+    Out += FloatLiterals[below(sizeof(FloatLiterals) / sizeof(*FloatLiterals))];
+}
+
+void CorpusGenerator::emitFloatExpr(unsigned MaxTerms)
+{
+    // Sema types a chain by its last operand, so always finish on a float
+    // literal to keep the expression a float.
+    unsigned Terms = 1 + below(MaxTerms);
+    for (unsigned I = 0; I < Terms; ++I)
+    {
+        const std::string *Var = chance(60) ? pickFloat() : nullptr;
+        if (Var)
+            Out += *Var;
+        else
+            emitFloatLiteral();
+        if (chance(15))
+            Out += " / 2.0";
+        Out += ' ';
+        Out += FloatOps[below(3)];
+        Out += ' ';
+    }
+    emitFloatLiteral();
+}
+
+void CorpusGenerator::emitCondition()
+{
+    const std::string *Var = pickFloat();
+    if (Var)
+        Out += *Var;
+    else
+        emitFloatLiteral();
+    Out += ' ';
+    Out += CompOps[below(4)];
+    Out += ' ';
+    emitFloatLiteral();
+}
+
+void CorpusGenerator::emitDeclaration(unsigned Depth)
+{
+    indent(Depth);
+    unsigned Kind = below(10);
+    if (Kind < 6)
+    {
+        std::string Name = freshName('f');
+        Out += "float " + Name + " = ";
+        emitFloatExpr(chance(10) ? 64 : 12);
+        Out += ";\n";
+        Scopes.back().Floats.push_back(Name);
+    }
+    else if (Kind < 8)
+    {
+        std::string Name = freshName('c');
+        Out += "color " + Name + " = color(";
+        for (unsigned I = 0; I < 3; ++I)
+        {
+            if (I)
+                Out += ", ";
+            emitFloatExpr(4);
+        }
+        Out += ");\n";
+        Scopes.back().Colors.push_back(Name);
+    }
+    else if (Kind < 9)
+    {
+        std::string Name = freshName('i');
+        Out += "int " + Name + " = " + std::to_string(below(1000)) + ";\n";
+        Scopes.back().Ints.push_back(Name);
+    }
+    else
+    {
+        Out += "string " + freshName('s') + " = \"label" +
+               std::to_string(below(100)) + "\";\n";
+    }
+}
+
+void CorpusGenerator::emitAssignment(unsigned Depth)
+{
+    const std::string *Color = chance(20) ? pickColor() : nullptr;
+    if (Color)
+    {
+        indent(Depth);
+        Out += *Color + " = " + *Color + " * ";
+        emitFloatLiteral();
+        Out += ";\n";
+        return;
+    }
+    const std::string *Var = pickFloat();
+    if (!Var)
+        return emitDeclaration(Depth);
+    indent(Depth);
+    Out += *Var + " = ";
+    emitFloatExpr(16);
+    Out += ";\n";
+}
+
+void CorpusGenerator::emitConditional(unsigned Depth)
+{
+    indent(Depth);
+    Out += "if (";
+    emitCondition();
+    Out += ")\n";
+    emitBlock(Depth);
+    if (chance(50))
+    {
+        indent(Depth);
+        Out += "else\n";
+        emitBlock(Depth);
+    }
+}
+
+void CorpusGenerator::emitLoop(unsigned Depth)
+{
+    // Keep trip counts and nesting small so the corpus also stays cheap to
+    // execute once it is compiled.
+    std::string Counter = freshName('k');
+    std::string Trip = std::to_string(2 + below(3));
+    unsigned Form = below(3);
+    // Half of the for loops step in their update clause, some of them with
+    // a second counter that outlives the loop.
+    bool StepInUpdate = Form == 2 && chance(50);
+    ++LoopDepth;
+
+    if (Form == 2)
+    {
+        std::string Update;
+        if (StepInUpdate)
+        {
+            Update = "(++" + Counter;
+            if (chance(50))
+            {
+                std::string Steps = freshName('n');
+                indent(Depth);
+                Out += "int " + Steps + " = 0;\n";
+                Scopes.back().Ints.push_back(Steps);
+                Update += ", ++" + Steps;
+            }
+            Update += ")";
+        }
+        indent(Depth);
+        Out += "for (int " + Counter + " = 0; " + Counter + " < " + Trip +
+               "; " + Update + ")\n";
+        Scopes.push_back(Scope());
+        Scopes.back().Ints.push_back(Counter);
+    }
+    else
+    {
+        indent(Depth);
+        Out += "int " + Counter + " = 0;\n";
+        Scopes.back().Ints.push_back(Counter);
+        indent(Depth);
+        Out += Form == 0 ? "while (" + Counter + " < " + Trip + ")\n" : "do\n";
+    }
+
+    indent(Depth);
+    Out += "{\n";
+    Scopes.push_back(Scope());
+    unsigned Stmts = 1 + below(4);
+    for (unsigned I = 0; I < Stmts; ++I)
+        emitStmt(Depth + 1);
+    if (chance(20))
+    {
+        indent(Depth + 1);
+        Out += "if (";
+        emitCondition();
+        Out += ")\n";
+        indent(Depth + 1);
+        Out += "{\n";
+        indent(Depth + 2);
+        // No continue: it would skip the counter update below, unless the
+        // update clause steps the counter.
+        Out += "break;\n";
+        indent(Depth + 1);
+        Out += "}\n";
+    }
+    if (!StepInUpdate)
+    {
+        indent(Depth + 1);
+        Out += Counter + " = " + Counter + " + 1;\n";
+    }
+    Scopes.pop_back();
+    indent(Depth);
+    Out += "}\n";
+
+    if (Form == 1)
+    {
+        indent(Depth);
+        Out += "while (" + Counter + " < " + Trip + ");\n";
+    }
+    if (Form == 2)
+        Scopes.pop_back();
+    --LoopDepth;
+}
+
+void CorpusGenerator::emitBlock(unsigned Depth)
+{
+    indent(Depth);
+    Out += "{\n";
+    Scopes.push_back(Scope());
+    unsigned Stmts = 2 + below(6);
+    for (unsigned I = 0; I < Stmts && Out.size() < Target; ++I)
+        emitStmt(Depth + 1);
+    Scopes.pop_back();
+    indent(Depth);
+    Out += "}\n";
+}
+
+void CorpusGenerator::emitStmt(unsigned Depth)
+{
+    unsigned Kind = below(100);
+    bool CanNest = Depth < 5;
+    if (Kind < 35)
+        return emitDeclaration(Depth);
+    if (Kind < 65)
+        return emitAssignment(Depth);
+    if (Kind < 78 && CanNest)
+        return emitConditional(Depth);
+    if (Kind < 88 && CanNest && LoopDepth < 2)
+        return emitLoop(Depth);
+    if (Kind < 95 && CanNest)
+        return emitBlock(Depth);
+    return emitDeclaration(Depth);
+}
+
+void CorpusGenerator::emitTopLevel()
+{
+    if (chance(40))
+        return emitDeclaration(0);
+    emitBlock(0);
+}
+
+void CorpusGenerator::emitBakedFloat()
+{
+    // Nine significant digits, as a float is printed to round-trip:
+    // 0.ddddddddd or d.dddddddde-N.
+    if (chance(70))
+    {
+        Out += "0.";
+        for (unsigned I = 0; I < 9; ++I)
+            Out += static_cast<char>('0' + below(10));
+        return;
+    }
+    Out += static_cast<char>('1' + below(9));
+    Out += '.';
+    for (unsigned I = 0; I < 8; ++I)
+        Out += static_cast<char>('0' + below(10));
+    Out += chance(50) ? "e-" : "e";
+    Out += std::to_string(1 + below(30));
+}
+
+std::string CorpusGenerator::generateBakedData(size_t TargetBytes)
+{
+    Out.clear();
+    Out.reserve(TargetBytes + 4096);
+    while (Out.size() < TargetBytes)
+    {
+        unsigned Kind = below(10);
+        if (Kind < 6)
+        {
+            Out += "float " + freshName('f') + " = ";
+            emitBakedFloat();
+        }
+        else if (Kind < 9)
+        {
+            Out += "color " + freshName('c') + " = color(";
+            for (unsigned I = 0; I < 3; ++I)
+            {
+                if (I)
+                    Out += ", ";
+                emitBakedFloat();
+            }
+            Out += ')';
+        }
+        else
+        {
+            static const char Hex[] = "0123456789abcdef";
+            Out += "int " + freshName('i') + " = 0x";
+            for (unsigned I = 0; I < 8; ++I)
+                Out += Hex[below(16)];
+        }
+        Out += ";\n";
+    }
+    return std::move(Out);
+}
+
+std::string CorpusGenerator::generate(size_t TargetBytes)
+{
+    Target = TargetBytes;
+    Out.clear();
+    Out.reserve(TargetBytes + 4096);
+    Scopes.assign(1, Scope());
+    while (Out.size() < TargetBytes)
+        emitTopLevel();
+    Scopes.clear();
+    return std::move(Out);
+}
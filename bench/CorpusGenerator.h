@@ -0,0 +1,71 @@
+#ifndef LLSHADER_BENCH_CORPUSGENERATOR_H
+#define LLSHADER_BENCH_CORPUSGENERATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Deterministic generator of .osl programs for the benchmark suite. The same
+// seed and size always produce byte-identical output, so numbers from
+// different runs and machines are comparable.
+//
+// Programs only use constructs the parser and Sema accept today: global
+// declarations, nested scoped blocks, long left-associative expression
+// chains, conditionals and bounded while/do-while/for loops, some for loops
+// stepping their counters in the update clause.
+class CorpusGenerator
+{
+  public:
+    static constexpr uint64_t DefaultSeed = 0x6c6c736861646572ULL;
+
+    explicit CorpusGenerator(uint64_t Seed = DefaultSeed) : State(Seed) {}
+
+    // Emit top-level statements until the program is at least TargetBytes
+    // long.
+    std::string generate(size_t TargetBytes);
+
+    // Emit global tables of numbers, like a shader with baked lookup data,
+    // until the program is at least TargetBytes long: floats spelled to
+    // full precision, colors and hexadecimal ints.
+    std::string generateBakedData(size_t TargetBytes);
+
+  private:
+    struct Scope
+    {
+        std::vector<std::string> Floats;
+        std::vector<std::string> Ints;
+        std::vector<std::string> Colors;
+    };
+
+    uint64_t State;
+    std::string Out;
+    size_t Target = 0;
+    std::vector<Scope> Scopes;
+    unsigned NextId = 0;
+    unsigned LoopDepth = 0;
+
+    uint64_t next();
+    unsigned below(unsigned N) { return static_cast<unsigned>(next() % N); }
+    bool chance(unsigned Percent) { return below(100) < Percent; }
+
+    std::string freshName(char Prefix);
+    const std::string *pickFloat();
+    const std::string *pickColor();
+
+    void indent(unsigned Depth);
+    void emitFloatLiteral();
+    void emitBakedFloat();
+    void emitFloatExpr(unsigned MaxTerms);
+    void emitCondition();
+
+    void emitTopLevel();
+    void emitBlock(unsigned Depth);
+    void emitStmt(unsigned Depth);
+    void emitDeclaration(unsigned Depth);
+    void emitAssignment(unsigned Depth);
+    void emitConditional(unsigned Depth);
+    void emitLoop(unsigned Depth);
+};
+
+#endif
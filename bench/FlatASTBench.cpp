@@ -0,0 +1,242 @@
+#include "BenchUtil.h"
+#include "llshader/AST/FlatAST.h"
+#include "llshader/AST/RecursiveASTVisitor.h"
+#include "llshader/Basic/Diagnostic.h"
+#include "llshader/Lexer/Lexer.h"
+#include "llshader/Parser/Parser.h"
+#include "llshader/Sema/ConstantFolder.h"
+#include "llshader/Sema/Sema.h"
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+
+// Node classes against the flat form: the same corpus is parsed once per
+// benchmark, and ast_bytes is the heap the representation holds.
+
+namespace
+{
+class FlatNodeCounter : public FlatASTVisitor<FlatNodeCounter>
+{
+  public:
+    uint64_t Count = 0;
+
+    FlatNodeCounter(const FlatAST &Tree) : FlatASTVisitor(Tree) {}
+
+    void visitNode(FlatNode N)
+    {
+        ++Count;
+        visitChildren(N);
+    }
+};
+
+class CRTPNodeCounter : public RecursiveASTVisitor<CRTPNodeCounter>
+{
+  public:
+    uint64_t Count = 0;
+
+#define AST_NODE(Class)                                                        \
+    bool visit##Class(Class &)                                                 \
+    {                                                                          \
+        ++Count;                                                               \
+        return true;                                                           \
+    }
+#include "llshader/AST/ASTNodes.def"
+};
+
+// Parses Src; TreeBytes receives the heap held by the resulting tree.
+AST *parseCorpus(const std::string &Src, int64_t &TreeBytes)
+{
+    int64_t Before = bench::liveBytes();
+    AST *Tree;
+    {
+        llvm::SourceMgr SrcMgr;
+        SrcMgr.AddNewSourceBuffer(
+            llvm::MemoryBuffer::getMemBuffer(Src, "corpus.osl"), llvm::SMLoc());
+        DiagnosticsEngine Diags(SrcMgr);
+        Lexer Lex(SrcMgr, Diags);
+        Parser P(Lex, Diags);
+        Tree = P.parse();
+    }
+    TreeBytes = bench::liveBytes() - Before;
+    return Tree;
+}
+
+void setTraversalCounters(benchmark::State &State, uint64_t Nodes,
+                          int64_t Bytes)
+{
+    State.counters["nodes_per_second"] = benchmark::Counter(
+        static_cast<double>(Nodes), benchmark::Counter::kIsRate);
+    State.counters["ast_bytes"] = static_cast<double>(Bytes);
+}
+
+void BM_TreeTraversal(benchmark::State &State, size_t Size)
+{
+    int64_t TreeBytes;
+    AST *Tree = parseCorpus(bench::getCorpus(Size), TreeBytes);
+    if (!Tree)
+    {
+        State.SkipWithError("corpus failed to parse");
+        return;
+    }
+    uint64_t Nodes = 0;
+    for (auto _ : State)
+        Nodes += bench::countNodes(Tree);
+    bench::destroyTree(Tree);
+    setTraversalCounters(State, Nodes, TreeBytes);
+}
+
+// Same walk as BM_TreeTraversal through RecursiveASTVisitor, so the two
+// differ only in virtual against compile-time dispatch.
+void BM_TreeTraversalCRTP(benchmark::State &State, size_t Size)
+{
+    int64_t TreeBytes;
+    AST *Tree = parseCorpus(bench::getCorpus(Size), TreeBytes);
+    if (!Tree)
+    {
+        State.SkipWithError("corpus failed to parse");
+        return;
+    }
+    uint64_t Nodes = 0;
+    for (auto _ : State)
+    {
+        CRTPNodeCounter Counter;
+        Counter.traverse(Tree);
+        Nodes += Counter.Count;
+    }
+    bench::destroyTree(Tree);
+    setTraversalCounters(State, Nodes, TreeBytes);
+}
+
+void BM_FlatTraversal(benchmark::State &State, size_t Size)
+{
+    int64_t TreeBytes;
+    AST *Tree = parseCorpus(bench::getCorpus(Size), TreeBytes);
+    if (!Tree)
+    {
+        State.SkipWithError("corpus failed to parse");
+        return;
+    }
+    int64_t Before = bench::liveBytes();
+    FlatAST Flat = FlatAST::build(Tree);
+    int64_t FlatBytes = bench::liveBytes() - Before;
+    bench::destroyTree(Tree);
+
+    uint64_t Nodes = 0;
+    for (auto _ : State)
+    {
+        FlatNodeCounter Counter(Flat);
+        Counter.visit(Flat.getRoot());
+        Nodes += Counter.Count;
+    }
+    setTraversalCounters(State, Nodes, FlatBytes);
+}
+
+void BM_FlatBuild(benchmark::State &State, size_t Size)
+{
+    const std::string &Src = bench::getCorpus(Size);
+    int64_t TreeBytes;
+    AST *Tree = parseCorpus(Src, TreeBytes);
+    if (!Tree)
+    {
+        State.SkipWithError("corpus failed to parse");
+        return;
+    }
+    uint64_t Alloc = 0;
+    for (auto _ : State)
+    {
+        uint64_t Before = bench::allocatedBytes();
+        FlatAST Flat = FlatAST::build(Tree);
+        Alloc += bench::allocatedBytes() - Before;
+        benchmark::DoNotOptimize(Flat.size());
+    }
+    bench::destroyTree(Tree);
+    bench::setCounters(State, State.iterations() * Src.size(), Alloc);
+}
+
+void BM_SemaFlat(benchmark::State &State, size_t Size)
+{
+    const std::string &Src = bench::getCorpus(Size);
+    int64_t TreeBytes;
+    AST *Tree = parseCorpus(Src, TreeBytes);
+    if (!Tree)
+    {
+        State.SkipWithError("corpus failed to parse");
+        return;
+    }
+    FlatAST Flat = FlatAST::build(Tree);
+    bench::destroyTree(Tree);
+
+    uint64_t Alloc = 0;
+    for (auto _ : State)
+    {
+        uint64_t Before = bench::allocatedBytes();
+        Sema S;
+        bool Ok = S.semantic(Flat);
+        Alloc += bench::allocatedBytes() - Before;
+        if (!Ok)
+        {
+            State.SkipWithError("corpus failed semantic analysis");
+            break;
+        }
+    }
+    bench::setCounters(State, State.iterations() * Src.size(), Alloc);
+    State.counters["nodes_per_second"] = benchmark::Counter(
+        static_cast<double>(State.iterations() * Flat.size()),
+        benchmark::Counter::kIsRate);
+}
+
+void BM_FlatConstantFold(benchmark::State &State, size_t Size)
+{
+    int64_t TreeBytes;
+    AST *Tree = parseCorpus(bench::getCorpus(Size), TreeBytes);
+    if (!Tree)
+    {
+        State.SkipWithError("corpus failed to parse");
+        return;
+    }
+    const FlatAST Flat = FlatAST::build(Tree);
+    bench::destroyTree(Tree);
+
+    uint64_t Folded = 0;
+    for (auto _ : State)
+    {
+        State.PauseTiming();
+        FlatAST Copy = Flat;
+        State.ResumeTiming();
+        Folded += foldConstants(Copy);
+    }
+    State.counters["nodes_per_second"] = benchmark::Counter(
+        static_cast<double>(State.iterations() * Flat.size()),
+        benchmark::Counter::kIsRate);
+    State.counters["folded"] = benchmark::Counter(
+        static_cast<double>(Folded), benchmark::Counter::kAvgIterations);
+}
+} // namespace
+
+void bench::registerFlatASTBenchmarks()
+{
+    for (size_t Size : getCorpusSizes())
+    {
+        benchmark::RegisterBenchmark("BM_TreeTraversal", BM_TreeTraversal,
+                                     Size)
+            ->Arg(static_cast<int64_t>(Size))
+            ->Unit(benchmark::kMicrosecond);
+        benchmark::RegisterBenchmark("BM_TreeTraversalCRTP",
+                                     BM_TreeTraversalCRTP, Size)
+            ->Arg(static_cast<int64_t>(Size))
+            ->Unit(benchmark::kMicrosecond);
+        benchmark::RegisterBenchmark("BM_FlatTraversal", BM_FlatTraversal,
+                                     Size)
+            ->Arg(static_cast<int64_t>(Size))
+            ->Unit(benchmark::kMicrosecond);
+        benchmark::RegisterBenchmark("BM_FlatBuild", BM_FlatBuild, Size)
+            ->Arg(static_cast<int64_t>(Size))
+            ->Unit(benchmark::kMicrosecond);
+        benchmark::RegisterBenchmark("BM_SemaFlat", BM_SemaFlat, Size)
+            ->Arg(static_cast<int64_t>(Size))
+            ->Unit(benchmark::kMicrosecond);
+        benchmark::RegisterBenchmark("BM_FlatConstantFold",
+                                     BM_FlatConstantFold, Size)
+            ->Arg(static_cast<int64_t>(Size))
+            ->Unit(benchmark::kMicrosecond);
+    }
+}
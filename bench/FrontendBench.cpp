@@ -0,0 +1,61 @@
+#include "BenchUtil.h"
+#include "llshader/Frontend/CompilerInstance.h"
+
+// A renderer compiling its shaders at scene load: many small shaders to
+// object code back to back, with one CompilerInstance kept warm or with
+// the instance and its object emitter created for every shader, as a
+// process per shader would.
+
+namespace
+{
+// Args: optimization level.
+void BM_CompileShaders(benchmark::State &State, bool Warm)
+{
+    const std::string &Src = bench::getCorpus(bench::getCorpusSizes()[0]);
+    unsigned OptLevel = static_cast<unsigned>(State.range(0));
+    std::string Error;
+    std::unique_ptr<ObjectEmitter> Emitter;
+    std::unique_ptr<CompilerInstance> Instance;
+    uint64_t Shaders = 0;
+    for (auto _ : State)
+    {
+        if (!Warm || !Instance)
+        {
+            Emitter = ObjectEmitter::create("x86-64", OptLevel, Error);
+            if (!Emitter)
+            {
+                State.SkipWithError(Error.c_str());
+                break;
+            }
+            Instance = std::make_unique<CompilerInstance>();
+            Instance->setOptLevel(OptLevel);
+            Instance->setObjectEmitter(Emitter.get());
+        }
+        CompileResult Result = Instance->compile(Src, "corpus.osl");
+        if (!Result.succeeded())
+        {
+            State.SkipWithError("corpus failed to compile");
+            break;
+        }
+        benchmark::DoNotOptimize(Result.getObject().data());
+        ++Shaders;
+    }
+    bench::setCounters(State, State.iterations() * Src.size(), 0);
+    State.counters["shaders_per_second"] = benchmark::Counter(
+        static_cast<double>(Shaders), benchmark::Counter::kIsRate);
+}
+} // namespace
+
+void bench::registerFrontendBenchmarks()
+{
+    benchmark::RegisterBenchmark("BM_CompileShadersWarm", BM_CompileShaders,
+                                 true)
+        ->Arg(0)
+        ->Arg(2)
+        ->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark("BM_CompileShadersCold", BM_CompileShaders,
+                                 false)
+        ->Arg(0)
+        ->Arg(2)
+        ->Unit(benchmark::kMicrosecond);
+}
@@ -0,0 +1,278 @@
+#include "BenchUtil.h"
+#include "llshader/Basic/Diagnostic.h"
+#include "llshader/CodeGen/CodeGen.h"
+#include "llshader/CodeGen/Optimizer.h"
+#include "llshader/Interp/BatchInterpreter.h"
+#include "llshader/Interp/Interpreter.h"
+#include "llshader/Lexer/Lexer.h"
+#include "llshader/Parser/Parser.h"
+#include "llshader/Sema/Sema.h"
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/TargetSelect.h>
+#include <cstring>
+
+// The interpreter against LLVM compiling the same shader in process with
+// ORC: time to the first result, from source to the outputs, and the time
+// of each further run. Then the interpreter shading a grid of points one
+// at a time and in batches.
+
+namespace
+{
+// A small loop over ints, floats and a triple, like a preview would run.
+const char *const Kernel = "int hits = 0;\n"
+                           "float acc = 0.0;\n"
+                           "color c = color(0.5, 0.25, 0.125);\n"
+                           "for (int i = 0; i < 10000; )\n"
+                           "{\n"
+                           "  float x = 0.0;\n"
+                           "  x = i * 0.0001;\n"
+                           "  c = c * 0.999 + x;\n"
+                           "  acc = c[1] * x + acc;\n"
+                           "  if (i % 3 == 0)\n"
+                           "  {\n"
+                           "    hits = hits + 1;\n"
+                           "  }\n"
+                           "  ++i;\n"
+                           "}\n"
+                           "int result;\n"
+                           "result = (int) acc;\n";
+
+// Shades the point at u with a triple and a branch that differs between
+// points.
+const char *const PointKernel = "float u;\n"
+                                "int bands = 0;\n"
+                                "color c = color(0.5, 0.25, 0.125);\n"
+                                "for (int i = 0; i < 32; )\n"
+                                "{\n"
+                                "  c = c * u + 0.25;\n"
+                                "  if (c[0] > 0.4)\n"
+                                "  {\n"
+                                "    bands = bands + 1;\n"
+                                "  }\n"
+                                "  ++i;\n"
+                                "}\n";
+
+// Points shaded per run of the point benchmarks.
+constexpr unsigned GridPoints = 4096;
+
+// Outputs of the JIT-compiled shader, which calls this for write_int.
+int64_t Sink = 0;
+
+void writeToSink(int Value) { Sink += Value; }
+
+// Parses and checks Source; null on failure. The tree refers into SrcMgr's
+// buffer.
+AST *parseKernel(llvm::SourceMgr &SrcMgr, const char *Source = Kernel)
+{
+    SrcMgr.AddNewSourceBuffer(
+        llvm::MemoryBuffer::getMemBuffer(Source, "kernel.osl"), llvm::SMLoc());
+    DiagnosticsEngine Diags(SrcMgr);
+    Lexer Lex(SrcMgr, Diags);
+    Parser P(Lex, Diags);
+    AST *Tree = P.parse();
+    if (!Tree || Diags.numErrors() || !Sema().semantic(Tree))
+        return nullptr;
+    return Tree;
+}
+
+// Compiles Tree with codegen and ORC at OptLevel and returns main, which
+// lives as long as JIT.
+int (*compileWithJIT(AST *Tree, unsigned OptLevel,
+                     std::unique_ptr<llvm::orc::LLJIT> &JIT))()
+{
+    llvm::Expected<std::unique_ptr<llvm::orc::LLJIT>> JITOrErr =
+        llvm::orc::LLJITBuilder().create();
+    if (!JITOrErr)
+    {
+        llvm::consumeError(JITOrErr.takeError());
+        return nullptr;
+    }
+    JIT = std::move(*JITOrErr);
+    llvm::orc::SymbolMap Symbols;
+    Symbols[JIT->mangleAndIntern("write_int")] =
+        llvm::JITEvaluatedSymbol::fromPointer(&writeToSink);
+    Symbols[JIT->mangleAndIntern("strcmp")] =
+        llvm::JITEvaluatedSymbol::fromPointer(&std::strcmp);
+    if (llvm::Error Err = JIT->getMainJITDylib().define(
+            llvm::orc::absoluteSymbols(std::move(Symbols))))
+    {
+        llvm::consumeError(std::move(Err));
+        return nullptr;
+    }
+
+    auto Ctx = std::make_unique<llvm::LLVMContext>();
+    auto M = std::make_unique<llvm::Module>("kernel", *Ctx);
+    M->setDataLayout(JIT->getDataLayout());
+    if (!CodeGen(M.get(), Ctx.get()).compile(Tree))
+        return nullptr;
+    optimizeModule(*M, OptLevel);
+    if (llvm::Error Err = JIT->addIRModule(
+            llvm::orc::ThreadSafeModule(std::move(M), std::move(Ctx))))
+    {
+        llvm::consumeError(std::move(Err));
+        return nullptr;
+    }
+    llvm::Expected<llvm::JITEvaluatedSymbol> Main = JIT->lookup("main");
+    if (!Main)
+    {
+        llvm::consumeError(Main.takeError());
+        return nullptr;
+    }
+    return reinterpret_cast<int (*)()>(Main->getAddress());
+}
+
+// Source to outputs: parse, check, lower to bytecode and run.
+void BM_InterpFirstResult(benchmark::State &State)
+{
+    for (auto _ : State)
+    {
+        llvm::SourceMgr SrcMgr;
+        AST *Tree = parseKernel(SrcMgr);
+        if (!Tree)
+        {
+            State.SkipWithError("kernel failed to compile");
+            break;
+        }
+        std::unique_ptr<Bytecode> Code = Bytecode::compile(Tree, llvm::errs());
+        Interpreter VM(*Code);
+        VM.run();
+        benchmark::DoNotOptimize(VM.getOutput(0));
+        bench::destroyTree(Tree);
+    }
+}
+
+void BM_InterpSteadyState(benchmark::State &State)
+{
+    llvm::SourceMgr SrcMgr;
+    AST *Tree = parseKernel(SrcMgr);
+    if (!Tree)
+    {
+        State.SkipWithError("kernel failed to compile");
+        return;
+    }
+    std::unique_ptr<Bytecode> Code = Bytecode::compile(Tree, llvm::errs());
+    Interpreter VM(*Code);
+    for (auto _ : State)
+    {
+        VM.run();
+        benchmark::DoNotOptimize(VM.getOutput(0));
+    }
+    bench::destroyTree(Tree);
+}
+
+// Arg: the optimization level of the IR pipeline.
+void BM_JITFirstResult(benchmark::State &State)
+{
+    unsigned OptLevel = static_cast<unsigned>(State.range(0));
+    for (auto _ : State)
+    {
+        llvm::SourceMgr SrcMgr;
+        AST *Tree = parseKernel(SrcMgr);
+        std::unique_ptr<llvm::orc::LLJIT> JIT;
+        int (*Main)() = Tree ? compileWithJIT(Tree, OptLevel, JIT) : nullptr;
+        if (!Main)
+        {
+            State.SkipWithError("kernel failed to compile");
+            break;
+        }
+        Main();
+        benchmark::DoNotOptimize(Sink);
+        bench::destroyTree(Tree);
+    }
+}
+
+void BM_JITSteadyState(benchmark::State &State)
+{
+    llvm::SourceMgr SrcMgr;
+    AST *Tree = parseKernel(SrcMgr);
+    std::unique_ptr<llvm::orc::LLJIT> JIT;
+    int (*Main)() =
+        Tree ? compileWithJIT(Tree, static_cast<unsigned>(State.range(0)), JIT)
+             : nullptr;
+    if (!Main)
+    {
+        State.SkipWithError("kernel failed to compile");
+        return;
+    }
+    for (auto _ : State)
+    {
+        Main();
+        benchmark::DoNotOptimize(Sink);
+    }
+    bench::destroyTree(Tree);
+}
+
+float getGridU(unsigned Point) { return Point / float(GridPoints); }
+
+// Arg: lanes per batch; 0 runs the scalar interpreter once per point.
+void BM_InterpPoints(benchmark::State &State)
+{
+    unsigned Lanes = static_cast<unsigned>(State.range(0));
+    llvm::SourceMgr SrcMgr;
+    AST *Tree = parseKernel(SrcMgr, PointKernel);
+    std::unique_ptr<Bytecode> Code =
+        Tree ? Bytecode::compile(Tree, llvm::errs()) : nullptr;
+    if (!Code)
+    {
+        State.SkipWithError("kernel failed to compile");
+        return;
+    }
+    Interpreter VM(*Code);
+    BatchInterpreter Batch(*Code, Lanes ? Lanes : 1);
+    int64_t Bands = 0;
+    for (auto _ : State)
+    {
+        if (!Lanes)
+        {
+            for (unsigned Point = 0; Point != GridPoints; ++Point)
+            {
+                VM.getInput(0)->F = getGridU(Point);
+                VM.run();
+                Bands += VM.getOutput(0);
+            }
+            continue;
+        }
+        for (unsigned First = 0; First < GridPoints; First += Lanes)
+        {
+            Slot *U = Batch.getInput(0);
+            for (unsigned L = 0; L != Lanes; ++L)
+                U[L].F = getGridU(First + L);
+            Batch.run();
+            for (unsigned L = 0; L != Lanes; ++L)
+                Bands += Batch.getOutput(0, L);
+        }
+    }
+    benchmark::DoNotOptimize(Bands);
+    bench::destroyTree(Tree);
+    State.counters["points_per_second"] = benchmark::Counter(
+        static_cast<double>(State.iterations() * GridPoints),
+        benchmark::Counter::kIsRate);
+}
+} // namespace
+
+void bench::registerInterpBenchmarks()
+{
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    benchmark::RegisterBenchmark("BM_InterpFirstResult", BM_InterpFirstResult)
+        ->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark("BM_InterpSteadyState", BM_InterpSteadyState)
+        ->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark("BM_InterpPoints", BM_InterpPoints)
+        ->Arg(0)
+        ->Arg(8)
+        ->Arg(64)
+        ->Arg(256)
+        ->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark("BM_JITFirstResult", BM_JITFirstResult)
+        ->Arg(0)
+        ->Arg(2)
+        ->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark("BM_JITSteadyState", BM_JITSteadyState)
+        ->Arg(0)
+        ->Arg(2)
+        ->Unit(benchmark::kMicrosecond);
+}
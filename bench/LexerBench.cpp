@@ -0,0 +1,183 @@
+#include "BenchUtil.h"
+#include "llshader/Basic/Diagnostic.h"
+#include "llshader/Lexer/Lexer.h"
+#include "llshader/Lexer/NumericLiteral.h"
+#include "llshader/Lexer/SourceWindow.h"
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+#include <cstdlib>
+
+namespace
+{
+void BM_LexerNext(benchmark::State &State, size_t Size)
+{
+    const std::string &Src = bench::getCorpus(Size);
+    uint64_t Tokens = 0;
+    uint64_t Alloc = 0;
+    for (auto _ : State)
+    {
+        uint64_t Before = bench::allocatedBytes();
+        llvm::SourceMgr SrcMgr;
+        SrcMgr.AddNewSourceBuffer(
+            llvm::MemoryBuffer::getMemBuffer(Src, "corpus.osl"), llvm::SMLoc());
+        DiagnosticsEngine Diags(SrcMgr);
+        Lexer Lex(SrcMgr, Diags);
+        Token Tok;
+        do
+        {
+            Lex.next(Tok);
+            ++Tokens;
+        } while (!Tok.is(tok::eof));
+        benchmark::DoNotOptimize(Tok);
+        Alloc += bench::allocatedBytes() - Before;
+    }
+    bench::setCounters(State, State.iterations() * Src.size(), Alloc);
+    State.counters["tokens_per_second"] =
+        benchmark::Counter(static_cast<double>(Tokens),
+                           benchmark::Counter::kIsRate);
+}
+
+void BM_LexerNextStreaming(benchmark::State &State, size_t Size)
+{
+    const std::string &Src = bench::getCorpus(Size);
+    llvm::SmallString<128> Path;
+    int FD;
+    if (llvm::sys::fs::createTemporaryFile("llshader-bench", "osl", FD, Path))
+    {
+        State.SkipWithError("cannot create corpus file");
+        return;
+    }
+    {
+        llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+        OS << Src;
+    }
+
+    uint64_t Tokens = 0;
+    uint64_t Alloc = 0;
+    for (auto _ : State)
+    {
+        uint64_t Before = bench::allocatedBytes();
+        std::error_code EC;
+        std::unique_ptr<SourceWindow> Window = SourceWindow::open(Path, EC);
+        llvm::SourceMgr SrcMgr;
+        DiagnosticsEngine Diags(SrcMgr);
+        Lexer Lex(*Window, SrcMgr, Diags);
+        Token Tok;
+        do
+        {
+            Lex.next(Tok);
+            ++Tokens;
+        } while (!Tok.is(tok::eof));
+        benchmark::DoNotOptimize(Tok);
+        Alloc += bench::allocatedBytes() - Before;
+    }
+    llvm::sys::fs::remove(Path);
+    bench::setCounters(State, State.iterations() * Src.size(), Alloc);
+    State.counters["tokens_per_second"] =
+        benchmark::Counter(static_cast<double>(Tokens),
+                           benchmark::Counter::kIsRate);
+}
+// Lexing a shader of baked tables, where nearly every other token is a
+// literal the Lexer converts.
+void BM_LexerBakedData(benchmark::State &State, size_t Size)
+{
+    const std::string &Src = bench::getBakedCorpus(Size);
+    uint64_t Tokens = 0;
+    uint64_t Literals = 0;
+    uint64_t Alloc = 0;
+    for (auto _ : State)
+    {
+        uint64_t Before = bench::allocatedBytes();
+        llvm::SourceMgr SrcMgr;
+        SrcMgr.AddNewSourceBuffer(
+            llvm::MemoryBuffer::getMemBuffer(Src, "baked.osl"), llvm::SMLoc());
+        DiagnosticsEngine Diags(SrcMgr);
+        Lexer Lex(SrcMgr, Diags);
+        Token Tok;
+        do
+        {
+            Lex.next(Tok);
+            ++Tokens;
+            Literals += Tok.isOneOf(tok::integer, tok::floating_point);
+        } while (!Tok.is(tok::eof));
+        benchmark::DoNotOptimize(Tok);
+        Alloc += bench::allocatedBytes() - Before;
+    }
+    bench::setCounters(State, State.iterations() * Src.size(), Alloc);
+    State.counters["tokens_per_second"] = benchmark::Counter(
+        static_cast<double>(Tokens), benchmark::Counter::kIsRate);
+    State.counters["literals_per_second"] = benchmark::Counter(
+        static_cast<double>(Literals), benchmark::Counter::kIsRate);
+}
+
+// Converting the float literals of a baked shader: with parseFloatLiteral,
+// as the Lexer does, or by copying each spelling for strtof, as every
+// consumer of a literal used to.
+void BM_FloatLiteralConvert(benchmark::State &State, size_t Size,
+                            bool Strtof)
+{
+    const std::string &Src = bench::getBakedCorpus(Size);
+    std::vector<StringRef> Spellings;
+    {
+        llvm::SourceMgr SrcMgr;
+        SrcMgr.AddNewSourceBuffer(
+            llvm::MemoryBuffer::getMemBuffer(Src, "baked.osl"), llvm::SMLoc());
+        DiagnosticsEngine Diags(SrcMgr);
+        Lexer Lex(SrcMgr, Diags);
+        Token Tok;
+        for (Lex.next(Tok); !Tok.is(tok::eof); Lex.next(Tok))
+            if (Tok.is(tok::floating_point))
+                Spellings.push_back(Tok.getText());
+    }
+
+    uint64_t Bytes = 0;
+    for (StringRef Text : Spellings)
+        Bytes += Text.size();
+    for (auto _ : State)
+    {
+        float Sum = 0;
+        for (StringRef Text : Spellings)
+        {
+            float Value;
+            if (Strtof)
+                Value = std::strtof(Text.str().c_str(), nullptr);
+            else
+                parseFloatLiteral(Text, Value);
+            Sum += Value;
+        }
+        benchmark::DoNotOptimize(Sum);
+    }
+    bench::setCounters(State, State.iterations() * Bytes, 0);
+    State.counters["literals_per_second"] = benchmark::Counter(
+        static_cast<double>(State.iterations() * Spellings.size()),
+        benchmark::Counter::kIsRate);
+}
+} // namespace
+
+void bench::registerLexerBenchmarks()
+{
+    for (size_t Size : getCorpusSizes())
+    {
+        benchmark::RegisterBenchmark("BM_LexerNext", BM_LexerNext, Size)
+            ->Arg(static_cast<int64_t>(Size))
+            ->Unit(benchmark::kMicrosecond);
+        benchmark::RegisterBenchmark("BM_LexerNextStreaming",
+                                     BM_LexerNextStreaming, Size)
+            ->Arg(static_cast<int64_t>(Size))
+            ->Unit(benchmark::kMicrosecond);
+        benchmark::RegisterBenchmark("BM_LexerBakedData", BM_LexerBakedData,
+                                     Size)
+            ->Arg(static_cast<int64_t>(Size))
+            ->Unit(benchmark::kMicrosecond);
+        benchmark::RegisterBenchmark("BM_FloatLiteralConvert",
+                                     BM_FloatLiteralConvert, Size, false)
+            ->Arg(static_cast<int64_t>(Size))
+            ->Unit(benchmark::kMicrosecond);
+        benchmark::RegisterBenchmark("BM_FloatLiteralStrtof",
+                                     BM_FloatLiteralConvert, Size, true)
+            ->Arg(static_cast<int64_t>(Size))
+            ->Unit(benchmark::kMicrosecond);
+    }
+}
@@ -0,0 +1,145 @@
+#include "BenchUtil.h"
+#include "CorpusGenerator.h"
+#include "llshader/Basic/Diagnostic.h"
+#include "llshader/CodeGen/OSOEmitter.h"
+#include "llshader/Interp/Bytecode.h"
+#include "llshader/Lexer/Lexer.h"
+#include "llshader/OSO/OSOShader.h"
+#include "llshader/Parser/Parser.h"
+#include "llshader/Sema/Sema.h"
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+
+// Loading compiled shaders: a directory of .oso files, written by
+// OSOEmitter from generated shaders, read back one file at a time, and
+// read and lowered to bytecode ready to run.
+
+namespace
+{
+// Shaders in the corpus; their total size is about this many times the
+// argument.
+constexpr unsigned CorpusFiles = 256;
+
+// Compiles the program in Src to .oso text; empty on failure.
+std::string compileToOSO(const std::string &Src, llvm::StringRef Name)
+{
+    llvm::SourceMgr SrcMgr;
+    SrcMgr.AddNewSourceBuffer(llvm::MemoryBuffer::getMemBuffer(Src, Name),
+                              llvm::SMLoc());
+    DiagnosticsEngine Diags(SrcMgr);
+    Lexer Lex(SrcMgr, Diags);
+    Parser P(Lex, Diags);
+    AST *Tree = P.parse();
+    std::string Text;
+    if (Tree && !Diags.numErrors() && Sema().semantic(Tree))
+    {
+        llvm::raw_string_ostream OS(Text);
+        if (!OSOEmitter(Name).emit(Tree, OS))
+            Text.clear();
+    }
+    bench::destroyTree(Tree);
+    return Text;
+}
+
+// Writes CorpusFiles shaders of about Size bytes of source each into a new
+// temporary directory, and returns their paths and total size; no paths
+// on failure.
+std::vector<std::string> writeCorpus(size_t Size, llvm::SmallString<128> &Dir,
+                                     uint64_t &Bytes)
+{
+    std::vector<std::string> Paths;
+    Bytes = 0;
+    if (llvm::sys::fs::createUniqueDirectory("llshader-bench-oso", Dir))
+        return Paths;
+    for (unsigned I = 0; I != CorpusFiles; ++I)
+    {
+        std::string Name = "shader" + std::to_string(I);
+        std::string Text = compileToOSO(
+            CorpusGenerator(CorpusGenerator::DefaultSeed + I).generate(Size),
+            Name);
+        llvm::SmallString<128> Path(Dir);
+        llvm::sys::path::append(Path, Name + ".oso");
+        std::error_code EC;
+        llvm::raw_fd_ostream OS(Path, EC);
+        if (Text.empty() || EC)
+            return {};
+        OS << Text;
+        Bytes += Text.size();
+        Paths.push_back(Path.str().str());
+    }
+    return Paths;
+}
+
+void removeCorpus(const std::vector<std::string> &Paths,
+                  llvm::StringRef Dir)
+{
+    for (const std::string &Path : Paths)
+        llvm::sys::fs::remove(Path);
+    llvm::sys::fs::remove(Dir);
+}
+
+// Arg: bytes of source per shader. Lower also lowers each shader to
+// bytecode.
+void BM_OSOLoad(benchmark::State &State, size_t Size, bool Lower)
+{
+    llvm::SmallString<128> Dir;
+    uint64_t Bytes;
+    std::vector<std::string> Paths = writeCorpus(Size, Dir, Bytes);
+    if (Paths.empty())
+    {
+        removeCorpus(Paths, Dir);
+        State.SkipWithError("cannot write the .oso corpus");
+        return;
+    }
+
+    uint64_t Instructions = 0;
+    uint64_t Alloc = 0;
+    for (auto _ : State)
+    {
+        uint64_t Before = bench::allocatedBytes();
+        for (const std::string &Path : Paths)
+        {
+            std::unique_ptr<OSOShader> Shader =
+                OSOShader::read(Path, llvm::errs());
+            if (!Shader)
+            {
+                State.SkipWithError("cannot read the .oso corpus");
+                break;
+            }
+            Instructions += Shader->getCode().size();
+            if (Lower)
+                benchmark::DoNotOptimize(
+                    Bytecode::compile(*Shader, llvm::errs()));
+        }
+        Alloc += bench::allocatedBytes() - Before;
+    }
+    removeCorpus(Paths, Dir);
+    bench::setCounters(State, State.iterations() * Bytes, Alloc);
+    State.counters["files_per_second"] = benchmark::Counter(
+        static_cast<double>(State.iterations() * Paths.size()),
+        benchmark::Counter::kIsRate);
+    State.counters["instructions_per_second"] = benchmark::Counter(
+        static_cast<double>(Instructions), benchmark::Counter::kIsRate);
+}
+} // namespace
+
+void bench::registerOSOBenchmarks()
+{
+    // Larger shaders would make a corpus of hundreds of megabytes.
+    for (size_t Size : getCorpusSizes())
+    {
+        if (Size > (size_t(100) << 10))
+            break;
+        benchmark::RegisterBenchmark("BM_OSOLoad", BM_OSOLoad, Size, false)
+            ->Arg(static_cast<int64_t>(Size))
+            ->Unit(benchmark::kMillisecond);
+        benchmark::RegisterBenchmark("BM_OSOLoadToBytecode", BM_OSOLoad, Size,
+                                     true)
+            ->Arg(static_cast<int64_t>(Size))
+            ->Unit(benchmark::kMillisecond);
+    }
+}
@@ -0,0 +1,147 @@
+#include "BenchUtil.h"
+#include "llshader/Basic/Diagnostic.h"
+#include "llshader/Lexer/Lexer.h"
+#include "llshader/Lexer/PipelinedLexer.h"
+#include "llshader/Parser/ParallelParser.h"
+#include "llshader/Parser/Parser.h"
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+
+namespace
+{
+void BM_ParserParse(benchmark::State &State, size_t Size)
+{
+    const std::string &Src = bench::getCorpus(Size);
+    uint64_t Nodes = 0;
+    uint64_t Alloc = 0;
+    for (auto _ : State)
+    {
+        uint64_t Before = bench::allocatedBytes();
+        llvm::SourceMgr SrcMgr;
+        SrcMgr.AddNewSourceBuffer(
+            llvm::MemoryBuffer::getMemBuffer(Src, "corpus.osl"), llvm::SMLoc());
+        DiagnosticsEngine Diags(SrcMgr);
+        Lexer Lex(SrcMgr, Diags);
+        Parser P(Lex, Diags);
+        AST *Tree = P.parse();
+        Alloc += bench::allocatedBytes() - Before;
+
+        State.PauseTiming();
+        if (!Tree)
+        {
+            State.SkipWithError("corpus failed to parse");
+            break;
+        }
+        Nodes += bench::countNodes(Tree);
+        bench::destroyTree(Tree);
+        State.ResumeTiming();
+    }
+    bench::setCounters(State, State.iterations() * Src.size(), Alloc);
+    State.counters["nodes_per_second"] = benchmark::Counter(
+        static_cast<double>(Nodes), benchmark::Counter::kIsRate);
+}
+
+// BM_ParserParse with the Lexer on a thread of its own.
+void BM_PipelinedParse(benchmark::State &State, size_t Size)
+{
+    const std::string &Src = bench::getCorpus(Size);
+    uint64_t Nodes = 0;
+    for (auto _ : State)
+    {
+        llvm::SourceMgr SrcMgr;
+        SrcMgr.AddNewSourceBuffer(
+            llvm::MemoryBuffer::getMemBuffer(Src, "corpus.osl"), llvm::SMLoc());
+        DiagnosticsEngine Diags(SrcMgr);
+        AST *Tree;
+        {
+            PipelinedLexer Lex(SrcMgr, Diags);
+            Parser P(Lex, Diags);
+            Tree = P.parse();
+        }
+
+        State.PauseTiming();
+        if (!Tree)
+        {
+            State.SkipWithError("corpus failed to parse");
+            break;
+        }
+        Nodes += bench::countNodes(Tree);
+        bench::destroyTree(Tree);
+        State.ResumeTiming();
+    }
+    bench::setCounters(State, State.iterations() * Src.size(), 0);
+    State.counters["nodes_per_second"] = benchmark::Counter(
+        static_cast<double>(Nodes), benchmark::Counter::kIsRate);
+}
+
+void BM_TopLevelBoundaries(benchmark::State &State, size_t Size)
+{
+    const std::string &Src = bench::getCorpus(Size);
+    uint64_t Statements = 0;
+    for (auto _ : State)
+    {
+        std::vector<size_t> Ends = findTopLevelBoundaries(Src);
+        Statements += Ends.size();
+        benchmark::DoNotOptimize(Ends.data());
+    }
+    bench::setCounters(State, State.iterations() * Src.size(), 0);
+    State.counters["statements_per_second"] = benchmark::Counter(
+        static_cast<double>(Statements), benchmark::Counter::kIsRate);
+}
+
+// Args: corpus size, thread count.
+void BM_ParallelParse(benchmark::State &State, size_t Size)
+{
+    const std::string &Src = bench::getCorpus(Size);
+    unsigned Threads = static_cast<unsigned>(State.range(1));
+    uint64_t Nodes = 0;
+    for (auto _ : State)
+    {
+        llvm::SourceMgr SrcMgr;
+        SrcMgr.AddNewSourceBuffer(
+            llvm::MemoryBuffer::getMemBuffer(Src, "corpus.osl"), llvm::SMLoc());
+        DiagnosticsEngine Diags(SrcMgr);
+        ParallelParser P(SrcMgr, Diags, Threads);
+        AST *Tree = P.parse();
+
+        State.PauseTiming();
+        if (!Tree)
+        {
+            State.SkipWithError("corpus failed to parse");
+            break;
+        }
+        Nodes += bench::countNodes(Tree);
+        bench::destroyTree(Tree);
+        State.ResumeTiming();
+    }
+    bench::setCounters(State, State.iterations() * Src.size(), 0);
+    State.counters["nodes_per_second"] = benchmark::Counter(
+        static_cast<double>(Nodes), benchmark::Counter::kIsRate);
+}
+} // namespace
+
+void bench::registerParserBenchmarks()
+{
+    for (size_t Size : getCorpusSizes())
+    {
+        benchmark::RegisterBenchmark("BM_ParserParse", BM_ParserParse, Size)
+            ->Arg(static_cast<int64_t>(Size))
+            ->Unit(benchmark::kMicrosecond);
+        benchmark::RegisterBenchmark("BM_PipelinedParse", BM_PipelinedParse,
+                                     Size)
+            ->Arg(static_cast<int64_t>(Size))
+            ->UseRealTime()
+            ->Unit(benchmark::kMicrosecond);
+        benchmark::RegisterBenchmark("BM_TopLevelBoundaries",
+                                     BM_TopLevelBoundaries, Size)
+            ->Arg(static_cast<int64_t>(Size))
+            ->Unit(benchmark::kMicrosecond);
+    }
+
+    // Thread scaling is only interesting on the largest corpus.
+    size_t Largest = getCorpusSizes().back();
+    benchmark::RegisterBenchmark("BM_ParallelParse", BM_ParallelParse, Largest)
+        ->ArgsProduct({{static_cast<int64_t>(Largest)}, {1, 2, 4, 8, 16, 32}})
+        ->UseRealTime()
+        ->Unit(benchmark::kMicrosecond);
+}
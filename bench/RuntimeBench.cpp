@@ -0,0 +1,275 @@
+#include "BenchUtil.h"
+#include "mathlib.h"
+#include "runtime.h"
+#include <cstdio>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// The runtime's batched math builtins under each kernel set, and its integer
+// I/O against the stdio calls it used to make per value.
+
+namespace
+{
+struct Batch
+{
+    std::vector<float> Data;
+    std::vector<float> T;
+    llsh_vec3_soa A, B, R;
+    float *Out;
+
+    explicit Batch(size_t N) : Data(10 * N), T(N)
+    {
+        // Deterministic values spread over several noise cells.
+        uint32_t Seed = 1;
+        for (float &F : Data)
+        {
+            Seed = Seed * 1664525u + 1013904223u;
+            F = static_cast<float>(Seed >> 8) / 16777216.0f * 16.0f - 8.0f;
+        }
+        for (size_t I = 0; I < N; ++I)
+            T[I] = static_cast<float>(I % 64) / 63.0f;
+        float *P = Data.data();
+        A = {P, P + N, P + 2 * N};
+        B = {P + 3 * N, P + 4 * N, P + 5 * N};
+        R = {P + 6 * N, P + 7 * N, P + 8 * N};
+        Out = P + 9 * N;
+    }
+};
+
+const llsh_mat4 Transform = {{{0.8f, 0.1f, 0.0f, 0.0f},
+                              {-0.1f, 0.9f, 0.2f, 0.0f},
+                              {0.0f, -0.2f, 1.1f, 0.01f},
+                              {3.0f, -2.0f, 0.5f, 1.0f}}};
+
+enum RuntimeOp
+{
+    OpDot,
+    OpCross,
+    OpLength,
+    OpNormalize,
+    OpMix,
+    OpClamp,
+    OpTransform,
+    OpTransformV,
+    OpNoise,
+};
+
+void runOp(RuntimeOp Op, Batch &B, size_t N)
+{
+    switch (Op)
+    {
+    case OpDot:
+        return llsh_dot_soa(B.Out, &B.A, &B.B, N);
+    case OpCross:
+        return llsh_cross_soa(&B.R, &B.A, &B.B, N);
+    case OpLength:
+        return llsh_length_soa(B.Out, &B.A, N);
+    case OpNormalize:
+        return llsh_normalize_soa(&B.R, &B.A, N);
+    case OpMix:
+        return llsh_mix_soa(&B.R, &B.A, &B.B, B.T.data(), N);
+    case OpClamp:
+        return llsh_clamp_soa(B.Out, B.A.x, -1.0f, 1.0f, N);
+    case OpTransform:
+        return llsh_transform_soa(&B.R, &Transform, &B.A, N);
+    case OpTransformV:
+        return llsh_transformv_soa(&B.R, &Transform, &B.A, N);
+    case OpNoise:
+        return llsh_noise_soa(B.Out, &B.A, N);
+    }
+}
+
+// Args: number of points, and the llsh_isa to run (0 scalar, 1 SSE, 2 AVX2).
+void BM_RuntimeMath(benchmark::State &State, RuntimeOp Op)
+{
+    size_t N = static_cast<size_t>(State.range(0));
+    llsh_isa Isa = static_cast<llsh_isa>(State.range(1));
+    if (Isa > llsh_host_isa())
+    {
+        State.SkipWithError("kernel set not supported by this host");
+        return;
+    }
+    llsh_isa Saved = llsh_get_isa();
+    llsh_set_isa(Isa);
+    Batch B(N);
+    for (auto _ : State)
+    {
+        runOp(Op, B, N);
+        benchmark::ClobberMemory();
+    }
+    llsh_set_isa(Saved);
+    State.counters["points_per_second"] = benchmark::Counter(
+        static_cast<double>(State.iterations() * N),
+        benchmark::Counter::kIsRate);
+}
+constexpr size_t NumIOValues = 1 << 20;
+
+// Values of every magnitude, so formatting and parsing see all lengths.
+std::vector<int> makeIOValues()
+{
+    std::vector<int> Values(NumIOValues);
+    uint32_t Seed = 7;
+    for (int &V : Values)
+    {
+        Seed = Seed * 1664525u + 1013904223u;
+        V = static_cast<int>(Seed) >> (Seed % 31);
+    }
+    return Values;
+}
+
+void setIOCounters(benchmark::State &State)
+{
+    State.counters["values_per_second"] = benchmark::Counter(
+        static_cast<double>(State.iterations() * NumIOValues),
+        benchmark::Counter::kIsRate);
+}
+
+enum WriteMode
+{
+    WritePrintf,
+    WriteInt,
+    WriteIntArray,
+    WriteIntArrayBinary,
+};
+
+void BM_RuntimeWrite(benchmark::State &State, WriteMode Mode)
+{
+    std::vector<int> Values = makeIOValues();
+    int Fd = open("/dev/null", O_WRONLY);
+    FILE *F = fdopen(Fd, "w");
+    if (!F)
+    {
+        State.SkipWithError("cannot open /dev/null");
+        return;
+    }
+    llsh_set_output_fd(Fd);
+    llsh_set_output_mode(Mode == WriteIntArrayBinary ? LLSH_OUTPUT_BINARY
+                                                     : LLSH_OUTPUT_TEXT);
+    for (auto _ : State)
+    {
+        switch (Mode)
+        {
+        case WritePrintf:
+            // What write_int did before: one locked stdio call per value.
+            for (int V : Values)
+                std::fprintf(F, "%d\n", V);
+            std::fflush(F);
+            break;
+        case WriteInt:
+            for (int V : Values)
+                write_int(V);
+            llsh_flush();
+            break;
+        case WriteIntArray:
+        case WriteIntArrayBinary:
+            write_int_array(Values.data(), Values.size());
+            llsh_flush();
+            break;
+        }
+    }
+    llsh_set_output_mode(LLSH_OUTPUT_TEXT);
+    llsh_set_output_fd(STDOUT_FILENO);
+    std::fclose(F);
+    setIOCounters(State);
+}
+
+enum ReadMode
+{
+    ReadScanf,
+    ReadInt,
+    ReadIntArray,
+};
+
+void BM_RuntimeRead(benchmark::State &State, ReadMode Mode)
+{
+    std::vector<int> Values = makeIOValues();
+    FILE *F = std::tmpfile();
+    if (!F)
+    {
+        State.SkipWithError("cannot create a temporary file");
+        return;
+    }
+    for (int V : Values)
+        std::fprintf(F, "%d\n", V);
+    std::fflush(F);
+    int Fd = fileno(F);
+
+    std::vector<int> Read(Values.size());
+    for (auto _ : State)
+    {
+        switch (Mode)
+        {
+        case ReadScanf:
+            // What read_int did before: one locked stdio call per value.
+            std::rewind(F);
+            for (int &V : Read)
+                if (std::fscanf(F, "%d", &V) != 1)
+                    break;
+            break;
+        case ReadInt:
+            lseek(Fd, 0, SEEK_SET);
+            llsh_set_input_fd(Fd);
+            for (int &V : Read)
+                V = read_int();
+            break;
+        case ReadIntArray:
+            lseek(Fd, 0, SEEK_SET);
+            llsh_set_input_fd(Fd);
+            read_int_array(Read.data(), Read.size());
+            break;
+        }
+    }
+    if (Read != Values)
+        State.SkipWithError("values read back differ");
+    llsh_set_input_fd(STDIN_FILENO);
+    std::fclose(F);
+    setIOCounters(State);
+}
+} // namespace
+
+void bench::registerRuntimeBenchmarks()
+{
+    static const struct
+    {
+        const char *Name;
+        RuntimeOp Op;
+    } Ops[] = {
+        {"BM_RuntimeDot", OpDot},
+        {"BM_RuntimeCross", OpCross},
+        {"BM_RuntimeLength", OpLength},
+        {"BM_RuntimeNormalize", OpNormalize},
+        {"BM_RuntimeMix", OpMix},
+        {"BM_RuntimeClamp", OpClamp},
+        {"BM_RuntimeTransform", OpTransform},
+        {"BM_RuntimeTransformV", OpTransformV},
+        {"BM_RuntimeNoise", OpNoise},
+    };
+    for (const auto &Entry : Ops)
+        benchmark::RegisterBenchmark(Entry.Name, BM_RuntimeMath, Entry.Op)
+            ->ArgsProduct({{4096, 1 << 20},
+                           {LLSH_ISA_SCALAR, LLSH_ISA_SSE, LLSH_ISA_AVX2}})
+            ->Unit(benchmark::kMicrosecond);
+
+    benchmark::RegisterBenchmark("BM_RuntimeWritePrintf", BM_RuntimeWrite,
+                                 WritePrintf)
+        ->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark("BM_RuntimeWriteInt", BM_RuntimeWrite,
+                                 WriteInt)
+        ->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark("BM_RuntimeWriteIntArray", BM_RuntimeWrite,
+                                 WriteIntArray)
+        ->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark("BM_RuntimeWriteIntArrayBinary",
+                                 BM_RuntimeWrite, WriteIntArrayBinary)
+        ->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark("BM_RuntimeReadScanf", BM_RuntimeRead,
+                                 ReadScanf)
+        ->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark("BM_RuntimeReadInt", BM_RuntimeRead, ReadInt)
+        ->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark("BM_RuntimeReadIntArray", BM_RuntimeRead,
+                                 ReadIntArray)
+        ->Unit(benchmark::kMillisecond);
+}
@@ -0,0 +1,67 @@
+#include "BenchUtil.h"
+#include "llshader/Basic/Diagnostic.h"
+#include "llshader/Lexer/Lexer.h"
+#include "llshader/Parser/Parser.h"
+#include "llshader/Sema/Sema.h"
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+
+namespace
+{
+// Args: corpus size, and the thread count if Threaded.
+void BM_SemaSemantic(benchmark::State &State, size_t Size, bool Threaded)
+{
+    const std::string &Src = bench::getCorpus(Size);
+    llvm::SourceMgr SrcMgr;
+    SrcMgr.AddNewSourceBuffer(
+        llvm::MemoryBuffer::getMemBuffer(Src, "corpus.osl"), llvm::SMLoc());
+    DiagnosticsEngine Diags(SrcMgr);
+    Lexer Lex(SrcMgr, Diags);
+    Parser P(Lex, Diags);
+    AST *Tree = P.parse();
+    if (!Tree)
+    {
+        State.SkipWithError("corpus failed to parse");
+        return;
+    }
+    uint64_t NodesPerTree = bench::countNodes(Tree);
+
+    uint64_t Nodes = 0;
+    uint64_t Alloc = 0;
+    for (auto _ : State)
+    {
+        uint64_t Before = bench::allocatedBytes();
+        Sema S;
+        if (Threaded)
+            S.setNumThreads(static_cast<unsigned>(State.range(1)));
+        bool Ok = S.semantic(Tree);
+        Alloc += bench::allocatedBytes() - Before;
+        if (!Ok)
+        {
+            State.SkipWithError("corpus failed semantic analysis");
+            break;
+        }
+        Nodes += NodesPerTree;
+    }
+    bench::destroyTree(Tree);
+    bench::setCounters(State, State.iterations() * Src.size(), Alloc);
+    State.counters["nodes_per_second"] = benchmark::Counter(
+        static_cast<double>(Nodes), benchmark::Counter::kIsRate);
+}
+} // namespace
+
+void bench::registerSemaBenchmarks()
+{
+    for (size_t Size : getCorpusSizes())
+        benchmark::RegisterBenchmark("BM_SemaSemantic", BM_SemaSemantic, Size,
+                                     false)
+            ->Arg(static_cast<int64_t>(Size))
+            ->Unit(benchmark::kMicrosecond);
+
+    size_t Largest = getCorpusSizes().back();
+    benchmark::RegisterBenchmark("BM_SemaParallel", BM_SemaSemantic, Largest,
+                                 true)
+        ->ArgsProduct({{static_cast<int64_t>(Largest)}, {1, 2, 4, 8, 16, 32}})
+        ->UseRealTime()
+        ->Unit(benchmark::kMicrosecond);
+}
@@ -10,6 +10,10 @@
 #include <vector>
 
 typedef llvm::StringMap<std::any> ProgramInfo;
+
+// Frame slot of a variable Sema has not bound.
+constexpr unsigned InvalidSlot = ~0u;
+
 class AST;
 class Program;
 class Statement;
@@ -36,6 +40,7 @@ class VariableRef;
 class IncDec;
 class TypeCast;
 class CompoundEx;
+class Derivative;
 
 using StmtList = std::vector<Statement *>;
 using ExprList = std::vector<Expression *>;
@@ -71,6 +76,7 @@ class ASTVisitor
     virtual void visit(IncDec &) {};
     virtual void visit(TypeCast &) {};
     virtual void visit(CompoundEx &) {};
+    virtual void visit(Derivative &) {};
 };
 
 // Base nodes
@@ -78,8 +84,24 @@ class ASTVisitor
 class AST
 {
   public:
+    enum NodeKind
+    {
+        NodeProgram,
+        NodeStmt,
+        NodeExpr,
+        NodeDefExpr,
+        NodeLValue,
+    };
+
+  private:
+    const NodeKind Kind;
+
+  public:
+    AST(NodeKind Kind) : Kind(Kind) {}
     virtual ~AST() {}
     virtual void accept(ASTVisitor &V) = 0;
+
+    NodeKind getNodeKind() const { return Kind; }
 };
 
 class Program : public AST
@@ -88,13 +110,19 @@ class Program : public AST
     ProgramInfo Info;
 
   public:
-    Program(StmtList *SL) : SL(SL) {};
-    Program(StmtList *SL, ProgramInfo Info) : SL(SL), Info(Info) {};
+    Program(StmtList *SL) : AST(NodeProgram), SL(SL) {};
+    Program(StmtList *SL, ProgramInfo Info)
+        : AST(NodeProgram), SL(SL), Info(Info) {};
+    ~Program();
 
     StmtList *getSL() const { return SL; };
     ProgramInfo getInfo() const { return Info; };
 
     virtual void accept(ASTVisitor &V) override { V.visit(*this); }
+    static bool classof(const AST *A)
+    {
+        return A->getNodeKind() == NodeProgram;
+    }
 };
 
 class Statement : public AST
@@ -112,13 +140,18 @@ class Statement : public AST
 
   private:
     const StmtKind Kind;
+    // Location of the statement's first token.
+    llvm::SMLoc Loc;
 
   public:
-    Statement(StmtKind Kind) : Kind(Kind) {}
+    Statement(StmtKind Kind) : AST(NodeStmt), Kind(Kind) {}
 
     StmtKind getKind() const { return Kind; };
+    llvm::SMLoc getLocation() const { return Loc; }
+    void setLocation(llvm::SMLoc L) { Loc = L; }
 
     virtual void accept(ASTVisitor &V) override { V.visit(*this); }
+    static bool classof(const AST *A) { return A->getNodeKind() == NodeStmt; }
 };
 
 class Expression : public AST
@@ -135,18 +168,20 @@ class Expression : public AST
         ExprIncDec,
         ExprTypeCast,
         ExprCompEx,
+        ExprDeriv,
     };
 
   private:
     const ExprKind Kind;
 
   public:
-    Expression(ExprKind Kind) : Kind(Kind) {}
+    Expression(ExprKind Kind) : AST(NodeExpr), Kind(Kind) {}
     virtual TokenKind getType() const = 0;
 
     ExprKind getKind() const { return Kind; };
 
     virtual void accept(ASTVisitor &V) override { V.visit(*this); }
+    static bool classof(const AST *A) { return A->getNodeKind() == NodeExpr; }
 };
 
 // Statement nodes
@@ -170,6 +205,7 @@ class CompoundSt : public Statement
     ExprList *getEL() const { return EL; };
 
     virtual void accept(ASTVisitor &V) override { V.visit(*this); }
+    static bool classof(const Statement *S) { return S->getKind() == StmtComp; }
 };
 
 class Scoped : public Statement
@@ -201,10 +237,12 @@ class DefExpr : public AST
 {
     StringRef Id;
     Expression *Value = nullptr;
+    unsigned Slot = InvalidSlot;
 
   public:
-    DefExpr(StringRef Id) : Id(Id) {};
-    DefExpr(StringRef Id, Expression *Value) : Id(Id), Value(Value) {};
+    DefExpr(StringRef Id) : AST(NodeDefExpr), Id(Id) {};
+    DefExpr(StringRef Id, Expression *Value)
+        : AST(NodeDefExpr), Id(Id), Value(Value) {};
 
     ~DefExpr()
     {
@@ -216,8 +254,15 @@ class DefExpr : public AST
 
     StringRef getId() const { return Id; };
     Expression *getValue() const { return Value; };
+    // Index of the variable in its function's frame, set by Sema.
+    unsigned getSlot() const { return Slot; };
+    void setSlot(unsigned NewSlot) { Slot = NewSlot; };
 
     virtual void accept(ASTVisitor &V) override { V.visit(*this); }
+    static bool classof(const AST *A)
+    {
+        return A->getNodeKind() == NodeDefExpr;
+    }
 };
 
 class Declaration : public Statement
@@ -270,6 +315,7 @@ class Conditional : public Statement
     Statement *getElse() const { return ElseStmt; };
 
     virtual void accept(ASTVisitor &V) override { V.visit(*this); }
+    static bool classof(const Statement *S) { return S->getKind() == StmtCond; }
 };
 
 class Loop : public Statement
@@ -307,16 +353,8 @@ class For : public Loop
         : Loop(LoopFor), Init(Init), Condition(Condition), Update(Update),
           Body(Body) {};
 
-    ~For()
-    {
-        if (Init)
-            delete Init;
-        if (Condition)
-            delete Condition;
-        if (Update)
-            delete Update;
-        delete Body;
-    };
+    // Defined after CompoundEx, which Update needs complete to be deleted.
+    ~For();
 
     Declaration *getInit() const { return Init; };
     Expression *getCondition() const { return Condition; };
@@ -324,6 +362,11 @@ class For : public Loop
     Statement *getBody() const { return Body; };
 
     virtual void accept(ASTVisitor &V) override { V.visit(*this); }
+    static bool classof(const Statement *S)
+    {
+        return Loop::classof(S) &&
+               static_cast<const Loop *>(S)->getKind() == LoopFor;
+    }
 };
 
 class While : public Loop
@@ -345,6 +388,11 @@ class While : public Loop
     Statement *getBody() const { return Body; };
 
     virtual void accept(ASTVisitor &V) override { V.visit(*this); }
+    static bool classof(const Statement *S)
+    {
+        return Loop::classof(S) &&
+               static_cast<const Loop *>(S)->getKind() == LoopWhile;
+    }
 };
 
 class DoWhile : public Loop
@@ -366,6 +414,11 @@ class DoWhile : public Loop
     Statement *getBody() const { return Body; };
 
     virtual void accept(ASTVisitor &V) override { V.visit(*this); }
+    static bool classof(const Statement *S)
+    {
+        return Loop::classof(S) &&
+               static_cast<const Loop *>(S)->getKind() == LoopDoWhile;
+    }
 };
 
 class LoopMod : public Statement
@@ -402,13 +455,27 @@ class Literal : public Expression
   private:
     LitKind Kind;
     StringRef Value;
+    // A number's value, converted once by the Lexer.
+    union
+    {
+        int32_t Int = 0;
+        float Float;
+    };
 
   public:
     Literal(LitKind Kind, StringRef Value)
         : Expression(ExprLit), Kind(Kind), Value(Value) {};
+    Literal(StringRef Value, int32_t Int)
+        : Expression(ExprLit), Kind(Integer), Value(Value), Int(Int) {};
+    Literal(StringRef Value, float Float)
+        : Expression(ExprLit), Kind(FloatingPoint), Value(Value),
+          Float(Float) {};
 
     LitKind getKind() const { return Kind; };
+    // The spelling; a string's is without its quotes.
     StringRef getValue() const { return Value; };
+    int32_t getInt() const { return Int; };
+    float getFloat() const { return Float; };
     TokenKind getType() const override
     {
         if (Kind == Integer)
@@ -546,10 +613,12 @@ class LValue : public AST
 {
     StringRef Id;
     ExprList *Indices = nullptr;
+    unsigned Slot = InvalidSlot;
+    TokenKind Type = TokenKind::kw_void;
 
   public:
     LValue(StringRef Id, ExprList *Indices = nullptr)
-        : Id(Id), Indices(Indices) {};
+        : AST(NodeLValue), Id(Id), Indices(Indices) {};
 
     ~LValue()
     {
@@ -565,8 +634,15 @@ class LValue : public AST
 
     StringRef getId() const { return Id; };
     ExprList *getIndices() const { return Indices; };
+    // The slot of the variable assigned to and the type of the assigned
+    // element, set by Sema.
+    unsigned getSlot() const { return Slot; };
+    void setSlot(unsigned NewSlot) { Slot = NewSlot; };
+    TokenKind getType() const { return Type; };
+    void setType(TokenKind NewType) { Type = NewType; };
 
     virtual void accept(ASTVisitor &V) override { V.visit(*this); }
+    static bool classof(const AST *A) { return A->getNodeKind() == NodeLValue; }
 };
 
 class Assignment : public Expression
@@ -592,13 +668,13 @@ class Assignment : public Expression
     {
         if (Op == "=")
             return Value->getType();
-        // get type for the lvalue
+        return Id->getType();
     };
 
     virtual void accept(ASTVisitor &V) override { V.visit(*this); }
-    static bool classof(const Statement *S)
+    static bool classof(const Expression *E)
     {
-        return S->getKind() == ExprAssmt;
+        return E->getKind() == ExprAssmt;
     }
 };
 
@@ -606,6 +682,7 @@ class VariableRef : public Expression
 {
     StringRef Id;
     Expression *Deref;
+    unsigned Slot = InvalidSlot;
     TokenKind Type = TokenKind::kw_void;
 
   public:
@@ -616,6 +693,10 @@ class VariableRef : public Expression
 
     StringRef getId() const { return Id; };
     Expression *getDeref() const { return Deref; };
+    // The slot of the variable read, set by Sema; InvalidSlot if it is
+    // undeclared.
+    unsigned getSlot() const { return Slot; };
+    void setSlot(unsigned NewSlot) { Slot = NewSlot; };
     TokenKind getType() const override { return Type; };
     void setType(TokenKind newType) { Type = newType; };
 
@@ -697,4 +778,62 @@ class CompoundEx : public Expression
     }
 };
 
+// Dx(E) or Dy(E): the derivative of E across the image in x or y, of the
+// same type as E (an int's is a float).
+class Derivative : public Expression
+{
+  public:
+    enum Axis
+    {
+        X,
+        Y
+    };
+
+  private:
+    Axis Dir;
+    Expression *E;
+
+  public:
+    Derivative(Axis Dir, Expression *E)
+        : Expression(ExprDeriv), Dir(Dir), E(E) {};
+
+    ~Derivative() { delete E; };
+
+    Axis getAxis() const { return Dir; };
+    // Dx or Dy.
+    StringRef getName() const { return Dir == X ? "Dx" : "Dy"; };
+    Expression *getE() const { return E; };
+    TokenKind getType() const override
+    {
+        TokenKind Type = E->getType();
+        return Type == TokenKind::kw_int ? TokenKind::kw_float : Type;
+    };
+
+    virtual void accept(ASTVisitor &V) override { V.visit(*this); }
+    static bool classof(const Expression *E)
+    {
+        return E->getKind() == ExprDeriv;
+    }
+};
+
+inline For::~For()
+{
+    if (Init)
+        delete Init;
+    if (Condition)
+        delete Condition;
+    if (Update)
+        delete Update;
+    delete Body;
+}
+
+inline Program::~Program()
+{
+    for (auto S : *SL)
+    {
+        delete S;
+    }
+    delete SL;
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,188 @@
+#ifndef LLSHADER_AST_FLATAST_H
+#define LLSHADER_AST_FLATAST_H
+
+#include "llshader/AST/AST.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/ErrorHandling.h"
+#include <cstdint>
+#include <vector>
+
+// Index of a node in a FlatAST.
+using FlatNode = uint32_t;
+constexpr FlatNode InvalidFlatNode = ~0u;
+
+enum class FlatKind : uint8_t
+{
+#define FLAT_NODE(Name) Name,
+#include "llshader/AST/FlatAST.def"
+};
+
+enum class FlatOp : uint8_t
+{
+    None,
+#define FLAT_OP(Name, Spelling) Name,
+#include "llshader/AST/FlatAST.def"
+};
+
+FlatOp getFlatOp(StringRef Spelling);
+const char *getFlatOpSpelling(FlatOp Op);
+
+// The type of Type1 Op Type2, by the rules of BinaryExpression::getType.
+TokenKind getBinaryType(FlatOp Op, TokenKind Type1, TokenKind Type2);
+
+// Structure-of-arrays form of a parsed Program. Every node is an index into
+// parallel arrays of kinds, types, operators, child ranges and a 32-bit
+// payload, and children are 32-bit indices stored contiguously per node.
+// Nodes are numbered in pre-order, so a node's children always have larger
+// indices than the node itself; a reverse sweep over the indices is a
+// post-order walk.
+//
+// Children per kind (optional ones are InvalidFlatNode when absent):
+//   Program, Scoped          statements
+//   CompoundSt, CompoundEx   expressions
+//   Declaration              DefExprs; the type is the declared type
+//   DefExpr                  [value]; payload is the identifier
+//   Conditional              condition, then, else?
+//   For                      init?, condition?, update?, body
+//   While, DoWhile           condition, body
+//   LoopMod                  none; payload is kw_break or kw_continue
+//   Literal                  none; payload indexes the literal table
+//   TypeConstructor          values
+//   BinaryExpression         lhs, rhs
+//   UnaryExpression, TypeCast  operand
+//   LValue                   indices; payload is the identifier
+//   Assignment               LValue, value
+//   VariableRef              deref?; payload is the identifier
+//   IncDec                   VariableRef
+//   Derivative               operand; the op is Dx or Dy
+class FlatAST
+{
+  public:
+    struct LiteralValue
+    {
+        Literal::LitKind Kind;
+        // Source spelling; empty for literals made by folding.
+        StringRef Text;
+        union
+        {
+            int64_t Int = 0;
+            double Float;
+        };
+    };
+
+  private:
+    std::vector<FlatKind> Kinds;
+    std::vector<TokenKind> Types;
+    std::vector<FlatOp> Ops;
+    std::vector<uint32_t> ChildBegin;
+    std::vector<uint32_t> ChildCount;
+    std::vector<uint32_t> Data;
+
+    std::vector<FlatNode> Children;
+    std::vector<LiteralValue> Literals;
+    std::vector<StringRef> Idents;
+    llvm::StringMap<uint32_t> IdentIds;
+    // Only statements have locations, and they are only looked up for
+    // diagnostics.
+    llvm::DenseMap<FlatNode, llvm::SMLoc> Locations;
+
+    friend class FlatASTBuilder;
+
+  public:
+    // Flattens a Program; its root is node 0. The identifier and literal
+    // spellings still point into the source buffer.
+    static FlatAST build(AST *Tree);
+
+    FlatNode getRoot() const { return 0; }
+    size_t size() const { return Kinds.size(); }
+
+    FlatKind getKind(FlatNode N) const { return Kinds[N]; }
+    TokenKind getType(FlatNode N) const { return Types[N]; }
+    FlatOp getOp(FlatNode N) const { return Ops[N]; }
+
+    llvm::ArrayRef<FlatNode> children(FlatNode N) const
+    {
+        return llvm::makeArrayRef(Children.data() + ChildBegin[N],
+                                  ChildCount[N]);
+    }
+    FlatNode getChild(FlatNode N, unsigned I) const
+    {
+        return I < ChildCount[N] ? Children[ChildBegin[N] + I]
+                                 : InvalidFlatNode;
+    }
+
+    // DefExpr, LValue and VariableRef name an identifier. Identifiers are
+    // numbered densely in order of first appearance.
+    uint32_t getIdent(FlatNode N) const { return Data[N]; }
+    StringRef getIdentName(uint32_t Ident) const { return Idents[Ident]; }
+    size_t getNumIdents() const { return Idents.size(); }
+
+    const LiteralValue &getLiteral(FlatNode N) const
+    {
+        return Literals[Data[N]];
+    }
+    TokenKind getLoopMod(FlatNode N) const
+    {
+        return static_cast<TokenKind>(Data[N]);
+    }
+
+    // Location of statement N's first token; invalid for other nodes.
+    llvm::SMLoc getLocation(FlatNode N) const
+    {
+        return Locations.lookup(N);
+    }
+
+    // Turns N into a literal of the given type. Its former children are left
+    // in place but are no longer reachable.
+    void replaceWithLiteral(FlatNode N, TokenKind Type,
+                            const LiteralValue &Value);
+
+    // Bytes held by the arrays, for comparison with the node classes.
+    size_t getMemorySize() const;
+};
+
+// Non-virtual visitor over a FlatAST. visit(N) switches on the node kind and
+// calls Derived::visit<Kind>(N); unless overridden these call visitNode,
+// which visits the present children. All calls resolve at compile time.
+template <typename Derived, typename RetTy = void> class FlatASTVisitor
+{
+  protected:
+    const FlatAST &Tree;
+
+    Derived &derived() { return *static_cast<Derived *>(this); }
+
+  public:
+    FlatASTVisitor(const FlatAST &Tree) : Tree(Tree) {}
+
+    RetTy visit(FlatNode N)
+    {
+        switch (Tree.getKind(N))
+        {
+#define FLAT_NODE(Name)                                                        \
+    case FlatKind::Name:                                                       \
+        return derived().visit##Name(N);
+#include "llshader/AST/FlatAST.def"
+        }
+        llvm_unreachable("Unknown flat node kind");
+    }
+
+    RetTy visitChildren(FlatNode N)
+    {
+        for (FlatNode Child : Tree.children(N))
+        {
+            if (Child != InvalidFlatNode)
+                derived().visit(Child);
+        }
+        return RetTy();
+    }
+
+    RetTy visitNode(FlatNode N) { return derived().visitChildren(N); }
+
+#define FLAT_NODE(Name)                                                        \
+    RetTy visit##Name(FlatNode N) { return derived().visitNode(N); }
+#include "llshader/AST/FlatAST.def"
+};
+
+#endif
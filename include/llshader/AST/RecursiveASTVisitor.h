@@ -0,0 +1,211 @@
+#ifndef LLSHADER_AST_RECURSIVEASTVISITOR_H
+#define LLSHADER_AST_RECURSIVEASTVISITOR_H
+
+#include "llshader/AST/AST.h"
+#include "llvm/Support/Casting.h"
+#include "llvm/Support/ErrorHandling.h"
+
+// Compile-time dispatched traversal of the node classes. traverse() switches
+// on the node kinds and calls Derived::traverse<Class>, which by default
+// calls Derived::visit<Class> and then traverses the children in source
+// order. Passes override visit<Class> to act on a node, or traverse<Class>
+// to control how (and whether) its children are walked. Returning false
+// from either stops the whole traversal.
+//
+// Unlike ASTVisitor there are no virtual calls, so the compiler can inline
+// the pass into the walk.
+template <typename Derived> class RecursiveASTVisitor
+{
+    Derived &getDerived() { return *static_cast<Derived *>(this); }
+
+  public:
+    bool traverse(AST *Node);
+    bool traverseStmt(Statement *S);
+    bool traverseExpr(Expression *E);
+
+    // Children are routed by their static type, which skips the switch on
+    // the node kind in traverse().
+    bool traverseNode(AST *Node) { return getDerived().traverse(Node); }
+    bool traverseNode(Statement *S) { return getDerived().traverseStmt(S); }
+    bool traverseNode(Expression *E) { return getDerived().traverseExpr(E); }
+    bool traverseNode(DefExpr *D)
+    {
+        return !D || getDerived().traverseDefExpr(*D);
+    }
+    bool traverseNode(LValue *L)
+    {
+        return !L || getDerived().traverseLValue(*L);
+    }
+
+    template <class List> bool traverseList(List *L)
+    {
+        if (L)
+        {
+            for (auto Node : *L)
+            {
+                if (!traverseNode(Node))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+#define AST_NODE(Class)                                                        \
+    bool traverse##Class(Class &Node);                                         \
+    bool visit##Class(Class &Node) { return true; }
+#include "llshader/AST/ASTNodes.def"
+};
+
+template <typename Derived>
+bool RecursiveASTVisitor<Derived>::traverse(AST *Node)
+{
+    if (!Node)
+        return true;
+    switch (Node->getNodeKind())
+    {
+    case AST::NodeProgram:
+        return getDerived().traverseProgram(*llvm::cast<Program>(Node));
+    case AST::NodeStmt:
+        return getDerived().traverseStmt(llvm::cast<Statement>(Node));
+    case AST::NodeExpr:
+        return getDerived().traverseExpr(llvm::cast<Expression>(Node));
+    case AST::NodeDefExpr:
+        return getDerived().traverseDefExpr(*llvm::cast<DefExpr>(Node));
+    case AST::NodeLValue:
+        return getDerived().traverseLValue(*llvm::cast<LValue>(Node));
+    }
+    llvm_unreachable("Unknown node kind");
+}
+
+template <typename Derived>
+bool RecursiveASTVisitor<Derived>::traverseStmt(Statement *S)
+{
+    if (!S)
+        return true;
+    switch (S->getKind())
+    {
+    case Statement::StmtComp:
+        return getDerived().traverseCompoundSt(*llvm::cast<CompoundSt>(S));
+    case Statement::StmtScoped:
+        return getDerived().traverseScoped(*llvm::cast<Scoped>(S));
+    case Statement::StmtDecl:
+        return getDerived().traverseDeclaration(*llvm::cast<Declaration>(S));
+    case Statement::StmtCond:
+        return getDerived().traverseConditional(*llvm::cast<Conditional>(S));
+    case Statement::StmtLoop:
+        switch (llvm::cast<Loop>(S)->getKind())
+        {
+        case Loop::LoopFor:
+            return getDerived().traverseFor(*llvm::cast<For>(S));
+        case Loop::LoopWhile:
+            return getDerived().traverseWhile(*llvm::cast<While>(S));
+        case Loop::LoopDoWhile:
+            return getDerived().traverseDoWhile(*llvm::cast<DoWhile>(S));
+        }
+        llvm_unreachable("Unknown loop kind");
+    case Statement::StmtLoopMod:
+        return getDerived().traverseLoopMod(*llvm::cast<LoopMod>(S));
+    }
+    llvm_unreachable("Unknown statement kind");
+}
+
+template <typename Derived>
+bool RecursiveASTVisitor<Derived>::traverseExpr(Expression *E)
+{
+    if (!E)
+        return true;
+    switch (E->getKind())
+    {
+    case Expression::ExprLit:
+        return getDerived().traverseLiteral(*llvm::cast<Literal>(E));
+    case Expression::ExprTypeCon:
+        return getDerived().traverseTypeConstructor(
+            *llvm::cast<TypeConstructor>(E));
+    case Expression::ExprBin:
+        return getDerived().traverseBinaryExpression(
+            *llvm::cast<BinaryExpression>(E));
+    case Expression::ExprUn:
+        return getDerived().traverseUnaryExpression(
+            *llvm::cast<UnaryExpression>(E));
+    case Expression::ExprAssmt:
+        return getDerived().traverseAssignment(*llvm::cast<Assignment>(E));
+    case Expression::ExprRef:
+        return getDerived().traverseVariableRef(*llvm::cast<VariableRef>(E));
+    case Expression::ExprIncDec:
+        return getDerived().traverseIncDec(*llvm::cast<IncDec>(E));
+    case Expression::ExprTypeCast:
+        return getDerived().traverseTypeCast(*llvm::cast<TypeCast>(E));
+    case Expression::ExprCompEx:
+        return getDerived().traverseCompoundEx(*llvm::cast<CompoundEx>(E));
+    case Expression::ExprDeriv:
+        return getDerived().traverseDerivative(*llvm::cast<Derivative>(E));
+    }
+    llvm_unreachable("Unknown expression kind");
+}
+
+// Default traversals: visit the node, then its children in source order.
+#define DEF_TRAVERSE(Class, Children)                                          \
+    template <typename Derived>                                                \
+    bool RecursiveASTVisitor<Derived>::traverse##Class(Class &Node)            \
+    {                                                                          \
+        if (!getDerived().visit##Class(Node))                                  \
+            return false;                                                      \
+        Children;                                                              \
+        return true;                                                           \
+    }
+#define TRY_TO(Call)                                                           \
+    do                                                                         \
+    {                                                                          \
+        if (!getDerived().Call)                                                \
+            return false;                                                      \
+    } while (false)
+
+DEF_TRAVERSE(Program, TRY_TO(traverseList(Node.getSL())))
+DEF_TRAVERSE(DefExpr, TRY_TO(traverseNode(Node.getValue())))
+DEF_TRAVERSE(LValue, TRY_TO(traverseList(Node.getIndices())))
+
+DEF_TRAVERSE(CompoundSt, TRY_TO(traverseList(Node.getEL())))
+DEF_TRAVERSE(Scoped, TRY_TO(traverseList(Node.getSL())))
+DEF_TRAVERSE(Declaration, TRY_TO(traverseList(Node.getDefs())))
+DEF_TRAVERSE(Conditional, {
+    TRY_TO(traverseNode(Node.getCondition()));
+    TRY_TO(traverseNode(Node.getThen()));
+    TRY_TO(traverseNode(Node.getElse()));
+})
+DEF_TRAVERSE(For, {
+    TRY_TO(traverseNode(Node.getInit()));
+    TRY_TO(traverseNode(Node.getCondition()));
+    TRY_TO(traverseNode(Node.getUpdate()));
+    TRY_TO(traverseNode(Node.getBody()));
+})
+DEF_TRAVERSE(While, {
+    TRY_TO(traverseNode(Node.getCondition()));
+    TRY_TO(traverseNode(Node.getBody()));
+})
+DEF_TRAVERSE(DoWhile, {
+    TRY_TO(traverseNode(Node.getBody()));
+    TRY_TO(traverseNode(Node.getCondition()));
+})
+DEF_TRAVERSE(LoopMod, {})
+
+DEF_TRAVERSE(Literal, {})
+DEF_TRAVERSE(TypeConstructor, TRY_TO(traverseList(Node.getValues())))
+DEF_TRAVERSE(BinaryExpression, {
+    TRY_TO(traverseNode(Node.getE1()));
+    TRY_TO(traverseNode(Node.getE2()));
+})
+DEF_TRAVERSE(UnaryExpression, TRY_TO(traverseNode(Node.getE())))
+DEF_TRAVERSE(Assignment, {
+    TRY_TO(traverseNode(Node.getId()));
+    TRY_TO(traverseNode(Node.getValue()));
+})
+DEF_TRAVERSE(VariableRef, TRY_TO(traverseNode(Node.getDeref())))
+DEF_TRAVERSE(IncDec, TRY_TO(traverseNode(Node.getId())))
+DEF_TRAVERSE(TypeCast, TRY_TO(traverseNode(Node.getE())))
+DEF_TRAVERSE(CompoundEx, TRY_TO(traverseList(Node.getEL())))
+DEF_TRAVERSE(Derivative, TRY_TO(traverseNode(Node.getE())))
+
+#undef TRY_TO
+#undef DEF_TRAVERSE
+
+#endif
@@ -4,6 +4,10 @@
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#include <string>
+#include <utility>
+#include <vector>
 
 using llvm::formatv;
 using llvm::SMLoc;
@@ -19,21 +23,83 @@ enum {
 };
 } // namespace diag
 
+/// Builds diagnostics for locations that do not point into a SourceMgr
+/// buffer, such as the sliding window of a streaming Lexer.
+class LocationResolver {
+public:
+  virtual ~LocationResolver() = default;
+  virtual bool resolve(const SourceMgr &SrcMgr, SMLoc Loc,
+                       SourceMgr::DiagKind Kind, StringRef Msg,
+                       llvm::SMDiagnostic &Diag) const = 0;
+  /// Line and 1-based column of Loc, like SourceMgr::getLineAndColumn;
+  /// false if Loc is not one of the resolver's.
+  virtual bool getLineAndColumn(SMLoc Loc, unsigned &Line,
+                                unsigned &Col) const = 0;
+};
+
+/// A diagnostic kept by a deferring DiagnosticsEngine.
+struct StoredDiagnostic {
+  SMLoc Loc;
+  SourceMgr::DiagKind Kind;
+  std::string Msg;
+};
+
 class DiagnosticsEngine {
   static const char *getDiagnosticText(unsigned DiagID);
   static SourceMgr::DiagKind getDiagnosticKind(unsigned DiagID);
   SourceMgr &SrcMgr;
   unsigned NumErrors;
+  const LocationResolver *Resolver = nullptr;
+  bool Deferring = false;
+  std::vector<StoredDiagnostic> Deferred;
+
+  void emit(SMLoc Loc, SourceMgr::DiagKind Kind, StringRef Msg) {
+    llvm::SMDiagnostic Diag;
+    if (Resolver && Resolver->resolve(SrcMgr, Loc, Kind, Msg, Diag))
+      SrcMgr.PrintMessage(llvm::errs(), Diag);
+    else
+      SrcMgr.PrintMessage(Loc, Kind, Msg);
+  }
 
 public:
   DiagnosticsEngine(SourceMgr &SrcMgr) : SrcMgr(SrcMgr), NumErrors(0) {}
 
   unsigned numErrors() { return NumErrors; }
+  SourceMgr &getSourceMgr() const { return SrcMgr; }
+  void setLocationResolver(const LocationResolver *R) { Resolver = R; }
+
+  /// Line and 1-based column of Loc, whether it points into the SourceMgr
+  /// or is the resolver's; {0, 0} if neither knows it.
+  std::pair<unsigned, unsigned> getLineAndColumn(SMLoc Loc) const {
+    unsigned Line, Col;
+    if (Resolver && Resolver->getLineAndColumn(Loc, Line, Col))
+      return {Line, Col};
+    if (!Loc.isValid() || !SrcMgr.FindBufferContainingLoc(Loc))
+      return {0, 0};
+    return SrcMgr.getLineAndColumn(Loc);
+  }
+
+  /// While deferring, diagnostics are stored instead of printed, so work done
+  /// out of source order (e.g. on worker threads) can be replayed in order.
+  /// A deferring engine never touches the SourceMgr.
+  void setDeferring(bool D) { Deferring = D; }
+  std::vector<StoredDiagnostic> takeDeferred() { return std::move(Deferred); }
+  void replay(const StoredDiagnostic &D) {
+    if (Deferring)
+      Deferred.push_back(D);
+    else
+      emit(D.Loc, D.Kind, D.Msg);
+    NumErrors += (D.Kind == SourceMgr::DK_Error);
+  }
+
   template <typename... Args>
   void report(SMLoc Loc, unsigned DiagID, Args &&...Arguments) {
     std::string Msg = formatv(getDiagnosticText(DiagID), Arguments...).str();
     SourceMgr::DiagKind Kind = getDiagnosticKind(DiagID);
-    SrcMgr.PrintMessage(Loc, Kind, Msg);
+    if (Deferring)
+      Deferred.push_back({Loc, Kind, std::move(Msg)});
+    else
+      emit(Loc, Kind, Msg);
     NumErrors += (Kind == SourceMgr::DK_Error);
   }
 };
@@ -13,6 +13,28 @@ const char *getTokenName(TokenKind Kind);
 const char *getPunctuatorSpelling(TokenKind Kind);
 const char *getKeywordSpelling(TokenKind Kind);
 
+/// The type keywords, which start a declaration, a constructor or a cast.
+inline bool isTypeKeyword(TokenKind Kind) {
+  switch (Kind) {
+  case kw_int:
+  case kw_float:
+  case kw_string:
+  case kw_point:
+  case kw_vector:
+  case kw_normal:
+  case kw_color:
+  case kw_matrix:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/// The operators that chain two operands left to right.
+inline bool isBinaryOperator(TokenKind Kind) {
+  return Kind == bin_op || Kind == bit_op || Kind == comp_op || Kind == log_op;
+}
+
 } // namespace tok
 } // namespace llshader
 
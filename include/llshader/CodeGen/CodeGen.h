@@ -2,17 +2,100 @@
 #define LLSHADER_CODEGEN_CODEGEN_H
 
 #include "llshader/AST/AST.h"
+#include "llshader/Basic/Diagnostic.h"
+#include "llshader/CodeGen/Profile.h"
+#include "llshader/Sema/Specialization.h"
+#include "llshader/Sema/Uniformity.h"
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
+#include <llvm/Support/SourceMgr.h>
+#include <string>
 
 class CodeGen
 {
     llvm::Module *M;
     llvm::LLVMContext *Ctx;
+    const llvm::SourceMgr *SrcMgr = nullptr;
+    std::string ProfileSource;
+    const ShaderProfile *Profile = nullptr;
+    const UniformityInfo *Uniformity = nullptr;
+    const Specialization *Spec = nullptr;
+    std::string ShaderName;
+    std::string Targets;
+    // Threads for setParallel; 0 if top-level blocks are emitted inline.
+    unsigned Threads = 0;
+    unsigned OptLevel = 0;
+    DiagnosticsEngine *Diags = nullptr;
 
   public:
     CodeGen(llvm::Module *M, llvm::LLVMContext *Ctx) : M(M), Ctx(Ctx) {}
-    void compile(AST *Tree);
+
+    // Instrument the shader with per-statement counters for the runtime's
+    // profiler (tools/runtime/profile.h). Statements are identified by their
+    // line and column in SrcMgr; Source names the shader in the profile.
+    void setProfileGenerate(const llvm::SourceMgr &SrcMgr,
+                            llvm::StringRef Source)
+    {
+        this->SrcMgr = &SrcMgr;
+        ProfileSource = Source.str();
+    }
+
+    // Attach the counts in Profile, collected from a -profile-generate build
+    // of the same source, to the branches and to main as branch weights and
+    // an entry count, so the optimizer can tell hot code from cold.
+    void setProfileUse(const llvm::SourceMgr &SrcMgr,
+                       const ShaderProfile &Profile)
+    {
+        this->SrcMgr = &SrcMgr;
+        this->Profile = &Profile;
+    }
+
+    // Evaluate the expressions Uniformity hoists out of each loop once,
+    // before the loop, instead of on every iteration.
+    void setUniformity(const UniformityInfo &Uniformity)
+    {
+        this->Uniformity = &Uniformity;
+    }
+
+    // Emit the variant of the shader Spec describes: bound parameters and
+    // folded expressions become constants and resolved branches are left
+    // out.
+    void setSpecialization(const Specialization &Spec) { this->Spec = &Spec; }
+
+    // Compile the shader for a shader library: the entry point is named
+    // after Name instead of main, and an llsh_shader_info describing it and
+    // the top-level variables is exported (see ShaderRegistry.h).
+    void setShaderName(llvm::StringRef Name) { ShaderName = Name.str(); }
+
+    // Record the comma-separated CPUs the code is compiled for in the
+    // .llshader.targets section and the llsh_shader_info.
+    void setTargets(llvm::StringRef CPUs) { Targets = CPUs.str(); }
+
+    // Compile each top-level block to a function of its own, in a module
+    // of its own, and emit and optimize those modules on Threads (at least
+    // 1) threads. compile() then runs the OptLevel pipeline over main's
+    // module itself and links the blocks into it in source order, so the
+    // result does not depend on Threads. The module's target triple and
+    // data layout must be set first. Not for profiling builds, whose
+    // counters live in main.
+    void setParallel(unsigned Threads, unsigned OptLevel)
+    {
+        this->Threads = Threads;
+        this->OptLevel = OptLevel;
+    }
+
+    // Report errors to Diags, at the statements they are in. Without an
+    // engine they are only counted.
+    void setDiagnostics(DiagnosticsEngine &Diags) { this->Diags = &Diags; }
+
+    // Name of the function compile() emits: main, or the shader library
+    // entry point.
+    std::string getEntryName() const;
+
+    // Emits `i32 main()`, which runs the program and then writes each
+    // top-level int variable with write_int. Returns false if there were
+    // errors.
+    bool compile(AST *Tree);
 };
 
 #endif
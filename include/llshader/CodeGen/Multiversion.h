@@ -0,0 +1,21 @@
+#ifndef LLSHADER_CODEGEN_MULTIVERSION_H
+#define LLSHADER_CODEGEN_MULTIVERSION_H
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/Function.h>
+#include <string>
+
+// Replaces Entry with an ifunc that picks, when the program or library is
+// loaded, the best of three versions of it for the CPU it runs on: the
+// module's own target (the baseline), x86-64-v3 (AVX2, FMA, BMI2) and
+// x86-64-v4 (AVX-512). The resolver checks the features with cpuid and the
+// OS's register state support with xgetbv. Run before optimizing, so each
+// version is vectorized for its own target. Returns false with Error set if
+// the module does not target x86-64.
+bool multiversion(llvm::Function &Entry, std::string &Error);
+
+// The CPUs multiversion compiles for with BaseCPU as the baseline, as a
+// comma-separated list from the baseline to the widest.
+std::string getMultiversionTargets(llvm::StringRef BaseCPU);
+
+#endif
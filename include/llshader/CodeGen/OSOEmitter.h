@@ -0,0 +1,42 @@
+#ifndef LLSHADER_CODEGEN_OSOEMITTER_H
+#define LLSHADER_CODEGEN_OSOEMITTER_H
+
+#include "llshader/AST/AST.h"
+#include "llshader/Basic/Diagnostic.h"
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/raw_ostream.h>
+#include <string>
+
+// Writes the program as OSL object code, the .oso text that oslc produces
+// and OSL runtimes load: a symbol table and the three-address code of
+// ___main___. Top-level int variables are the shader's output parameters
+// and top-level shader globals declared without a value are its globals;
+// everything else is a local. Temporaries are typed, and ones whose
+// lifetimes do not overlap share a $tmpN symbol.
+class OSOEmitter
+{
+    std::string ShaderName;
+    const DiagnosticsEngine *Diags = nullptr;
+    std::string FileName;
+
+  public:
+    explicit OSOEmitter(llvm::StringRef ShaderName)
+        : ShaderName(ShaderName.str())
+    {
+    }
+
+    // Annotate the code with %filename and %line hints, locating statements
+    // with Diags, which also knows the locations a streaming Lexer pinned.
+    void setSourceInfo(const DiagnosticsEngine &Diags, llvm::StringRef FileName)
+    {
+        this->Diags = &Diags;
+        this->FileName = FileName.str();
+    }
+
+    // Lowers Tree, which must have passed semantic analysis, and streams
+    // the .oso text to OS. Errors are printed to errs() like codegen's;
+    // nothing is written and false is returned if there were any.
+    bool emit(AST *Tree, llvm::raw_ostream &OS);
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef LLSHADER_CODEGEN_OBJECTEMITTER_H
+#define LLSHADER_CODEGEN_OBJECTEMITTER_H
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+#include <memory>
+#include <string>
+
+// Compiles modules to position-independent native object files for the
+// host's target triple.
+class ObjectEmitter
+{
+    std::unique_ptr<llvm::TargetMachine> TM;
+
+    ObjectEmitter(std::unique_ptr<llvm::TargetMachine> TM)
+        : TM(std::move(TM))
+    {
+    }
+
+  public:
+    // Targets CPU, or the host CPU and all of its features if CPU is
+    // "native". Returns null with Error set if the target or CPU is unknown.
+    static std::unique_ptr<ObjectEmitter> create(llvm::StringRef CPU,
+                                                 unsigned OptLevel,
+                                                 std::string &Error);
+
+    llvm::StringRef getCPU() const { return TM->getTargetCPU(); }
+
+    // Sets M's target triple and data layout; call before optimizing M.
+    void configure(llvm::Module &M) const;
+
+    // Writes M, which must be configured, to FileName.
+    bool emit(llvm::Module &M, llvm::StringRef FileName,
+              std::string &Error) const;
+    // Writes M, which must be configured, to Object in memory.
+    bool emit(llvm::Module &M, llvm::SmallVectorImpl<char> &Object,
+              std::string &Error) const;
+
+  private:
+    bool emit(llvm::Module &M, llvm::raw_pwrite_stream &Out,
+              std::string &Error) const;
+};
+
+// Links Objects into the shared library FileName with the system compiler
+// driver. Undefined symbols are left to the loading process.
+bool linkSharedLibrary(llvm::ArrayRef<std::string> Objects,
+                       llvm::StringRef FileName, std::string &Error);
+
+#endif
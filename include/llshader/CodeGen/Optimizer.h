@@ -0,0 +1,28 @@
+#ifndef LLSHADER_CODEGEN_OPTIMIZER_H
+#define LLSHADER_CODEGEN_OPTIMIZER_H
+
+#include <llvm/IR/Module.h>
+#include <memory>
+
+// Runs LLVM's default pipeline for OptLevel 0 to 3 over M. Branch weights
+// and entry counts from CodeGen::setProfileUse steer block placement,
+// unrolling and inlining.
+void optimizeModule(llvm::Module &M, unsigned OptLevel);
+
+// optimizeModule for many modules in a row: the pass pipeline and the
+// analysis managers are built once and the analyses cleared after each
+// module.
+class ModuleOptimizer
+{
+    struct Pipeline;
+    std::unique_ptr<Pipeline> P;
+
+  public:
+    explicit ModuleOptimizer(unsigned OptLevel);
+    ~ModuleOptimizer();
+
+    unsigned getOptLevel() const;
+    void run(llvm::Module &M);
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef LLSHADER_CODEGEN_PROFILE_H
+#define LLSHADER_CODEGEN_PROFILE_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Counters of one statement of a shader built with -profile-generate. Line
+// and Column are 1-based; site 0 is the whole shader and has neither.
+struct ProfileSite
+{
+    unsigned Line;
+    unsigned Column;
+    uint64_t Count;
+    // Inclusive cycles, or 0 if the statement was not timed.
+    uint64_t Cycles;
+};
+
+struct ShaderProfile
+{
+    std::string Source;
+    std::vector<ProfileSite> Sites;
+};
+
+// A profile file written by the runtime, see tools/runtime/profile.h.
+class ProfileData
+{
+    std::vector<ShaderProfile> Shaders;
+
+  public:
+    // Returns null and sets Error if FileName cannot be read or parsed.
+    static std::unique_ptr<ProfileData> read(llvm::StringRef FileName,
+                                             std::string &Error);
+
+    const std::vector<ShaderProfile> &getShaders() const { return Shaders; }
+
+    // The profile of the shader compiled from Source, or null.
+    const ShaderProfile *lookup(llvm::StringRef Source) const;
+
+    // Prints the shader's source Text with the hit count and share of the
+    // shader's cycles of the statements starting on each line.
+    static void annotate(llvm::raw_ostream &OS, const ShaderProfile &Profile,
+                         llvm::StringRef Text);
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef LLSHADER_CODEGEN_SHADERREGISTRY_H
+#define LLSHADER_CODEGEN_SHADERREGISTRY_H
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/Module.h>
+#include <string>
+
+// Symbols of shader libraries; these match tools/runtime/registry.h.
+namespace registry
+{
+constexpr unsigned Version = 2;
+constexpr const char *RegistrySymbol = "llsh_shader_registry";
+
+enum class ParamType : unsigned
+{
+    Int,
+    Float,
+    Point,
+    Vector,
+    Normal,
+    Color,
+    Matrix,
+    String
+};
+
+constexpr unsigned ParamOutput = 1;
+
+// Name of a shader compiled from FileName: its stem, with characters that
+// cannot appear in a C identifier replaced by '_'.
+std::string getShaderName(llvm::StringRef FileName);
+
+// The shader's entry point, `int ()`.
+std::string getEntrySymbol(llvm::StringRef ShaderName);
+
+// The shader's llsh_shader_info.
+std::string getInfoSymbol(llvm::StringRef ShaderName);
+
+// Defines llsh_shader_registry in M, listing the llsh_shader_info of each
+// of Shaders, which are defined in other modules.
+void emitRegistry(llvm::Module &M, llvm::ArrayRef<std::string> Shaders);
+} // namespace registry
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef LLSHADER_FRONTEND_COMPILERINSTANCE_H
+#define LLSHADER_FRONTEND_COMPILERINSTANCE_H
+
+#include "llshader/CodeGen/ObjectEmitter.h"
+#include "llshader/CodeGen/Optimizer.h"
+#include "llshader/Sema/Sema.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+// What one CompilerInstance::compile produced: the diagnostics, and on
+// success the optimized module and, with an object emitter, its object code.
+class CompileResult
+{
+  public:
+    enum Status
+    {
+        Success,
+        SyntaxError,
+        SemanticError,
+        CodeGenError,
+        EmitError
+    };
+
+  private:
+    Status S = Success;
+    std::vector<llvm::SMDiagnostic> Diags;
+    std::unique_ptr<llvm::Module> M;
+    llvm::SmallVector<char, 0> Object;
+    std::string EntryName;
+
+    friend class CompilerInstance;
+
+  public:
+    Status getStatus() const { return S; }
+    bool succeeded() const { return S == Success; }
+
+    // Warnings and errors in the order the driver would print them.
+    llvm::ArrayRef<llvm::SMDiagnostic> getDiagnostics() const
+    {
+        return Diags;
+    }
+    void printDiagnostics(llvm::raw_ostream &OS) const;
+
+    // The module, which lives in the instance's context: it must be freed
+    // before the instance. Null unless the compile succeeded.
+    llvm::Module *getModule() const { return M.get(); }
+    std::unique_ptr<llvm::Module> takeModule() { return std::move(M); }
+
+    // The object file, if the instance has an object emitter.
+    llvm::StringRef getObject() const
+    {
+        return llvm::StringRef(Object.data(), Object.size());
+    }
+
+    // The function that runs the shader: main, or the shader library entry
+    // point if a shader name was given.
+    llvm::StringRef getEntryName() const { return EntryName; }
+};
+
+// Compiles shaders from strings in memory, one after another, without the
+// driver. What does not depend on the source stays alive between compiles:
+// the LLVMContext the modules are created in, the optimization pipeline and
+// its analysis managers, Sema's slot tables and the caller's object emitter,
+// whose target machine is the costliest part to create. The front end is
+// not kept warm: the Lexer's keyword and operator tables, the tokens and
+// the AST are built again for every compile, so reuse saves the LLVM and
+// emitter setup only.
+//
+// One instance compiles on one thread at a time; use one per thread to
+// compile in parallel.
+class CompilerInstance
+{
+    llvm::LLVMContext Ctx;
+    Sema S;
+    std::unique_ptr<ModuleOptimizer> Optimizer;
+    const ObjectEmitter *Emitter = nullptr;
+    unsigned OptLevel = 0;
+    unsigned ParseThreads = 1;
+    bool HoistInvariants = true;
+
+  public:
+    // Optimization level, 0 to 3, of the pipeline run over the IR.
+    void setOptLevel(unsigned Level) { OptLevel = Level; }
+
+    // Parse top-level statements and check independent top-level scopes on
+    // this many threads.
+    void setParseThreads(unsigned N) { ParseThreads = N; }
+    void setSemaThreads(unsigned N) { S.setNumThreads(N); }
+
+    // Evaluate loop-invariant expressions once before their loop.
+    void setHoistInvariants(bool B) { HoistInvariants = B; }
+
+    // Also compile each module to an object file with E, which must outlive
+    // the compiles; null for IR only.
+    void setObjectEmitter(const ObjectEmitter *E) { Emitter = E; }
+
+    llvm::LLVMContext &getContext() { return Ctx; }
+
+    // Compiles Source, which diagnostics call BufferName. ShaderName, if
+    // set, compiles it for a shader library, see CodeGen::setShaderName.
+    CompileResult compile(llvm::StringRef Source,
+                          llvm::StringRef BufferName = "<memory>",
+                          llvm::StringRef ShaderName = "");
+};
+
+#endif
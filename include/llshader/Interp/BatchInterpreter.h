@@ -0,0 +1,55 @@
+#ifndef LLSHADER_INTERP_BATCHINTERPRETER_H
+#define LLSHADER_INTERP_BATCHINTERPRETER_H
+
+#include "llshader/Interp/Bytecode.h"
+#include <cstdint>
+#include <vector>
+
+// Runs Bytecode on a batch of shading points at once. Every slot holds one
+// value per lane, the lanes of a slot side by side (structure of arrays),
+// so each instruction is a loop over the lanes, which the compiler
+// vectorizes, and dispatch is paid once per batch rather than per point.
+//
+// Lanes that branch differently continue under execution masks: each lane
+// keeps its own position, and the lanes at the earliest position run next
+// with the others masked off. Since loops jump back only to their start
+// and everything else jumps forward, lanes that leave an if or a loop wait
+// at its end for the rest, and run unmasked again from there.
+class BatchInterpreter
+{
+    const Bytecode &Code;
+    unsigned Lanes;
+    std::vector<Slot> Frame;
+    // Position of each lane while they diverge.
+    std::vector<uint32_t> LanePC;
+    // Lanes at the instruction being run.
+    std::vector<uint8_t> Mask;
+
+    template <bool Masked> void execute(const Instruction &I);
+    // Sets PC to the earliest lane position and the mask to the lanes
+    // there; returns false once the lanes have converged.
+    bool schedule(uint32_t &PC);
+
+  public:
+    BatchInterpreter(const Bytecode &Code, unsigned Lanes);
+
+    unsigned getNumLanes() const { return Lanes; }
+
+    // The values of component C of input I, see Bytecode::getInputs, one
+    // per lane. Inputs start at zero and keep their values between runs.
+    Slot *getInput(size_t I, unsigned C = 0)
+    {
+        return &Frame[(Code.getInputs()[I].Slot + C) * Lanes];
+    }
+
+    // Runs the program from the start on every lane.
+    void run();
+
+    // Value of output I, see Bytecode::getOutputs, in Lane after run().
+    int32_t getOutput(size_t I, unsigned Lane) const
+    {
+        return Frame[Code.getOutputs()[I].Slot * Lanes + Lane].I;
+    }
+};
+
+#endif
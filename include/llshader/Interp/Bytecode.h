@@ -0,0 +1,98 @@
+#ifndef LLSHADER_INTERP_BYTECODE_H
+#define LLSHADER_INTERP_BYTECODE_H
+
+#include "llshader/AST/AST.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+class OSOShader;
+
+enum class Opcode : uint8_t
+{
+#define OPCODE(Name, Format) Name,
+#include "llshader/Interp/Opcodes.def"
+};
+
+const char *getOpcodeName(Opcode Op);
+
+struct Instruction
+{
+    Opcode Op;
+    uint16_t W;
+    uint32_t A;
+    uint32_t B;
+    uint32_t C;
+};
+
+// A 32-bit register. Triples take 3 consecutive slots, matrices 16 in
+// row-major order. A string is the index of its text in the program's
+// string table, whose entries are unique, so strings compare as ints.
+union Slot
+{
+    int32_t I;
+    float F;
+};
+
+// The program in register-based bytecode, lowered straight from the node
+// classes with the same typing and semantics as codegen, for running
+// shaders without LLVM. Variables and temporaries live in slots of a flat
+// frame; the constants are in the slots after them, which an interpreter
+// fills in when it is created.
+class Bytecode
+{
+  public:
+    struct Output
+    {
+        std::string Name;
+        uint32_t Slot;
+    };
+
+    // A top-level variable named after a shader global and declared
+    // without a value, which the caller sets per shading point.
+    struct Input
+    {
+        std::string Name;
+        uint32_t Slot;
+        uint32_t Width;
+    };
+
+  private:
+    std::vector<Instruction> Code;
+    std::vector<Slot> Constants;
+    uint32_t NumSlots = 0;
+    std::vector<Output> Outputs;
+    std::vector<Input> Inputs;
+    std::deque<std::string> Strings;
+
+    friend class BytecodeCompiler;
+    friend class OSOBytecodeCompiler;
+
+  public:
+    // Lowers Tree, which must have passed semantic analysis. Errors are
+    // printed to Errs like codegen's; returns null if there were any.
+    static std::unique_ptr<Bytecode> compile(AST *Tree,
+                                             llvm::raw_ostream &Errs);
+
+    // Lowers the instructions of a shader read from OSL object code. The
+    // ops OSOEmitter writes are supported; errors name the instruction.
+    static std::unique_ptr<Bytecode> compile(const OSOShader &Shader,
+                                             llvm::raw_ostream &Errs);
+
+    const std::vector<Instruction> &getCode() const { return Code; }
+    const std::vector<Slot> &getConstants() const { return Constants; }
+    // Slots of the frame, including the constants at the end.
+    uint32_t getNumSlots() const { return NumSlots; }
+    // The top-level int variables, which the program writes when it ends.
+    const std::vector<Output> &getOutputs() const { return Outputs; }
+    // The program does not initialize these; they start at zero.
+    const std::vector<Input> &getInputs() const { return Inputs; }
+    const std::string &getString(int32_t Index) const { return Strings[Index]; }
+
+    void print(llvm::raw_ostream &OS) const;
+};
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef LLSHADER_INTERP_INTERPRETER_H
+#define LLSHADER_INTERP_INTERPRETER_H
+
+#include "llshader/Interp/Bytecode.h"
+#include <vector>
+
+// Runs Bytecode. With GCC and Clang the dispatch is threaded through a
+// table of label addresses, so each instruction jumps straight to the next
+// one's handler; other compilers use a switch in a loop.
+class Interpreter
+{
+    const Bytecode &Code;
+    std::vector<Slot> Frame;
+
+  public:
+    explicit Interpreter(const Bytecode &Code);
+
+    // The slots of input I, see Bytecode::getInputs. Inputs start at zero
+    // and keep their values between runs.
+    Slot *getInput(size_t I) { return &Frame[Code.getInputs()[I].Slot]; }
+
+    // Runs the program from the start.
+    void run();
+
+    // Value of output I, see Bytecode::getOutputs, after run().
+    int32_t getOutput(size_t I) const
+    {
+        return Frame[Code.getOutputs()[I].Slot].I;
+    }
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef LLSHADER_LEXER_CHARINFO_H
+#define LLSHADER_LEXER_CHARINFO_H
+
+#include "llvm/Support/Compiler.h"
+
+// Character classes of the scanners: the source Lexer and the .oso reader.
+namespace charinfo
+{
+LLVM_READNONE inline static bool isWhitespace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\f' || c == '\v' || c == '\r' ||
+           c == '\n';
+}
+LLVM_READNONE inline static bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+LLVM_READNONE inline static bool isHexDigit(char c)
+{
+    return isDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+LLVM_READNONE inline static bool isSign(char c)
+{
+    return (c == '-') || (c == '+');
+}
+LLVM_READNONE inline static bool isLetter(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+LLVM_READNONE inline static bool isLetter_(char c)
+{
+    return isLetter(c) || c == '_';
+}
+LLVM_READNONE inline static bool isLetterDigit_(char c)
+{
+    return isLetter_(c) || isDigit(c);
+}
+} // namespace charinfo
+
+#endif
@@ -40,38 +40,6 @@ class KeywordFilter
         auto it = KeywordMap.find(Identifier.str());
         return (it != KeywordMap.end()) ? it->second : TokenKind::identifier;
     }
-
-    bool isSimpleType(StringRef Identifier) const
-    {
-        auto it = KeywordMap.find(Identifier.str());
-        if (it != KeywordMap.end())
-        {
-            auto type = it->second;
-            if (type == TokenKind::kw_int || type == TokenKind::kw_float ||
-                type == TokenKind::kw_string)
-                return true;
-        }
-        return false;
-    }
-
-    bool isComplexType(StringRef Identifier) const
-    {
-        auto it = KeywordMap.find(Identifier.str());
-        if (it != KeywordMap.end())
-        {
-            auto type = it->second;
-            if (type == TokenKind::kw_point || type == TokenKind::kw_vector ||
-                type == TokenKind::kw_normal || type == TokenKind::kw_color ||
-                type == TokenKind::kw_matrix)
-                return true;
-        }
-        return false;
-    }
-
-    bool isType(StringRef Identifier) const
-    {
-        return isSimpleType(Identifier) || isComplexType(Identifier);
-    }
 };
 
 #endif
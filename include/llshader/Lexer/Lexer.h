@@ -4,10 +4,13 @@
 #include "llshader/Basic/Diagnostic.h"
 #include "llshader/Lexer/KeywordFilter.h"
 #include "llshader/Lexer/OperatorFilter.h"
+#include "llshader/Lexer/SourceWindow.h"
 #include "llshader/Lexer/Token.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Allocator.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/StringSaver.h"
 
 using llvm::StringRef;
 using namespace llshader;
@@ -17,13 +20,22 @@ class Lexer
     unsigned CurrBuffer = 0;
     StringRef Buffer;
     const char *BufferPtr;
+    // Optional end of input short of the buffer's NUL terminator.
+    const char *BufferLimit = nullptr;
 
     llvm::SourceMgr &SrcMgr;
 
     KeywordFilter kwFilter;
     OperatorFilter opFilter;
 
-    DiagnosticsEngine Diags;
+    DiagnosticsEngine &Diags;
+
+    // Streaming mode: input comes from a sliding window instead of a
+    // SourceMgr buffer, and token text is copied out of the window so it
+    // outlives the next slide.
+    SourceWindow *Window = nullptr;
+    llvm::BumpPtrAllocator TextAlloc;
+    llvm::UniqueStringSaver TextSaver{TextAlloc};
 
   public:
     Lexer(llvm::SourceMgr &SrcMgr, DiagnosticsEngine &Diags)
@@ -34,19 +46,49 @@ class Lexer
         BufferPtr = Buffer.begin();
     }
 
+    // Lexes only Range, a slice of the main buffer that ends on a token
+    // boundary. Used to lex chunks of one file independently.
+    Lexer(llvm::SourceMgr &SrcMgr, DiagnosticsEngine &Diags, StringRef Range)
+        : SrcMgr(SrcMgr), Diags(Diags)
+    {
+        CurrBuffer = SrcMgr.getMainFileID();
+        Buffer = Range;
+        BufferPtr = Buffer.begin();
+        BufferLimit = Buffer.end();
+    }
+
+    Lexer(SourceWindow &Window, llvm::SourceMgr &SrcMgr,
+          DiagnosticsEngine &Diags)
+        : SrcMgr(SrcMgr), Diags(Diags), Window(&Window)
+    {
+        Buffer = StringRef(Window.begin(), Window.end() - Window.begin());
+        BufferPtr = Buffer.begin();
+        Diags.setLocationResolver(&Window);
+    }
+
     DiagnosticsEngine &getDiagnostics() { return Diags; }
 
     void next(Token &Tok);
 
+    // Loc, a location of the current token, in a form that outlives it. In
+    // streaming mode a token's location is only valid until the window
+    // slides, so it is pinned; otherwise it already points into the
+    // SourceMgr's buffer.
+    SMLoc keepLocation(SMLoc Loc) { return Window ? Window->pin(Loc) : Loc; }
+
     // Might be useful
     Token peek(unsigned N = 0);
 
   private:
+    void lexToken(Token &Tok);
     const char* getDigitSequence();
     const char* getHexDigitSequence();
     const char* getDecimalPart();
     const char* getExponent();
     void formToken(Token &Result, const char *TokEnd, TokenKind Kind);
+    // Sets the value of an integer or floating_point token and diagnoses
+    // one that does not fit.
+    void convertLiteral(Token &Tok);
 
     SMLoc getLoc() { return SMLoc::getFromPointer(BufferPtr); }
 };
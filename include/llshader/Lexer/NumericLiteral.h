@@ -0,0 +1,38 @@
+#ifndef LLSHADER_LEXER_NUMERICLITERAL_H
+#define LLSHADER_LEXER_NUMERICLITERAL_H
+
+#include "llvm/ADT/StringRef.h"
+#include <cstdint>
+
+using llvm::StringRef;
+
+// How converting a literal's spelling went. The value is still set for
+// every status but Invalid and TooLarge.
+enum class LiteralStatus : uint8_t
+{
+    Ok,
+    // Not a literal of the kind asked for.
+    Invalid,
+    // An int that does not fit in 64 bits.
+    TooLarge,
+    // A decimal int outside int's range, or a hexadecimal one that does not
+    // fit in 32 bits; it wraps.
+    Wrapped,
+    // A float too large for float; it is infinity.
+    Overflow,
+    // A nonzero float too small for float; it is zero.
+    Underflow,
+    // A float that rounds to a denormal and keeps fewer significant bits.
+    Denormal
+};
+
+// Converts a decimal or 0x-prefixed hexadecimal integer, with an optional
+// sign, to the 32-bit int the compiler computes with.
+LiteralStatus parseIntegerLiteral(StringRef Text, int32_t &Value);
+
+// Converts a decimal floating-point literal, with an optional sign and
+// exponent, to the nearest float, exactly as strtof would but without
+// copying the text or going through the C locale.
+LiteralStatus parseFloatLiteral(StringRef Text, float &Value);
+
+#endif
@@ -3,6 +3,7 @@
 
 #include "llshader/Lexer/Token.h"
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
 
 class OperatorFilter
@@ -15,7 +16,7 @@ class OperatorFilter
     std::unordered_set<std::string> incdec_op_set;
     std::unordered_set<std::string> log_op_set;
     std::unordered_set<std::string> assignment_set;
-    std::unordered_set<std::string> punctuator_set;
+    std::unordered_map<std::string, TokenKind> punctuator_map;
 
   public:
     OperatorFilter()
@@ -28,7 +29,10 @@ class OperatorFilter
         log_op_set = {"&&", "||"};
         assignment_set = {
             "=", "+=", "-=", "*=", "/=", "%=", "&=", "|=", "^=", "<<=", ">>="};
-        punctuator_set = {";", "(", ")", "{", "}", "[", "]", ","};
+        punctuator_map = {
+#define PUNCTUATOR(ID, SP) {SP, TokenKind::ID},
+#include "llshader/Basic/TokenKinds.def"
+        };
     };
 
     bool isOperator(std::string op)
@@ -36,7 +40,7 @@ class OperatorFilter
         return bin_op_set.count(op) || bit_op_set.count(op) ||
                un_op_set.count(op) || log_op_set.count(op) ||
                incdec_op_set.count(op) || assignment_set.count(op) ||
-               comp_op_set.count(op) || punctuator_set.count(op);
+               comp_op_set.count(op) || punctuator_map.count(op);
     }
 
     TokenKind getTokenKind(std::string op)
@@ -55,8 +59,9 @@ class OperatorFilter
             return TokenKind::incdec_op;
         if (assignment_set.count(op))
             return TokenKind::assignment;
-        if (punctuator_set.count(op))
-            return TokenKind::punctuator;
+        auto it = punctuator_map.find(op);
+        if (it != punctuator_map.end())
+            return it->second;
         return TokenKind::unknown;
     }
 };
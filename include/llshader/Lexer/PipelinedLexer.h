@@ -0,0 +1,86 @@
+#ifndef LLSHADER_LEXER_PIPELINEDLEXER_H
+#define LLSHADER_LEXER_PIPELINEDLEXER_H
+
+#include "llshader/Basic/Diagnostic.h"
+#include "llshader/Lexer/Token.h"
+#include "llvm/Support/SourceMgr.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Lexes the main buffer of a SourceMgr on a thread of its own, so a Parser
+// reading from it overlaps lexing with parsing. Tokens pass through a
+// bounded single-producer/single-consumer ring in a packed 16-byte form;
+// each side makes its progress visible to the other only every Batch tokens
+// (and the Lexer at eof), so the two threads share the ring's counters
+// rarely and no lock is taken per token.
+//
+// The Lexer's diagnostics are stored on its thread and replayed into Diags
+// when the Parser reaches the token they were reported for, so they are
+// printed exactly as a serial Lexer would print them. Tokens are packed
+// with 32-bit offsets, so the buffer must be smaller than 4 GiB; see
+// canLex.
+class PipelinedLexer
+{
+  public:
+    // Tokens in the ring, a power of two, and tokens per publication.
+    static constexpr uint32_t Capacity = 4096;
+    static constexpr uint32_t Batch = 64;
+
+  private:
+    struct PackedToken
+    {
+        // The spelling, as an offset into the buffer.
+        uint32_t Offset;
+        uint32_t Length;
+        TokenKind Kind;
+        // Set if lexing the token reported diagnostics.
+        bool HasDiags;
+        // The bits of the token's value.
+        int32_t Value;
+    };
+    static_assert(sizeof(PackedToken) == 16, "PackedToken must stay packed");
+
+    StringRef Buffer;
+    DiagnosticsEngine &Diags;
+    std::unique_ptr<PackedToken[]> Ring;
+
+    // Tokens published by the Lexer and released by the Parser, on lines
+    // of their own so that each side writes only its own.
+    alignas(64) std::atomic<uint32_t> Head{0};
+    alignas(64) std::atomic<uint32_t> Tail{0};
+    alignas(64) std::atomic<bool> Stop{false};
+
+    // The Parser's side: the next token to read and the published tokens
+    // it last saw.
+    uint32_t Read = 0;
+    uint32_t Avail = 0;
+
+    // Diagnostics of each token with HasDiags, in order.
+    std::mutex DiagsLock;
+    std::vector<std::vector<StoredDiagnostic>> PendingDiags;
+    size_t NextDiags = 0;
+
+    std::thread Producer;
+
+    void produce(llvm::SourceMgr &SrcMgr);
+
+  public:
+    // Whether the main buffer of SrcMgr is small enough to pipeline; a
+    // larger one needs the serial Lexer.
+    static bool canLex(const llvm::SourceMgr &SrcMgr);
+
+    // SrcMgr must satisfy canLex.
+    PipelinedLexer(llvm::SourceMgr &SrcMgr, DiagnosticsEngine &Diags);
+    // Stops the Lexer if the Parser did not read up to eof.
+    ~PipelinedLexer();
+
+    DiagnosticsEngine &getDiagnostics() { return Diags; }
+
+    // Like Lexer::next; eof repeats once reached.
+    void next(Token &Tok);
+};
+
+#endif
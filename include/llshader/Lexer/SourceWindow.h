@@ -0,0 +1,95 @@
+#ifndef LLSHADER_LEXER_SOURCEWINDOW_H
+#define LLSHADER_LEXER_SOURCEWINDOW_H
+
+#include "llshader/Basic/Diagnostic.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/FileSystem.h"
+#include <memory>
+#include <system_error>
+#include <vector>
+
+// Sliding window over a source file that is read in fixed-size chunks, so
+// that the Lexer never needs the whole file in memory. The window is always
+// NUL-terminated like a SourceMgr buffer, which keeps the Lexer's sentinel
+// checks valid.
+//
+// The window also resolves locations that point into it, so diagnostics on
+// streamed tokens still carry the exact file line and column. A location
+// that has to outlive the window, such as a statement's, is pinned: it is
+// replaced by one that records its line and column and that the window
+// resolves for as long as it lives.
+class SourceWindow : public llshader::LocationResolver
+{
+    std::string FileName;
+    llvm::sys::fs::file_t File;
+    size_t ChunkSize;
+    bool AtEOF = false;
+
+    // Window bytes followed by a NUL.
+    std::vector<char> Storage;
+    size_t Size = 0;
+
+    // Position of Storage[0] in the file. BaseCol is non-zero only when the
+    // window starts in the middle of a line.
+    uint64_t BaseOffset = 0;
+    unsigned BaseLine = 1;
+    unsigned BaseCol = 0;
+
+    // Pinned locations, by their address: a byte of PinAlloc each, so they
+    // never point into the window or a SourceMgr buffer.
+    struct LineAndColumn
+    {
+        unsigned Line;
+        unsigned Col;
+    };
+    llvm::BumpPtrAllocator PinAlloc;
+    llvm::DenseMap<const char *, LineAndColumn> Pins;
+
+    // Where pin() left off counting lines, as offsets into the window.
+    // Statements are pinned in source order, so each byte is counted about
+    // once.
+    size_t PinPos = 0;
+    size_t PinLineStart = 0;
+    unsigned PinLine = 1;
+
+    SourceWindow(StringRef FileName, llvm::sys::fs::file_t File,
+                 size_t ChunkSize);
+
+    void readChunk();
+
+  public:
+    static constexpr size_t DefaultChunkSize = 64 * 1024;
+
+    static std::unique_ptr<SourceWindow>
+    open(StringRef FileName, std::error_code &EC,
+         size_t ChunkSize = DefaultChunkSize);
+
+    ~SourceWindow();
+
+    const char *begin() const { return Storage.data(); }
+    const char *end() const { return Storage.data() + Size; }
+
+    // True once the file has no more bytes beyond end().
+    bool atEOF() const { return AtEOF; }
+
+    uint64_t getBaseOffset() const { return BaseOffset; }
+    StringRef getFileName() const { return FileName; }
+
+    // Drops everything before Keep, except the start of Keep's line so it can
+    // still be quoted in diagnostics, and reads the next chunk. Pointers into
+    // the window are invalidated; the new address of Keep is returned.
+    const char *slide(const char *Keep);
+
+    // A location that stays valid after Loc, which must point into the
+    // window, has slid out of it.
+    SMLoc pin(SMLoc Loc);
+
+    bool resolve(const SourceMgr &SrcMgr, SMLoc Loc, SourceMgr::DiagKind Kind,
+                 StringRef Msg, llvm::SMDiagnostic &Diag) const override;
+    bool getLineAndColumn(SMLoc Loc, unsigned &Line,
+                          unsigned &Col) const override;
+};
+
+#endif
@@ -4,7 +4,7 @@
 #include "llshader/Basic/TokenKinds.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/SMLoc.h"
-#include <unordered_set>
+#include <cstdint>
 
 using llvm::SMLoc;
 using llvm::StringRef;
@@ -14,22 +14,33 @@ using tok::TokenKind;
 
 class Token {
   friend class Lexer;
+  friend class PipelinedLexer;
 
 private:
   TokenKind Kind;
   StringRef Text;
+  SMLoc Loc;
+  // The value of an integer or floating_point token, converted as it is
+  // lexed.
+  union {
+    int32_t IntValue = 0;
+    float FloatValue;
+  };
 
 public:
   TokenKind getKind() const { return Kind; }
   StringRef getText() const { return Text; }
   size_t getLength() const { return Text.size(); }
+  int32_t getIntValue() const { return IntValue; }
+  float getFloatValue() const { return FloatValue; }
 
   bool is(TokenKind K) const { return Kind == K; }
-  bool is(std::unordered_set<tok::TokenKind> K) const { return K.count(Kind); }
   template <typename... Ts> bool isOneOf(Ts... Ks) const {
     return (... || is(Ks));
   }
 
-  SMLoc getLocation() const { return SMLoc::getFromPointer(Text.data()); }
+  // Points at the token's text. When streaming it is only valid until the
+  // Lexer's window slides; see Lexer::keepLocation.
+  SMLoc getLocation() const { return Loc; }
 };
 #endif
@@ -0,0 +1,127 @@
+#ifndef LLSHADER_OSO_OSOSHADER_H
+#define LLSHADER_OSO_OSOSHADER_H
+
+#include "llshader/Basic/TokenKinds.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// A shader read from OSL object code, the .oso text that OSOEmitter and
+// oslc write: its symbol table and instructions, for the compiler's later
+// stages to take without going through source. Names, types and values
+// refer into the file's buffer, which the shader owns.
+class OSOShader
+{
+  public:
+    enum class SymbolKind : uint8_t
+    {
+        Param,
+        OParam,
+        Global,
+        Local,
+        Const,
+        Temp
+    };
+
+    struct Symbol
+    {
+        SymbolKind Kind;
+        // The type, or kw_void for one the compiler does not have, like a
+        // closure or a struct; TypeName spells it.
+        llshader::tok::TokenKind Type;
+        llvm::StringRef TypeName;
+        // Elements of an array, -1 if unsized; 0 if it is not one.
+        int ArrayLength = 0;
+        llvm::StringRef Name;
+        // Default of a parameter or value of a constant, see getValues.
+        uint32_t FirstValue = 0;
+        uint32_t NumValues = 0;
+    };
+
+    // Arguments live in one array for all instructions, like values for
+    // all symbols, so neither has storage of its own to copy or free.
+    struct Instruction
+    {
+        static constexpr unsigned MaxJumps = 4;
+
+        llvm::StringRef Op;
+        // See getArgs.
+        uint32_t FirstArg = 0;
+        uint32_t NumArgs = 0;
+        // Instruction indices: an if's else and end, a loop's condition,
+        // body, update and end.
+        int32_t Jumps[MaxJumps];
+        unsigned NumJumps = 0;
+        // Bit I is set if the instruction writes argument I.
+        uint32_t Written = 0;
+        // Source line from the %line hints; 0 if unknown.
+        unsigned Line = 0;
+
+        llvm::ArrayRef<int32_t> getJumps() const { return {Jumps, NumJumps}; }
+    };
+
+    // The code of ___main___ or of a parameter's initializer, from First
+    // up to the next section's.
+    struct CodeSection
+    {
+        llvm::StringRef Name;
+        uint32_t First;
+    };
+
+  private:
+    std::unique_ptr<llvm::MemoryBuffer> Buffer;
+    llvm::StringRef ShaderType;
+    llvm::StringRef Name;
+    std::vector<Symbol> Symbols;
+    std::vector<llvm::StringRef> Values;
+    llvm::StringMap<uint32_t> SymbolIds;
+    std::vector<Instruction> Code;
+    std::vector<uint32_t> Args;
+    std::vector<CodeSection> Sections;
+
+    friend class OSOReader;
+
+  public:
+    // Maps FileName and reads it. Errors are printed to Errs with the line
+    // they are on; returns null if there were any.
+    static std::unique_ptr<OSOShader> read(llvm::StringRef FileName,
+                                           llvm::raw_ostream &Errs);
+
+    // Reads the .oso text in Buffer, which need not be NUL-terminated.
+    static std::unique_ptr<OSOShader>
+    read(std::unique_ptr<llvm::MemoryBuffer> Buffer, llvm::raw_ostream &Errs);
+
+    // "shader", "surface" and so on.
+    llvm::StringRef getShaderType() const { return ShaderType; }
+    llvm::StringRef getName() const { return Name; }
+    const std::vector<Symbol> &getSymbols() const { return Symbols; }
+    const std::vector<Instruction> &getCode() const { return Code; }
+    const std::vector<CodeSection> &getSections() const { return Sections; }
+
+    // One entry per component as written; strings are without their
+    // quotes.
+    llvm::ArrayRef<llvm::StringRef> getValues(const Symbol &S) const
+    {
+        return llvm::makeArrayRef(Values).slice(S.FirstValue, S.NumValues);
+    }
+
+    // Symbols, by index.
+    llvm::ArrayRef<uint32_t> getArgs(const Instruction &I) const
+    {
+        return llvm::makeArrayRef(Args).slice(I.FirstArg, I.NumArgs);
+    }
+
+    // Index of the symbol named Name; -1 if there is none.
+    int lookup(llvm::StringRef Name) const
+    {
+        auto It = SymbolIds.find(Name);
+        return It == SymbolIds.end() ? -1 : static_cast<int>(It->second);
+    }
+};
+
+#endif
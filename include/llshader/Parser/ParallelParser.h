@@ -0,0 +1,45 @@
+#ifndef LLSHADER_PARSER_PARALLELPARSER_H
+#define LLSHADER_PARSER_PARALLELPARSER_H
+
+#include "llshader/AST/AST.h"
+#include "llshader/Basic/Diagnostic.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/SourceMgr.h"
+#include <vector>
+
+// Offsets just past each top-level statement of Src, found by a byte scan
+// that tracks bracket depth, string literals and the keywords that continue
+// a statement (else, and the while of a do-while). Only certain boundaries
+// are reported: unbalanced input stops the scan, leaving the rest as one
+// statement.
+std::vector<size_t> findTopLevelBoundaries(StringRef Src);
+
+// Parses the main buffer of SrcMgr in two phases: findTopLevelBoundaries
+// cuts the file into chunks of whole top-level statements, then the chunks
+// are parsed on a thread pool and their statements are stitched into one
+// Program in source order.
+//
+// Diagnostics are replayed in source order. If a chunk fails to parse, the
+// rest of the file is re-parsed serially from that chunk, so errors are
+// exactly those of the serial Parser.
+class ParallelParser
+{
+    llvm::SourceMgr &SrcMgr;
+    DiagnosticsEngine &Diags;
+    unsigned NumThreads;
+
+  public:
+    // Chunks are never made smaller than this, so small inputs parse
+    // serially.
+    static constexpr size_t MinChunkBytes = 16 * 1024;
+
+    ParallelParser(llvm::SourceMgr &SrcMgr, DiagnosticsEngine &Diags,
+                   unsigned NumThreads)
+        : SrcMgr(SrcMgr), Diags(Diags), NumThreads(NumThreads)
+    {
+    }
+
+    AST *parse();
+};
+
+#endif
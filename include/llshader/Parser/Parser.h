@@ -4,12 +4,15 @@
 #include "llshader/AST/AST.h"
 #include "llshader/Basic/Diagnostic.h"
 #include "llshader/Lexer/Lexer.h"
+#include "llshader/Lexer/PipelinedLexer.h"
 #include "llvm/Support/raw_ostream.h"
 #include <vector>
 
 class Parser
 {
-    Lexer &Lex;
+    // Where tokens come from: exactly one is set.
+    Lexer *Lex = nullptr;
+    PipelinedLexer *Pipe = nullptr;
     Token Tok;
     DiagnosticsEngine &Diags;
 
@@ -21,7 +24,13 @@ class Parser
         UnexpectedTokens.push_back({Tok.getKind(), Kind});
     }
 
-    void advance() { Lex.next(Tok); }
+    void advance()
+    {
+        if (Pipe)
+            Pipe->next(Tok);
+        else
+            Lex->next(Tok);
+    }
     void advance(unsigned N)
     {
         for (unsigned I = 0; I < N; I++)
@@ -53,28 +62,33 @@ class Parser
     }
 
     Statement *parseStmt();
+    Statement *parseStmtBody();
     Expression *parseExpr();
     Expression *parseTerm();
+    Expression *parseDerivative(Derivative::Axis Dir);
 
   public:
-    Parser(Lexer &Lex, DiagnosticsEngine &Diags) : Lex(Lex), Diags(Diags)
+    Parser(Lexer &Lex, DiagnosticsEngine &Diags) : Lex(&Lex), Diags(Diags)
+    {
+        advance();
+    }
+
+    // Parses while Pipe lexes ahead on its own thread.
+    Parser(PipelinedLexer &Pipe, DiagnosticsEngine &Diags)
+        : Pipe(&Pipe), Diags(Diags)
     {
         advance();
     }
 
     AST *parse();
 
+    // Parses statements up to eof into SL; false after a syntax error.
+    bool parseStmtList(StmtList &SL);
+
     template <class... Tokens> void skipUntil(Tokens... Toks)
     {
-        std::unordered_set<tok::TokenKind> Skipset = {tok::eof, Toks...};
-        while (true)
-        {
-            if (Skipset.count(Tok.getKind()))
-            {
-                break;
-            }
+        while (!Tok.isOneOf(tok::eof, Toks...))
             advance();
-        }
     }
 };
 #endif
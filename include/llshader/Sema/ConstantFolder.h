@@ -0,0 +1,21 @@
+#ifndef LLSHADER_SEMA_CONSTANTFOLDER_H
+#define LLSHADER_SEMA_CONSTANTFOLDER_H
+
+#include "llshader/AST/FlatAST.h"
+
+// Folds unary, binary, cast, derivative and parenthesized expressions over
+// int and float literals into literals, in place; a literal's derivative is
+// 0. Ints fold with 32-bit wraparound; division or remainder by zero and
+// out-of-range shifts are left alone. Returns the number of nodes folded.
+unsigned foldConstants(FlatAST &Tree);
+
+// The rules foldConstants applies, on int and float values: each sets Out
+// and returns true if the operation folds.
+bool foldBinary(FlatOp Op, const FlatAST::LiteralValue &L,
+                const FlatAST::LiteralValue &R, FlatAST::LiteralValue &Out);
+bool foldUnary(FlatOp Op, const FlatAST::LiteralValue &V,
+               FlatAST::LiteralValue &Out);
+bool foldCast(TokenKind Type, const FlatAST::LiteralValue &V,
+              FlatAST::LiteralValue &Out);
+
+#endif
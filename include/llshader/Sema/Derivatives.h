@@ -0,0 +1,41 @@
+#ifndef LLSHADER_SEMA_DERIVATIVES_H
+#define LLSHADER_SEMA_DERIVATIVES_H
+
+#include "llshader/AST/AST.h"
+#include <vector>
+
+// Which variables must carry derivatives so that the program's Dx and Dy
+// queries can be answered: those a query reads, and those assigned a value
+// computed from a variable that must. Everything else is compiled without
+// derivatives.
+//
+// Variables are the frame slots Sema binds. Like OSL's runtime, the analysis
+// is per variable and ignores control flow, so a variable carries
+// derivatives everywhere if any of its values may reach a query. Reads that
+// cannot carry a derivative are not followed: subscripts, operands of
+// comparisons and of logical, bitwise and unary operators, values converted
+// to int, string or matrix, and operands of queries nested in a query, whose
+// derivatives are 0.
+class DerivativeInfo
+{
+    std::vector<bool> Needed;
+    unsigned NumQueries = 0;
+    unsigned NumNeeded = 0;
+
+    friend class DerivativeBuilder;
+
+  public:
+    static DerivativeInfo compute(AST *Tree);
+
+    bool hasQueries() const { return NumQueries != 0; }
+    unsigned getNumQueries() const { return NumQueries; }
+
+    // True if the variable in Slot carries derivatives.
+    bool needsDerivatives(unsigned Slot) const
+    {
+        return Slot < Needed.size() && Needed[Slot];
+    }
+    unsigned getNumVariables() const { return NumNeeded; }
+};
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef LLSHADER_SEMA_FRAMELAYOUT_H
+#define LLSHADER_SEMA_FRAMELAYOUT_H
+
+#include "llshader/Lexer/Token.h"
+#include "llvm/ADT/ArrayRef.h"
+#include <vector>
+
+using llshader::tok::TokenKind;
+
+// Byte offsets in a function's frame for the slots Sema numbered. Slots are
+// packed by type: strings (pointers) first, then matrices, colors, points,
+// vectors, normals, floats and ints, each group in slot order. Every slot is
+// then aligned without padding, and the variables of one type are adjacent,
+// so a frame can be cleared or copied a type at a time.
+class FrameLayout
+{
+    std::vector<uint32_t> Offsets;
+    uint32_t Size = 0;
+
+  public:
+    static FrameLayout compute(llvm::ArrayRef<TokenKind> SlotTypes);
+
+    // Size and alignment of a variable of Type in the frame: 8 for a string,
+    // 64 for a matrix, 12 for the other aggregates and 4 otherwise.
+    static uint32_t getSize(TokenKind Type);
+    static uint32_t getAlign(TokenKind Type);
+
+    uint32_t getOffset(unsigned Slot) const { return Offsets[Slot]; }
+    unsigned getNumSlots() const { return Offsets.size(); }
+    // Bytes of the whole frame, a multiple of its largest alignment.
+    uint32_t getFrameSize() const { return Size; }
+};
+
+#endif
@@ -2,11 +2,41 @@
 #define LLSHADER_SEMA_SEMA_H
 
 #include "llshader/AST/AST.h"
+#include "llshader/AST/FlatAST.h"
+#include "llshader/Basic/Diagnostic.h"
 #include "llshader/Lexer/Lexer.h"
+#include "llshader/Sema/FrameLayout.h"
 
 class Sema {
+  unsigned NumThreads = 1;
+  DiagnosticsEngine *Diags = nullptr;
+  std::vector<TokenKind> SlotTypes;
+
 public:
+  /// Report errors to D, at the statements they are in. Without an engine
+  /// they are only counted.
+  void setDiagnostics(DiagnosticsEngine &D) { Diags = &D; }
+
+  /// Check independent top-level scopes on up to N threads. Diagnostics and
+  /// the result are the same for every N.
+  void setNumThreads(unsigned N) { NumThreads = N; }
+
+  /// Checks Tree and binds every DefExpr, VariableRef and LValue in it to
+  /// the frame slot of its variable, numbering the declarations in source
+  /// order from 0 (the program is one function), and every VariableRef and
+  /// LValue to the variable's type.
   bool semantic(AST *Tree);
+
+  /// The same checks over the flat form; always single-threaded. Slots are
+  /// not bound, as FlatAST already numbers identifiers.
+  bool semantic(const FlatAST &Tree);
+
+  /// The type of each slot the last semantic(AST *) bound.
+  llvm::ArrayRef<TokenKind> getSlotTypes() const { return SlotTypes; }
+  unsigned getNumSlots() const { return SlotTypes.size(); }
+  FrameLayout getFrameLayout() const {
+    return FrameLayout::compute(SlotTypes);
+  }
 };
 
 #endif
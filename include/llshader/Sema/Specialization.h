@@ -0,0 +1,70 @@
+#ifndef LLSHADER_SEMA_SPECIALIZATION_H
+#define LLSHADER_SEMA_SPECIALIZATION_H
+
+#include "llshader/AST/AST.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/StringSaver.h"
+#include "llvm/Support/raw_ostream.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+// A shader with constant values bound to some of its parameters, the
+// top-level int, float and string variables. The tree is left as it is:
+// the specialization records which expressions codegen replaces with
+// literals and which branches it drops, so one checked tree can be
+// specialized for many parameter sets.
+//
+// A bound parameter is initialized with its value. If nothing assigns to it
+// anywhere in the shader, its references become literals too. Then
+// operations on literals are folded with the rules of foldConstants,
+// float operations rounded to float as codegen computes them, and an if
+// whose condition folds keeps one branch, a while or for loop whose
+// condition folds to false disappears.
+class Specialization
+{
+    llvm::DenseMap<const DefExpr *, Literal *> Initializers;
+    llvm::DenseMap<const Expression *, Literal *> Replacements;
+    llvm::DenseMap<const Statement *, bool> Conditions;
+    std::vector<std::unique_ptr<Literal>> Literals;
+    llvm::BumpPtrAllocator Alloc;
+    llvm::StringSaver Saver{Alloc};
+    std::string Key;
+    unsigned NumBound = 0;
+    unsigned NumFolded = 0;
+    unsigned NumDeadBranches = 0;
+
+    friend class SpecializationBuilder;
+
+  public:
+    // Binds each of Values, by parameter name, in Tree, which must have
+    // passed semantic analysis. Returns null with Error set if a name is not
+    // a parameter of the shader, or a value is not one of its type.
+    static std::unique_ptr<Specialization>
+    compute(AST *Tree, const llvm::StringMap<std::string> &Values,
+            std::string &Error);
+
+    // The value a bound parameter's declaration initializes it with.
+    Literal *getInitializer(const DefExpr *Def) const;
+
+    // The literal E evaluates to, or null.
+    Literal *getReplacement(const Expression *E) const;
+
+    // The value the condition of a Conditional, For or While always has,
+    // for those whose code the specialization changes.
+    llvm::Optional<bool> getCondition(const Statement *S) const;
+
+    // The bindings in canonical form, "name=value" by name separated by
+    // ';', with each value spelled as its literal. Equal keys give equal
+    // code.
+    llvm::StringRef getKey() const { return Key; }
+
+    // Prints how many parameters were bound, expressions folded and
+    // branches removed.
+    void print(llvm::raw_ostream &OS) const;
+};
+
+#endif
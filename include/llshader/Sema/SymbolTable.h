@@ -17,21 +17,53 @@ using tok::TokenKind;
 class SymbolTable
 {
   public:
-    SymbolTable(std::shared_ptr<SymbolTable> parent = nullptr)
-        : parent(parent) {};
+    // Names of parent are visible only if they were inserted before its
+    // ParentLimit'th insertion, so a scope checked out of order still sees
+    // exactly the enclosing names declared before it. Lookups never modify a
+    // table, so several child scopes may share one parent across threads.
+    SymbolTable(std::shared_ptr<const SymbolTable> parent = nullptr,
+                unsigned parentLimit = ~0u)
+        : parent(parent), parentLimit(parentLimit) {};
 
-    void insert(const std::string &name, TokenKind type) { table[name] = type; }
+    struct Entry
+    {
+        TokenKind type;
+        // The variable's frame slot.
+        unsigned slot;
+        unsigned order;
+    };
+
+    void insert(const std::string &name, TokenKind type,
+                unsigned slot = InvalidSlot)
+    {
+        table[name] = {type, slot, numInserted++};
+    }
 
-    TokenKind lookup(const std::string &name, bool recursive = true)
+    // The visible entry for name, or null.
+    const Entry *find(const std::string &name, bool recursive = true,
+                      unsigned limit = ~0u) const
     {
-        if (table.find(name) != table.end())
-            return table[name];
+        auto it = table.find(name);
+        if (it != table.end() && it->second.order < limit)
+            return &it->second;
         if (parent && recursive)
-            return parent->lookup(name);
-        return TokenKind::kw_void;
+            return parent->find(name, true, parentLimit);
+        return nullptr;
     }
 
+    TokenKind lookup(const std::string &name, bool recursive = true,
+                     unsigned limit = ~0u) const
+    {
+        const Entry *entry = find(name, recursive, limit);
+        return entry ? entry->type : TokenKind::kw_void;
+    }
+
+    // Number of insertions so far; a limit for child scopes created now.
+    unsigned size() const { return numInserted; }
+
   private:
-    std::unordered_map<std::string, TokenKind> table;
-    std::shared_ptr<SymbolTable> parent;
+    std::unordered_map<std::string, Entry> table;
+    std::shared_ptr<const SymbolTable> parent;
+    unsigned parentLimit;
+    unsigned numInserted = 0;
 };
@@ -0,0 +1,76 @@
+#ifndef LLSHADER_SEMA_UNIFORMITY_H
+#define LLSHADER_SEMA_UNIFORMITY_H
+
+#include "llshader/AST/AST.h"
+#include "llshader/Basic/Diagnostic.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/raw_ostream.h"
+#include <vector>
+
+// How an expression's value varies across shading points: Constant has no
+// variable operands, Uniform is the same at every point, Varying may differ.
+enum class Variance
+{
+    Constant,
+    Uniform,
+    Varying
+};
+
+// True if Name is one of OSL's shader globals (P, N, u, v, ...), which
+// top-level variables are named after to stand for per-point inputs.
+bool isShaderGlobal(llvm::StringRef Name);
+
+// Dataflow over the node classes that classifies every expression by
+// Variance and finds the expressions inside loops that are loop-invariant.
+//
+// Top-level variables named after OSL shader globals (P, N, u, v, ...) are
+// the per-point inputs and so varying. A variable becomes varying when it is
+// assigned a varying value or assigned under a branch or loop whose outcome
+// is varying. Expressions are loop-invariant in a loop if they have no side
+// effects and read no variable written in it.
+//
+// For each loop the maximal invariant expressions that do some work are
+// collected for hoisting: codegen evaluates them once before the loop, as
+// far out as they stay invariant. This is safe because every operation is
+// total (division by zero is 0) and free of side effects.
+class UniformityInfo
+{
+  public:
+    struct LoopStats
+    {
+        const Loop *L;
+        unsigned Hoisted = 0;
+        // AST nodes evaluated once before the loop instead of every
+        // iteration.
+        unsigned HoistedNodes = 0;
+    };
+
+  private:
+    struct ExprInfo
+    {
+        Variance Var;
+        bool LoopInvariant;
+    };
+    llvm::DenseMap<const Expression *, ExprInfo> Exprs;
+    llvm::DenseMap<const Loop *, std::vector<Expression *>> Hoisted;
+    std::vector<LoopStats> Loops;
+
+    friend class UniformityBuilder;
+
+  public:
+    static UniformityInfo compute(AST *Tree);
+
+    Variance getVariance(const Expression *E) const;
+    // True if E is inside a loop and invariant in the innermost one.
+    bool isLoopInvariant(const Expression *E) const;
+
+    // Expressions to evaluate before L, in source order.
+    llvm::ArrayRef<Expression *> getHoisted(const Loop *L) const;
+
+    // Prints the expression counts by class and the work hoisted out of each
+    // loop; Diags, if set, locates the loops.
+    void print(llvm::raw_ostream &OS, const DiagnosticsEngine *Diags) const;
+};
+
+#endif
@@ -0,0 +1,374 @@
+#include "llshader/AST/FlatAST.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Support/Casting.h"
+
+FlatOp getFlatOp(StringRef Spelling)
+{
+    return llvm::StringSwitch<FlatOp>(Spelling)
+#define FLAT_OP(Name, Spelling) .Case(Spelling, FlatOp::Name)
+#include "llshader/AST/FlatAST.def"
+        .Default(FlatOp::None);
+}
+
+const char *getFlatOpSpelling(FlatOp Op)
+{
+    switch (Op)
+    {
+    case FlatOp::None:
+        return "";
+#define FLAT_OP(Name, Spelling)                                                \
+    case FlatOp::Name:                                                         \
+        return Spelling;
+#include "llshader/AST/FlatAST.def"
+    }
+    llvm_unreachable("Unknown flat operator");
+}
+
+namespace
+{
+bool isComplex(TokenKind Type)
+{
+    return Type == TokenKind::kw_color || Type == TokenKind::kw_normal ||
+           Type == TokenKind::kw_point || Type == TokenKind::kw_vector ||
+           Type == TokenKind::kw_matrix;
+}
+} // namespace
+
+TokenKind getBinaryType(FlatOp Op, TokenKind Type1, TokenKind Type2)
+{
+    if (Type1 == TokenKind::kw_string || Type2 == TokenKind::kw_string)
+    {
+        if (Type1 != Type2)
+            return TokenKind::kw_err;
+        if (Op != FlatOp::EQ && Op != FlatOp::NE)
+            return TokenKind::kw_err;
+        return TokenKind::kw_int;
+    }
+
+    switch (Op)
+    {
+    case FlatOp::LT:
+    case FlatOp::GT:
+    case FlatOp::LE:
+    case FlatOp::GE:
+    case FlatOp::EQ:
+    case FlatOp::NE:
+    case FlatOp::LAnd:
+    case FlatOp::LOr:
+        return TokenKind::kw_int;
+    default:
+        break;
+    }
+
+    if (isComplex(Type1) && isComplex(Type2))
+        return Type1 == Type2 ? Type1 : TokenKind::kw_err;
+    if (isComplex(Type1) || isComplex(Type2))
+    {
+        TokenKind NonComplex = isComplex(Type1) ? Type2 : Type1;
+        if (NonComplex == TokenKind::kw_int ||
+            NonComplex == TokenKind::kw_float)
+            return isComplex(Type1) ? Type1 : Type2;
+        return TokenKind::kw_err;
+    }
+    if (Type1 == Type2)
+        return Type1;
+    return TokenKind::kw_float;
+}
+
+class FlatASTBuilder : public ASTVisitor
+{
+    FlatAST &Out;
+    FlatNode Result = InvalidFlatNode;
+
+    FlatNode addNode(FlatKind Kind, TokenKind Type = TokenKind::kw_void,
+                     FlatOp Op = FlatOp::None, uint32_t Data = 0)
+    {
+        FlatNode N = static_cast<FlatNode>(Out.Kinds.size());
+        Out.Kinds.push_back(Kind);
+        Out.Types.push_back(Type);
+        Out.Ops.push_back(Op);
+        Out.ChildBegin.push_back(0);
+        Out.ChildCount.push_back(0);
+        Out.Data.push_back(Data);
+        return N;
+    }
+
+    void setChildren(FlatNode N, llvm::ArrayRef<FlatNode> Children)
+    {
+        Out.ChildBegin[N] = static_cast<uint32_t>(Out.Children.size());
+        Out.ChildCount[N] = static_cast<uint32_t>(Children.size());
+        Out.Children.insert(Out.Children.end(), Children.begin(),
+                            Children.end());
+    }
+
+    uint32_t getIdent(StringRef Name)
+    {
+        auto Res = Out.IdentIds.try_emplace(
+            Name, static_cast<uint32_t>(Out.Idents.size()));
+        if (Res.second)
+            Out.Idents.push_back(Name);
+        return Res.first->second;
+    }
+
+    FlatNode flatten(AST *Node)
+    {
+        if (!Node)
+            return InvalidFlatNode;
+        Node->accept(*this);
+        if (auto *S = llvm::dyn_cast<Statement>(Node))
+            if (S->getLocation().isValid())
+                Out.Locations[Result] = S->getLocation();
+        return Result;
+    }
+
+    TokenKind typeOf(FlatNode N) const
+    {
+        return N == InvalidFlatNode ? TokenKind::kw_void : Out.Types[N];
+    }
+
+    template <class List> void flattenList(FlatNode N, List *L)
+    {
+        llvm::SmallVector<FlatNode, 8> Children;
+        if (L)
+        {
+            for (auto Child : *L)
+                Children.push_back(flatten(Child));
+        }
+        setChildren(N, Children);
+        Result = N;
+    }
+
+  public:
+    FlatASTBuilder(FlatAST &Out) : Out(Out) {}
+
+    void visit(Program &Node) override
+    {
+        flattenList(addNode(FlatKind::Program), Node.getSL());
+    }
+
+    void visit(CompoundSt &Node) override
+    {
+        flattenList(addNode(FlatKind::CompoundSt), Node.getEL());
+    }
+
+    void visit(Scoped &Node) override
+    {
+        flattenList(addNode(FlatKind::Scoped), Node.getSL());
+    }
+
+    void visit(DefExpr &Node) override
+    {
+        FlatNode N = addNode(FlatKind::DefExpr, TokenKind::kw_void,
+                             FlatOp::None, getIdent(Node.getId()));
+        if (Node.getValue())
+        {
+            FlatNode Value = flatten(Node.getValue());
+            setChildren(N, Value);
+        }
+        Result = N;
+    }
+
+    void visit(Declaration &Node) override
+    {
+        flattenList(addNode(FlatKind::Declaration, Node.getType()),
+                    Node.getDefs());
+    }
+
+    void visit(Conditional &Node) override
+    {
+        FlatNode N = addNode(FlatKind::Conditional);
+        FlatNode Children[] = {flatten(Node.getCondition()),
+                               flatten(Node.getThen()),
+                               flatten(Node.getElse())};
+        setChildren(N, Children);
+        Result = N;
+    }
+
+    void visit(For &Node) override
+    {
+        FlatNode N = addNode(FlatKind::For);
+        FlatNode Children[] = {
+            flatten(Node.getInit()), flatten(Node.getCondition()),
+            flatten(Node.getUpdate()), flatten(Node.getBody())};
+        setChildren(N, Children);
+        Result = N;
+    }
+
+    void visit(While &Node) override
+    {
+        FlatNode N = addNode(FlatKind::While);
+        FlatNode Children[] = {flatten(Node.getCondition()),
+                               flatten(Node.getBody())};
+        setChildren(N, Children);
+        Result = N;
+    }
+
+    void visit(DoWhile &Node) override
+    {
+        FlatNode N = addNode(FlatKind::DoWhile);
+        FlatNode Children[] = {flatten(Node.getCondition()),
+                               flatten(Node.getBody())};
+        setChildren(N, Children);
+        Result = N;
+    }
+
+    void visit(LoopMod &Node) override
+    {
+        Result = addNode(FlatKind::LoopMod, TokenKind::kw_void, FlatOp::None,
+                         Node.getMod());
+    }
+
+    void visit(Literal &Node) override
+    {
+        FlatAST::LiteralValue Value;
+        Value.Kind = Node.getKind();
+        Value.Text = Node.getValue();
+        if (Value.Kind == Literal::Integer)
+            Value.Int = Node.getInt();
+        else if (Value.Kind == Literal::FloatingPoint)
+            Value.Float = Node.getFloat();
+        Result = addNode(FlatKind::Literal, Node.getType(), FlatOp::None,
+                         static_cast<uint32_t>(Out.Literals.size()));
+        Out.Literals.push_back(Value);
+    }
+
+    void visit(TypeConstructor &Node) override
+    {
+        flattenList(addNode(FlatKind::TypeConstructor, Node.getType()),
+                    Node.getValues());
+    }
+
+    void visit(BinaryExpression &Node) override
+    {
+        FlatOp Op = getFlatOp(Node.getOp());
+        FlatNode N =
+            addNode(FlatKind::BinaryExpression, TokenKind::kw_void, Op);
+        FlatNode Children[] = {flatten(Node.getE1()), flatten(Node.getE2())};
+        setChildren(N, Children);
+        Out.Types[N] =
+            getBinaryType(Op, typeOf(Children[0]), typeOf(Children[1]));
+        Result = N;
+    }
+
+    void visit(UnaryExpression &Node) override
+    {
+        FlatNode N = addNode(FlatKind::UnaryExpression, TokenKind::kw_int,
+                             getFlatOp(Node.getOp()));
+        FlatNode Operand = flatten(Node.getE());
+        setChildren(N, Operand);
+        Result = N;
+    }
+
+    void visit(LValue &Node) override
+    {
+        flattenList(addNode(FlatKind::LValue, TokenKind::kw_void,
+                            FlatOp::None, getIdent(Node.getId())),
+                    Node.getIndices());
+    }
+
+    void visit(Assignment &Node) override
+    {
+        FlatOp Op = getFlatOp(Node.getOp());
+        FlatNode N = addNode(FlatKind::Assignment, TokenKind::kw_void, Op);
+        FlatNode Children[] = {flatten(Node.getId()),
+                               flatten(Node.getValue())};
+        setChildren(N, Children);
+        // Only plain assignments have a type until lvalues are typed.
+        if (Op == FlatOp::Assign)
+            Out.Types[N] = typeOf(Children[1]);
+        Result = N;
+    }
+
+    void visit(VariableRef &Node) override
+    {
+        FlatNode N = addNode(FlatKind::VariableRef, Node.getType(),
+                             FlatOp::None, getIdent(Node.getId()));
+        if (Node.getDeref())
+        {
+            FlatNode Deref = flatten(Node.getDeref());
+            setChildren(N, Deref);
+        }
+        Result = N;
+    }
+
+    void visit(IncDec &Node) override
+    {
+        FlatNode N = addNode(FlatKind::IncDec, TokenKind::kw_void,
+                             getFlatOp(Node.getOp()));
+        FlatNode Id = flatten(Node.getId());
+        setChildren(N, Id);
+        Out.Types[N] = typeOf(Id);
+        Result = N;
+    }
+
+    void visit(TypeCast &Node) override
+    {
+        FlatNode N = addNode(FlatKind::TypeCast, Node.getType());
+        FlatNode Operand = flatten(Node.getE());
+        setChildren(N, Operand);
+        Result = N;
+    }
+
+    void visit(Derivative &Node) override
+    {
+        FlatNode N = addNode(FlatKind::Derivative, Node.getType(),
+                             getFlatOp(Node.getName()));
+        FlatNode Operand = flatten(Node.getE());
+        setChildren(N, Operand);
+        Result = N;
+    }
+
+    void visit(CompoundEx &Node) override
+    {
+        FlatNode N = addNode(FlatKind::CompoundEx);
+        flattenList(N, Node.getEL());
+        if (Out.ChildCount[N] == 1)
+            Out.Types[N] = typeOf(Out.getChild(N, 0));
+    }
+};
+
+FlatAST FlatAST::build(AST *Tree)
+{
+    FlatAST Out;
+    FlatASTBuilder Builder(Out);
+    Tree->accept(Builder);
+    Out.Kinds.shrink_to_fit();
+    Out.Types.shrink_to_fit();
+    Out.Ops.shrink_to_fit();
+    Out.ChildBegin.shrink_to_fit();
+    Out.ChildCount.shrink_to_fit();
+    Out.Data.shrink_to_fit();
+    Out.Children.shrink_to_fit();
+    Out.Literals.shrink_to_fit();
+    Out.Idents.shrink_to_fit();
+    return Out;
+}
+
+void FlatAST::replaceWithLiteral(FlatNode N, TokenKind Type,
+                                 const LiteralValue &Value)
+{
+    Kinds[N] = FlatKind::Literal;
+    Types[N] = Type;
+    Ops[N] = FlatOp::None;
+    ChildCount[N] = 0;
+    Data[N] = static_cast<uint32_t>(Literals.size());
+    Literals.push_back(Value);
+}
+
+size_t FlatAST::getMemorySize() const
+{
+    auto bytes = [](const auto &V)
+    {
+        using T = typename std::decay_t<decltype(V)>::value_type;
+        return V.capacity() * sizeof(T);
+    };
+    size_t Size = bytes(Kinds) + bytes(Types) + bytes(Ops) +
+                  bytes(ChildBegin) + bytes(ChildCount) + bytes(Data) +
+                  bytes(Children) + bytes(Literals) + bytes(Idents);
+    Size += IdentIds.getNumBuckets() * (sizeof(void *) + sizeof(unsigned));
+    Size += Locations.getMemorySize();
+    for (const auto &Entry : IdentIds)
+        Size += sizeof(Entry) + Entry.getKeyLength() + 1;
+    return Size;
+}
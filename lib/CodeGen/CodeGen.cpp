@@ -1,98 +1,1771 @@
-// #include "llshader/CodeGen/CodeGen.h"
-// #include "llvm/ADT/StringMap.h"
-// #include "llvm/IR/IRBuilder.h"
-// #include "llvm/IR/LLVMContext.h"
-// #include "llvm/IR/Module.h"
-// #include "llvm/Support/raw_ostream.h"
-
-// using namespace llvm;
-
-// namespace
-// {
-// class ToIRVisitor : public ASTVisitor
-// {
-//     Module *M;
-//     IRBuilder<> Builder;
-//     Type *VoidTy;
-//     Type *Int32Ty;
-//     PointerType *PtrTy;
-//     Constant *Int32Zero;
-//     Value *V;
-//     StringMap<Value *> nameMap;
-
-//   public:
-//     ToIRVisitor(Module *M) : M(M), Builder(M->getContext())
-//     {
-//         VoidTy = Type::getVoidTy(M->getContext());
-//         Int32Ty = Type::getInt32Ty(M->getContext());
-//         PtrTy = PointerType::getUnqual(M->getContext());
-//         Int32Zero = ConstantInt::get(Int32Ty, 0, true);
-//     }
-
-//     void run(AST *Tree)
-//     {
-//         FunctionType *MainFty =
-//             FunctionType::get(Int32Ty, {Int32Ty, PtrTy}, false);
-//         Function *MainFn =
-//             Function::Create(MainFty, GlobalValue::ExternalLinkage, "main", M);
-//         BasicBlock *BB = BasicBlock::Create(M->getContext(), "entry", MainFn);
-//         Builder.SetInsertPoint(BB);
-//         Tree->accept(*this);
-
-//         FunctionType *WriteFnTy = FunctionType::get(VoidTy, {Int32Ty}, false);
-//         Function *WriteFn = Function::Create(
-//             WriteFnTy, GlobalValue::ExternalLinkage, "write_int", M);
-//         Builder.CreateCall(WriteFnTy, WriteFn, {V});
-//         Builder.CreateRet(Int32Zero);
-//     }
-
-//     virtual void visit(Program &Node) override
-//     {
-//         if (Node.getSL())
-//         {
-//             for (auto &stmt : *Node.getSL())
-//             {
-//                 stmt->accept(*this);
-//             }
-//         }
-//     };
-
-//     void visit(Statement &Node) override
-//     {
-//         if (llvm::isa<Declaration>(Node))
-//         {
-//             Node.accept(*this);
-//             return;
-//         }
-//         if (llvm::isa<Scoped>(Node))
-//         {
-//             Node.accept(*this);
-//             return;
-//         }
-//         if (llvm::isa<Assignment>(Node))
-//         {
-//             Node.accept(*this);
-//             return;
-//         }
-//     }
-
-//     void visit(Scoped &Node) override
-//     {
-//         if (Node.getSL())
-//         {
-//             for (auto &stmt : *Node.getSL())
-//             {
-//                 stmt->accept(*this);
-//             }
-//         }
-//     }
-
-//     void visit(Declaration &Node) override {}
-// };
-// }; // namespace
-
-// void CodeGen::compile(AST *Tree)
-// {
-//     ToIRVisitor ToIR(M);
-//     ToIR.run(Tree);
-// }
+#include "llshader/CodeGen/CodeGen.h"
+#include "llshader/AST/RecursiveASTVisitor.h"
+#include "llshader/CodeGen/Optimizer.h"
+#include "llshader/CodeGen/ShaderRegistry.h"
+#include "llshader/Sema/Derivatives.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/ProfileData/InstrProf.h"
+#include "llvm/ProfileData/ProfileCommon.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+using namespace llvm;
+
+namespace
+{
+// A top-level block compiled to its own function, see CodeGen::setParallel.
+// It takes the addresses of the top-level variables it uses, in Params,
+// each followed by those of its derivatives if it carries them.
+struct Part
+{
+    struct Param
+    {
+        std::string Name;
+        TokenKind Type;
+        bool HasDerivs;
+    };
+    Scoped *Node;
+    std::string Name;
+    std::vector<Param> Params;
+};
+
+// Collects the variables a block uses that are declared in Declared, in
+// order of first use.
+class VariableCollector : public RecursiveASTVisitor<VariableCollector>
+{
+    const StringMap<bool> &Declared;
+    StringSet<> Seen;
+    std::vector<StringRef> Names;
+
+    void add(StringRef Id)
+    {
+        if (Declared.count(Id) && Seen.insert(Id).second)
+            Names.push_back(Id);
+    }
+
+  public:
+    VariableCollector(const StringMap<bool> &Declared) : Declared(Declared) {}
+
+    std::vector<StringRef> collect(Scoped &Node)
+    {
+        traverseScoped(Node);
+        return Names;
+    }
+
+    bool visitVariableRef(VariableRef &Node)
+    {
+        add(Node.getId());
+        return true;
+    }
+
+    bool visitLValue(LValue &Node)
+    {
+        add(Node.getId());
+        return true;
+    }
+};
+
+// Emits the program as the body of main. The AST's expression types are
+// incomplete (variable references are never typed), so values are typed by
+// their LLVM types: int is i32, float is float, the triples are <3 x float>,
+// matrix is <16 x float> in row-major order and string is i8*.
+//
+// Each node decides the order its children are emitted in and which blocks
+// they go to (short-circuits, loop headers and latches), and expressions hand
+// their value back through V. On RecursiveASTVisitor every node would
+// override its traverse function and the visitor would only provide the
+// dispatch: a switch instead of one virtual call per node, which is noise
+// next to the IRBuilder calls each node makes.
+class ToIRVisitor : public ASTVisitor
+{
+    Module *M;
+    LLVMContext &Ctx;
+    IRBuilder<> Builder;
+    Type *VoidTy;
+    IntegerType *Int1Ty;
+    IntegerType *Int32Ty;
+    IntegerType *Int64Ty;
+    Type *FloatTy;
+    Type *TripleTy;
+    Type *MatrixTy;
+    PointerType *StringTy;
+    Function *MainFn = nullptr;
+
+    // Value of the last expression visited; null for an empty compound
+    // expression.
+    Value *V = nullptr;
+
+    // A variable's storage: an alloca, or in a block outlined by
+    // CodeGen::setParallel, the address of a top-level variable passed in.
+    struct Variable
+    {
+        Value *Addr;
+        Type *Ty;
+        TokenKind Kind;
+        // Storage of the derivatives in x and y, of the same type, if the
+        // variable carries them (see DerivativeInfo).
+        Value *Derivs[2] = {nullptr, nullptr};
+    };
+    std::vector<StringMap<Variable>> Scopes;
+    // Top-level int variables, written out when the program ends.
+    std::vector<std::pair<std::string, AllocaInst *>> Outputs;
+
+    StringRef EntryName;
+    // Names the entry point's llsh_shader_info in a shader library; empty
+    // for a standalone program.
+    StringRef ShaderName;
+    // CPUs the code is compiled for, see CodeGen::setTargets.
+    StringRef Targets;
+    struct Param
+    {
+        std::string Name;
+        TokenKind Type;
+        bool IsOutput;
+    };
+    // Top-level variables in declaration order.
+    std::vector<Param> Params;
+
+    struct LoopTargets
+    {
+        BasicBlock *Break;
+        BasicBlock *Continue;
+        // Timers running when the loop was entered.
+        size_t Timers;
+    };
+    std::vector<LoopTargets> Loops;
+
+    bool HasError = false;
+    // Where errors are reported; null to only count them.
+    DiagnosticsEngine *Diags = nullptr;
+    // The statement being emitted, where errors are reported.
+    SMLoc CurLoc;
+
+    // Top-level blocks compiled to functions of their own; null if they are
+    // emitted inline.
+    std::vector<Part> *Parts = nullptr;
+
+    // Locates statements for profiling; null if there is no profiling.
+    const SourceMgr *SrcMgr;
+
+    // Instrumentation state, see CodeGen::setProfileGenerate. Site 0 is the
+    // whole program, the others statements in the order they are emitted.
+    StringRef ProfileSource;
+    GlobalVariable *ProfileDesc = nullptr;
+    Value *Counters = nullptr;
+    std::vector<std::pair<unsigned, unsigned>> Sites;
+    struct Timer
+    {
+        unsigned Site;
+        Value *Start;
+    };
+    std::vector<Timer> Timers;
+
+    // Counts from CodeGen::setProfileUse by statement line and column.
+    const ShaderProfile *Profile;
+    DenseMap<std::pair<unsigned, unsigned>, uint64_t> ProfileCounts;
+
+    // Loop-invariant expressions, see CodeGen::setUniformity, and their
+    // values once evaluated before their loop.
+    const UniformityInfo *Uniformity;
+    DenseMap<const Expression *, Value *> HoistedValues;
+
+    // Constants and resolved branches, see CodeGen::setSpecialization.
+    const Specialization *Spec;
+
+    // The variables that carry derivatives; null if there are no queries.
+    const DerivativeInfo *Derivs = nullptr;
+
+    // A value and its derivatives in x and y, which are null if it has none
+    // (it is 0 or not a float or triple).
+    struct Dual
+    {
+        Value *Val;
+        Value *D[2] = {nullptr, nullptr};
+    };
+
+  public:
+    ToIRVisitor(Module *M, StringRef EntryName, StringRef ShaderName,
+                StringRef Targets, const SourceMgr *SrcMgr,
+                StringRef ProfileSource, const ShaderProfile *Profile,
+                const UniformityInfo *Uniformity, const Specialization *Spec)
+        : M(M), Ctx(M->getContext()), Builder(M->getContext()),
+          EntryName(EntryName), ShaderName(ShaderName), Targets(Targets),
+          SrcMgr(SrcMgr), ProfileSource(ProfileSource), Profile(Profile),
+          Uniformity(Uniformity), Spec(Spec)
+    {
+        VoidTy = Type::getVoidTy(Ctx);
+        Int1Ty = Type::getInt1Ty(Ctx);
+        Int32Ty = Type::getInt32Ty(Ctx);
+        Int64Ty = Type::getInt64Ty(Ctx);
+        FloatTy = Type::getFloatTy(Ctx);
+        TripleTy = FixedVectorType::get(FloatTy, 3);
+        MatrixTy = FixedVectorType::get(FloatTy, 16);
+        StringTy = Type::getInt8PtrTy(Ctx);
+    }
+
+    bool run(AST *Tree)
+    {
+        FunctionType *MainTy = FunctionType::get(Int32Ty, false);
+        MainFn = Function::Create(MainTy, GlobalValue::ExternalLinkage,
+                                  EntryName, M);
+        Builder.SetInsertPoint(BasicBlock::Create(Ctx, "entry", MainFn));
+        Scopes.emplace_back();
+        if (Profile)
+            applyProfile();
+        if (!ProfileSource.empty())
+            beginProfile();
+
+        Tree->accept(*this);
+
+        if (!ProfileSource.empty())
+            endProfile();
+        FunctionCallee WriteFn = M->getOrInsertFunction(
+            "write_int", FunctionType::get(VoidTy, {Int32Ty}, false));
+        for (auto &Out : Outputs)
+            Builder.CreateCall(WriteFn, {Builder.CreateLoad(
+                                            Int32Ty, Out.second, Out.first)});
+        Builder.CreateRet(ConstantInt::get(Int32Ty, 0));
+        if (!ShaderName.empty())
+            emitShaderInfo();
+        if (!Targets.empty())
+            emitTargets();
+
+        verify();
+        return !HasError;
+    }
+
+    // Report errors to Diags instead of only counting them.
+    void setDiagnostics(DiagnosticsEngine &Diags) { this->Diags = &Diags; }
+
+    // Give the variables Derivs selects derivatives and answer Dx and Dy
+    // from them.
+    void setDerivatives(const DerivativeInfo &Derivs)
+    {
+        if (Derivs.hasQueries())
+            this->Derivs = &Derivs;
+    }
+
+    // Make run() declare each top-level block as a function and call it,
+    // and add the block to Parts to be emitted with runPart().
+    void setOutlining(std::vector<Part> &Parts) { this->Parts = &Parts; }
+
+    // Emits the function for P into this visitor's module.
+    bool runPart(const Part &P)
+    {
+        std::vector<Type *> ParamTys;
+        for (auto &Param : P.Params)
+            ParamTys.insert(ParamTys.end(), Param.HasDerivs ? 3 : 1,
+                            getType(Param.Type)->getPointerTo());
+        MainFn = Function::Create(FunctionType::get(VoidTy, ParamTys, false),
+                                  GlobalValue::ExternalLinkage, P.Name, M);
+        Builder.SetInsertPoint(BasicBlock::Create(Ctx, "entry", MainFn));
+        Scopes.emplace_back();
+        unsigned ArgNo = 0;
+        for (auto &Param : P.Params)
+        {
+            Argument *Arg = MainFn->getArg(ArgNo++);
+            Arg->setName(Param.Name);
+            Variable Var = {Arg, getType(Param.Type), Param.Type};
+            if (Param.HasDerivs)
+                for (unsigned A = 0; A < 2; ++A)
+                {
+                    Var.Derivs[A] = MainFn->getArg(ArgNo++);
+                    Var.Derivs[A]->setName(Param.Name + getDerivSuffix(A));
+                }
+            Scopes.back()[Param.Name] = Var;
+        }
+
+        emitStmt(P.Node);
+
+        Builder.CreateRetVoid();
+        verify();
+        return !HasError;
+    }
+
+    virtual void visit(Program &Node) override
+    {
+        for (Statement *S : *Node.getSL())
+        {
+            auto *Block = dyn_cast<Scoped>(S);
+            if (Parts && Block)
+                emitPartCall(*Block);
+            else
+                emitStmt(S);
+        }
+    }
+
+    // Statements
+
+    virtual void visit(CompoundSt &Node) override
+    {
+        for (Expression *E : *Node.getEL())
+            emit(E);
+    }
+
+    virtual void visit(Scoped &Node) override
+    {
+        Scopes.emplace_back();
+        for (Statement *S : *Node.getSL())
+            emitStmt(S);
+        Scopes.pop_back();
+    }
+
+    virtual void visit(Declaration &Node) override
+    {
+        Type *Ty = getType(Node.getType());
+        if (!Ty)
+        {
+            error(diag::err_cannot_declare_type);
+            return;
+        }
+        for (DefExpr *Def : *Node.getDefs())
+        {
+            bool HasDerivs = Derivs && isDifferentiable(Ty) &&
+                             Derivs->needsDerivatives(Def->getSlot());
+            // The initializer is emitted before the name is bound, so it
+            // sees any outer variable of the same name.
+            Dual Init;
+            if (Literal *Bound = Spec ? Spec->getInitializer(Def) : nullptr)
+                Init.Val = convert(emitValue(Bound), Ty,
+                                   "initialization of " + Def->getId());
+            else if (Def->getValue())
+                Init = convertDual(HasDerivs ? emitDual(Def->getValue())
+                                             : Dual{emitValue(Def->getValue())},
+                                   Ty, "initialization of " + Def->getId());
+            else if (Ty == StringTy)
+                Init.Val = Builder.CreateGlobalStringPtr("", "str");
+            else
+            {
+                Init.Val = Constant::getNullValue(Ty);
+                if (HasDerivs && Scopes.size() == 1 &&
+                    isShaderGlobal(Def->getId()))
+                    Init = getGlobalDerivatives(Def->getId(), Init.Val);
+            }
+            AllocaInst *Addr = createAlloca(Ty, Def->getId());
+            Builder.CreateStore(Init.Val, Addr);
+            Variable Var = {Addr, Ty, Node.getType()};
+            if (HasDerivs)
+                for (unsigned A = 0; A < 2; ++A)
+                {
+                    Var.Derivs[A] =
+                        createAlloca(Ty, Def->getId() + getDerivSuffix(A));
+                    Builder.CreateStore(getDerivative(Init, A, Ty),
+                                        Var.Derivs[A]);
+                }
+            Scopes.back()[Def->getId()] = Var;
+            if (Scopes.size() == 1 && Ty == Int32Ty)
+                Outputs.push_back({Def->getId().str(), Addr});
+            if (Scopes.size() == 1)
+                Params.push_back(
+                    {Def->getId().str(), Node.getType(), Ty == Int32Ty});
+        }
+    }
+
+    virtual void visit(Conditional &Node) override
+    {
+        if (Optional<bool> Known = getKnownCondition(Node))
+        {
+            if (Statement *Taken = *Known ? Node.getThen() : Node.getElse())
+                emitStmt(Taken);
+            return;
+        }
+        Value *Cond = toBool(emitValue(Node.getCondition()));
+        BasicBlock *ThenBB = createBlock("if.then");
+        BasicBlock *ElseBB = Node.getElse() ? createBlock("if.else") : nullptr;
+        BasicBlock *EndBB = createBlock("if.end");
+        BranchInst *Br =
+            Builder.CreateCondBr(Cond, ThenBB, ElseBB ? ElseBB : EndBB);
+        if (Optional<uint64_t> Count = getCount(&Node))
+            if (Optional<uint64_t> Taken = getCount(Node.getThen()))
+                setWeights(Br, *Taken, *Count - std::min(*Count, *Taken));
+
+        Builder.SetInsertPoint(ThenBB);
+        emitStmt(Node.getThen());
+        Builder.CreateBr(EndBB);
+        if (ElseBB)
+        {
+            Builder.SetInsertPoint(ElseBB);
+            emitStmt(Node.getElse());
+            Builder.CreateBr(EndBB);
+        }
+        Builder.SetInsertPoint(EndBB);
+    }
+
+    virtual void visit(For &Node) override
+    {
+        Scopes.emplace_back();
+        if (Node.getInit())
+            Node.getInit()->accept(*this);
+        if (getKnownCondition(Node))
+        {
+            // The condition is false on entry.
+            Scopes.pop_back();
+            return;
+        }
+        BasicBlock *CondBB = createBlock("for.cond");
+        BasicBlock *BodyBB = createBlock("for.body");
+        BasicBlock *IncBB = createBlock("for.inc");
+        BasicBlock *EndBB = createBlock("for.end");
+        emitHoisted(Node);
+        Builder.CreateBr(CondBB);
+
+        Builder.SetInsertPoint(CondBB);
+        if (Node.getCondition())
+            setLoopWeights(Builder.CreateCondBr(
+                               toBool(emitValue(Node.getCondition())), BodyBB,
+                               EndBB),
+                           Node, Node.getBody(), false);
+        else
+            Builder.CreateBr(BodyBB);
+
+        Builder.SetInsertPoint(BodyBB);
+        emitLoopBody(Node.getBody(), EndBB, IncBB);
+        Builder.CreateBr(IncBB);
+
+        Builder.SetInsertPoint(IncBB);
+        if (Node.getUpdate())
+            emit(Node.getUpdate());
+        Builder.CreateBr(CondBB);
+
+        Builder.SetInsertPoint(EndBB);
+        Scopes.pop_back();
+    }
+
+    virtual void visit(While &Node) override
+    {
+        if (getKnownCondition(Node))
+            return;
+        BasicBlock *CondBB = createBlock("while.cond");
+        BasicBlock *BodyBB = createBlock("while.body");
+        BasicBlock *EndBB = createBlock("while.end");
+        emitHoisted(Node);
+        Builder.CreateBr(CondBB);
+
+        Builder.SetInsertPoint(CondBB);
+        setLoopWeights(Builder.CreateCondBr(
+                           toBool(emitValue(Node.getCondition())), BodyBB,
+                           EndBB),
+                       Node, Node.getBody(), false);
+
+        Builder.SetInsertPoint(BodyBB);
+        emitLoopBody(Node.getBody(), EndBB, CondBB);
+        Builder.CreateBr(CondBB);
+
+        Builder.SetInsertPoint(EndBB);
+    }
+
+    virtual void visit(DoWhile &Node) override
+    {
+        BasicBlock *BodyBB = createBlock("do.body");
+        BasicBlock *CondBB = createBlock("do.cond");
+        BasicBlock *EndBB = createBlock("do.end");
+        emitHoisted(Node);
+        Builder.CreateBr(BodyBB);
+
+        Builder.SetInsertPoint(BodyBB);
+        emitLoopBody(Node.getBody(), EndBB, CondBB);
+        Builder.CreateBr(CondBB);
+
+        Builder.SetInsertPoint(CondBB);
+        setLoopWeights(Builder.CreateCondBr(
+                           toBool(emitValue(Node.getCondition())), BodyBB,
+                           EndBB),
+                       Node, Node.getBody(), true);
+
+        Builder.SetInsertPoint(EndBB);
+    }
+
+    virtual void visit(LoopMod &Node) override
+    {
+        bool IsBreak = Node.getMod() == TokenKind::kw_break;
+        if (Loops.empty())
+        {
+            error(diag::err_loop_mod_outside_loop,
+                  IsBreak ? "break" : "continue");
+            return;
+        }
+        for (size_t I = Timers.size(); I > Loops.back().Timers; --I)
+            stopTimer(Timers[I - 1]);
+        Builder.CreateBr(IsBreak ? Loops.back().Break : Loops.back().Continue);
+        // Statements after the jump are unreachable but still emitted.
+        Builder.SetInsertPoint(
+            createBlock(IsBreak ? "after.break" : "after.continue"));
+    }
+
+    // Expressions
+
+    virtual void visit(Literal &Node) override
+    {
+        switch (Node.getKind())
+        {
+        case Literal::Integer:
+            V = ConstantInt::get(Int32Ty, static_cast<uint32_t>(Node.getInt()));
+            break;
+        case Literal::FloatingPoint:
+            V = ConstantFP::get(FloatTy, Node.getFloat());
+            break;
+        case Literal::String:
+            V = Builder.CreateGlobalStringPtr(Node.getValue(), "str");
+            break;
+        }
+    }
+
+    virtual void visit(TypeConstructor &Node) override
+    {
+        Type *Ty = getType(Node.getType());
+        ExprList &Values = *Node.getValues();
+        unsigned Components = Ty && Ty->isVectorTy()
+                                  ? cast<FixedVectorType>(Ty)->getNumElements()
+                                  : 1;
+        if (!Ty || (Values.size() != 1 && Values.size() != Components))
+        {
+            error(diag::err_type_constructor_arity);
+            V = Ty ? UndefValue::get(Ty) : UndefValue::get(Int32Ty);
+            return;
+        }
+        if (Values.size() == 1)
+        {
+            V = convert(emitValue(Values[0]), Ty, "type constructor");
+            return;
+        }
+        Value *Result = UndefValue::get(Ty);
+        for (unsigned I = 0; I < Components; ++I)
+            Result = Builder.CreateInsertElement(
+                Result,
+                convert(emitValue(Values[I]), FloatTy, "type constructor"), I);
+        V = Result;
+    }
+
+    virtual void visit(BinaryExpression &Node) override
+    {
+        StringRef Op = Node.getOp();
+        if (Op == "&&" || Op == "||")
+        {
+            V = emitLogical(Node);
+            return;
+        }
+        Value *LHS = emitValue(Node.getE1());
+        Value *RHS = emitValue(Node.getE2());
+        V = emitBinary(Op, LHS, RHS);
+    }
+
+    virtual void visit(UnaryExpression &Node) override
+    {
+        Value *E = emitValue(Node.getE());
+        if (Node.getOp() == "!")
+        {
+            V = Builder.CreateZExt(Builder.CreateNot(toBool(E)), Int32Ty);
+            return;
+        }
+        if (E->getType() != Int32Ty)
+        {
+            error(diag::err_complement_operand);
+            V = ConstantInt::get(Int32Ty, 0);
+            return;
+        }
+        V = Builder.CreateNot(E);
+    }
+
+    virtual void visit(Assignment &Node) override
+    {
+        V = emitAssignment(Node, false).Val;
+    }
+
+    virtual void visit(VariableRef &Node) override
+    {
+        const Variable *Var = lookup(Node.getId());
+        if (!Var)
+        {
+            V = ConstantInt::get(Int32Ty, 0);
+            return;
+        }
+        V = Builder.CreateLoad(Var->Ty, Var->Addr, Node.getId());
+        if (Node.getDeref())
+            V = emitElement(V, Node.getDeref(), Node.getId());
+    }
+
+    virtual void visit(IncDec &Node) override
+    {
+        V = emitIncDec(Node, false).Val;
+    }
+
+    virtual void visit(TypeCast &Node) override
+    {
+        Value *E = emitValue(Node.getE());
+        Type *Ty = getType(Node.getType());
+        if (!Ty)
+        {
+            error(diag::err_invalid_cast);
+            V = E;
+            return;
+        }
+        V = convert(E, Ty, "cast");
+    }
+
+    virtual void visit(CompoundEx &Node) override
+    {
+        Value *Last = nullptr;
+        for (Expression *E : *Node.getEL())
+            Last = emit(E);
+        V = Last;
+    }
+
+    virtual void visit(Derivative &Node) override
+    {
+        Dual E = emitDual(Node.getE());
+        Type *Ty = E.Val->getType() == Int32Ty ? FloatTy : E.Val->getType();
+        if (!isDifferentiable(Ty))
+        {
+            error(diag::err_derivative_operand, Node.getName());
+            V = ConstantFP::get(FloatTy, 0.0);
+            return;
+        }
+        V = getDerivative(E, Node.getAxis(), Ty);
+    }
+
+  private:
+    template <typename... Args>
+    void error(unsigned DiagID, Args &&...Arguments)
+    {
+        if (Diags)
+            Diags->report(CurLoc, DiagID, std::forward<Args>(Arguments)...);
+        HasError = true;
+    }
+
+    // Reports what the verifier finds wrong with M, at no location.
+    void verify()
+    {
+        std::string Msg;
+        raw_string_ostream OS(Msg);
+        if (HasError || !verifyModule(*M, &OS))
+            return;
+        CurLoc = SMLoc();
+        error(diag::err_invalid_ir, StringRef(OS.str()).trim());
+    }
+
+    Type *getType(TokenKind Kind)
+    {
+        switch (Kind)
+        {
+        case TokenKind::kw_int:
+            return Int32Ty;
+        case TokenKind::kw_float:
+            return FloatTy;
+        case TokenKind::kw_string:
+            return StringTy;
+        case TokenKind::kw_point:
+        case TokenKind::kw_vector:
+        case TokenKind::kw_normal:
+        case TokenKind::kw_color:
+            return TripleTy;
+        case TokenKind::kw_matrix:
+            return MatrixTy;
+        default:
+            return nullptr;
+        }
+    }
+
+    StringRef getTypeName(Type *Ty)
+    {
+        if (Ty == Int32Ty)
+            return "int";
+        if (Ty == FloatTy)
+            return "float";
+        if (Ty == TripleTy)
+            return "triple";
+        if (Ty == MatrixTy)
+            return "matrix";
+        return "string";
+    }
+
+    BasicBlock *createBlock(const Twine &Name)
+    {
+        return BasicBlock::Create(Ctx, Name, MainFn);
+    }
+
+    AllocaInst *createAlloca(Type *Ty, const Twine &Name)
+    {
+        BasicBlock &Entry = MainFn->getEntryBlock();
+        IRBuilder<> EntryBuilder(&Entry, Entry.begin());
+        return EntryBuilder.CreateAlloca(Ty, nullptr, Name);
+    }
+
+    const Variable *find(StringRef Id)
+    {
+        for (auto I = Scopes.rbegin(), E = Scopes.rend(); I != E; ++I)
+        {
+            auto It = I->find(Id);
+            if (It != I->end())
+                return &It->second;
+        }
+        return nullptr;
+    }
+
+    const Variable *lookup(StringRef Id)
+    {
+        if (const Variable *Var = find(Id))
+            return Var;
+        error(diag::err_undeclared_variable, Id);
+        return nullptr;
+    }
+
+    Value *emit(Expression *E)
+    {
+        auto It = HoistedValues.find(E);
+        if (It != HoistedValues.end())
+            return V = It->second;
+        if (Spec)
+            if (Literal *Lit = Spec->getReplacement(E))
+                E = Lit;
+        V = nullptr;
+        E->accept(*this);
+        return V;
+    }
+
+    Value *emitValue(Expression *E)
+    {
+        if (Value *Val = emit(E))
+            return Val;
+        error(diag::err_expression_has_no_value);
+        return ConstantInt::get(Int32Ty, 0);
+    }
+
+    // Assignments
+
+    // Emits an assignment. Its value has derivatives if WantDerivs or the
+    // variable carries them, and they are stored with the value.
+    Dual emitAssignment(Assignment &Node, bool WantDerivs)
+    {
+        LValue *LV = Node.getId();
+        const Variable *Var = lookup(LV->getId());
+        if (!Var)
+            return {ConstantInt::get(Int32Ty, 0)};
+        Value *Addr = Var->Addr;
+        Type *VarTy = Var->Ty;
+        bool HasDerivs = Var->Derivs[0] != nullptr;
+
+        Value *Index = nullptr;
+        Type *Ty = VarTy;
+        if (ExprList *Indices = LV->getIndices())
+        {
+            std::vector<Value *> Idx;
+            for (Expression *E : *Indices)
+                Idx.push_back(convert(emitValue(E), Int32Ty, "subscript"));
+            if (VarTy == TripleTy && Idx.size() == 1)
+                Index = clampIndex(Idx[0], 3);
+            else if (VarTy == MatrixTy && Idx.size() == 2)
+                Index = Builder.CreateAdd(
+                    Builder.CreateShl(clampIndex(Idx[0], 4), 2),
+                    clampIndex(Idx[1], 4));
+            else
+            {
+                error(diag::err_invalid_subscript, LV->getId());
+                return {ConstantInt::get(Int32Ty, 0)};
+            }
+            Ty = FloatTy;
+        }
+
+        Dual New = HasDerivs || WantDerivs ? emitDual(Node.getValue())
+                                           : Dual{emitValue(Node.getValue())};
+        StringRef Op = Node.getOp();
+        if (Op != "=")
+        {
+            Dual Old = {Builder.CreateLoad(VarTy, Addr, LV->getId())};
+            if (HasDerivs)
+                for (unsigned A = 0; A < 2; ++A)
+                    Old.D[A] = Builder.CreateLoad(
+                        VarTy, Var->Derivs[A], LV->getId() + getDerivSuffix(A));
+            if (Index)
+                Old = extractDual(Old, Index);
+            New = emitDualBinary(Op.drop_back(), Old, New);
+        }
+        New = convertDual(New, Ty, "assignment to " + LV->getId());
+        if (Index)
+            Builder.CreateStore(
+                Builder.CreateInsertElement(
+                    Builder.CreateLoad(VarTy, Addr, LV->getId()), New.Val,
+                    Index),
+                Addr);
+        else
+            Builder.CreateStore(New.Val, Addr);
+        if (HasDerivs)
+            for (unsigned A = 0; A < 2; ++A)
+            {
+                Value *D = getDerivative(New, A, Ty);
+                if (Index)
+                    D = Builder.CreateInsertElement(
+                        Builder.CreateLoad(VarTy, Var->Derivs[A]), D, Index);
+                Builder.CreateStore(D, Var->Derivs[A]);
+            }
+        return New;
+    }
+
+    // Emits ++ or --, which leave the derivatives as they are. They are
+    // part of the value if WantDerivs.
+    Dual emitIncDec(IncDec &Node, bool WantDerivs)
+    {
+        VariableRef *Ref = Node.getId();
+        const Variable *Var = lookup(Ref->getId());
+        if (!Var)
+            return {ConstantInt::get(Int32Ty, 0)};
+        Value *Addr = Var->Addr;
+        Type *VarTy = Var->Ty;
+        Value *Index = nullptr;
+        Value *Old = Builder.CreateLoad(VarTy, Addr, Ref->getId());
+        if (Ref->getDeref())
+        {
+            Index = emitIndex(Old, Ref->getDeref(), Ref->getId());
+            if (!Index)
+                return {Old};
+            Old = Builder.CreateExtractElement(Old, Index);
+        }
+        Value *New = emitBinary(Node.getOp() == "++" ? "+" : "-", Old,
+                                ConstantInt::get(Int32Ty, 1));
+        if (Index)
+            Builder.CreateStore(Builder.CreateInsertElement(
+                                    Builder.CreateLoad(VarTy, Addr), New,
+                                    Index),
+                                Addr);
+        else
+            Builder.CreateStore(New, Addr);
+        Dual Out = {New};
+        if (WantDerivs && Var->Derivs[0])
+            for (unsigned A = 0; A < 2; ++A)
+            {
+                Out.D[A] = Builder.CreateLoad(VarTy, Var->Derivs[A],
+                                              Ref->getId() + getDerivSuffix(A));
+                if (Index)
+                    Out.D[A] = Builder.CreateExtractElement(Out.D[A], Index);
+            }
+        return Out;
+    }
+
+    // Derivatives
+
+    bool isDifferentiable(Type *Ty) { return Ty == FloatTy || Ty == TripleTy; }
+
+    static bool hasDerivs(const Dual &D) { return D.D[0] || D.D[1]; }
+
+    static const char *getDerivSuffix(unsigned Axis)
+    {
+        return Axis ? ".dy" : ".dx";
+    }
+
+    // The derivative of D along Axis as a Ty: 0 if it has none, and a
+    // float's spread over a triple.
+    Value *getDerivative(const Dual &D, unsigned Axis, Type *Ty)
+    {
+        Value *Deriv = D.D[Axis];
+        if (!Deriv)
+            return Constant::getNullValue(Ty);
+        if (Deriv->getType() != Ty)
+            return Builder.CreateVectorSplat(3, Deriv);
+        return Deriv;
+    }
+
+    // Converts D's value like convert. The derivatives of a float converted
+    // to a triple are spread like the value, and other conversions drop
+    // them.
+    Dual convertDual(Dual D, Type *To, const Twine &Context)
+    {
+        Type *From = D.Val->getType();
+        D.Val = convert(D.Val, To, Context);
+        if (From == To)
+            return D;
+        for (unsigned A = 0; A < 2; ++A)
+            D.D[A] = D.D[A] && From == FloatTy && To == TripleTy
+                         ? Builder.CreateVectorSplat(3, D.D[A])
+                         : nullptr;
+        return D;
+    }
+
+    Dual extractDual(Dual D, Value *Index)
+    {
+        D.Val = Builder.CreateExtractElement(D.Val, Index);
+        for (unsigned A = 0; A < 2; ++A)
+            if (D.D[A])
+                D.D[A] = Builder.CreateExtractElement(D.D[A], Index);
+        return D;
+    }
+
+    // A shader global's derivatives, which the renderer provides in the
+    // top-level variables named like OSL's (dPdx, dPdy, dudx, ...) when
+    // they are declared before it with its type; 0 otherwise.
+    Dual getGlobalDerivatives(StringRef Id, Value *Val)
+    {
+        Dual Out = {Val};
+        for (unsigned A = 0; A < 2; ++A)
+        {
+            std::string Name = ("d" + Id + (A ? "dy" : "dx")).str();
+            auto It = Scopes.front().find(Name);
+            if (It != Scopes.front().end() &&
+                It->second.Ty == Val->getType())
+                Out.D[A] = Builder.CreateLoad(It->second.Ty,
+                                              It->second.Addr, Name);
+        }
+        return Out;
+    }
+
+    // Emits E with its derivatives, in forward mode: every operation
+    // computes the derivatives of its result from those of its operands
+    // along with its value. Only floats and triples have derivatives.
+    // Expressions that cannot carry them are emitted as by emit, and so
+    // are those whose operands have none, so the code is the same as
+    // without derivatives wherever they are 0.
+    Dual emitDual(Expression *E)
+    {
+        if (Spec && Spec->getReplacement(E))
+            return {emitValue(E)};
+        switch (E->getKind())
+        {
+        case Expression::ExprRef:
+            return emitDualRef(*cast<VariableRef>(E));
+        case Expression::ExprBin:
+        {
+            auto *Bin = cast<BinaryExpression>(E);
+            if (!isArithmetic(Bin->getOp()))
+                break;
+            Dual L = emitDual(Bin->getE1());
+            Dual R = emitDual(Bin->getE2());
+            return emitDualBinary(Bin->getOp(), L, R);
+        }
+        case Expression::ExprTypeCon:
+            return emitDualConstructor(*cast<TypeConstructor>(E));
+        case Expression::ExprTypeCast:
+        {
+            auto *Cast = cast<TypeCast>(E);
+            Type *Ty = getType(Cast->getType());
+            if (!Ty)
+                break;
+            return convertDual(emitDual(Cast->getE()), Ty, "cast");
+        }
+        case Expression::ExprAssmt:
+            return emitAssignment(*cast<Assignment>(E), true);
+        case Expression::ExprIncDec:
+            return emitIncDec(*cast<IncDec>(E), true);
+        case Expression::ExprCompEx:
+        {
+            ExprList &EL = *cast<CompoundEx>(E)->getEL();
+            if (EL.empty())
+                break;
+            for (size_t I = 0; I + 1 < EL.size(); ++I)
+                emit(EL[I]);
+            return emitDual(EL.back());
+        }
+        default:
+            break;
+        }
+        return {emitValue(E)};
+    }
+
+    static bool isArithmetic(StringRef Op)
+    {
+        return Op == "+" || Op == "-" || Op == "*" || Op == "/" || Op == "%";
+    }
+
+    Dual emitDualRef(VariableRef &Node)
+    {
+        const Variable *Var = find(Node.getId());
+        if (!Var || !Var->Derivs[0])
+            return {emitValue(&Node)};
+        StringRef Id = Node.getId();
+        Dual Out = {Builder.CreateLoad(Var->Ty, Var->Addr, Id)};
+        for (unsigned A = 0; A < 2; ++A)
+            Out.D[A] = Builder.CreateLoad(Var->Ty, Var->Derivs[A],
+                                          Id + getDerivSuffix(A));
+        if (Node.getDeref())
+        {
+            Value *Index = emitIndex(Out.Val, Node.getDeref(), Id);
+            if (!Index)
+                return {ConstantFP::get(FloatTy, 0.0)};
+            Out = extractDual(Out, Index);
+        }
+        return Out;
+    }
+
+    Dual emitDualConstructor(TypeConstructor &Node)
+    {
+        Type *Ty = getType(Node.getType());
+        ExprList &Values = *Node.getValues();
+        if (!Ty || !isDifferentiable(Ty) ||
+            (Values.size() != 1 && Values.size() != (Ty == TripleTy ? 3 : 1)))
+            return {emitValue(&Node)};
+        if (Values.size() == 1)
+            return convertDual(emitDual(Values[0]), Ty, "type constructor");
+        Dual Out = {UndefValue::get(Ty)};
+        for (unsigned I = 0; I < 3; ++I)
+        {
+            Dual C = convertDual(emitDual(Values[I]), FloatTy,
+                                 "type constructor");
+            Out.Val = Builder.CreateInsertElement(Out.Val, C.Val, I);
+            for (unsigned A = 0; A < 2; ++A)
+                if (C.D[A])
+                    Out.D[A] = Builder.CreateInsertElement(
+                        Out.D[A] ? Out.D[A] : Constant::getNullValue(Ty),
+                        C.D[A], I);
+        }
+        return Out;
+    }
+
+    // Op on L and R, with the derivatives of the result by the sum, product
+    // and quotient rules. Like OSL, a remainder has the derivatives of its
+    // left operand.
+    Dual emitDualBinary(StringRef Op, const Dual &L, const Dual &R)
+    {
+        Type *LTy = L.Val->getType();
+        Type *RTy = R.Val->getType();
+        auto IsNumber = [this](Type *Ty)
+        { return Ty == Int32Ty || isDifferentiable(Ty); };
+        if (!isArithmetic(Op) || (!hasDerivs(L) && !hasDerivs(R)) ||
+            !IsNumber(LTy) || !IsNumber(RTy))
+            return {emitBinary(Op, L.Val, R.Val)};
+
+        Type *Ty = LTy == TripleTy || RTy == TripleTy ? TripleTy : FloatTy;
+        Value *LV = convert(L.Val, Ty, Op);
+        Value *RV = convert(R.Val, Ty, Op);
+        Dual Out = {emitBinary(Op, LV, RV)};
+        for (unsigned A = 0; A < 2; ++A)
+        {
+            Value *DL = L.D[A] ? getDerivative(L, A, Ty) : nullptr;
+            Value *DR = R.D[A] ? getDerivative(R, A, Ty) : nullptr;
+            if (Op == "+")
+                Out.D[A] = !DL ? DR : !DR ? DL : Builder.CreateFAdd(DL, DR);
+            else if (Op == "-")
+                Out.D[A] = !DR   ? DL
+                           : !DL ? Builder.CreateFNeg(DR)
+                                 : Builder.CreateFSub(DL, DR);
+            else if (Op == "*")
+            {
+                // (a b)' = a' b + a b'
+                Value *T1 = DL ? Builder.CreateFMul(DL, RV) : nullptr;
+                Value *T2 = DR ? Builder.CreateFMul(LV, DR) : nullptr;
+                Out.D[A] = !T1 ? T2 : !T2 ? T1 : Builder.CreateFAdd(T1, T2);
+            }
+            else if (Op == "/")
+            {
+                // (a / b)' = (a' - (a / b) b') / b
+                Value *Num = DL;
+                if (DR)
+                    Num = Builder.CreateFSub(
+                        DL ? DL : Constant::getNullValue(Ty),
+                        Builder.CreateFMul(Out.Val, DR));
+                Out.D[A] = Num ? Builder.CreateFDiv(Num, RV) : nullptr;
+            }
+            else
+                Out.D[A] = DL;
+        }
+        return Out;
+    }
+
+    // Evaluates the expressions hoisted out of L; must be called before
+    // branching into it.
+    void emitHoisted(const Loop &L)
+    {
+        if (!Uniformity)
+            return;
+        for (Expression *E : Uniformity->getHoisted(&L))
+            HoistedValues[E] = emit(E);
+    }
+
+    Optional<bool> getKnownCondition(const Statement &S)
+    {
+        return Spec ? Spec->getCondition(&S) : None;
+    }
+
+    void emitStmt(Statement *S)
+    {
+        SMLoc OuterLoc = CurLoc;
+        CurLoc = S->getLocation();
+        emitCountedStmt(S);
+        CurLoc = OuterLoc;
+    }
+
+    void emitCountedStmt(Statement *S)
+    {
+        if (!Counters)
+        {
+            S->accept(*this);
+            return;
+        }
+        unsigned Site = addSite(S->getLocation());
+        addToCounter(2 * Site, ConstantInt::get(Int64Ty, 1));
+        // Timing every statement would cost more than most statements, so
+        // only blocks are timed.
+        bool Timed = isa<Scoped>(S) || isa<Conditional>(S) || isa<Loop>(S);
+        if (Timed)
+            Timers.push_back({Site, readCycleCounter()});
+        S->accept(*this);
+        if (Timed)
+        {
+            stopTimer(Timers.back());
+            Timers.pop_back();
+        }
+    }
+
+    // Declares the function for a top-level block, calls it with the
+    // addresses of the top-level variables it uses and adds it to Parts.
+    void emitPartCall(Scoped &Block)
+    {
+        StringMap<bool> Declared;
+        for (auto &Var : Scopes.front())
+            Declared[Var.first()] = true;
+        Part P;
+        P.Node = &Block;
+        P.Name = (EntryName + ".part" + Twine(Parts->size())).str();
+        std::vector<Type *> ParamTys;
+        std::vector<Value *> Args;
+        for (StringRef Id : VariableCollector(Declared).collect(Block))
+        {
+            const Variable &Var = Scopes.front().find(Id)->second;
+            P.Params.push_back({Id.str(), Var.Kind, Var.Derivs[0] != nullptr});
+            ParamTys.push_back(Var.Addr->getType());
+            Args.push_back(Var.Addr);
+            if (Var.Derivs[0])
+                for (Value *Addr : Var.Derivs)
+                {
+                    ParamTys.push_back(Addr->getType());
+                    Args.push_back(Addr);
+                }
+        }
+        Function *Fn =
+            Function::Create(FunctionType::get(VoidTy, ParamTys, false),
+                             GlobalValue::ExternalLinkage, P.Name, M);
+        Builder.CreateCall(Fn, Args);
+        Parts->push_back(std::move(P));
+    }
+
+    void emitLoopBody(Statement *Body, BasicBlock *Break, BasicBlock *Continue)
+    {
+        Loops.push_back({Break, Continue, Timers.size()});
+        emitStmt(Body);
+        Loops.pop_back();
+    }
+
+    // Index into an aggregate value, clamped to its bounds.
+    Value *emitIndex(Value *Agg, Expression *E, StringRef Id)
+    {
+        auto *VecTy = dyn_cast<FixedVectorType>(Agg->getType());
+        if (!VecTy)
+        {
+            error(diag::err_subscript_non_aggregate, Id);
+            return nullptr;
+        }
+        return clampIndex(convert(emitValue(E), Int32Ty, "subscript"),
+                          VecTy->getNumElements());
+    }
+
+    Value *emitElement(Value *Agg, Expression *E, StringRef Id)
+    {
+        Value *Index = emitIndex(Agg, E, Id);
+        if (!Index)
+            return ConstantFP::get(FloatTy, 0.0);
+        return Builder.CreateExtractElement(Agg, Index);
+    }
+
+    Value *clampIndex(Value *Index, unsigned Size)
+    {
+        Value *Zero = ConstantInt::get(Int32Ty, 0);
+        Value *Last = ConstantInt::get(Int32Ty, Size - 1);
+        Index = Builder.CreateSelect(Builder.CreateICmpSLT(Index, Zero), Zero,
+                                     Index);
+        return Builder.CreateSelect(Builder.CreateICmpSGT(Index, Last), Last,
+                                    Index);
+    }
+
+    Value *convert(Value *Val, Type *To, const Twine &Context)
+    {
+        Type *From = Val->getType();
+        if (From == To)
+            return Val;
+        bool FromScalar = From == Int32Ty || From == FloatTy;
+        if (To == FloatTy && From == Int32Ty)
+            return Builder.CreateSIToFP(Val, FloatTy);
+        if (To == Int32Ty && From == FloatTy)
+            return Builder.CreateFPToSI(Val, Int32Ty);
+        if (To == TripleTy && FromScalar)
+            return Builder.CreateVectorSplat(3, convert(Val, FloatTy, Context));
+        if (To == MatrixTy && FromScalar)
+        {
+            // A scalar converts to a matrix with it on the diagonal.
+            Value *F = convert(Val, FloatTy, Context);
+            Value *Result = Constant::getNullValue(MatrixTy);
+            for (unsigned I = 0; I < 16; I += 5)
+                Result = Builder.CreateInsertElement(Result, F, I);
+            return Result;
+        }
+        error(diag::err_cannot_convert, getTypeName(From), getTypeName(To),
+              Context.str());
+        return UndefValue::get(To);
+    }
+
+    Value *toBool(Value *Val)
+    {
+        if (Val->getType() == Int32Ty)
+            return Builder.CreateICmpNE(Val, ConstantInt::get(Int32Ty, 0));
+        if (Val->getType() == FloatTy)
+            return Builder.CreateFCmpUNE(Val, ConstantFP::get(FloatTy, 0.0));
+        error(diag::err_condition_type);
+        return ConstantInt::getFalse(Ctx);
+    }
+
+    Value *emitLogical(BinaryExpression &Node)
+    {
+        bool IsOr = Node.getOp() == "||";
+        Value *LHS = toBool(emitValue(Node.getE1()));
+        BasicBlock *LHSBB = Builder.GetInsertBlock();
+        BasicBlock *RHSBB = createBlock(IsOr ? "lor.rhs" : "land.rhs");
+        BasicBlock *EndBB = createBlock(IsOr ? "lor.end" : "land.end");
+        if (IsOr)
+            Builder.CreateCondBr(LHS, EndBB, RHSBB);
+        else
+            Builder.CreateCondBr(LHS, RHSBB, EndBB);
+
+        Builder.SetInsertPoint(RHSBB);
+        Value *RHS = toBool(emitValue(Node.getE2()));
+        RHSBB = Builder.GetInsertBlock();
+        Builder.CreateBr(EndBB);
+
+        Builder.SetInsertPoint(EndBB);
+        PHINode *Phi = Builder.CreatePHI(Int1Ty, 2);
+        Phi->addIncoming(ConstantInt::get(Int1Ty, IsOr), LHSBB);
+        Phi->addIncoming(RHS, RHSBB);
+        return Builder.CreateZExt(Phi, Int32Ty);
+    }
+
+    Value *emitBinary(StringRef Op, Value *LHS, Value *RHS)
+    {
+        Type *LTy = LHS->getType();
+        Type *RTy = RHS->getType();
+        Value *Zero = ConstantInt::get(Int32Ty, 0);
+
+        if (LTy == StringTy || RTy == StringTy)
+        {
+            if (LTy != RTy || (Op != "==" && Op != "!="))
+            {
+                error(diag::err_invalid_string_operands, Op);
+                return Zero;
+            }
+            FunctionCallee Strcmp = M->getOrInsertFunction(
+                "strcmp",
+                FunctionType::get(Int32Ty, {StringTy, StringTy}, false));
+            Value *Cmp = Builder.CreateCall(Strcmp, {LHS, RHS});
+            return Builder.CreateZExt(Op == "==" ? Builder.CreateICmpEQ(Cmp, Zero)
+                                                 : Builder.CreateICmpNE(Cmp, Zero),
+                                      Int32Ty);
+        }
+
+        if (Op == "<" || Op == ">" || Op == "<=" || Op == ">=" || Op == "==" ||
+            Op == "!=")
+            return emitComparison(Op, LHS, RHS);
+
+        if (Op == "&" || Op == "|" || Op == "^" || Op == "<<" || Op == ">>")
+        {
+            if (LTy != Int32Ty || RTy != Int32Ty)
+            {
+                error(diag::err_operands_not_int, Op);
+                return Zero;
+            }
+            if (Op == "&")
+                return Builder.CreateAnd(LHS, RHS);
+            if (Op == "|")
+                return Builder.CreateOr(LHS, RHS);
+            if (Op == "^")
+                return Builder.CreateXor(LHS, RHS);
+            // Shift counts are taken modulo 32, as x86 does.
+            RHS = Builder.CreateAnd(RHS, 31);
+            return Op == "<<" ? Builder.CreateShl(LHS, RHS)
+                              : Builder.CreateAShr(LHS, RHS);
+        }
+
+        if (LTy == MatrixTy && RTy == MatrixTy && Op == "*")
+            return emitMatrixMultiply(LHS, RHS);
+        if ((LTy == MatrixTy || RTy == MatrixTy) &&
+            (LTy == TripleTy || RTy == TripleTy ||
+             (LTy == RTy && (Op == "/" || Op == "%"))))
+        {
+            error(diag::err_invalid_matrix_operands, Op);
+            return UndefValue::get(MatrixTy);
+        }
+
+        Type *Ty = Int32Ty;
+        if (LTy == MatrixTy || RTy == MatrixTy)
+        {
+            // Matrices combine with scalars element by element.
+            Ty = MatrixTy;
+            if (LTy != MatrixTy)
+                LHS = Builder.CreateVectorSplat(16, convert(LHS, FloatTy, Op));
+            if (RTy != MatrixTy)
+                RHS = Builder.CreateVectorSplat(16, convert(RHS, FloatTy, Op));
+        }
+        else if (LTy == TripleTy || RTy == TripleTy)
+            Ty = TripleTy;
+        else if (LTy == FloatTy || RTy == FloatTy)
+            Ty = FloatTy;
+        LHS = convert(LHS, Ty, Op);
+        RHS = convert(RHS, Ty, Op);
+
+        if (Ty == Int32Ty)
+        {
+            if (Op == "+")
+                return Builder.CreateAdd(LHS, RHS);
+            if (Op == "-")
+                return Builder.CreateSub(LHS, RHS);
+            if (Op == "*")
+                return Builder.CreateMul(LHS, RHS);
+            return emitIntDivision(Op == "/", LHS, RHS);
+        }
+        if (Op == "+")
+            return Builder.CreateFAdd(LHS, RHS);
+        if (Op == "-")
+            return Builder.CreateFSub(LHS, RHS);
+        if (Op == "*")
+            return Builder.CreateFMul(LHS, RHS);
+        if (Op == "/")
+            return Builder.CreateFDiv(LHS, RHS);
+        return Builder.CreateFRem(LHS, RHS);
+    }
+
+    // Division or remainder by zero is 0, and INT_MIN / -1 wraps, so that
+    // no input makes the shader trap.
+    Value *emitIntDivision(bool IsDiv, Value *LHS, Value *RHS)
+    {
+        Value *Zero = ConstantInt::get(Int32Ty, 0);
+        Value *One = ConstantInt::get(Int32Ty, 1);
+        Value *MinusOne = ConstantInt::getSigned(Int32Ty, -1);
+        Value *IsZero = Builder.CreateICmpEQ(RHS, Zero);
+        Value *IsMinusOne = Builder.CreateICmpEQ(RHS, MinusOne);
+        Value *SafeRHS =
+            Builder.CreateSelect(Builder.CreateOr(IsZero, IsMinusOne), One, RHS);
+        Value *Result = IsDiv ? Builder.CreateSDiv(LHS, SafeRHS)
+                              : Builder.CreateSRem(LHS, SafeRHS);
+        Result = Builder.CreateSelect(
+            IsMinusOne, IsDiv ? Builder.CreateNeg(LHS) : Zero, Result);
+        return Builder.CreateSelect(IsZero, Zero, Result);
+    }
+
+    Value *emitComparison(StringRef Op, Value *LHS, Value *RHS)
+    {
+        Type *LTy = LHS->getType();
+        Type *RTy = RHS->getType();
+        Value *Cmp;
+        if (LTy == Int32Ty && RTy == Int32Ty)
+        {
+            CmpInst::Predicate Pred = StringSwitch<CmpInst::Predicate>(Op)
+                                          .Case("<", CmpInst::ICMP_SLT)
+                                          .Case(">", CmpInst::ICMP_SGT)
+                                          .Case("<=", CmpInst::ICMP_SLE)
+                                          .Case(">=", CmpInst::ICMP_SGE)
+                                          .Case("==", CmpInst::ICMP_EQ)
+                                          .Default(CmpInst::ICMP_NE);
+            Cmp = Builder.CreateICmp(Pred, LHS, RHS);
+        }
+        else if (LTy->isVectorTy() || RTy->isVectorTy())
+        {
+            // Triples and matrices are only equal or not.
+            if (Op != "==" && Op != "!=")
+            {
+                error(diag::err_invalid_operands, Op);
+                return ConstantInt::get(Int32Ty, 0);
+            }
+            Type *Ty = LTy == MatrixTy || RTy == MatrixTy ? MatrixTy : TripleTy;
+            Value *Equal = Builder.CreateAndReduce(Builder.CreateFCmpOEQ(
+                convert(LHS, Ty, Op), convert(RHS, Ty, Op)));
+            Cmp = Op == "==" ? Equal : Builder.CreateNot(Equal);
+        }
+        else
+        {
+            CmpInst::Predicate Pred = StringSwitch<CmpInst::Predicate>(Op)
+                                          .Case("<", CmpInst::FCMP_OLT)
+                                          .Case(">", CmpInst::FCMP_OGT)
+                                          .Case("<=", CmpInst::FCMP_OLE)
+                                          .Case(">=", CmpInst::FCMP_OGE)
+                                          .Case("==", CmpInst::FCMP_OEQ)
+                                          .Default(CmpInst::FCMP_UNE);
+            Cmp = Builder.CreateFCmp(Pred, convert(LHS, FloatTy, Op),
+                                     convert(RHS, FloatTy, Op));
+        }
+        return Builder.CreateZExt(Cmp, Int32Ty);
+    }
+
+    // Row I of A * B is the sum over K of A[I][K] * row K of B.
+    Value *emitMatrixMultiply(Value *A, Value *B)
+    {
+        Value *Rows[4];
+        for (int I = 0; I < 4; ++I)
+        {
+            Value *Row = nullptr;
+            for (int K = 0; K < 4; ++K)
+            {
+                Value *BRow = Builder.CreateShuffleVector(
+                    B, {4 * K, 4 * K + 1, 4 * K + 2, 4 * K + 3});
+                Value *Term = Builder.CreateFMul(
+                    Builder.CreateVectorSplat(
+                        4, Builder.CreateExtractElement(A, 4 * I + K)),
+                    BRow);
+                Row = Row ? Builder.CreateFAdd(Row, Term) : Term;
+            }
+            Rows[I] = Row;
+        }
+        SmallVector<int, 16> Concat;
+        for (int I = 0; I < 8; ++I)
+            Concat.push_back(I);
+        Value *Top = Builder.CreateShuffleVector(Rows[0], Rows[1], Concat);
+        Value *Bottom = Builder.CreateShuffleVector(Rows[2], Rows[3], Concat);
+        for (int I = 8; I < 16; ++I)
+            Concat.push_back(I);
+        return Builder.CreateShuffleVector(Top, Bottom, Concat);
+    }
+
+    // Shader library
+
+    void emitShaderInfo()
+    {
+        // Matches llsh_shader_param and llsh_shader_info in
+        // tools/runtime/registry.h.
+        StructType *ParamTy = StructType::create(
+            Ctx, {StringTy, Int32Ty, Int32Ty}, "llsh_shader_param");
+        StructType *InfoTy = StructType::create(
+            Ctx,
+            {StringTy, MainFn->getType(), Int32Ty, ParamTy->getPointerTo(),
+             StringTy},
+            "llsh_shader_info");
+
+        std::vector<Constant *> ParamInits;
+        for (const Param &P : Params)
+            ParamInits.push_back(ConstantStruct::get(
+                ParamTy,
+                {getStringConstant(P.Name),
+                 ConstantInt::get(Int32Ty,
+                                  static_cast<unsigned>(getParamType(P.Type))),
+                 ConstantInt::get(Int32Ty,
+                                  P.IsOutput ? registry::ParamOutput : 0)}));
+        ArrayType *ParamsTy = ArrayType::get(ParamTy, ParamInits.size());
+        auto *ParamArray = new GlobalVariable(
+            *M, ParamsTy, true, GlobalValue::PrivateLinkage,
+            ConstantArray::get(ParamsTy, ParamInits), "llsh_params");
+        Constant *Zero = ConstantInt::get(Int32Ty, 0);
+
+        new GlobalVariable(
+            *M, InfoTy, true, GlobalValue::ExternalLinkage,
+            ConstantStruct::get(
+                InfoTy, {getStringConstant(ShaderName), MainFn,
+                         ConstantInt::get(Int32Ty, Params.size()),
+                         ConstantExpr::getInBoundsGetElementPtr(
+                             ParamsTy, ParamArray,
+                             ArrayRef<Constant *>({Zero, Zero})),
+                         getStringConstant(Targets)}),
+            registry::getInfoSymbol(ShaderName));
+    }
+
+    // Records the targets where tools can find them without loading the
+    // code: `readelf -p .llshader.targets`.
+    void emitTargets()
+    {
+        Constant *Init = ConstantDataArray::getString(Ctx, Targets);
+        auto *GV = new GlobalVariable(*M, Init->getType(), true,
+                                      GlobalValue::PrivateLinkage, Init,
+                                      "llsh_targets");
+        GV->setSection(".llshader.targets");
+        GV->setAlignment(Align(1));
+        appendToUsed(*M, {GV});
+    }
+
+    Constant *getStringConstant(StringRef Str)
+    {
+        Constant *Init = ConstantDataArray::getString(Ctx, Str);
+        auto *GV = new GlobalVariable(*M, Init->getType(), true,
+                                      GlobalValue::PrivateLinkage, Init, "str");
+        GV->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+        Constant *Zero = ConstantInt::get(Int32Ty, 0);
+        return ConstantExpr::getInBoundsGetElementPtr(
+            Init->getType(), GV, ArrayRef<Constant *>({Zero, Zero}));
+    }
+
+    registry::ParamType getParamType(TokenKind Kind)
+    {
+        switch (Kind)
+        {
+        case TokenKind::kw_int:
+            return registry::ParamType::Int;
+        case TokenKind::kw_float:
+            return registry::ParamType::Float;
+        case TokenKind::kw_point:
+            return registry::ParamType::Point;
+        case TokenKind::kw_vector:
+            return registry::ParamType::Vector;
+        case TokenKind::kw_normal:
+            return registry::ParamType::Normal;
+        case TokenKind::kw_color:
+            return registry::ParamType::Color;
+        case TokenKind::kw_matrix:
+            return registry::ParamType::Matrix;
+        default:
+            return registry::ParamType::String;
+        }
+    }
+
+    // Profile instrumentation
+
+    Value *readCycleCounter()
+    {
+        return Builder.CreateIntrinsic(Intrinsic::readcyclecounter, {}, {});
+    }
+
+    std::pair<unsigned, unsigned> getLineAndColumn(SMLoc Loc)
+    {
+        if (!Loc.isValid() || !SrcMgr->FindBufferContainingLoc(Loc))
+            return {0, 0};
+        return SrcMgr->getLineAndColumn(Loc);
+    }
+
+    unsigned addSite(SMLoc Loc)
+    {
+        Sites.push_back(getLineAndColumn(Loc));
+        return Sites.size() - 1;
+    }
+
+    void addToCounter(unsigned Index, Value *Delta)
+    {
+        Value *Addr = Builder.CreateConstInBoundsGEP1_64(Int64Ty, Counters,
+                                                         Index);
+        Builder.CreateStore(
+            Builder.CreateAdd(Builder.CreateLoad(Int64Ty, Addr), Delta), Addr);
+    }
+
+    void stopTimer(const Timer &T)
+    {
+        addToCounter(2 * T.Site + 1,
+                     Builder.CreateSub(readCycleCounter(), T.Start));
+    }
+
+    void beginProfile()
+    {
+        // Matches llsh_prof_desc in tools/runtime/profile.h; the initializer
+        // is set once the number of sites is known.
+        StructType *DescTy = StructType::create(Ctx, "llsh_prof_desc");
+        PointerType *Int32PtrTy = Type::getInt32PtrTy(Ctx);
+        DescTy->setBody({StringTy, Int32Ty, Int32Ty, Int32PtrTy, Int32PtrTy,
+                         Type::getInt64PtrTy(Ctx), DescTy->getPointerTo()});
+        ProfileDesc = new GlobalVariable(*M, DescTy, false,
+                                         GlobalValue::InternalLinkage, nullptr,
+                                         "__llsh_prof_desc");
+        FunctionCallee Begin = M->getOrInsertFunction(
+            "llsh_prof_begin", FunctionType::get(Type::getInt64PtrTy(Ctx),
+                                                 {DescTy->getPointerTo()},
+                                                 false));
+        Counters = Builder.CreateCall(Begin, {ProfileDesc}, "counters");
+        Sites.push_back({0, 0});
+        addToCounter(0, ConstantInt::get(Int64Ty, 1));
+        Timers.push_back({0, readCycleCounter()});
+    }
+
+    void endProfile()
+    {
+        stopTimer(Timers.back());
+        Timers.pop_back();
+
+        std::vector<uint32_t> Lines, Cols;
+        for (auto &Site : Sites)
+        {
+            Lines.push_back(Site.first);
+            Cols.push_back(Site.second);
+        }
+        auto CreateArray = [&](Constant *Init, bool IsConstant, StringRef Name)
+        {
+            auto *GV = new GlobalVariable(*M, Init->getType(), IsConstant,
+                                          GlobalValue::InternalLinkage, Init,
+                                          Name);
+            return ConstantExpr::getInBoundsGetElementPtr(
+                Init->getType(), GV,
+                ArrayRef<Constant *>({ConstantInt::get(Int64Ty, 0),
+                                      ConstantInt::get(Int64Ty, 0)}));
+        };
+        Constant *LinesArr = CreateArray(
+            ConstantDataArray::get(Ctx, Lines), true, "__llsh_prof_lines");
+        Constant *ColsArr = CreateArray(ConstantDataArray::get(Ctx, Cols), true,
+                                        "__llsh_prof_cols");
+        Constant *Totals = CreateArray(
+            ConstantAggregateZero::get(ArrayType::get(Int64Ty, 2 * Sites.size())),
+            false, "__llsh_prof_totals");
+        Constant *Source = CreateArray(
+            ConstantDataArray::getString(Ctx, ProfileSource), true,
+            "__llsh_prof_source");
+
+        StructType *DescTy = cast<StructType>(ProfileDesc->getValueType());
+        ProfileDesc->setInitializer(ConstantStruct::get(
+            DescTy,
+            {Source, ConstantInt::get(Int32Ty, Sites.size()),
+             ConstantInt::get(Int32Ty, 0), LinesArr, ColsArr, Totals,
+             ConstantPointerNull::get(DescTy->getPointerTo())}));
+    }
+
+    // Profile use
+
+    void applyProfile()
+    {
+        for (const ProfileSite &Site : Profile->Sites)
+            if (Site.Line)
+                ProfileCounts[{Site.Line, Site.Column}] = Site.Count;
+        if (Profile->Sites.empty())
+            return;
+
+        // Site 0 counts the runs of main. The summary lets the optimizer
+        // rank the counts as hot or cold.
+        MainFn->setEntryCount(
+            Function::ProfileCount(Profile->Sites[0].Count, Function::PCT_Real));
+        InstrProfRecord Record;
+        for (const ProfileSite &Site : Profile->Sites)
+            Record.Counts.push_back(Site.Count);
+        InstrProfSummaryBuilder Summary(ProfileSummaryBuilder::DefaultCutoffs);
+        Summary.addRecord(Record);
+        M->setProfileSummary(Summary.getSummary()->getMD(Ctx),
+                             ProfileSummary::PSK_Instr);
+    }
+
+    Optional<uint64_t> getCount(Statement *S)
+    {
+        if (!Profile || !S)
+            return None;
+        auto It = ProfileCounts.find(getLineAndColumn(S->getLocation()));
+        if (It == ProfileCounts.end())
+            return None;
+        return It->second;
+    }
+
+    void setWeights(BranchInst *Br, uint64_t Taken, uint64_t NotTaken)
+    {
+        // Weights are 32-bit; scale both down alike when they do not fit.
+        uint64_t Scale = std::max(Taken, NotTaken) / UINT32_MAX + 1;
+        Br->setMetadata(LLVMContext::MD_prof,
+                        MDBuilder(Ctx).createBranchWeights(
+                            static_cast<uint32_t>(Taken / Scale),
+                            static_cast<uint32_t>(NotTaken / Scale)));
+    }
+
+    // Each entry of a loop leaves it once, so the branch into the body is
+    // taken as often as the body ran and the exit as often as the loop was
+    // entered. The bottom test of a do-while loop skips the first entry into
+    // the body.
+    void setLoopWeights(BranchInst *Br, Loop &L, Statement *Body,
+                        bool IsBottomTest)
+    {
+        Optional<uint64_t> Entries = getCount(&L);
+        Optional<uint64_t> Iterations = getCount(Body);
+        if (!Entries || !Iterations)
+            return;
+        uint64_t Back = *Iterations;
+        if (IsBottomTest)
+            Back -= std::min(Back, *Entries);
+        setWeights(Br, Back, *Entries);
+    }
+};
+} // namespace
+
+std::string CodeGen::getEntryName() const
+{
+    return ShaderName.empty() ? "main" : registry::getEntrySymbol(ShaderName);
+}
+
+bool CodeGen::compile(AST *Tree)
+{
+    if (!Tree)
+        return false;
+    ToIRVisitor ToIR(M, getEntryName(), ShaderName, Targets, SrcMgr,
+                     ProfileSource, Profile, Uniformity, Spec);
+    if (Diags)
+        ToIR.setDiagnostics(*Diags);
+    DerivativeInfo Derivs = DerivativeInfo::compute(Tree);
+    ToIR.setDerivatives(Derivs);
+    if (!Threads)
+        return ToIR.run(Tree);
+
+    std::vector<Part> Parts;
+    ToIR.setOutlining(Parts);
+    if (!ToIR.run(Tree))
+        return false;
+
+    // Each part is emitted and optimized in a context of its own and handed
+    // back as bitcode. Which thread compiles which part does not matter:
+    // the results are collected by index and linked in source order.
+    std::vector<SmallVector<char, 0>> Bitcode(Parts.size());
+    std::vector<std::vector<StoredDiagnostic>> Errors(Parts.size());
+    std::vector<char> Ok(Parts.size(), false);
+    std::string Triple = M->getTargetTriple();
+    std::string DataLayout = M->getDataLayoutStr();
+    ThreadPool Pool(hardware_concurrency(Threads));
+    for (size_t I = 0; I < Parts.size(); ++I)
+        Pool.async(
+            [&, I]()
+            {
+                LLVMContext PartCtx;
+                Module PartM(Parts[I].Name, PartCtx);
+                PartM.setTargetTriple(Triple);
+                PartM.setDataLayout(DataLayout);
+                ToIRVisitor PartIR(&PartM, getEntryName(), "", "", nullptr, "",
+                                   nullptr, Uniformity, Spec);
+                // A deferring engine never touches the SourceMgr, so each
+                // thread can have one.
+                Optional<DiagnosticsEngine> PartDiags;
+                if (Diags)
+                {
+                    PartDiags.emplace(Diags->getSourceMgr());
+                    PartDiags->setDeferring(true);
+                    PartIR.setDiagnostics(*PartDiags);
+                }
+                PartIR.setDerivatives(Derivs);
+                bool PartOk = PartIR.runPart(Parts[I]);
+                if (PartDiags)
+                    Errors[I] = PartDiags->takeDeferred();
+                if (!PartOk)
+                    return;
+                optimizeModule(PartM, OptLevel);
+                raw_svector_ostream OS(Bitcode[I]);
+                WriteBitcodeToFile(PartM, OS);
+                Ok[I] = true;
+            });
+    optimizeModule(*M, OptLevel);
+    Pool.wait();
+
+    bool Success = true;
+    for (size_t I = 0; I < Parts.size(); ++I)
+    {
+        if (Diags)
+            for (const StoredDiagnostic &D : Errors[I])
+                Diags->replay(D);
+        Success &= bool(Ok[I]);
+    }
+    if (!Success)
+        return false;
+    Linker L(*M);
+    for (size_t I = 0; I < Parts.size(); ++I)
+    {
+        Expected<std::unique_ptr<Module>> PartM = parseBitcodeFile(
+            MemoryBufferRef(StringRef(Bitcode[I].data(), Bitcode[I].size()),
+                            Parts[I].Name),
+            *Ctx);
+        if (!PartM)
+        {
+            std::string Msg = toString(PartM.takeError());
+            if (Diags)
+                Diags->report(SMLoc(), diag::err_block_bitcode, Msg);
+            return false;
+        }
+        if (L.linkInModule(std::move(*PartM)))
+            return false;
+        M->getFunction(Parts[I].Name)->setLinkage(GlobalValue::InternalLinkage);
+    }
+    return true;
+}
@@ -0,0 +1,159 @@
+#include "llshader/CodeGen/Multiversion.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/IR/GlobalIFunc.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+using namespace llvm;
+
+namespace
+{
+struct Level
+{
+    const char *CPU;
+    const char *Suffix;
+    // Set explicitly so the version does not inherit the target machine's
+    // features, which may be the host's.
+    const char *Features;
+};
+
+const Level Levels[] = {
+    {"x86-64-v3", "avx2",
+     "+avx,+avx2,+bmi,+bmi2,+f16c,+fma,+lzcnt,+movbe,+xsave"},
+    {"x86-64-v4", "avx512",
+     "+avx,+avx2,+bmi,+bmi2,+f16c,+fma,+lzcnt,+movbe,+xsave,+avx512f,"
+     "+avx512bw,+avx512cd,+avx512dq,+avx512vl"},
+};
+
+// cpuid bits, see the Intel SDM volume 2A.
+constexpr uint32_t Leaf1EcxOSXSAVEAndAVX = 1u << 27 | 1u << 28;
+constexpr uint32_t Leaf1EcxV3 = 1u << 12 | 1u << 22 | 1u << 29; // FMA MOVBE F16C
+constexpr uint32_t Leaf7EbxV3 = 1u << 3 | 1u << 5 | 1u << 8;    // BMI AVX2 BMI2
+constexpr uint32_t Leaf7EbxV4 = 1u << 16 | 1u << 17 | 1u << 28 | 1u << 30 |
+                                1u << 31; // AVX512 F DQ CD BW VL
+constexpr uint32_t ExtLeaf1EcxLZCNT = 1u << 5;
+// XCR0: SSE and AVX state, and also the AVX-512 opmask and ZMM state.
+constexpr uint32_t XCR0V3 = 0x6;
+constexpr uint32_t XCR0V4 = 0xe6;
+
+class ResolverBuilder
+{
+    IRBuilder<> Builder;
+    IntegerType *Int32Ty;
+    InlineAsm *Cpuid;
+    InlineAsm *Xgetbv;
+
+  public:
+    ResolverBuilder(LLVMContext &Ctx)
+        : Builder(Ctx), Int32Ty(Type::getInt32Ty(Ctx))
+    {
+        Cpuid = InlineAsm::get(
+            FunctionType::get(
+                StructType::get(Int32Ty, Int32Ty, Int32Ty, Int32Ty),
+                {Int32Ty, Int32Ty}, false),
+            "cpuid", "={ax},={bx},={cx},={dx},{ax},{cx},~{dirflag},~{fpsr}",
+            false);
+        Xgetbv = InlineAsm::get(
+            FunctionType::get(StructType::get(Int32Ty, Int32Ty), {Int32Ty},
+                              false),
+            "xgetbv", "={ax},={dx},{cx},~{dirflag},~{fpsr}", false);
+    }
+
+    // Register Reg (0 eax to 3 edx) of cpuid for Leaf.
+    Value *cpuid(uint32_t Leaf, unsigned Reg)
+    {
+        Value *Regs = Builder.CreateCall(
+            Cpuid,
+            {ConstantInt::get(Int32Ty, Leaf), ConstantInt::get(Int32Ty, 0)});
+        return Builder.CreateExtractValue(Regs, Reg);
+    }
+
+    Value *hasAll(Value *Reg, uint32_t Bits)
+    {
+        return Builder.CreateICmpEQ(
+            Builder.CreateAnd(Reg, Bits), ConstantInt::get(Int32Ty, Bits));
+    }
+
+    void build(Function *Resolver, Function *Base, Function *V3, Function *V4)
+    {
+        LLVMContext &Ctx = Resolver->getContext();
+        BasicBlock *Entry = BasicBlock::Create(Ctx, "entry", Resolver);
+        BasicBlock *Check = BasicBlock::Create(Ctx, "check", Resolver);
+        BasicBlock *Baseline = BasicBlock::Create(Ctx, "baseline", Resolver);
+
+        // xgetbv faults unless the OS enabled it, so check OSXSAVE first.
+        Builder.SetInsertPoint(Entry);
+        Value *MaxLeaf = cpuid(0, 0);
+        Value *Leaf1Ecx = cpuid(1, 2);
+        Builder.CreateCondBr(
+            Builder.CreateAnd(
+                Builder.CreateICmpUGE(MaxLeaf, ConstantInt::get(Int32Ty, 7)),
+                hasAll(Leaf1Ecx, Leaf1EcxOSXSAVEAndAVX)),
+            Check, Baseline);
+
+        Builder.SetInsertPoint(Check);
+        Value *XCR0 = Builder.CreateExtractValue(
+            Builder.CreateCall(Xgetbv, {ConstantInt::get(Int32Ty, 0)}), 0);
+        Value *Leaf7Ebx = cpuid(7, 1);
+        Value *ExtLeaf1Ecx = cpuid(0x80000001, 2);
+        Value *IsV3 = Builder.CreateAnd(
+            {hasAll(XCR0, XCR0V3), hasAll(Leaf1Ecx, Leaf1EcxV3),
+             hasAll(Leaf7Ebx, Leaf7EbxV3),
+             hasAll(ExtLeaf1Ecx, ExtLeaf1EcxLZCNT)});
+        Value *IsV4 = Builder.CreateAnd(
+            {IsV3, hasAll(XCR0, XCR0V4), hasAll(Leaf7Ebx, Leaf7EbxV4)});
+        Builder.CreateRet(
+            Builder.CreateSelect(IsV4, V4, Builder.CreateSelect(IsV3, V3, Base)));
+
+        Builder.SetInsertPoint(Baseline);
+        Builder.CreateRet(Base);
+    }
+};
+} // namespace
+
+bool multiversion(Function &Entry, std::string &Error)
+{
+    Module &M = *Entry.getParent();
+    if (Triple(M.getTargetTriple()).getArch() != Triple::x86_64)
+    {
+        Error = "multiversioning needs an x86-64 target";
+        return false;
+    }
+
+    // The ifunc takes over Entry's name and uses, and Entry becomes the
+    // baseline version.
+    std::string Name = Entry.getName().str();
+    GlobalValue::LinkageTypes Linkage = Entry.getLinkage();
+    Entry.setName(Name + ".base");
+    Entry.setLinkage(GlobalValue::InternalLinkage);
+    Function *Resolver = Function::Create(
+        FunctionType::get(Entry.getType(), false),
+        GlobalValue::InternalLinkage, Name + ".resolver", M);
+    GlobalIFunc *IFunc =
+        GlobalIFunc::create(Entry.getFunctionType(), 0, Linkage, Name,
+                            Resolver, &M);
+    Entry.replaceAllUsesWith(IFunc);
+
+    Function *Versions[2];
+    for (int I = 0; I < 2; ++I)
+    {
+        ValueToValueMapTy VMap;
+        Versions[I] = CloneFunction(&Entry, VMap);
+        Versions[I]->setName(Name + "." + Levels[I].Suffix);
+        Versions[I]->addFnAttr("target-cpu", Levels[I].CPU);
+        Versions[I]->addFnAttr("target-features", Levels[I].Features);
+    }
+    ResolverBuilder(M.getContext())
+        .build(Resolver, &Entry, Versions[0], Versions[1]);
+    return true;
+}
+
+std::string getMultiversionTargets(StringRef BaseCPU)
+{
+    std::string Targets = BaseCPU.str();
+    for (const Level &L : Levels)
+        Targets += std::string(",") + L.CPU;
+    return Targets;
+}
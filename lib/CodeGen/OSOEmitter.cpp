@@ -0,0 +1,1184 @@
+#include "llshader/CodeGen/OSOEmitter.h"
+#include "llshader/AST/RecursiveASTVisitor.h"
+#include "llshader/Sema/Uniformity.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/Twine.h"
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <queue>
+
+using namespace llvm;
+
+namespace
+{
+// Symbols are listed in this order.
+enum class SymKind : uint8_t
+{
+    OParam,
+    Global,
+    Local,
+    Const,
+    Temp
+};
+
+const char *getKindName(SymKind Kind)
+{
+    switch (Kind)
+    {
+    case SymKind::OParam:
+        return "oparam";
+    case SymKind::Global:
+        return "global";
+    case SymKind::Local:
+        return "local";
+    case SymKind::Const:
+        return "const";
+    default:
+        return "temp";
+    }
+}
+
+struct Symbol
+{
+    SymKind Kind;
+    TokenKind Type;
+    std::string Name;
+    // Default of a parameter or value of a constant, as written.
+    std::string Value;
+    // A scalar constant's value, for folding conversions.
+    double Number = 0;
+};
+
+struct Instruction
+{
+    const char *Name;
+    SmallVector<uint32_t, 4> Args;
+    // How many of the leading arguments it writes; it reads the rest.
+    unsigned Written;
+    SmallVector<int, 4> Jumps;
+    // Line of the statement it belongs to; 0 if unknown.
+    unsigned Line;
+};
+
+constexpr int NoDef = -1;
+
+// A value: its symbol and type.
+struct Operand
+{
+    uint32_t Sym = 0;
+    TokenKind Ty = TokenKind::kw_void;
+    // A variable, which later code may change.
+    bool IsVar = false;
+    // Index of the instruction that wrote it into a fresh temporary.
+    int Def = NoDef;
+};
+
+bool isTriple(TokenKind Ty)
+{
+    return Ty == TokenKind::kw_color || Ty == TokenKind::kw_point ||
+           Ty == TokenKind::kw_vector || Ty == TokenKind::kw_normal;
+}
+
+bool isScalar(TokenKind Ty)
+{
+    return Ty == TokenKind::kw_int || Ty == TokenKind::kw_float;
+}
+
+// The .oso name of a type; null if variables cannot have it.
+const char *getTypeName(TokenKind Ty)
+{
+    switch (Ty)
+    {
+    case TokenKind::kw_int:
+        return "int";
+    case TokenKind::kw_float:
+        return "float";
+    case TokenKind::kw_string:
+        return "string";
+    case TokenKind::kw_color:
+        return "color";
+    case TokenKind::kw_point:
+        return "point";
+    case TokenKind::kw_vector:
+        return "vector";
+    case TokenKind::kw_normal:
+        return "normal";
+    case TokenKind::kw_matrix:
+        return "matrix";
+    default:
+        return nullptr;
+    }
+}
+
+bool isLoop(const Instruction &I)
+{
+    return I.Jumps.size() == 4;
+}
+
+// The shortest text that reads back as the same float.
+std::string formatFloat(float Value)
+{
+    char Buffer[32];
+    for (int Precision = 6; Precision < 9; ++Precision)
+    {
+        std::snprintf(Buffer, sizeof(Buffer), "%.*g", Precision, Value);
+        if (std::strtof(Buffer, nullptr) == Value)
+            return Buffer;
+    }
+    std::snprintf(Buffer, sizeof(Buffer), "%.9g", Value);
+    return Buffer;
+}
+
+// Value repeated N times, as a constant of an aggregate is written.
+std::string repeat(StringRef Value, unsigned N)
+{
+    std::string Result = Value.str();
+    for (unsigned I = 1; I < N; ++I)
+        Result += (" " + Value).str();
+    return Result;
+}
+
+class SideEffectFinder : public RecursiveASTVisitor<SideEffectFinder>
+{
+  public:
+    bool Found = false;
+
+    bool visitAssignment(Assignment &)
+    {
+        Found = true;
+        return false;
+    }
+
+    bool visitIncDec(IncDec &)
+    {
+        Found = true;
+        return false;
+    }
+};
+
+bool hasSideEffects(Expression *E)
+{
+    SideEffectFinder Finder;
+    Finder.traverseExpr(E);
+    return Finder.Found;
+}
+
+// Lowers the program to instructions over symbols with the typing rules of
+// ToIRVisitor in CodeGen.cpp. Every intermediate value gets a temporary of
+// its own; allocateTemps then folds them into as few as it can.
+class OSOLowering : public ASTVisitor
+{
+    const DiagnosticsEngine *Diags;
+    bool HasError = false;
+
+    // Value of the last expression visited; kw_void for an empty compound
+    // expression.
+    Operand V;
+    unsigned Line = 0;
+    unsigned LoopDepth = 0;
+
+    std::vector<StringMap<Operand>> Scopes;
+    // How many variables have had each name, to make the symbols' names
+    // unique.
+    StringMap<unsigned> NameUses;
+    // By type and value.
+    StringMap<uint32_t> ConstantIds;
+
+  public:
+    std::vector<Symbol> Symbols;
+    std::vector<Instruction> Code;
+
+    explicit OSOLowering(const DiagnosticsEngine *Diags) : Diags(Diags) {}
+
+    bool run(AST *Tree)
+    {
+        Scopes.emplace_back();
+        Tree->accept(*this);
+        emit("end", {}, 0);
+        if (HasError)
+            return false;
+        allocateTemps();
+        return true;
+    }
+
+    virtual void visit(Program &Node) override
+    {
+        for (Statement *S : *Node.getSL())
+            emitStmt(S);
+    }
+
+    // Statements
+
+    virtual void visit(CompoundSt &Node) override
+    {
+        for (Expression *E : *Node.getEL())
+            emitExpr(E);
+    }
+
+    virtual void visit(Scoped &Node) override
+    {
+        Scopes.emplace_back();
+        for (Statement *S : *Node.getSL())
+            emitStmt(S);
+        Scopes.pop_back();
+    }
+
+    virtual void visit(Declaration &Node) override
+    {
+        TokenKind Ty = Node.getType();
+        if (!getTypeName(Ty))
+        {
+            error("cannot declare variables of this type");
+            return;
+        }
+        bool TopLevel = Scopes.size() == 1;
+        for (DefExpr *Def : *Node.getDefs())
+        {
+            StringRef Id = Def->getId();
+            // The initializer is lowered before the name is bound, so it
+            // sees any outer variable of the same name.
+            Operand Value;
+            if (Def->getValue())
+                Value = convert(emitValue(Def->getValue()), Ty,
+                                "initialization of " + Id);
+            SymKind Kind = SymKind::Local;
+            if (TopLevel && Ty == TokenKind::kw_int)
+                Kind = SymKind::OParam;
+            else if (TopLevel && !Def->getValue() &&
+                     Ty != TokenKind::kw_string && isShaderGlobal(Id))
+                Kind = SymKind::Global;
+            Operand Var = {addSymbol(Kind, Ty, getUniqueName(Id)), Ty, true};
+            if (Kind == SymKind::OParam)
+            {
+                // A constant initializer is the parameter's default.
+                bool IsConstant = Def->getValue() && isConstant(Value);
+                Symbols[Var.Sym].Value =
+                    IsConstant ? Symbols[Value.Sym].Value : "0";
+                if (Def->getValue() && !IsConstant)
+                    store(Var, Value);
+            }
+            else if (Def->getValue())
+                store(Var, Value);
+            else if (Kind == SymKind::Local)
+                store(Var, getZero(Ty));
+            Scopes.back()[Id] = Var;
+        }
+    }
+
+    virtual void visit(Conditional &Node) override
+    {
+        size_t If = emit("if", {emitCondition(Node.getCondition()).Sym}, 0);
+        emitStmt(Node.getThen());
+        int Else = here();
+        if (Node.getElse())
+            emitStmt(Node.getElse());
+        Code[If].Jumps = {Else, here()};
+    }
+
+    virtual void visit(For &Node) override
+    {
+        Scopes.emplace_back();
+        emitLoop("for", Node.getInit(), Node.getCondition(), Node.getBody(),
+                 Node.getUpdate());
+        Scopes.pop_back();
+    }
+
+    virtual void visit(While &Node) override
+    {
+        emitLoop("while", nullptr, Node.getCondition(), Node.getBody(),
+                 nullptr);
+    }
+
+    virtual void visit(DoWhile &Node) override
+    {
+        emitLoop("dowhile", nullptr, Node.getCondition(), Node.getBody(),
+                 nullptr);
+    }
+
+    virtual void visit(LoopMod &Node) override
+    {
+        bool IsBreak = Node.getMod() == TokenKind::kw_break;
+        if (!LoopDepth)
+        {
+            error(IsBreak ? "break outside of a loop"
+                          : "continue outside of a loop");
+            return;
+        }
+        emit(IsBreak ? "break" : "continue", {}, 0);
+    }
+
+    // Expressions
+
+    virtual void visit(Literal &Node) override
+    {
+        switch (Node.getKind())
+        {
+        case Literal::Integer:
+            V = getInt(Node.getInt());
+            break;
+        case Literal::FloatingPoint:
+            V = getFloat(Node.getFloat());
+            break;
+        case Literal::String:
+            V = getConstant(TokenKind::kw_string,
+                            ("\"" + Node.getValue() + "\"").str());
+            break;
+        }
+    }
+
+    virtual void visit(TypeConstructor &Node) override
+    {
+        TokenKind Ty = Node.getType();
+        ExprList &Values = *Node.getValues();
+        unsigned Components = isTriple(Ty)                  ? 3
+                              : Ty == TokenKind::kw_matrix ? 16
+                                                           : 1;
+        if (!getTypeName(Ty) ||
+            (Values.size() != 1 && Values.size() != Components))
+        {
+            error("wrong number of values in type constructor");
+            V = getZero(getTypeName(Ty) ? Ty : TokenKind::kw_int);
+            return;
+        }
+        if (Values.size() == 1)
+        {
+            V = convert(emitValue(Values[0]), Ty, "type constructor");
+            return;
+        }
+        SmallVector<uint32_t, 16> Args;
+        bool AllConstant = true;
+        for (unsigned I = 0; I < Components; ++I)
+        {
+            Operand E = convert(emitValue(Values[I]), TokenKind::kw_float,
+                                "type constructor");
+            if (std::any_of(Values.begin() + I + 1, Values.end(),
+                            hasSideEffects))
+                E = materialize(E);
+            Args.push_back(E.Sym);
+            AllConstant &= isConstant(E);
+        }
+        // Constructors of constants are constants.
+        if (AllConstant)
+        {
+            std::string Value;
+            for (uint32_t Arg : Args)
+                Value += (Value.empty() ? "" : " ") + Symbols[Arg].Value;
+            V = getConstant(Ty, Value);
+            return;
+        }
+        V = produce(getTypeName(Ty), Ty, Args);
+    }
+
+    virtual void visit(BinaryExpression &Node) override
+    {
+        StringRef Op = Node.getOp();
+        if (Op == "&&" || Op == "||")
+        {
+            V = emitLogical(Node);
+            return;
+        }
+        Operand LHS = emitValue(Node.getE1());
+        if (hasSideEffects(Node.getE2()))
+            LHS = materialize(LHS);
+        Operand RHS = emitValue(Node.getE2());
+        V = emitBinary(Op, LHS, RHS);
+    }
+
+    virtual void visit(UnaryExpression &Node) override
+    {
+        Operand E = emitValue(Node.getE());
+        if (Node.getOp() == "!")
+        {
+            if (!isScalar(E.Ty))
+            {
+                error("condition must be an int or a float");
+                V = getInt(0);
+                return;
+            }
+            V = produce("eq", TokenKind::kw_int, {E.Sym, getZero(E.Ty).Sym});
+            return;
+        }
+        if (E.Ty != TokenKind::kw_int)
+        {
+            error("operand of ~ must be an int");
+            V = getInt(0);
+            return;
+        }
+        V = produce("compl", TokenKind::kw_int, {E.Sym});
+    }
+
+    virtual void visit(Assignment &Node) override
+    {
+        LValue *LV = Node.getId();
+        const Operand *Var = lookup(LV->getId());
+        if (!Var)
+        {
+            V = getInt(0);
+            return;
+        }
+
+        SmallVector<Operand, 2> Idx;
+        TokenKind Ty = Var->Ty;
+        if (ExprList *Indices = LV->getIndices())
+        {
+            for (Expression *E : *Indices)
+                Idx.push_back(
+                    convert(emitValue(E), TokenKind::kw_int, "subscript"));
+            if (!(isTriple(Var->Ty) && Idx.size() == 1) &&
+                !(Var->Ty == TokenKind::kw_matrix && Idx.size() == 2))
+            {
+                error("invalid subscript of " + LV->getId());
+                V = getInt(0);
+                return;
+            }
+            for (Operand &I : Idx)
+            {
+                I = clampIndex(I, isTriple(Var->Ty) ? 3 : 4);
+                if (hasSideEffects(Node.getValue()))
+                    I = materialize(I);
+            }
+            Ty = TokenKind::kw_float;
+        }
+
+        Operand New = emitValue(Node.getValue());
+        StringRef Op = Node.getOp();
+        if (Op != "=")
+        {
+            Operand Old = Idx.empty() ? *Var : emitComponent(*Var, Idx);
+            New = emitBinary(Op.drop_back(), Old, New);
+        }
+        New = convert(New, Ty, "assignment to " + LV->getId());
+        if (!Idx.empty())
+        {
+            emitComponentStore(*Var, Idx, New);
+            V = New;
+        }
+        else
+            V = store(*Var, New);
+    }
+
+    virtual void visit(VariableRef &Node) override
+    {
+        const Operand *Var = lookup(Node.getId());
+        if (!Var)
+        {
+            V = getInt(0);
+            return;
+        }
+        V = *Var;
+        if (Node.getDeref())
+        {
+            SmallVector<Operand, 2> Idx =
+                emitIndex(*Var, Node.getDeref(), Node.getId());
+            V = Idx.empty() ? getFloat(0) : emitComponent(*Var, Idx);
+        }
+    }
+
+    virtual void visit(IncDec &Node) override
+    {
+        VariableRef *Ref = Node.getId();
+        const Operand *Var = lookup(Ref->getId());
+        if (!Var)
+        {
+            V = getInt(0);
+            return;
+        }
+        Operand One = getInt(1);
+        StringRef Op = Node.getOp() == "++" ? "+" : "-";
+        if (!Ref->getDeref())
+        {
+            V = store(*Var, emitBinary(Op, *Var, One));
+            return;
+        }
+        SmallVector<Operand, 2> Idx =
+            emitIndex(*Var, Ref->getDeref(), Ref->getId());
+        if (Idx.empty())
+        {
+            V = *Var;
+            return;
+        }
+        Operand New = emitBinary(Op, emitComponent(*Var, Idx), One);
+        emitComponentStore(*Var, Idx, New);
+        V = New;
+    }
+
+    virtual void visit(TypeCast &Node) override
+    {
+        Operand E = emitValue(Node.getE());
+        if (!getTypeName(Node.getType()))
+        {
+            error("invalid cast");
+            V = E;
+            return;
+        }
+        V = convert(E, Node.getType(), "cast");
+    }
+
+    virtual void visit(Derivative &Node) override
+    {
+        Operand E = emitValue(Node.getE());
+        if (E.Ty == TokenKind::kw_int)
+            E = convert(E, TokenKind::kw_float, Node.getName());
+        if (E.Ty != TokenKind::kw_float && !isTriple(E.Ty))
+        {
+            error("operand of " + Node.getName() +
+                  " must be a float or a triple");
+            V = getFloat(0);
+            return;
+        }
+        V = produce(Node.getAxis() == Derivative::X ? "Dx" : "Dy", E.Ty,
+                    {E.Sym});
+    }
+
+    virtual void visit(CompoundEx &Node) override
+    {
+        Operand Last;
+        for (Expression *E : *Node.getEL())
+            Last = emitExpr(E);
+        V = Last;
+    }
+
+  private:
+    void error(const Twine &Msg)
+    {
+        errs() << "Error: " << Msg << "\n";
+        HasError = true;
+    }
+
+    // Symbols and code
+
+    int here() const { return static_cast<int>(Code.size()); }
+
+    size_t emit(const char *Name, ArrayRef<uint32_t> Args, unsigned Written)
+    {
+        Code.push_back({Name, SmallVector<uint32_t, 4>(Args.begin(),
+                                                       Args.end()),
+                        Written, {}, Line});
+        return Code.size() - 1;
+    }
+
+    uint32_t addSymbol(SymKind Kind, TokenKind Ty, std::string Name)
+    {
+        Symbols.push_back({Kind, Ty, std::move(Name), ""});
+        return static_cast<uint32_t>(Symbols.size() - 1);
+    }
+
+    // Id, or Id mangled like oslc's if another variable had it.
+    std::string getUniqueName(StringRef Id)
+    {
+        unsigned Uses = NameUses[Id]++;
+        if (!Uses)
+            return Id.str();
+        return ("___" + Twine(Uses) + "_" + Id).str();
+    }
+
+    // Emits Name writing a new temporary of type Ty.
+    Operand produce(const char *Name, TokenKind Ty, ArrayRef<uint32_t> Args)
+    {
+        Operand Result = {addSymbol(SymKind::Temp, Ty, ""), Ty};
+        SmallVector<uint32_t, 4> All = {Result.Sym};
+        All.append(Args.begin(), Args.end());
+        Result.Def = static_cast<int>(emit(Name, All, 1));
+        return Result;
+    }
+
+    // Copies a variable's value, so code lowered after it cannot change it.
+    Operand materialize(Operand E)
+    {
+        if (!E.IsVar)
+            return E;
+        return produce("assign", E.Ty, {E.Sym});
+    }
+
+    // Stores Val in Var. If the last instruction computed Val, it writes
+    // Var directly instead, and Val's temporary goes unused.
+    Operand store(const Operand &Var, Operand Val)
+    {
+        if (Val.Def != NoDef && Val.Def == here() - 1 && Val.Ty == Var.Ty &&
+            Code.back().Args[0] == Val.Sym)
+            Code.back().Args[0] = Var.Sym;
+        else if (Val.Sym != Var.Sym)
+            emit("assign", {Var.Sym, Val.Sym}, 1);
+        return Var;
+    }
+
+    Operand getConstant(TokenKind Ty, const std::string &Value,
+                        double Number = 0)
+    {
+        auto Inserted = ConstantIds.try_emplace(
+            (Twine(getTypeName(Ty)) + " " + Value).str(),
+            static_cast<uint32_t>(Symbols.size()));
+        if (Inserted.second)
+        {
+            addSymbol(SymKind::Const, Ty, "");
+            Symbols.back().Value = Value;
+            Symbols.back().Number = Number;
+        }
+        return {Inserted.first->second, Ty};
+    }
+
+    Operand getInt(int32_t Value)
+    {
+        return getConstant(TokenKind::kw_int, std::to_string(Value), Value);
+    }
+
+    Operand getFloat(float Value)
+    {
+        return getConstant(TokenKind::kw_float, formatFloat(Value), Value);
+    }
+
+    bool isConstant(const Operand &E) const
+    {
+        return Symbols[E.Sym].Kind == SymKind::Const;
+    }
+
+    // A zero of type Ty, which is also what variables start at.
+    Operand getZero(TokenKind Ty)
+    {
+        switch (Ty)
+        {
+        case TokenKind::kw_int:
+            return getInt(0);
+        case TokenKind::kw_string:
+            return getConstant(Ty, "\"\"");
+        case TokenKind::kw_matrix:
+            return getConstant(Ty, repeat("0", 16));
+        default:
+            if (isTriple(Ty))
+                return getConstant(Ty, repeat("0", 3));
+            return getFloat(0);
+        }
+    }
+
+    const Operand *lookup(StringRef Id)
+    {
+        for (auto I = Scopes.rbegin(), E = Scopes.rend(); I != E; ++I)
+        {
+            auto It = I->find(Id);
+            if (It != I->end())
+                return &It->second;
+        }
+        error("use of undeclared variable " + Id);
+        return nullptr;
+    }
+
+    // Lowering helpers
+
+    void emitStmt(Statement *S)
+    {
+        if (Diags)
+        {
+            // A statement that cannot be located keeps the previous line.
+            if (unsigned L = Diags->getLineAndColumn(S->getLocation()).first)
+                Line = L;
+        }
+        S->accept(*this);
+    }
+
+    Operand emitExpr(Expression *E)
+    {
+        V = Operand();
+        E->accept(*this);
+        return V;
+    }
+
+    Operand emitValue(Expression *E)
+    {
+        Operand Val = emitExpr(E);
+        if (Val.Ty != TokenKind::kw_void)
+            return Val;
+        error("expression has no value");
+        return getInt(0);
+    }
+
+    // An int that is nonzero if Cond is true, as if and the loops test.
+    Operand emitCondition(Expression *Cond)
+    {
+        Operand Val = emitValue(Cond);
+        if (Val.Ty == TokenKind::kw_int)
+            return Val;
+        if (Val.Ty == TokenKind::kw_float)
+            return produce("neq", TokenKind::kw_int,
+                           {Val.Sym, getFloat(0).Sym});
+        error("condition must be an int or a float");
+        return getInt(0);
+    }
+
+    // A loop instruction reads its condition and is followed by the code
+    // of Init, Cond, Body and Update, which it jumps between. A loop
+    // without a condition tests the constant 1.
+    void emitLoop(const char *Name, Declaration *Init, Expression *Cond,
+                  Statement *Body, CompoundEx *Update)
+    {
+        size_t Loop = emit(Name, {}, 0);
+        unsigned LoopLine = Line;
+        if (Init)
+            Init->accept(*this);
+        int CondStart = here();
+        uint32_t CondSym = (Cond ? emitCondition(Cond) : getInt(1)).Sym;
+        Code[Loop].Args.push_back(CondSym);
+        int BodyStart = here();
+        ++LoopDepth;
+        emitStmt(Body);
+        --LoopDepth;
+        int UpdateStart = here();
+        Line = LoopLine;
+        if (Update)
+            emitExpr(Update);
+        Code[Loop].Jumps = {CondStart, BodyStart, UpdateStart, here()};
+    }
+
+    // The subscripts of Agg by E, which are a triple's component or the
+    // row and column of a matrix's element in row-major order; none if Agg
+    // is not an aggregate.
+    SmallVector<Operand, 2> emitIndex(const Operand &Agg, Expression *E,
+                                      StringRef Id)
+    {
+        if (!isTriple(Agg.Ty) && Agg.Ty != TokenKind::kw_matrix)
+        {
+            error("subscript of non-aggregate variable " + Id);
+            return {};
+        }
+        Operand Index = convert(emitValue(E), TokenKind::kw_int, "subscript");
+        if (isTriple(Agg.Ty))
+            return {clampIndex(Index, 3)};
+        Index = clampIndex(Index, 16);
+        if (isConstant(Index))
+        {
+            int32_t Flat = static_cast<int32_t>(Symbols[Index.Sym].Number);
+            return {getInt(Flat / 4), getInt(Flat % 4)};
+        }
+        return {produce("shr", TokenKind::kw_int, {Index.Sym, getInt(2).Sym}),
+                produce("bitand", TokenKind::kw_int,
+                        {Index.Sym, getInt(3).Sym})};
+    }
+
+    // compref and mxcompref clamp their subscripts themselves, so only
+    // constants are clamped here, and a flat subscript of a matrix before
+    // it is split.
+    Operand clampIndex(Operand Index, unsigned Size)
+    {
+        if (isConstant(Index))
+            return getInt(std::min(
+                std::max(static_cast<int32_t>(Symbols[Index.Sym].Number), 0),
+                int32_t(Size) - 1));
+        if (Size <= 4)
+            return Index;
+        return produce("clamp", TokenKind::kw_int,
+                       {Index.Sym, getInt(0).Sym, getInt(Size - 1).Sym});
+    }
+
+    Operand emitComponent(const Operand &Agg, ArrayRef<Operand> Idx)
+    {
+        if (Idx.size() == 1)
+            return produce("compref", TokenKind::kw_float,
+                           {Agg.Sym, Idx[0].Sym});
+        return produce("mxcompref", TokenKind::kw_float,
+                       {Agg.Sym, Idx[0].Sym, Idx[1].Sym});
+    }
+
+    void emitComponentStore(const Operand &Agg, ArrayRef<Operand> Idx,
+                            const Operand &Val)
+    {
+        if (Idx.size() == 1)
+            emit("compassign", {Agg.Sym, Idx[0].Sym, Val.Sym}, 1);
+        else
+            emit("mxcompassign", {Agg.Sym, Idx[0].Sym, Idx[1].Sym, Val.Sym},
+                 1);
+    }
+
+    Operand convert(Operand Val, TokenKind To, const Twine &Context)
+    {
+        TokenKind From = Val.Ty;
+        if (From == To)
+            return Val;
+        if (isScalar(From) && (To == TokenKind::kw_float || isTriple(To) ||
+                               To == TokenKind::kw_matrix))
+        {
+            if (From == TokenKind::kw_int && isConstant(Val))
+                Val = getFloat(static_cast<float>(Symbols[Val.Sym].Number));
+            else if (From == TokenKind::kw_int)
+                Val = produce("assign", TokenKind::kw_float, {Val.Sym});
+            if (To == TokenKind::kw_float)
+                return Val;
+            if (!isConstant(Val))
+                return produce("assign", To, {Val.Sym});
+            // A scalar converts to a matrix with it on the diagonal.
+            const std::string &F = Symbols[Val.Sym].Value;
+            if (isTriple(To))
+                return getConstant(To, repeat(F, 3));
+            std::string Diagonal;
+            for (unsigned I = 0; I < 16; ++I)
+                Diagonal += (I ? " " : "") + (I % 5 ? "0" : F);
+            return getConstant(To, Diagonal);
+        }
+        if ((From == TokenKind::kw_float && To == TokenKind::kw_int) ||
+            (isTriple(From) && isTriple(To)))
+            return produce("assign", To, {Val.Sym});
+        error("cannot convert " + Twine(getTypeName(From)) + " to " +
+              getTypeName(To) + " in " + Context);
+        return getZero(To);
+    }
+
+    // A matrix with Val, a scalar, in every element.
+    Operand splat(Operand Val, StringRef Op)
+    {
+        Val = convert(Val, TokenKind::kw_float, Op);
+        if (isConstant(Val))
+            return getConstant(TokenKind::kw_matrix,
+                               repeat(Symbols[Val.Sym].Value, 16));
+        return produce("matrix", TokenKind::kw_matrix,
+                       SmallVector<uint32_t, 16>(16, Val.Sym));
+    }
+
+    // && and || short-circuit through an if, whose then-code runs when
+    // the result so far is true and whose else-code when it is false.
+    Operand emitLogical(BinaryExpression &Node)
+    {
+        bool IsOr = Node.getOp() == "||";
+        Operand Result = {addSymbol(SymKind::Temp, TokenKind::kw_int, ""),
+                          TokenKind::kw_int};
+        emitTruth(Result, emitValue(Node.getE1()));
+        size_t If = emit("if", {Result.Sym}, 0);
+        int Start = here();
+        emitTruth(Result, emitValue(Node.getE2()));
+        Code[If].Jumps = {IsOr ? Start : here(), here()};
+        return Result;
+    }
+
+    void emitTruth(const Operand &Dest, const Operand &Val)
+    {
+        if (!isScalar(Val.Ty))
+        {
+            error("condition must be an int or a float");
+            return;
+        }
+        emit("neq", {Dest.Sym, Val.Sym, getZero(Val.Ty).Sym}, 1);
+    }
+
+    Operand emitBinary(StringRef Op, Operand LHS, Operand RHS)
+    {
+        TokenKind LTy = LHS.Ty;
+        TokenKind RTy = RHS.Ty;
+
+        if (LTy == TokenKind::kw_string || RTy == TokenKind::kw_string)
+        {
+            if (LTy != RTy || (Op != "==" && Op != "!="))
+            {
+                error("invalid string operands to " + Op);
+                return getInt(0);
+            }
+            return produce(Op == "==" ? "eq" : "neq", TokenKind::kw_int,
+                           {LHS.Sym, RHS.Sym});
+        }
+
+        if (Op == "<" || Op == ">" || Op == "<=" || Op == ">=" || Op == "==" ||
+            Op == "!=")
+            return emitComparison(Op, LHS, RHS);
+
+        if (Op == "&" || Op == "|" || Op == "^" || Op == "<<" || Op == ">>")
+        {
+            if (LTy != TokenKind::kw_int || RTy != TokenKind::kw_int)
+            {
+                error("operands of " + Op + " must be ints");
+                return getInt(0);
+            }
+            const char *IntOp = Op == "&"    ? "bitand"
+                                : Op == "|"  ? "bitor"
+                                : Op == "^"  ? "xor"
+                                : Op == "<<" ? "shl"
+                                             : "shr";
+            return produce(IntOp, TokenKind::kw_int, {LHS.Sym, RHS.Sym});
+        }
+
+        const char *Name = Op == "+"   ? "add"
+                           : Op == "-" ? "sub"
+                           : Op == "*" ? "mul"
+                           : Op == "/" ? "div"
+                                       : "mod";
+        bool LMatrix = LTy == TokenKind::kw_matrix;
+        bool RMatrix = RTy == TokenKind::kw_matrix;
+        if (LMatrix && RMatrix && Op == "*")
+            return produce("mul", LTy, {LHS.Sym, RHS.Sym});
+        if ((LMatrix || RMatrix) &&
+            (isTriple(LTy) || isTriple(RTy) ||
+             (LTy == RTy && (Op == "/" || Op == "%"))))
+        {
+            error("invalid matrix operands to " + Op);
+            return getZero(TokenKind::kw_matrix);
+        }
+        if (LMatrix || RMatrix)
+        {
+            // Matrices combine with scalars element by element. mul and
+            // div scale a matrix by a float, and add and sub take two
+            // matrices; OSL has no other element-wise matrix operations.
+            if (Op == "*" || (Op == "/" && LMatrix))
+            {
+                LHS = LMatrix ? LHS : convert(LHS, TokenKind::kw_float, Op);
+                RHS = RMatrix ? RHS : convert(RHS, TokenKind::kw_float, Op);
+                return produce(Name, TokenKind::kw_matrix, {LHS.Sym, RHS.Sym});
+            }
+            if (Op == "+" || Op == "-")
+            {
+                LHS = LMatrix ? LHS : splat(LHS, Op);
+                RHS = RMatrix ? RHS : splat(RHS, Op);
+                return produce(Name, TokenKind::kw_matrix, {LHS.Sym, RHS.Sym});
+            }
+            error("matrix operands to " + Op + " cannot be written as .oso");
+            return getZero(TokenKind::kw_matrix);
+        }
+
+        TokenKind Ty = TokenKind::kw_int;
+        if (isTriple(LTy))
+            Ty = LTy;
+        else if (isTriple(RTy))
+            Ty = RTy;
+        else if (LTy == TokenKind::kw_float || RTy == TokenKind::kw_float)
+            Ty = TokenKind::kw_float;
+        LHS = convert(LHS, Ty, Op);
+        RHS = convert(RHS, Ty, Op);
+        return produce(Name, Ty, {LHS.Sym, RHS.Sym});
+    }
+
+    Operand emitComparison(StringRef Op, Operand LHS, Operand RHS)
+    {
+        const char *Name = Op == "<"    ? "lt"
+                           : Op == ">"  ? "gt"
+                           : Op == "<=" ? "le"
+                           : Op == ">=" ? "ge"
+                           : Op == "==" ? "eq"
+                                        : "neq";
+        TokenKind LTy = LHS.Ty;
+        TokenKind RTy = RHS.Ty;
+        if (LTy == TokenKind::kw_int && RTy == TokenKind::kw_int)
+            return produce(Name, TokenKind::kw_int, {LHS.Sym, RHS.Sym});
+        if (!isScalar(LTy) || !isScalar(RTy))
+        {
+            // Triples and matrices are only equal or not.
+            if (Op != "==" && Op != "!=")
+            {
+                error("invalid operands to " + Op);
+                return getInt(0);
+            }
+            TokenKind Ty = LTy == TokenKind::kw_matrix ||
+                                   RTy == TokenKind::kw_matrix
+                               ? TokenKind::kw_matrix
+                           : isTriple(LTy) ? LTy
+                                           : RTy;
+            LHS = convert(LHS, Ty, Op);
+            RHS = convert(RHS, Ty, Op);
+            return produce(Name, TokenKind::kw_int, {LHS.Sym, RHS.Sym});
+        }
+        LHS = convert(LHS, TokenKind::kw_float, Op);
+        RHS = convert(RHS, TokenKind::kw_float, Op);
+        return produce(Name, TokenKind::kw_int, {LHS.Sym, RHS.Sym});
+    }
+
+    // Temporaries
+
+    // Gives temporaries whose lifetimes do not overlap the same symbol, so
+    // a shader has about as many $tmpN as values live at once rather than
+    // one per intermediate value. Unused temporaries and constants are
+    // dropped and the symbols sorted and named.
+    void allocateTemps()
+    {
+        // A temporary lives from the first instruction that uses it to the
+        // last. Temporaries belong to one expression, so no lifetime
+        // crosses into or out of a loop's code, except that the loop
+        // instruction reads its condition after the condition's code runs
+        // on each iteration.
+        size_t N = Symbols.size();
+        std::vector<int> Start(N, INT_MAX), End(N, -1);
+        for (int I = 0, E = here(); I != E; ++I)
+        {
+            const Instruction &Inst = Code[I];
+            int At = isLoop(Inst) ? Inst.Jumps[1] - 1 : I;
+            for (uint32_t Arg : Inst.Args)
+            {
+                Start[Arg] = std::min(Start[Arg], At);
+                End[Arg] = std::max(End[Arg], At);
+            }
+        }
+
+        std::vector<uint32_t> Temps;
+        for (uint32_t S = 0; S != N; ++S)
+            if (Symbols[S].Kind == SymKind::Temp && End[S] >= 0)
+                Temps.push_back(S);
+        std::stable_sort(Temps.begin(), Temps.end(),
+                         [&](uint32_t A, uint32_t B)
+                         { return Start[A] < Start[B]; });
+
+        // Linear scan: a temporary takes a free one of its type whose
+        // lifetime ended before it starts, or becomes a new one.
+        std::vector<uint32_t> Target(N);
+        for (uint32_t S = 0; S != N; ++S)
+            Target[S] = S;
+        using Live = std::pair<int, uint32_t>;
+        std::priority_queue<Live, std::vector<Live>, std::greater<Live>>
+            Active;
+        std::map<TokenKind, std::vector<uint32_t>> Free;
+        for (uint32_t T : Temps)
+        {
+            while (!Active.empty() && Active.top().first < Start[T])
+            {
+                uint32_t Done = Active.top().second;
+                Free[Symbols[Done].Type].push_back(Done);
+                Active.pop();
+            }
+            std::vector<uint32_t> &Pool = Free[Symbols[T].Type];
+            if (!Pool.empty())
+            {
+                Target[T] = Pool.back();
+                Pool.pop_back();
+            }
+            Active.push({End[T], Target[T]});
+        }
+
+        // Keep variables, used constants and the temporaries others were
+        // folded into, and number them in listing order.
+        std::vector<uint32_t> Kept;
+        for (uint32_t S = 0; S != N; ++S)
+            if ((Symbols[S].Kind != SymKind::Temp &&
+                 Symbols[S].Kind != SymKind::Const) ||
+                (End[S] >= 0 && Target[S] == S))
+                Kept.push_back(S);
+        std::stable_sort(Kept.begin(), Kept.end(),
+                         [&](uint32_t A, uint32_t B)
+                         { return Symbols[A].Kind < Symbols[B].Kind; });
+        std::vector<uint32_t> NewIndex(N);
+        std::vector<Symbol> Sorted;
+        unsigned NumConsts = 0, NumTemps = 0;
+        for (uint32_t S : Kept)
+        {
+            NewIndex[S] = static_cast<uint32_t>(Sorted.size());
+            Sorted.push_back(std::move(Symbols[S]));
+            Symbol &Sym = Sorted.back();
+            if (Sym.Kind == SymKind::Const)
+                Sym.Name = "$const" + std::to_string(++NumConsts);
+            else if (Sym.Kind == SymKind::Temp)
+                Sym.Name = "$tmp" + std::to_string(++NumTemps);
+        }
+        for (Instruction &Inst : Code)
+            for (uint32_t &Arg : Inst.Args)
+                Arg = NewIndex[Target[Arg]];
+        Symbols = std::move(Sorted);
+    }
+};
+
+// Writes the lowered shader as .oso text, one line at a time.
+class OSOWriter
+{
+    raw_ostream &OS;
+    const std::vector<Symbol> &Symbols;
+    const std::vector<Instruction> &Code;
+
+  public:
+    OSOWriter(raw_ostream &OS, const OSOLowering &Lowering)
+        : OS(OS), Symbols(Lowering.Symbols), Code(Lowering.Code)
+    {
+    }
+
+    void write(StringRef ShaderName, StringRef FileName)
+    {
+        OS << "OpenShadingLanguage 1.00\n"
+           << "# Compiled by llshader\n"
+           << "shader " << ShaderName << "\n";
+        writeSymbols();
+        OS << "code ___main___\n";
+        unsigned Line = 0;
+        bool NamedFile = false;
+        for (const Instruction &Inst : Code)
+        {
+            OS << "\t" << Inst.Name;
+            if (!Inst.Args.empty())
+            {
+                OS << "\t";
+                for (uint32_t Arg : Inst.Args)
+                    OS << Symbols[Arg].Name << " ";
+                for (int Target : Inst.Jumps)
+                    OS << Target << " ";
+            }
+
+            // Hints: where the instruction came from, when that changes,
+            // and which arguments it reads and writes.
+            const char *Separator = "\t";
+            if (Inst.Line && Inst.Line != Line)
+            {
+                OS << Separator;
+                if (!NamedFile && !FileName.empty())
+                {
+                    OS << "%filename{\"" << FileName << "\"} ";
+                    NamedFile = true;
+                }
+                OS << "%line{" << Inst.Line << "}";
+                Line = Inst.Line;
+                Separator = " ";
+            }
+            if (!Inst.Args.empty())
+            {
+                OS << Separator << "%argrw{\"";
+                for (size_t I = 0, E = Inst.Args.size(); I != E; ++I)
+                    OS << (I < Inst.Written ? 'w' : 'r');
+                OS << "\"}";
+            }
+            OS << "\n";
+        }
+    }
+
+  private:
+    // Each symbol with the first and last instruction that reads and that
+    // writes it, or INT_MAX,-1 for none.
+    void writeSymbols()
+    {
+        size_t N = Symbols.size();
+        std::vector<int> FirstRead(N, INT_MAX), LastRead(N, -1),
+            FirstWrite(N, INT_MAX), LastWrite(N, -1);
+        for (int I = 0, E = static_cast<int>(Code.size()); I != E; ++I)
+        {
+            const Instruction &Inst = Code[I];
+            for (size_t A = 0, AE = Inst.Args.size(); A != AE; ++A)
+            {
+                uint32_t S = Inst.Args[A];
+                if (A < Inst.Written)
+                {
+                    FirstWrite[S] = std::min(FirstWrite[S], I);
+                    LastWrite[S] = std::max(LastWrite[S], I);
+                }
+                else
+                {
+                    FirstRead[S] = std::min(FirstRead[S], I);
+                    LastRead[S] = std::max(LastRead[S], I);
+                }
+            }
+        }
+
+        for (size_t S = 0; S != N; ++S)
+        {
+            const Symbol &Sym = Symbols[S];
+            OS << getKindName(Sym.Kind) << "\t" << getTypeName(Sym.Type)
+               << "\t" << Sym.Name;
+            if (!Sym.Value.empty())
+                OS << "\t" << Sym.Value << "\t";
+            OS << "\t%read{" << FirstRead[S] << "," << LastRead[S]
+               << "} %write{" << FirstWrite[S] << "," << LastWrite[S]
+               << "}\n";
+        }
+    }
+};
+} // namespace
+
+bool OSOEmitter::emit(AST *Tree, raw_ostream &OS)
+{
+    if (!Tree)
+        return false;
+    OSOLowering Lowering(Diags);
+    if (!Lowering.run(Tree))
+        return false;
+    OSOWriter(OS, Lowering).write(ShaderName, FileName);
+    return true;
+}
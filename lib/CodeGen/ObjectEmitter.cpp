@@ -0,0 +1,118 @@
+#include "llshader/CodeGen/ObjectEmitter.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/MC/SubtargetFeature.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+std::unique_ptr<ObjectEmitter> ObjectEmitter::create(StringRef CPU,
+                                                     unsigned OptLevel,
+                                                     std::string &Error)
+{
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+    // For the inline assembly of multiversion's resolvers.
+    InitializeNativeTargetAsmParser();
+
+    std::string Triple = sys::getProcessTriple();
+    const Target *T = TargetRegistry::lookupTarget(Triple, Error);
+    if (!T)
+        return nullptr;
+
+    std::string CPUName = CPU.str();
+    SubtargetFeatures Features;
+    if (CPU == "native")
+    {
+        CPUName = sys::getHostCPUName().str();
+        StringMap<bool> HostFeatures;
+        if (sys::getHostCPUFeatures(HostFeatures))
+            for (auto &Feature : HostFeatures)
+                Features.AddFeature(Feature.first(), Feature.second);
+    }
+    else
+    {
+        std::unique_ptr<MCSubtargetInfo> STI(
+            T->createMCSubtargetInfo(Triple, "", ""));
+        if (!STI->isCPUStringValid(CPUName))
+        {
+            Error = "unknown CPU '" + CPUName + "' for " + Triple;
+            return nullptr;
+        }
+    }
+
+    CodeGenOpt::Level Level = OptLevel == 0   ? CodeGenOpt::None
+                              : OptLevel == 1 ? CodeGenOpt::Less
+                              : OptLevel == 2 ? CodeGenOpt::Default
+                                              : CodeGenOpt::Aggressive;
+    std::unique_ptr<TargetMachine> TM(
+        T->createTargetMachine(Triple, CPUName, Features.getString(),
+                               TargetOptions(), Reloc::PIC_, None, Level));
+    if (!TM)
+    {
+        Error = "cannot create a target machine for " + Triple;
+        return nullptr;
+    }
+    return std::unique_ptr<ObjectEmitter>(new ObjectEmitter(std::move(TM)));
+}
+
+void ObjectEmitter::configure(Module &M) const
+{
+    M.setTargetTriple(TM->getTargetTriple().str());
+    M.setDataLayout(TM->createDataLayout());
+}
+
+bool ObjectEmitter::emit(Module &M, StringRef FileName,
+                         std::string &Error) const
+{
+    std::error_code EC;
+    raw_fd_ostream Out(FileName, EC, sys::fs::OF_None);
+    if (EC)
+    {
+        Error = "cannot write " + FileName.str() + ": " + EC.message();
+        return false;
+    }
+    return emit(M, Out, Error);
+}
+
+bool ObjectEmitter::emit(Module &M, SmallVectorImpl<char> &Object,
+                         std::string &Error) const
+{
+    raw_svector_ostream Out(Object);
+    return emit(M, Out, Error);
+}
+
+bool ObjectEmitter::emit(Module &M, raw_pwrite_stream &Out,
+                         std::string &Error) const
+{
+    legacy::PassManager PM;
+    if (TM->addPassesToEmitFile(PM, Out, nullptr, CGFT_ObjectFile))
+    {
+        Error = "the target cannot emit object files";
+        return false;
+    }
+    PM.run(M);
+    return true;
+}
+
+bool linkSharedLibrary(ArrayRef<std::string> Objects, StringRef FileName,
+                       std::string &Error)
+{
+    ErrorOr<std::string> Linker = sys::findProgramByName("cc");
+    if (!Linker)
+    {
+        Error = "cannot find the system compiler 'cc' to link with";
+        return false;
+    }
+    std::vector<StringRef> Args = {*Linker, "-shared", "-o", FileName};
+    Args.insert(Args.end(), Objects.begin(), Objects.end());
+    int Result = sys::ExecuteAndWait(*Linker, Args, None, {}, 0, 0, &Error);
+    if (Result != 0 && Error.empty())
+        Error = "linking " + FileName.str() + " failed";
+    return Result == 0;
+}
@@ -0,0 +1,59 @@
+#include "llshader/CodeGen/Optimizer.h"
+#include "llvm/Passes/PassBuilder.h"
+
+struct ModuleOptimizer::Pipeline
+{
+    unsigned OptLevel;
+    llvm::LoopAnalysisManager LAM;
+    llvm::FunctionAnalysisManager FAM;
+    llvm::CGSCCAnalysisManager CGAM;
+    llvm::ModuleAnalysisManager MAM;
+    llvm::PassBuilder PB;
+    llvm::ModulePassManager MPM;
+};
+
+ModuleOptimizer::ModuleOptimizer(unsigned OptLevel) : P(new Pipeline())
+{
+    P->OptLevel = OptLevel;
+    llvm::PassBuilder &PB = P->PB;
+    PB.registerModuleAnalyses(P->MAM);
+    PB.registerCGSCCAnalyses(P->CGAM);
+    PB.registerFunctionAnalyses(P->FAM);
+    PB.registerLoopAnalyses(P->LAM);
+    PB.crossRegisterProxies(P->LAM, P->FAM, P->CGAM, P->MAM);
+
+    switch (OptLevel)
+    {
+    case 0:
+        P->MPM = PB.buildO0DefaultPipeline(llvm::OptimizationLevel::O0);
+        break;
+    case 1:
+        P->MPM = PB.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O1);
+        break;
+    case 2:
+        P->MPM = PB.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O2);
+        break;
+    default:
+        P->MPM = PB.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O3);
+        break;
+    }
+}
+
+ModuleOptimizer::~ModuleOptimizer() = default;
+
+unsigned ModuleOptimizer::getOptLevel() const { return P->OptLevel; }
+
+void ModuleOptimizer::run(llvm::Module &M)
+{
+    P->MPM.run(M, P->MAM);
+    // The analyses refer to M, which the next run will not see.
+    P->LAM.clear();
+    P->FAM.clear();
+    P->CGAM.clear();
+    P->MAM.clear();
+}
+
+void optimizeModule(llvm::Module &M, unsigned OptLevel)
+{
+    ModuleOptimizer(OptLevel).run(M);
+}
@@ -0,0 +1,120 @@
+#include "llshader/CodeGen/Profile.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <algorithm>
+
+std::unique_ptr<ProfileData> ProfileData::read(llvm::StringRef FileName,
+                                               std::string &Error)
+{
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> FileOrErr =
+        llvm::MemoryBuffer::getFile(FileName);
+    if (std::error_code EC = FileOrErr.getError())
+    {
+        Error = EC.message();
+        return nullptr;
+    }
+
+    auto Data = std::make_unique<ProfileData>();
+    auto Fail = [&](const llvm::line_iterator &Line, llvm::StringRef Msg)
+    {
+        Error = ("line " + llvm::Twine(Line.line_number()) + ": " + Msg).str();
+        return nullptr;
+    };
+    // Sites still expected by the last shader line.
+    unsigned Pending = 0;
+    for (llvm::line_iterator Line(**FileOrErr, /*SkipBlanks=*/true, '#');
+         !Line.is_at_eof(); ++Line)
+    {
+        llvm::StringRef Rest = Line->trim();
+        if (Rest.consume_front("shader "))
+        {
+            if (Pending)
+                return Fail(Line, "missing statements");
+            llvm::StringRef Count, Source;
+            std::tie(Count, Source) = Rest.split(' ');
+            if (Count.getAsInteger(10, Pending) || Source.empty())
+                return Fail(Line, "malformed shader line");
+            Data->Shaders.push_back({Source.str(), {}});
+            continue;
+        }
+
+        ProfileSite Site;
+        llvm::SmallVector<llvm::StringRef, 4> Fields;
+        Rest.split(Fields, ' ', -1, /*KeepEmpty=*/false);
+        if (!Pending || Fields.size() != 4 ||
+            Fields[0].getAsInteger(10, Site.Line) ||
+            Fields[1].getAsInteger(10, Site.Column) ||
+            Fields[2].getAsInteger(10, Site.Count) ||
+            Fields[3].getAsInteger(10, Site.Cycles))
+            return Fail(Line, "malformed statement line");
+        Data->Shaders.back().Sites.push_back(Site);
+        --Pending;
+    }
+    if (Pending)
+    {
+        Error = "unexpected end of file";
+        return nullptr;
+    }
+    return Data;
+}
+
+const ShaderProfile *ProfileData::lookup(llvm::StringRef Source) const
+{
+    for (const ShaderProfile &Shader : Shaders)
+        if (Shader.Source == Source)
+            return &Shader;
+    return nullptr;
+}
+
+void ProfileData::annotate(llvm::raw_ostream &OS, const ShaderProfile &Profile,
+                           llvm::StringRef Text)
+{
+    // A line may start several statements, and the cycles of nested ones
+    // are included in their parent's, so each line shows the largest.
+    struct LineCounters
+    {
+        bool HasSite = false;
+        uint64_t Count = 0;
+        uint64_t Cycles = 0;
+    };
+    std::vector<LineCounters> Lines;
+    uint64_t TotalCycles = 0;
+    for (const ProfileSite &Site : Profile.Sites)
+    {
+        if (!Site.Line)
+        {
+            TotalCycles = std::max(TotalCycles, Site.Cycles);
+            continue;
+        }
+        if (Lines.size() <= Site.Line)
+            Lines.resize(Site.Line + 1);
+        LineCounters &L = Lines[Site.Line];
+        L.HasSite = true;
+        L.Count = std::max(L.Count, Site.Count);
+        L.Cycles = std::max(L.Cycles, Site.Cycles);
+    }
+
+    OS << Profile.Source << "\n";
+    OS << "        Hits   Time% | Source\n";
+    unsigned LineNo = 0;
+    while (!Text.empty())
+    {
+        llvm::StringRef Line;
+        std::tie(Line, Text) = Text.split('\n');
+        ++LineNo;
+        const LineCounters *L =
+            LineNo < Lines.size() && Lines[LineNo].HasSite ? &Lines[LineNo]
+                                                            : nullptr;
+        if (L)
+            OS << llvm::format("%12llu", (unsigned long long)L->Count);
+        else
+            OS.indent(12);
+        if (L && L->Cycles && TotalCycles)
+            OS << llvm::format(" %6.1f%%", 100.0 * L->Cycles / TotalCycles);
+        else
+            OS.indent(8);
+        OS << " | " << Line.rtrim('\r') << "\n";
+    }
+}
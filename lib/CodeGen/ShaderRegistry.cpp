@@ -0,0 +1,62 @@
+#include "llshader/CodeGen/ShaderRegistry.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/Support/Path.h"
+
+using namespace llvm;
+
+std::string registry::getShaderName(StringRef FileName)
+{
+    std::string Name = sys::path::stem(FileName).str();
+    for (char &C : Name)
+        if (!isAlnum(C) && C != '_')
+            C = '_';
+    if (Name.empty() || isDigit(Name[0]))
+        Name.insert(0, "_");
+    return Name;
+}
+
+std::string registry::getEntrySymbol(StringRef ShaderName)
+{
+    return ("llsh_shader_" + ShaderName).str();
+}
+
+std::string registry::getInfoSymbol(StringRef ShaderName)
+{
+    return ("llsh_shader_info_" + ShaderName).str();
+}
+
+void registry::emitRegistry(Module &M, ArrayRef<std::string> Shaders)
+{
+    LLVMContext &Ctx = M.getContext();
+    IntegerType *Int32Ty = Type::getInt32Ty(Ctx);
+    PointerType *PtrTy = Type::getInt8PtrTy(Ctx);
+
+    // The infos are only referenced by address, so their type is opaque
+    // here.
+    std::vector<Constant *> Infos;
+    for (const std::string &Shader : Shaders)
+        Infos.push_back(M.getOrInsertGlobal(getInfoSymbol(Shader),
+                                            Type::getInt8Ty(Ctx)));
+    ArrayType *InfosTy = ArrayType::get(PtrTy, Infos.size());
+    auto *InfoArray = new GlobalVariable(
+        M, InfosTy, true, GlobalValue::PrivateLinkage,
+        ConstantArray::get(InfosTy, Infos), "llsh_shaders");
+
+    // Matches llsh_shader_registry in tools/runtime/registry.h.
+    StructType *RegistryTy = StructType::create(
+        Ctx, {Int32Ty, Int32Ty, PointerType::getUnqual(PtrTy)},
+        "llsh_shader_registry");
+    Constant *Zero = ConstantInt::get(Int32Ty, 0);
+    new GlobalVariable(
+        M, RegistryTy, true, GlobalValue::ExternalLinkage,
+        ConstantStruct::get(
+            RegistryTy,
+            {ConstantInt::get(Int32Ty, Version),
+             ConstantInt::get(Int32Ty, Shaders.size()),
+             ConstantExpr::getInBoundsGetElementPtr(InfosTy, InfoArray,
+                                                    ArrayRef<Constant *>{
+                                                        Zero, Zero})}),
+        RegistrySymbol);
+}
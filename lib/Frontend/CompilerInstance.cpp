@@ -0,0 +1,91 @@
+#include "llshader/Frontend/CompilerInstance.h"
+#include "llshader/Basic/Diagnostic.h"
+#include "llshader/CodeGen/CodeGen.h"
+#include "llshader/Parser/ParallelParser.h"
+#include "llshader/Sema/Uniformity.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+using namespace llvm;
+
+void CompileResult::printDiagnostics(raw_ostream &OS) const
+{
+    for (const SMDiagnostic &D : Diags)
+        D.print(nullptr, OS);
+}
+
+CompileResult CompilerInstance::compile(StringRef Source, StringRef BufferName,
+                                        StringRef ShaderName)
+{
+    CompileResult Result;
+    SourceMgr SrcMgr;
+    SrcMgr.AddNewSourceBuffer(MemoryBuffer::getMemBuffer(Source, BufferName),
+                              SMLoc());
+
+    // Diagnostics are kept, not printed, and turned into SMDiagnostics while
+    // the SourceMgr that locates them is alive.
+    DiagnosticsEngine Diags(SrcMgr);
+    Diags.setDeferring(true);
+    auto takeDiagnostics = [&]()
+    {
+        for (const StoredDiagnostic &D : Diags.takeDeferred())
+            Result.Diags.push_back(SrcMgr.GetMessage(D.Loc, D.Kind, D.Msg));
+    };
+    std::unique_ptr<AST> Tree(ParallelParser(SrcMgr, Diags, ParseThreads)
+                                  .parse());
+    takeDiagnostics();
+    if (!Tree || Diags.numErrors())
+    {
+        Result.S = CompileResult::SyntaxError;
+        return Result;
+    }
+
+    S.setDiagnostics(Diags);
+    bool SemaOk = S.semantic(Tree.get());
+    takeDiagnostics();
+    if (!SemaOk)
+    {
+        Result.S = CompileResult::SemanticError;
+        return Result;
+    }
+
+    auto M = std::make_unique<Module>(BufferName, Ctx);
+    if (Emitter)
+        Emitter->configure(*M);
+    UniformityInfo Uniformity;
+    CodeGen CG(M.get(), &Ctx);
+    if (HoistInvariants)
+    {
+        Uniformity = UniformityInfo::compute(Tree.get());
+        CG.setUniformity(Uniformity);
+    }
+    if (!ShaderName.empty())
+        CG.setShaderName(ShaderName);
+    if (Emitter)
+        CG.setTargets(Emitter->getCPU());
+    CG.setDiagnostics(Diags);
+    bool CodeGenOk = CG.compile(Tree.get());
+    takeDiagnostics();
+    if (!CodeGenOk)
+    {
+        Result.S = CompileResult::CodeGenError;
+        return Result;
+    }
+    Result.EntryName = CG.getEntryName();
+    // The tree refers to the source, which the caller may free once
+    // compile() returns.
+    Tree.reset();
+
+    if (!Optimizer || Optimizer->getOptLevel() != OptLevel)
+        Optimizer = std::make_unique<ModuleOptimizer>(OptLevel);
+    Optimizer->run(*M);
+
+    std::string Error;
+    if (Emitter && !Emitter->emit(*M, Result.Object, Error))
+    {
+        Result.Diags.emplace_back(BufferName, SourceMgr::DK_Error, Error);
+        Result.S = CompileResult::EmitError;
+        return Result;
+    }
+    Result.M = std::move(M);
+    return Result;
+}
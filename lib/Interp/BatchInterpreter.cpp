@@ -0,0 +1,294 @@
+#include "llshader/Interp/BatchInterpreter.h"
+#include "Operations.h"
+#include <algorithm>
+
+BatchInterpreter::BatchInterpreter(const Bytecode &Code, unsigned Lanes)
+    : Code(Code), Lanes(Lanes), Frame(size_t(Code.getNumSlots()) * Lanes),
+      LanePC(Lanes), Mask(Lanes)
+{
+    const std::vector<Slot> &Constants = Code.getConstants();
+    size_t First = Code.getNumSlots() - Constants.size();
+    for (size_t K = 0, E = Constants.size(); K != E; ++K)
+        std::fill_n(&Frame[(First + K) * Lanes], Lanes, Constants[K]);
+}
+
+namespace
+{
+// The jumps come last in Opcodes.def.
+bool isJump(Opcode Op) { return Op >= Opcode::Jmp; }
+
+uint32_t getTarget(const Instruction &I)
+{
+    switch (I.Op)
+    {
+    case Opcode::Jmp:
+        return I.A;
+    case Opcode::Jz:
+    case Opcode::Jnz:
+        return I.B;
+    default:
+        return I.C;
+    }
+}
+} // namespace
+
+void BatchInterpreter::run()
+{
+    const Instruction *Insts = Code.getCode().data();
+    std::vector<uint8_t> Taken(Lanes);
+    uint32_t PC = 0;
+    bool Diverged = false;
+    for (;;)
+    {
+        const Instruction &I = Insts[PC];
+        if (!isJump(I.Op))
+        {
+            if (!Diverged)
+            {
+                if (I.Op == Opcode::Halt)
+                    return;
+                execute<false>(I);
+                ++PC;
+                continue;
+            }
+            // Halt is last, so the lanes have converged before they get
+            // there.
+            execute<true>(I);
+            for (unsigned L = 0; L != Lanes; ++L)
+                if (Mask[L])
+                    ++LanePC[L];
+            Diverged = schedule(PC);
+            continue;
+        }
+
+        const Slot *X = &Frame[size_t(I.A) * Lanes];
+        const Slot *Y = &Frame[size_t(I.B) * Lanes];
+        switch (I.Op)
+        {
+#define JUMP_IF(Name, Cond)                                                    \
+    case Opcode::Name:                                                         \
+        for (unsigned L = 0; L != Lanes; ++L)                                  \
+            Taken[L] = Cond;                                                   \
+        break;
+            JUMP_IF(Jmp, true)
+            JUMP_IF(Jz, X[L].I == 0)
+            JUMP_IF(Jnz, X[L].I != 0)
+            JUMP_IF(JEqI, X[L].I == Y[L].I)
+            JUMP_IF(JNeI, X[L].I != Y[L].I)
+            JUMP_IF(JLtI, X[L].I < Y[L].I)
+            JUMP_IF(JGtI, X[L].I > Y[L].I)
+            JUMP_IF(JLeI, X[L].I <= Y[L].I)
+            JUMP_IF(JGeI, X[L].I >= Y[L].I)
+#undef JUMP_IF
+        default:
+            break;
+        }
+        uint32_t Target = getTarget(I);
+        if (!Diverged)
+        {
+            size_t Count = std::count(Taken.begin(), Taken.end(), 1);
+            if (Count == 0 || Count == Lanes)
+            {
+                PC = Count ? Target : PC + 1;
+                continue;
+            }
+            std::fill(Mask.begin(), Mask.end(), 1);
+            std::fill(LanePC.begin(), LanePC.end(), PC);
+        }
+        for (unsigned L = 0; L != Lanes; ++L)
+            if (Mask[L])
+                LanePC[L] = Taken[L] ? Target : PC + 1;
+        Diverged = schedule(PC);
+    }
+}
+
+bool BatchInterpreter::schedule(uint32_t &PC)
+{
+    PC = *std::min_element(LanePC.begin(), LanePC.end());
+    bool Converged = true;
+    for (unsigned L = 0; L != Lanes; ++L)
+    {
+        Mask[L] = LanePC[L] == PC;
+        Converged &= Mask[L];
+    }
+    return !Converged;
+}
+
+template <bool Masked> void BatchInterpreter::execute(const Instruction &I)
+{
+    const unsigned N = Lanes;
+    const uint8_t *M = Mask.data();
+    Slot *D = &Frame[size_t(I.A) * N];
+    Slot *X = &Frame[size_t(I.B) * N];
+    Slot *Y = &Frame[size_t(I.C) * N];
+
+    // The statement for each active lane L of a slot, or for each value K
+    // of the W slots of an aggregate.
+#define EACH(...)                                                              \
+    for (unsigned L = 0; L != N; ++L)                                          \
+        if (!Masked || M[L])                                                   \
+        {                                                                      \
+            __VA_ARGS__;                                                       \
+        }
+#define EACH_W(...)                                                            \
+    for (unsigned C = 0, W = I.W; C != W; ++C)                                 \
+        for (unsigned L = 0, K = C * N; L != N; ++L, ++K)                      \
+            if (!Masked || M[L])                                               \
+            {                                                                  \
+                __VA_ARGS__;                                                   \
+            }
+
+    switch (I.Op)
+    {
+    case Opcode::Mov:
+        EACH_W(D[K] = X[K]);
+        return;
+
+    case Opcode::AddI:
+        EACH(D[L].I = interp::add(X[L].I, Y[L].I));
+        return;
+    case Opcode::SubI:
+        EACH(D[L].I = interp::sub(X[L].I, Y[L].I));
+        return;
+    case Opcode::MulI:
+        EACH(D[L].I = interp::mul(X[L].I, Y[L].I));
+        return;
+    case Opcode::DivI:
+        EACH(D[L].I = interp::div(X[L].I, Y[L].I));
+        return;
+    case Opcode::RemI:
+        EACH(D[L].I = interp::rem(X[L].I, Y[L].I));
+        return;
+    case Opcode::AndI:
+        EACH(D[L].I = X[L].I & Y[L].I);
+        return;
+    case Opcode::OrI:
+        EACH(D[L].I = X[L].I | Y[L].I);
+        return;
+    case Opcode::XorI:
+        EACH(D[L].I = X[L].I ^ Y[L].I);
+        return;
+    case Opcode::ShlI:
+        EACH(D[L].I = interp::shl(X[L].I, Y[L].I));
+        return;
+    case Opcode::ShrI:
+        EACH(D[L].I = interp::shr(X[L].I, Y[L].I));
+        return;
+    case Opcode::NotI:
+        EACH(D[L].I = ~X[L].I);
+        return;
+    case Opcode::LNotI:
+        EACH(D[L].I = X[L].I == 0);
+        return;
+    case Opcode::ClampI:
+        EACH(D[L].I = interp::clamp(X[L].I, I.W));
+        return;
+
+    case Opcode::AddF:
+        EACH_W(D[K].F = X[K].F + Y[K].F);
+        return;
+    case Opcode::SubF:
+        EACH_W(D[K].F = X[K].F - Y[K].F);
+        return;
+    case Opcode::MulF:
+        EACH_W(D[K].F = X[K].F * Y[K].F);
+        return;
+    case Opcode::DivF:
+        EACH_W(D[K].F = X[K].F / Y[K].F);
+        return;
+    case Opcode::RemF:
+        EACH_W(D[K].F = interp::rem(X[K].F, Y[K].F));
+        return;
+    case Opcode::LNotF:
+        EACH(D[L].I = !(X[L].F != 0.0f));
+        return;
+
+    case Opcode::EqI:
+        EACH(D[L].I = X[L].I == Y[L].I);
+        return;
+    case Opcode::NeI:
+        EACH(D[L].I = X[L].I != Y[L].I);
+        return;
+    case Opcode::LtI:
+        EACH(D[L].I = X[L].I < Y[L].I);
+        return;
+    case Opcode::GtI:
+        EACH(D[L].I = X[L].I > Y[L].I);
+        return;
+    case Opcode::LeI:
+        EACH(D[L].I = X[L].I <= Y[L].I);
+        return;
+    case Opcode::GeI:
+        EACH(D[L].I = X[L].I >= Y[L].I);
+        return;
+    case Opcode::EqF:
+        EACH(D[L].I = X[L].F == Y[L].F);
+        return;
+    case Opcode::NeF:
+        EACH(D[L].I = X[L].F != Y[L].F);
+        return;
+    case Opcode::LtF:
+        EACH(D[L].I = X[L].F < Y[L].F);
+        return;
+    case Opcode::GtF:
+        EACH(D[L].I = X[L].F > Y[L].F);
+        return;
+    case Opcode::LeF:
+        EACH(D[L].I = X[L].F <= Y[L].F);
+        return;
+    case Opcode::GeF:
+        EACH(D[L].I = X[L].F >= Y[L].F);
+        return;
+    case Opcode::EqV:
+    case Opcode::NeV:
+    {
+        bool Eq = I.Op == Opcode::EqV;
+        EACH({
+            bool Equal = true;
+            for (unsigned C = 0; C != I.W; ++C)
+                Equal &= X[C * N + L].F == Y[C * N + L].F;
+            D[L].I = Equal == Eq;
+        });
+        return;
+    }
+
+    case Opcode::IToF:
+        EACH(D[L].F = static_cast<float>(X[L].I));
+        return;
+    case Opcode::FToI:
+        EACH(D[L].I = interp::toInt(X[L].F));
+        return;
+    case Opcode::Splat:
+        EACH_W(D[K] = X[L]);
+        return;
+    case Opcode::Diag:
+        for (unsigned C = 0; C != 16; ++C)
+            EACH(D[C * N + L].F = C % 5 ? 0.0f : X[L].F);
+        return;
+
+    case Opcode::Extract:
+        EACH(D[L] = X[Y[L].I * N + L]);
+        return;
+    case Opcode::Insert:
+        EACH(D[X[L].I * N + L] = Y[L]);
+        return;
+    case Opcode::MatMul:
+        EACH({
+            float A[16], B[16];
+            for (unsigned C = 0; C != 16; ++C)
+            {
+                A[C] = X[C * N + L].F;
+                B[C] = Y[C * N + L].F;
+            }
+            interp::matMul(A, A, B);
+            for (unsigned C = 0; C != 16; ++C)
+                D[C * N + L].F = A[C];
+        });
+        return;
+
+    default:
+        return;
+    }
+#undef EACH
+#undef EACH_W
+}
@@ -0,0 +1,62 @@
+#include "llshader/Interp/Bytecode.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+namespace
+{
+struct OpcodeInfo
+{
+    const char *Name;
+    const char *Format;
+};
+
+const OpcodeInfo Opcodes[] = {
+#define OPCODE(Name, Format) {#Name, Format},
+#include "llshader/Interp/Opcodes.def"
+};
+} // namespace
+
+const char *getOpcodeName(Opcode Op)
+{
+    return Opcodes[static_cast<unsigned>(Op)].Name;
+}
+
+void Bytecode::print(raw_ostream &OS) const
+{
+    OS << "; " << Code.size() << " instructions, " << NumSlots << " slots, "
+       << Constants.size() << " constants\n";
+    for (size_t I = 0, E = Code.size(); I != E; ++I)
+    {
+        const Instruction &Inst = Code[I];
+        OS << format("%5zu  ", I) << format("%-8s", getOpcodeName(Inst.Op));
+        StringRef Format = Opcodes[static_cast<unsigned>(Inst.Op)].Format;
+        const uint32_t Operands[] = {Inst.A, Inst.B, Inst.C};
+        unsigned N = 0;
+        for (char Kind : Format)
+        {
+            if (Kind == 'W')
+            {
+                OS << " x" << Inst.W;
+                continue;
+            }
+            OS << (N ? ", " : " ");
+            if (Kind == 'J')
+                OS << "@" << Operands[N];
+            else
+                OS << "%" << Operands[N];
+            ++N;
+        }
+        OS << "\n";
+    }
+    uint32_t First = NumSlots - Constants.size();
+    for (size_t I = 0, E = Constants.size(); I != E; ++I)
+        OS << "%" << First + I << " = "
+           << format("0x%08x", static_cast<uint32_t>(Constants[I].I)) << "\n";
+    for (const Input &In : Inputs)
+        OS << "input " << In.Name << " = %" << In.Slot << " x" << In.Width
+           << "\n";
+    for (const Output &Out : Outputs)
+        OS << "output " << Out.Name << " = %" << Out.Slot << "\n";
+}
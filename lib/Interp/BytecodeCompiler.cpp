@@ -0,0 +1,961 @@
+#include "llshader/AST/RecursiveASTVisitor.h"
+#include "llshader/Interp/Bytecode.h"
+#include "llshader/Sema/Uniformity.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/Twine.h"
+#include <algorithm>
+
+using namespace llvm;
+
+namespace
+{
+enum class ValType : uint8_t
+{
+    None,
+    Int,
+    Float,
+    Triple,
+    Matrix,
+    String
+};
+
+unsigned getWidth(ValType Ty)
+{
+    return Ty == ValType::Triple ? 3 : Ty == ValType::Matrix ? 16 : 1;
+}
+
+StringRef getTypeName(ValType Ty)
+{
+    switch (Ty)
+    {
+    case ValType::Int:
+        return "int";
+    case ValType::Float:
+        return "float";
+    case ValType::Triple:
+        return "triple";
+    case ValType::Matrix:
+        return "matrix";
+    default:
+        return "string";
+    }
+}
+
+// Constants are numbered separately while lowering and placed after the
+// variables and temporaries at the end.
+constexpr uint32_t ConstantBit = 1u << 31;
+constexpr uint32_t NoDef = ~0u;
+
+// A value: the first of its slots and its type.
+struct Operand
+{
+    uint32_t Slot = 0;
+    ValType Ty = ValType::None;
+    // A variable's own slots, which later code may change.
+    bool IsVar = false;
+    // Index of the instruction that wrote it into a fresh temporary.
+    uint32_t Def = NoDef;
+};
+
+class SideEffectFinder : public RecursiveASTVisitor<SideEffectFinder>
+{
+  public:
+    bool Found = false;
+
+    bool visitAssignment(Assignment &)
+    {
+        Found = true;
+        return false;
+    }
+
+    bool visitIncDec(IncDec &)
+    {
+        Found = true;
+        return false;
+    }
+};
+
+bool hasSideEffects(Expression *E)
+{
+    SideEffectFinder Finder;
+    Finder.traverseExpr(E);
+    return Finder.Found;
+}
+} // namespace
+
+// Lowers the program the way ToIRVisitor emits it; see CodeGen.cpp for the
+// typing rules. Values are typed when lowering, so each instruction works
+// on one type and the interpreter never checks types.
+class BytecodeCompiler : public ASTVisitor
+{
+    Bytecode &Out;
+    raw_ostream &Errs;
+    bool HasError = false;
+    // The warning that derivatives are 0 comes once, at the first.
+    bool WarnedDerivatives = false;
+
+    // Value of the last expression visited; None for an empty compound
+    // expression.
+    Operand V;
+
+    struct Variable
+    {
+        uint32_t Slot = 0;
+        ValType Ty = ValType::None;
+    };
+    // Variables Sema bound by their frame slot, and the others by name in
+    // a map per scope.
+    std::vector<Variable> Bound;
+    std::vector<StringMap<Variable>> Scopes;
+
+    // Slots are allocated like a stack: a scope's variables are freed when
+    // it ends and a statement's temporaries when it is done.
+    uint32_t Top = 0;
+    uint32_t MaxTop = 0;
+    // By bits, widened past DenseMap's reserved keys.
+    DenseMap<uint64_t, uint32_t> ConstantIds;
+    StringMap<int32_t> StringIds;
+
+    struct LoopTargets
+    {
+        std::vector<size_t> Breaks;
+        std::vector<size_t> Continues;
+    };
+    std::vector<LoopTargets> Loops;
+
+  public:
+    BytecodeCompiler(Bytecode &Out, raw_ostream &Errs) : Out(Out), Errs(Errs)
+    {
+    }
+
+    bool run(AST *Tree)
+    {
+        Scopes.emplace_back();
+        Tree->accept(*this);
+        emit(Opcode::Halt);
+
+        // Constants go after everything else.
+        Out.NumSlots = MaxTop + Out.Constants.size();
+        for (Instruction &I : Out.Code)
+            for (uint32_t *Op : {&I.A, &I.B, &I.C})
+                if (*Op & ConstantBit)
+                    *Op = MaxTop + (*Op & ~ConstantBit);
+        return !HasError;
+    }
+
+    virtual void visit(Program &Node) override
+    {
+        for (Statement *S : *Node.getSL())
+            emitStmt(S);
+    }
+
+    // Statements
+
+    virtual void visit(CompoundSt &Node) override
+    {
+        for (Expression *E : *Node.getEL())
+            emitExpr(E);
+    }
+
+    virtual void visit(Scoped &Node) override
+    {
+        uint32_t Mark = Top;
+        Scopes.emplace_back();
+        for (Statement *S : *Node.getSL())
+            emitStmt(S);
+        Scopes.pop_back();
+        Top = Mark;
+    }
+
+    virtual void visit(Declaration &Node) override
+    {
+        ValType Ty = getType(Node.getType());
+        if (Ty == ValType::None)
+        {
+            error("cannot declare variables of this type");
+            return;
+        }
+        for (DefExpr *Def : *Node.getDefs())
+        {
+            // The initializer is lowered before the name is bound, so it
+            // sees any outer variable of the same name.
+            Variable Var = {alloc(getWidth(Ty)), Ty};
+            // Inputs keep the values the caller gives them.
+            if (Scopes.size() == 1 && !Def->getValue() &&
+                Ty != ValType::String && isShaderGlobal(Def->getId()))
+                Out.Inputs.push_back(
+                    {Def->getId().str(), Var.Slot, getWidth(Ty)});
+            else if (Def->getValue())
+                store(Var, convert(emitValue(Def->getValue()), Ty,
+                                   "initialization of " + Def->getId()));
+            else if (Ty == ValType::String)
+                store(Var, getString(""));
+            else if (Ty == ValType::Int)
+                store(Var, getInt(0));
+            else
+                emit(Opcode::Splat, Var.Slot, getFloat(0).Slot, 0,
+                     getWidth(Ty));
+            Top = Var.Slot + getWidth(Ty);
+            bind(Def, Var);
+            if (Scopes.size() == 1 && Ty == ValType::Int)
+                Out.Outputs.push_back({Def->getId().str(), Var.Slot});
+        }
+    }
+
+    virtual void visit(Conditional &Node) override
+    {
+        size_t ToElse = emitBranch(Node.getCondition(), false);
+        emitStmt(Node.getThen());
+        if (!Node.getElse())
+        {
+            setTarget(ToElse, here());
+            return;
+        }
+        size_t ToEnd = emit(Opcode::Jmp);
+        setTarget(ToElse, here());
+        emitStmt(Node.getElse());
+        setTarget(ToEnd, here());
+    }
+
+    // Loops test at the bottom, so an iteration takes one jump.
+
+    virtual void visit(For &Node) override
+    {
+        uint32_t Mark = Top;
+        Scopes.emplace_back();
+        if (Node.getInit())
+            Node.getInit()->accept(*this);
+        size_t ToCond = emit(Opcode::Jmp);
+        uint32_t Body = here();
+        Loops.emplace_back();
+        emitStmt(Node.getBody());
+        uint32_t Inc = here();
+        if (Node.getUpdate())
+            emitExpr(Node.getUpdate());
+        setTarget(ToCond, here());
+        if (Node.getCondition())
+            setTarget(emitBranch(Node.getCondition(), true), Body);
+        else
+            setTarget(emit(Opcode::Jmp), Body);
+        endLoop(Inc);
+        Scopes.pop_back();
+        Top = Mark;
+    }
+
+    virtual void visit(While &Node) override
+    {
+        size_t ToCond = emit(Opcode::Jmp);
+        uint32_t Body = here();
+        Loops.emplace_back();
+        emitStmt(Node.getBody());
+        uint32_t Cond = here();
+        setTarget(ToCond, Cond);
+        setTarget(emitBranch(Node.getCondition(), true), Body);
+        endLoop(Cond);
+    }
+
+    virtual void visit(DoWhile &Node) override
+    {
+        uint32_t Body = here();
+        Loops.emplace_back();
+        emitStmt(Node.getBody());
+        uint32_t Cond = here();
+        setTarget(emitBranch(Node.getCondition(), true), Body);
+        endLoop(Cond);
+    }
+
+    virtual void visit(LoopMod &Node) override
+    {
+        bool IsBreak = Node.getMod() == TokenKind::kw_break;
+        if (Loops.empty())
+        {
+            error(IsBreak ? "break outside of a loop"
+                          : "continue outside of a loop");
+            return;
+        }
+        (IsBreak ? Loops.back().Breaks : Loops.back().Continues)
+            .push_back(emit(Opcode::Jmp));
+    }
+
+    // Expressions
+
+    virtual void visit(Literal &Node) override
+    {
+        switch (Node.getKind())
+        {
+        case Literal::Integer:
+            V = getInt(Node.getInt());
+            break;
+        case Literal::FloatingPoint:
+            V = getFloat(Node.getFloat());
+            break;
+        case Literal::String:
+            V = getString(Node.getValue());
+            break;
+        }
+    }
+
+    virtual void visit(TypeConstructor &Node) override
+    {
+        ValType Ty = getType(Node.getType());
+        ExprList &Values = *Node.getValues();
+        unsigned Components = getWidth(Ty);
+        if (Ty == ValType::None ||
+            (Values.size() != 1 && Values.size() != Components))
+        {
+            error("wrong number of values in type constructor");
+            V = getZero(Ty == ValType::None ? ValType::Int : Ty);
+            return;
+        }
+        if (Values.size() == 1)
+        {
+            V = convert(emitValue(Values[0]), Ty, "type constructor");
+            return;
+        }
+        Operand Result = allocTemp(Ty);
+        for (unsigned I = 0; I < Components; ++I)
+        {
+            Operand E = convert(emitValue(Values[I]), ValType::Float,
+                                "type constructor");
+            emit(Opcode::Mov, Result.Slot + I, E.Slot);
+        }
+        V = Result;
+    }
+
+    virtual void visit(BinaryExpression &Node) override
+    {
+        StringRef Op = Node.getOp();
+        if (Op == "&&" || Op == "||")
+        {
+            V = emitLogical(Node);
+            return;
+        }
+        Operand LHS = emitValue(Node.getE1());
+        if (hasSideEffects(Node.getE2()))
+            LHS = materialize(LHS);
+        Operand RHS = emitValue(Node.getE2());
+        V = emitBinary(Op, LHS, RHS);
+    }
+
+    virtual void visit(UnaryExpression &Node) override
+    {
+        Operand E = emitValue(Node.getE());
+        if (Node.getOp() == "!")
+        {
+            if (E.Ty == ValType::Float)
+                V = produce(Opcode::LNotF, ValType::Int, E.Slot);
+            else
+                V = produce(Opcode::LNotI, ValType::Int, toBool(E).Slot);
+            return;
+        }
+        if (E.Ty != ValType::Int)
+        {
+            error("operand of ~ must be an int");
+            V = getInt(0);
+            return;
+        }
+        V = produce(Opcode::NotI, ValType::Int, E.Slot);
+    }
+
+    virtual void visit(Assignment &Node) override
+    {
+        LValue *LV = Node.getId();
+        const Variable *Var = lookup(LV->getId(), LV->getSlot());
+        if (!Var)
+        {
+            V = getInt(0);
+            return;
+        }
+
+        Operand Index;
+        ValType Ty = Var->Ty;
+        if (ExprList *Indices = LV->getIndices())
+        {
+            std::vector<Operand> Idx;
+            for (Expression *E : *Indices)
+                Idx.push_back(
+                    convert(emitValue(E), ValType::Int, "subscript"));
+            if (Var->Ty == ValType::Triple && Idx.size() == 1)
+                Index = clampIndex(Idx[0], 3);
+            else if (Var->Ty == ValType::Matrix && Idx.size() == 2)
+                Index = produce(
+                    Opcode::AddI, ValType::Int,
+                    produce(Opcode::ShlI, ValType::Int,
+                            clampIndex(Idx[0], 4).Slot, getInt(2).Slot)
+                        .Slot,
+                    clampIndex(Idx[1], 4).Slot);
+            else
+            {
+                error("invalid subscript of " + LV->getId());
+                V = getInt(0);
+                return;
+            }
+            Ty = ValType::Float;
+        }
+
+        Operand New = emitValue(Node.getValue());
+        StringRef Op = Node.getOp();
+        if (Op != "=")
+        {
+            Operand Old = {Var->Slot, Var->Ty, true};
+            if (Index.Ty != ValType::None)
+                Old = produce(Opcode::Extract, ValType::Float, Var->Slot,
+                              Index.Slot, getWidth(Var->Ty));
+            New = emitBinary(Op.drop_back(), Old, New);
+        }
+        New = convert(New, Ty, "assignment to " + LV->getId());
+        if (Index.Ty != ValType::None)
+        {
+            emit(Opcode::Insert, Var->Slot, Index.Slot, New.Slot,
+                 getWidth(Var->Ty));
+            V = New;
+        }
+        else
+            V = store(*Var, New);
+    }
+
+    virtual void visit(VariableRef &Node) override
+    {
+        const Variable *Var = lookup(Node.getId(), Node.getSlot());
+        if (!Var)
+        {
+            V = getInt(0);
+            return;
+        }
+        V = {Var->Slot, Var->Ty, true};
+        if (Node.getDeref())
+            V = emitElement(V, Node.getDeref(), Node.getId());
+    }
+
+    virtual void visit(IncDec &Node) override
+    {
+        VariableRef *Ref = Node.getId();
+        const Variable *Var = lookup(Ref->getId(), Ref->getSlot());
+        if (!Var)
+        {
+            V = getInt(0);
+            return;
+        }
+        Operand Whole = {Var->Slot, Var->Ty, true};
+        Operand One = getInt(1);
+        StringRef Op = Node.getOp() == "++" ? "+" : "-";
+        if (!Ref->getDeref())
+        {
+            V = store(*Var, emitBinary(Op, Whole, One));
+            return;
+        }
+        Operand Index = emitIndex(Whole, Ref->getDeref(), Ref->getId());
+        if (Index.Ty == ValType::None)
+        {
+            V = Whole;
+            return;
+        }
+        Operand Old = produce(Opcode::Extract, ValType::Float, Var->Slot,
+                              Index.Slot, getWidth(Var->Ty));
+        Operand New = emitBinary(Op, Old, One);
+        emit(Opcode::Insert, Var->Slot, Index.Slot, New.Slot,
+             getWidth(Var->Ty));
+        V = New;
+    }
+
+    virtual void visit(TypeCast &Node) override
+    {
+        Operand E = emitValue(Node.getE());
+        ValType Ty = getType(Node.getType());
+        if (Ty == ValType::None)
+        {
+            error("invalid cast");
+            V = E;
+            return;
+        }
+        V = convert(E, Ty, "cast");
+    }
+
+    // Shading points run one at a time, with no neighbours to differ
+    // from, so derivatives are 0, as in OSL when they are unavailable.
+    virtual void visit(Derivative &Node) override
+    {
+        Operand E = emitValue(Node.getE());
+        if (E.Ty != ValType::Int && E.Ty != ValType::Float &&
+            E.Ty != ValType::Triple)
+        {
+            error("operand of " + Node.getName() +
+                  " must be a float or a triple");
+            V = getFloat(0);
+            return;
+        }
+        if (!WarnedDerivatives)
+        {
+            Errs << "Warning: derivatives are 0 in the interpreter\n";
+            WarnedDerivatives = true;
+        }
+        V = getZero(E.Ty == ValType::Triple ? ValType::Triple
+                                            : ValType::Float);
+    }
+
+    virtual void visit(CompoundEx &Node) override
+    {
+        Operand Last;
+        for (Expression *E : *Node.getEL())
+            Last = emitExpr(E);
+        V = Last;
+    }
+
+  private:
+    void error(const Twine &Msg)
+    {
+        Errs << "Error: " << Msg << "\n";
+        HasError = true;
+    }
+
+    ValType getType(TokenKind Kind)
+    {
+        switch (Kind)
+        {
+        case TokenKind::kw_int:
+            return ValType::Int;
+        case TokenKind::kw_float:
+            return ValType::Float;
+        case TokenKind::kw_string:
+            return ValType::String;
+        case TokenKind::kw_point:
+        case TokenKind::kw_vector:
+        case TokenKind::kw_normal:
+        case TokenKind::kw_color:
+            return ValType::Triple;
+        case TokenKind::kw_matrix:
+            return ValType::Matrix;
+        default:
+            return ValType::None;
+        }
+    }
+
+    // Code and slots
+
+    uint32_t here() const { return static_cast<uint32_t>(Out.Code.size()); }
+
+    size_t emit(Opcode Op, uint32_t A = 0, uint32_t B = 0, uint32_t C = 0,
+                unsigned W = 1)
+    {
+        Out.Code.push_back({Op, static_cast<uint16_t>(W), A, B, C});
+        return Out.Code.size() - 1;
+    }
+
+    void setTarget(size_t Jump, uint32_t Target)
+    {
+        Instruction &I = Out.Code[Jump];
+        switch (I.Op)
+        {
+        case Opcode::Jmp:
+            I.A = Target;
+            return;
+        case Opcode::Jz:
+        case Opcode::Jnz:
+            I.B = Target;
+            return;
+        default:
+            I.C = Target;
+            return;
+        }
+    }
+
+    void endLoop(uint32_t Continue)
+    {
+        for (size_t Jump : Loops.back().Continues)
+            setTarget(Jump, Continue);
+        for (size_t Jump : Loops.back().Breaks)
+            setTarget(Jump, here());
+        Loops.pop_back();
+    }
+
+    uint32_t alloc(unsigned Width)
+    {
+        uint32_t Slot = Top;
+        Top += Width;
+        MaxTop = std::max(MaxTop, Top);
+        return Slot;
+    }
+
+    Operand allocTemp(ValType Ty) { return {alloc(getWidth(Ty)), Ty}; }
+
+    // Emits Op writing a new temporary of type Ty.
+    Operand produce(Opcode Op, ValType Ty, uint32_t B, uint32_t C = 0,
+                    unsigned W = 1)
+    {
+        Operand Result = allocTemp(Ty);
+        Result.Def = emit(Op, Result.Slot, B, C, W);
+        return Result;
+    }
+
+    // Copies a variable's value, so code lowered after it cannot change it.
+    Operand materialize(Operand E)
+    {
+        if (!E.IsVar)
+            return E;
+        return produce(Opcode::Mov, E.Ty, E.Slot, 0, getWidth(E.Ty));
+    }
+
+    // Stores Val in Var. If the last instruction computed Val, it writes
+    // Var directly instead.
+    Operand store(const Variable &Var, Operand Val)
+    {
+        if (Val.Def != NoDef && Val.Def == Out.Code.size() - 1 &&
+            Out.Code.back().A == Val.Slot)
+            Out.Code.back().A = Var.Slot;
+        else if (Val.Slot != Var.Slot)
+            emit(Opcode::Mov, Var.Slot, Val.Slot, 0, getWidth(Var.Ty));
+        return {Var.Slot, Var.Ty, true};
+    }
+
+    // Constants of any type with the same bits share a slot.
+    Operand getConstant(ValType Ty, Slot Value)
+    {
+        auto Inserted = ConstantIds.try_emplace(
+            uint64_t(static_cast<uint32_t>(Value.I)),
+            static_cast<uint32_t>(Out.Constants.size()));
+        if (Inserted.second)
+            Out.Constants.push_back(Value);
+        return {Inserted.first->second | ConstantBit, Ty};
+    }
+
+    Operand getInt(int32_t Value)
+    {
+        Slot S;
+        S.I = Value;
+        return getConstant(ValType::Int, S);
+    }
+
+    Operand getFloat(float Value)
+    {
+        Slot S;
+        S.F = Value;
+        return getConstant(ValType::Float, S);
+    }
+
+    Operand getString(StringRef Text)
+    {
+        auto Inserted = StringIds.try_emplace(
+            Text, static_cast<int32_t>(Out.Strings.size()));
+        if (Inserted.second)
+            Out.Strings.push_back(Text.str());
+        Slot S;
+        S.I = Inserted.first->second;
+        return getConstant(ValType::String, S);
+    }
+
+    // A zero of type Ty, for the value of an erroneous expression.
+    Operand getZero(ValType Ty)
+    {
+        if (Ty == ValType::Int || Ty == ValType::String)
+            return getInt(0);
+        if (Ty == ValType::Float)
+            return getFloat(0);
+        return produce(Opcode::Splat, Ty, getFloat(0).Slot, 0, getWidth(Ty));
+    }
+
+    void bind(DefExpr *Def, const Variable &Var)
+    {
+        unsigned Slot = Def->getSlot();
+        if (Slot == InvalidSlot)
+        {
+            Scopes.back()[Def->getId()] = Var;
+            return;
+        }
+        if (Slot >= Bound.size())
+            Bound.resize(Slot + 1);
+        Bound[Slot] = Var;
+    }
+
+    // The variable Id names, found by its slot if Sema bound it.
+    const Variable *lookup(StringRef Id, unsigned Slot)
+    {
+        if (Slot != InvalidSlot && Slot < Bound.size() &&
+            Bound[Slot].Ty != ValType::None)
+            return &Bound[Slot];
+        for (auto I = Scopes.rbegin(), E = Scopes.rend(); I != E; ++I)
+        {
+            auto It = I->find(Id);
+            if (It != I->end())
+                return &It->second;
+        }
+        error("use of undeclared variable " + Id);
+        return nullptr;
+    }
+
+    // Lowering helpers
+
+    void emitStmt(Statement *S)
+    {
+        // Temporaries die with the statement; declarations keep their
+        // variables' slots.
+        uint32_t Mark = Top;
+        S->accept(*this);
+        if (!isa<Declaration>(S))
+            Top = Mark;
+    }
+
+    Operand emitExpr(Expression *E)
+    {
+        V = Operand();
+        E->accept(*this);
+        return V;
+    }
+
+    Operand emitValue(Expression *E)
+    {
+        Operand Val = emitExpr(E);
+        if (Val.Ty != ValType::None)
+            return Val;
+        error("expression has no value");
+        return getInt(0);
+    }
+
+    // Emits a jump to be patched with setTarget, taken if Cond is true
+    // (IfTrue) or false. Int comparisons fuse into the jump.
+    size_t emitBranch(Expression *Cond, bool IfTrue)
+    {
+        static const StringMap<std::pair<Opcode, Opcode>> Fused = {
+            {"==", {Opcode::JEqI, Opcode::JNeI}},
+            {"!=", {Opcode::JNeI, Opcode::JEqI}},
+            {"<", {Opcode::JLtI, Opcode::JGeI}},
+            {">", {Opcode::JGtI, Opcode::JLeI}},
+            {"<=", {Opcode::JLeI, Opcode::JGtI}},
+            {">=", {Opcode::JGeI, Opcode::JLtI}}};
+        auto *Bin = dyn_cast<BinaryExpression>(Cond);
+        auto It = Bin ? Fused.find(Bin->getOp()) : Fused.end();
+        if (It != Fused.end())
+        {
+            Operand LHS = emitValue(Bin->getE1());
+            if (hasSideEffects(Bin->getE2()))
+                LHS = materialize(LHS);
+            Operand RHS = emitValue(Bin->getE2());
+            if (LHS.Ty == ValType::Int && RHS.Ty == ValType::Int)
+                return emit(IfTrue ? It->second.first : It->second.second,
+                            LHS.Slot, RHS.Slot);
+            return emit(IfTrue ? Opcode::Jnz : Opcode::Jz,
+                        toBool(emitBinary(Bin->getOp(), LHS, RHS)).Slot);
+        }
+        return emit(IfTrue ? Opcode::Jnz : Opcode::Jz,
+                    toBool(emitValue(Cond)).Slot);
+    }
+
+    // Index into an aggregate value, clamped to its bounds; None if Agg is
+    // not an aggregate.
+    Operand emitIndex(Operand Agg, Expression *E, StringRef Id)
+    {
+        if (Agg.Ty != ValType::Triple && Agg.Ty != ValType::Matrix)
+        {
+            error("subscript of non-aggregate variable " + Id);
+            return Operand();
+        }
+        return clampIndex(convert(emitValue(E), ValType::Int, "subscript"),
+                          getWidth(Agg.Ty));
+    }
+
+    Operand emitElement(Operand Agg, Expression *E, StringRef Id)
+    {
+        Operand Index = emitIndex(Agg, E, Id);
+        if (Index.Ty == ValType::None)
+            return getFloat(0);
+        return produce(Opcode::Extract, ValType::Float, Agg.Slot, Index.Slot,
+                       getWidth(Agg.Ty));
+    }
+
+    Operand clampIndex(Operand Index, unsigned Size)
+    {
+        if (Index.Slot & ConstantBit)
+            return getInt(std::min(
+                std::max(Out.Constants[Index.Slot & ~ConstantBit].I, 0),
+                int32_t(Size) - 1));
+        return produce(Opcode::ClampI, ValType::Int, Index.Slot, 0, Size);
+    }
+
+    Operand convert(Operand Val, ValType To, const Twine &Context)
+    {
+        ValType From = Val.Ty;
+        if (From == To)
+            return Val;
+        bool FromScalar = From == ValType::Int || From == ValType::Float;
+        if (To == ValType::Float && From == ValType::Int)
+        {
+            if (Val.Slot & ConstantBit)
+                return getFloat(static_cast<float>(
+                    Out.Constants[Val.Slot & ~ConstantBit].I));
+            return produce(Opcode::IToF, ValType::Float, Val.Slot);
+        }
+        if (To == ValType::Int && From == ValType::Float)
+            return produce(Opcode::FToI, ValType::Int, Val.Slot);
+        if (To == ValType::Triple && FromScalar)
+            return produce(Opcode::Splat, ValType::Triple,
+                           convert(Val, ValType::Float, Context).Slot, 0, 3);
+        if (To == ValType::Matrix && FromScalar)
+            return produce(Opcode::Diag, ValType::Matrix,
+                           convert(Val, ValType::Float, Context).Slot);
+        error("cannot convert " + getTypeName(From) + " to " +
+              getTypeName(To) + " in " + Context);
+        return getZero(To);
+    }
+
+    // An int that is nonzero if Val is true.
+    Operand toBool(Operand Val)
+    {
+        if (Val.Ty == ValType::Int)
+            return Val;
+        if (Val.Ty == ValType::Float)
+            return produce(Opcode::NeF, ValType::Int, Val.Slot,
+                           getFloat(0).Slot);
+        error("condition must be an int or a float");
+        return getInt(0);
+    }
+
+    Operand emitLogical(BinaryExpression &Node)
+    {
+        bool IsOr = Node.getOp() == "||";
+        Operand Result = allocTemp(ValType::Int);
+        size_t Short =
+            emit(IsOr ? Opcode::Jnz : Opcode::Jz,
+                 toBool(emitValue(Node.getE1())).Slot);
+        emit(Opcode::NeI, Result.Slot, toBool(emitValue(Node.getE2())).Slot,
+             getInt(0).Slot);
+        size_t ToEnd = emit(Opcode::Jmp);
+        setTarget(Short, here());
+        emit(Opcode::Mov, Result.Slot, getInt(IsOr).Slot);
+        setTarget(ToEnd, here());
+        return Result;
+    }
+
+    Operand emitBinary(StringRef Op, Operand LHS, Operand RHS)
+    {
+        ValType LTy = LHS.Ty;
+        ValType RTy = RHS.Ty;
+
+        if (LTy == ValType::String || RTy == ValType::String)
+        {
+            if (LTy != RTy || (Op != "==" && Op != "!="))
+            {
+                error("invalid string operands to " + Op);
+                return getInt(0);
+            }
+            // Strings are interned, so equal strings have equal indices.
+            return produce(Op == "==" ? Opcode::EqI : Opcode::NeI,
+                           ValType::Int, LHS.Slot, RHS.Slot);
+        }
+
+        if (Op == "<" || Op == ">" || Op == "<=" || Op == ">=" || Op == "==" ||
+            Op == "!=")
+            return emitComparison(Op, LHS, RHS);
+
+        if (Op == "&" || Op == "|" || Op == "^" || Op == "<<" || Op == ">>")
+        {
+            if (LTy != ValType::Int || RTy != ValType::Int)
+            {
+                error("operands of " + Op + " must be ints");
+                return getInt(0);
+            }
+            Opcode IntOp = Op == "&"    ? Opcode::AndI
+                           : Op == "|"  ? Opcode::OrI
+                           : Op == "^"  ? Opcode::XorI
+                           : Op == "<<" ? Opcode::ShlI
+                                        : Opcode::ShrI;
+            return produce(IntOp, ValType::Int, LHS.Slot, RHS.Slot);
+        }
+
+        if (LTy == ValType::Matrix && RTy == ValType::Matrix && Op == "*")
+            return produce(Opcode::MatMul, ValType::Matrix, LHS.Slot,
+                           RHS.Slot);
+        if ((LTy == ValType::Matrix || RTy == ValType::Matrix) &&
+            (LTy == ValType::Triple || RTy == ValType::Triple ||
+             (LTy == RTy && (Op == "/" || Op == "%"))))
+        {
+            error("invalid matrix operands to " + Op);
+            return getZero(ValType::Matrix);
+        }
+
+        ValType Ty = ValType::Int;
+        if (LTy == ValType::Matrix || RTy == ValType::Matrix)
+        {
+            // Matrices combine with scalars element by element.
+            Ty = ValType::Matrix;
+            if (LTy != ValType::Matrix)
+                LHS = produce(Opcode::Splat, Ty,
+                              convert(LHS, ValType::Float, Op).Slot, 0, 16);
+            if (RTy != ValType::Matrix)
+                RHS = produce(Opcode::Splat, Ty,
+                              convert(RHS, ValType::Float, Op).Slot, 0, 16);
+        }
+        else if (LTy == ValType::Triple || RTy == ValType::Triple)
+            Ty = ValType::Triple;
+        else if (LTy == ValType::Float || RTy == ValType::Float)
+            Ty = ValType::Float;
+        LHS = convert(LHS, Ty, Op);
+        RHS = convert(RHS, Ty, Op);
+
+        if (Ty == ValType::Int)
+        {
+            Opcode IntOp = Op == "+"   ? Opcode::AddI
+                           : Op == "-" ? Opcode::SubI
+                           : Op == "*" ? Opcode::MulI
+                           : Op == "/" ? Opcode::DivI
+                                       : Opcode::RemI;
+            return produce(IntOp, Ty, LHS.Slot, RHS.Slot);
+        }
+        Opcode FloatOp = Op == "+"   ? Opcode::AddF
+                         : Op == "-" ? Opcode::SubF
+                         : Op == "*" ? Opcode::MulF
+                         : Op == "/" ? Opcode::DivF
+                                     : Opcode::RemF;
+        return produce(FloatOp, Ty, LHS.Slot, RHS.Slot, getWidth(Ty));
+    }
+
+    Operand emitComparison(StringRef Op, Operand LHS, Operand RHS)
+    {
+        ValType LTy = LHS.Ty;
+        ValType RTy = RHS.Ty;
+        if (LTy == ValType::Int && RTy == ValType::Int)
+        {
+            Opcode IntOp = Op == "<"    ? Opcode::LtI
+                           : Op == ">"  ? Opcode::GtI
+                           : Op == "<=" ? Opcode::LeI
+                           : Op == ">=" ? Opcode::GeI
+                           : Op == "==" ? Opcode::EqI
+                                        : Opcode::NeI;
+            return produce(IntOp, ValType::Int, LHS.Slot, RHS.Slot);
+        }
+        if (getWidth(LTy) > 1 || getWidth(RTy) > 1)
+        {
+            // Triples and matrices are only equal or not.
+            if (Op != "==" && Op != "!=")
+            {
+                error("invalid operands to " + Op);
+                return getInt(0);
+            }
+            ValType Ty = LTy == ValType::Matrix || RTy == ValType::Matrix
+                             ? ValType::Matrix
+                             : ValType::Triple;
+            LHS = convert(LHS, Ty, Op);
+            RHS = convert(RHS, Ty, Op);
+            return produce(Op == "==" ? Opcode::EqV : Opcode::NeV,
+                           ValType::Int, LHS.Slot, RHS.Slot, getWidth(Ty));
+        }
+        Opcode FloatOp = Op == "<"    ? Opcode::LtF
+                         : Op == ">"  ? Opcode::GtF
+                         : Op == "<=" ? Opcode::LeF
+                         : Op == ">=" ? Opcode::GeF
+                         : Op == "==" ? Opcode::EqF
+                                      : Opcode::NeF;
+        LHS = convert(LHS, ValType::Float, Op);
+        RHS = convert(RHS, ValType::Float, Op);
+        return produce(FloatOp, ValType::Int, LHS.Slot, RHS.Slot);
+    }
+};
+
+std::unique_ptr<Bytecode> Bytecode::compile(AST *Tree, raw_ostream &Errs)
+{
+    if (!Tree)
+        return nullptr;
+    std::unique_ptr<Bytecode> Code(new Bytecode());
+    if (!BytecodeCompiler(*Code, Errs).run(Tree))
+        return nullptr;
+    return Code;
+}
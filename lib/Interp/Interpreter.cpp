@@ -0,0 +1,281 @@
+#include "llshader/Interp/Interpreter.h"
+#include "Operations.h"
+#include <algorithm>
+
+Interpreter::Interpreter(const Bytecode &Code)
+    : Code(Code), Frame(Code.getNumSlots())
+{
+    const std::vector<Slot> &Constants = Code.getConstants();
+    std::copy(Constants.begin(), Constants.end(),
+              Frame.end() - Constants.size());
+}
+
+#if defined(__GNUC__)
+#define LLSHADER_THREADED_DISPATCH
+#endif
+
+void Interpreter::run()
+{
+    Slot *R = Frame.data();
+    const Instruction *Base = Code.getCode().data();
+    const Instruction *IP = Base;
+
+#define DST R[IP->A]
+#define SRC1 R[IP->B]
+#define SRC2 R[IP->C]
+#define LANES(Expr)                                                            \
+    for (unsigned L = 0, W = IP->W; L != W; ++L)                               \
+    {                                                                          \
+        Slot *D = &DST + L;                                                    \
+        const Slot *X = &SRC1 + L;                                             \
+        const Slot *Y = &SRC2 + L;                                             \
+        Expr;                                                                  \
+    }
+
+#ifdef LLSHADER_THREADED_DISPATCH
+    static const void *const Labels[] = {
+#define OPCODE(Name, Format) &&Op##Name,
+#include "llshader/Interp/Opcodes.def"
+    };
+#define CASE(Name) Op##Name:
+#define DISPATCH() goto *Labels[static_cast<unsigned>(IP->Op)]
+#define NEXT()                                                                 \
+    ++IP;                                                                      \
+    DISPATCH()
+#define JUMP(Target)                                                           \
+    IP = Base + (Target);                                                      \
+    DISPATCH()
+    DISPATCH();
+#else
+#define CASE(Name) case Opcode::Name:
+#define NEXT()                                                                 \
+    ++IP;                                                                      \
+    continue
+#define JUMP(Target)                                                           \
+    IP = Base + (Target);                                                      \
+    continue
+    for (;;)
+        switch (IP->Op)
+        {
+#endif
+
+    CASE(Halt)
+    return;
+    CASE(Mov)
+    std::copy_n(&SRC1, IP->W, &DST);
+    NEXT();
+
+    CASE(AddI)
+    DST.I = interp::add(SRC1.I, SRC2.I);
+    NEXT();
+    CASE(SubI)
+    DST.I = interp::sub(SRC1.I, SRC2.I);
+    NEXT();
+    CASE(MulI)
+    DST.I = interp::mul(SRC1.I, SRC2.I);
+    NEXT();
+    CASE(DivI)
+    DST.I = interp::div(SRC1.I, SRC2.I);
+    NEXT();
+    CASE(RemI)
+    DST.I = interp::rem(SRC1.I, SRC2.I);
+    NEXT();
+    CASE(AndI)
+    DST.I = SRC1.I & SRC2.I;
+    NEXT();
+    CASE(OrI)
+    DST.I = SRC1.I | SRC2.I;
+    NEXT();
+    CASE(XorI)
+    DST.I = SRC1.I ^ SRC2.I;
+    NEXT();
+    CASE(ShlI)
+    DST.I = interp::shl(SRC1.I, SRC2.I);
+    NEXT();
+    CASE(ShrI)
+    DST.I = interp::shr(SRC1.I, SRC2.I);
+    NEXT();
+    CASE(NotI)
+    DST.I = ~SRC1.I;
+    NEXT();
+    CASE(LNotI)
+    DST.I = SRC1.I == 0;
+    NEXT();
+    CASE(ClampI)
+    DST.I = interp::clamp(SRC1.I, IP->W);
+    NEXT();
+
+    CASE(AddF)
+    LANES(D->F = X->F + Y->F);
+    NEXT();
+    CASE(SubF)
+    LANES(D->F = X->F - Y->F);
+    NEXT();
+    CASE(MulF)
+    LANES(D->F = X->F * Y->F);
+    NEXT();
+    CASE(DivF)
+    LANES(D->F = X->F / Y->F);
+    NEXT();
+    CASE(RemF)
+    LANES(D->F = interp::rem(X->F, Y->F));
+    NEXT();
+    CASE(LNotF)
+    DST.I = !(SRC1.F != 0.0f);
+    NEXT();
+
+    CASE(EqI)
+    DST.I = SRC1.I == SRC2.I;
+    NEXT();
+    CASE(NeI)
+    DST.I = SRC1.I != SRC2.I;
+    NEXT();
+    CASE(LtI)
+    DST.I = SRC1.I < SRC2.I;
+    NEXT();
+    CASE(GtI)
+    DST.I = SRC1.I > SRC2.I;
+    NEXT();
+    CASE(LeI)
+    DST.I = SRC1.I <= SRC2.I;
+    NEXT();
+    CASE(GeI)
+    DST.I = SRC1.I >= SRC2.I;
+    NEXT();
+    CASE(EqF)
+    DST.I = SRC1.F == SRC2.F;
+    NEXT();
+    CASE(NeF)
+    DST.I = SRC1.F != SRC2.F;
+    NEXT();
+    CASE(LtF)
+    DST.I = SRC1.F < SRC2.F;
+    NEXT();
+    CASE(GtF)
+    DST.I = SRC1.F > SRC2.F;
+    NEXT();
+    CASE(LeF)
+    DST.I = SRC1.F <= SRC2.F;
+    NEXT();
+    CASE(GeF)
+    DST.I = SRC1.F >= SRC2.F;
+    NEXT();
+    CASE(EqV)
+    {
+        bool Equal = true;
+        for (unsigned L = 0, W = IP->W; L != W; ++L)
+            Equal &= (&SRC1)[L].F == (&SRC2)[L].F;
+        DST.I = Equal;
+    }
+    NEXT();
+    CASE(NeV)
+    {
+        bool Equal = true;
+        for (unsigned L = 0, W = IP->W; L != W; ++L)
+            Equal &= (&SRC1)[L].F == (&SRC2)[L].F;
+        DST.I = !Equal;
+    }
+    NEXT();
+
+    CASE(IToF)
+    DST.F = static_cast<float>(SRC1.I);
+    NEXT();
+    CASE(FToI)
+    DST.I = interp::toInt(SRC1.F);
+    NEXT();
+    CASE(Splat)
+    std::fill_n(&DST, IP->W, SRC1);
+    NEXT();
+    CASE(Diag)
+    {
+        Slot Value = SRC1;
+        Slot *D = &DST;
+        std::fill_n(D, 16, Slot{0});
+        for (unsigned L = 0; L < 16; L += 5)
+            D[L] = Value;
+    }
+    NEXT();
+
+    CASE(Extract)
+    DST = (&SRC1)[SRC2.I];
+    NEXT();
+    CASE(Insert)
+    (&DST)[SRC1.I] = SRC2;
+    NEXT();
+    CASE(MatMul)
+    {
+        float A[16], B[16];
+        for (unsigned L = 0; L < 16; ++L)
+        {
+            A[L] = (&SRC1)[L].F;
+            B[L] = (&SRC2)[L].F;
+        }
+        interp::matMul(A, A, B);
+        for (unsigned L = 0; L < 16; ++L)
+            (&DST)[L].F = A[L];
+    }
+    NEXT();
+
+    CASE(Jmp)
+    JUMP(IP->A);
+    CASE(Jz)
+    if (R[IP->A].I == 0)
+    {
+        JUMP(IP->B);
+    }
+    NEXT();
+    CASE(Jnz)
+    if (R[IP->A].I != 0)
+    {
+        JUMP(IP->B);
+    }
+    NEXT();
+    CASE(JEqI)
+    if (R[IP->A].I == R[IP->B].I)
+    {
+        JUMP(IP->C);
+    }
+    NEXT();
+    CASE(JNeI)
+    if (R[IP->A].I != R[IP->B].I)
+    {
+        JUMP(IP->C);
+    }
+    NEXT();
+    CASE(JLtI)
+    if (R[IP->A].I < R[IP->B].I)
+    {
+        JUMP(IP->C);
+    }
+    NEXT();
+    CASE(JGtI)
+    if (R[IP->A].I > R[IP->B].I)
+    {
+        JUMP(IP->C);
+    }
+    NEXT();
+    CASE(JLeI)
+    if (R[IP->A].I <= R[IP->B].I)
+    {
+        JUMP(IP->C);
+    }
+    NEXT();
+    CASE(JGeI)
+    if (R[IP->A].I >= R[IP->B].I)
+    {
+        JUMP(IP->C);
+    }
+    NEXT();
+
+#ifndef LLSHADER_THREADED_DISPATCH
+        }
+#endif
+#undef CASE
+#undef NEXT
+#undef JUMP
+#undef DISPATCH
+#undef LANES
+#undef DST
+#undef SRC1
+#undef SRC2
+}
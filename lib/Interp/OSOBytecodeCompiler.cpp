@@ -0,0 +1,797 @@
+#include "llshader/Interp/Bytecode.h"
+#include "llshader/OSO/OSOShader.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/Twine.h"
+#include <algorithm>
+#include <cstdlib>
+
+using namespace llvm;
+
+namespace
+{
+constexpr uint32_t ConstantBit = 1u << 31;
+
+bool isTriple(TokenKind Ty)
+{
+    return Ty == TokenKind::kw_color || Ty == TokenKind::kw_point ||
+           Ty == TokenKind::kw_vector || Ty == TokenKind::kw_normal;
+}
+
+bool isScalar(TokenKind Ty)
+{
+    return Ty == TokenKind::kw_int || Ty == TokenKind::kw_float;
+}
+
+unsigned getWidth(TokenKind Ty)
+{
+    return isTriple(Ty) ? 3 : Ty == TokenKind::kw_matrix ? 16 : 1;
+}
+
+// A symbol's or an intermediate value's first slot and type; kw_void for
+// a symbol of a type the interpreter does not have.
+struct Value
+{
+    uint32_t Slot = 0;
+    TokenKind Ty = TokenKind::kw_void;
+};
+} // namespace
+
+// Lowers OSL object code to bytecode with the semantics of the ops that
+// OSOEmitter writes, which are those of the source: ints wrap, conversions
+// are explicit assigns, and triples and matrices combine with scalars
+// element by element. Each symbol gets slots of its own, and .oso control
+// flow is structured, so ifs and loops are rebuilt from their jump targets
+// the way BytecodeCompiler lowers the statements.
+class OSOBytecodeCompiler
+{
+    using Inst = OSOShader::Instruction;
+
+    const OSOShader &Shader;
+    Bytecode &Out;
+    raw_ostream &Errs;
+    bool HasError = false;
+    bool WarnedDerivatives = false;
+
+    std::vector<Value> Symbols;
+    // Values converted for an instruction live past the symbols' slots
+    // until it is done.
+    uint32_t Base = 0;
+    uint32_t Top = 0;
+    uint32_t MaxTop = 0;
+    // By bits, widened past DenseMap's reserved keys.
+    DenseMap<uint64_t, uint32_t> ConstantIds;
+    StringMap<int32_t> StringIds;
+    // Index of the instruction being lowered, for errors.
+    uint32_t Current = 0;
+
+    struct LoopTargets
+    {
+        std::vector<size_t> Breaks;
+        std::vector<size_t> Continues;
+    };
+    std::vector<LoopTargets> Loops;
+
+  public:
+    OSOBytecodeCompiler(const OSOShader &Shader, Bytecode &Out,
+                        raw_ostream &Errs)
+        : Shader(Shader), Out(Out), Errs(Errs)
+    {
+    }
+
+    bool run()
+    {
+        allocateSymbols();
+        if (HasError)
+            return false;
+
+        // Parameters take their defaults, then their initializers run, then
+        // ___main___.
+        for (uint32_t S = 0, E = Symbols.size(); S != E; ++S)
+        {
+            const OSOShader::Symbol &Sym = Shader.getSymbols()[S];
+            if ((Sym.Kind == OSOShader::SymbolKind::Param ||
+                 Sym.Kind == OSOShader::SymbolKind::OParam) &&
+                Sym.NumValues && Symbols[S].Ty != TokenKind::kw_void)
+                emit(Opcode::Mov, Symbols[S].Slot, addConstants(Sym), 0,
+                     getWidth(Symbols[S].Ty));
+        }
+        const std::vector<OSOShader::CodeSection> &Sections =
+            Shader.getSections();
+        int Main = -1;
+        for (size_t S = 0, E = Sections.size(); S != E; ++S)
+        {
+            if (Sections[S].Name == "___main___")
+                Main = static_cast<int>(S);
+            else
+                lowerRange(Sections[S].First, getSectionEnd(S));
+        }
+        if (Main >= 0)
+            lowerRange(Sections[Main].First, getSectionEnd(Main));
+        emit(Opcode::Halt);
+
+        // Constants go after everything else.
+        Out.NumSlots = MaxTop + Out.Constants.size();
+        for (Instruction &I : Out.Code)
+            for (uint32_t *Op : {&I.A, &I.B, &I.C})
+                if (*Op & ConstantBit)
+                    *Op = MaxTop + (*Op & ~ConstantBit);
+        return !HasError;
+    }
+
+  private:
+    void error(const Twine &Msg)
+    {
+        const Inst &I = Shader.getCode()[Current];
+        Errs << "Error: instruction " << Current << " (" << I.Op;
+        if (I.Line)
+            Errs << ", line " << I.Line;
+        Errs << "): " << Msg << "\n";
+        HasError = true;
+    }
+
+    // Once per shader, at the first Dx or Dy.
+    void warnZeroDerivatives()
+    {
+        if (WarnedDerivatives)
+            return;
+        WarnedDerivatives = true;
+        const Inst &I = Shader.getCode()[Current];
+        Errs << "Warning: instruction " << Current << " (" << I.Op;
+        if (I.Line)
+            Errs << ", line " << I.Line;
+        Errs << "): derivatives are 0 in the interpreter\n";
+    }
+
+    uint32_t getSectionEnd(size_t S) const
+    {
+        const std::vector<OSOShader::CodeSection> &Sections =
+            Shader.getSections();
+        return S + 1 < Sections.size() ? Sections[S + 1].First
+                                       : Shader.getCode().size();
+    }
+
+    // Symbols
+
+    void allocateSymbols()
+    {
+        for (const OSOShader::Symbol &Sym : Shader.getSymbols())
+        {
+            Value V;
+            if (Sym.ArrayLength || Sym.Type == TokenKind::kw_void)
+            {
+                // Errors come when an instruction uses it.
+                Symbols.push_back(V);
+                continue;
+            }
+            V.Ty = Sym.Type;
+            unsigned Width = getWidth(Sym.Type);
+            if (Sym.Kind == OSOShader::SymbolKind::Const)
+                V.Slot = addConstants(Sym);
+            else
+                V.Slot = alloc(Width);
+            if (Sym.Kind == OSOShader::SymbolKind::OParam &&
+                Sym.Type == TokenKind::kw_int)
+                Out.Outputs.push_back({Sym.Name.str(), V.Slot});
+            if (Sym.Kind == OSOShader::SymbolKind::Global &&
+                Sym.Type != TokenKind::kw_string)
+                Out.Inputs.push_back({Sym.Name.str(), V.Slot, Width});
+            Symbols.push_back(V);
+        }
+        Base = Top;
+    }
+
+    // The values of Sym in consecutive constant slots. One value fills a
+    // triple, or the diagonal of a matrix.
+    uint32_t addConstants(const OSOShader::Symbol &Sym)
+    {
+        unsigned Width = getWidth(Sym.Type);
+        uint32_t First = Out.Constants.size() | ConstantBit;
+        ArrayRef<StringRef> Values = Shader.getValues(Sym);
+        if (Values.size() != Width && Values.size() != 1)
+        {
+            Errs << "Error: " << Sym.Name << " has " << Values.size()
+                 << " values, not " << Width << "\n";
+            HasError = true;
+            return First;
+        }
+        for (unsigned I = 0; I != Width; ++I)
+        {
+            Slot S;
+            StringRef Text = Values[Values.size() == 1 ? 0 : I];
+            if (Sym.Type == TokenKind::kw_matrix && Values.size() == 1 &&
+                I % 5)
+                Text = "0";
+            if (Sym.Type == TokenKind::kw_string)
+                S.I = getStringId(Text);
+            else if (Sym.Type == TokenKind::kw_int)
+            {
+                if (Text.getAsInteger(10, S.I))
+                {
+                    Errs << "Error: invalid int " << Text << " in "
+                         << Sym.Name << "\n";
+                    HasError = true;
+                }
+            }
+            else
+            {
+                SmallString<32> Buffer(Text);
+                S.F = std::strtof(Buffer.c_str(), nullptr);
+            }
+            Out.Constants.push_back(S);
+        }
+        return First;
+    }
+
+    int32_t getStringId(StringRef Text)
+    {
+        auto Inserted = StringIds.try_emplace(
+            Text, static_cast<int32_t>(Out.Strings.size()));
+        if (Inserted.second)
+            Out.Strings.push_back(Text.str());
+        return Inserted.first->second;
+    }
+
+    // Constants of any type with the same bits share a slot.
+    Value getConstant(TokenKind Ty, Slot S)
+    {
+        auto Inserted = ConstantIds.try_emplace(
+            uint64_t(static_cast<uint32_t>(S.I)),
+            static_cast<uint32_t>(Out.Constants.size()));
+        if (Inserted.second)
+            Out.Constants.push_back(S);
+        return {Inserted.first->second | ConstantBit, Ty};
+    }
+
+    Value getInt(int32_t V)
+    {
+        Slot S;
+        S.I = V;
+        return getConstant(TokenKind::kw_int, S);
+    }
+
+    Value getFloat(float V)
+    {
+        Slot S;
+        S.F = V;
+        return getConstant(TokenKind::kw_float, S);
+    }
+
+    bool isConstant(const Value &V) const { return V.Slot & ConstantBit; }
+
+    int32_t getConstantInt(const Value &V) const
+    {
+        return Out.Constants[V.Slot & ~ConstantBit].I;
+    }
+
+    // Argument N of I, or a zero int after an error if it is missing or
+    // of a type the interpreter does not have.
+    Value getArg(const Inst &I, unsigned N)
+    {
+        ArrayRef<uint32_t> Args = Shader.getArgs(I);
+        if (N >= Args.size())
+        {
+            error("missing argument " + Twine(N));
+            return getInt(0);
+        }
+        const Value &V = Symbols[Args[N]];
+        if (V.Ty == TokenKind::kw_void)
+        {
+            const OSOShader::Symbol &Sym = Shader.getSymbols()[Args[N]];
+            error("symbol " + Sym.Name + " of type " + Sym.TypeName +
+                  (Sym.ArrayLength ? "[]" : "") + " is not supported");
+            return getInt(0);
+        }
+        return V;
+    }
+
+    // Code and slots
+
+    uint32_t here() const { return static_cast<uint32_t>(Out.Code.size()); }
+
+    size_t emit(Opcode Op, uint32_t A = 0, uint32_t B = 0, uint32_t C = 0,
+                unsigned W = 1)
+    {
+        Out.Code.push_back({Op, static_cast<uint16_t>(W), A, B, C});
+        return Out.Code.size() - 1;
+    }
+
+    void setTarget(size_t Jump, uint32_t Target)
+    {
+        Instruction &I = Out.Code[Jump];
+        if (I.Op == Opcode::Jmp)
+            I.A = Target;
+        else
+            I.B = Target;
+    }
+
+    void endLoop(uint32_t Continue)
+    {
+        for (size_t Jump : Loops.back().Continues)
+            setTarget(Jump, Continue);
+        for (size_t Jump : Loops.back().Breaks)
+            setTarget(Jump, here());
+        Loops.pop_back();
+    }
+
+    uint32_t alloc(unsigned Width)
+    {
+        uint32_t Slot = Top;
+        Top += Width;
+        MaxTop = std::max(MaxTop, Top);
+        return Slot;
+    }
+
+    Value produce(Opcode Op, TokenKind Ty, uint32_t B, uint32_t C = 0,
+                  unsigned W = 1)
+    {
+        Value Result = {alloc(getWidth(Ty)), Ty};
+        emit(Op, Result.Slot, B, C, W);
+        return Result;
+    }
+
+    // Conversions
+
+    void convertInto(Value V, Value Dest)
+    {
+        TokenKind From = V.Ty;
+        TokenKind To = Dest.Ty;
+        if (From == To || (isTriple(From) && isTriple(To)))
+        {
+            if (V.Slot != Dest.Slot)
+                emit(Opcode::Mov, Dest.Slot, V.Slot, 0, getWidth(To));
+            return;
+        }
+        if (From == TokenKind::kw_int && To == TokenKind::kw_float)
+            emit(Opcode::IToF, Dest.Slot, V.Slot);
+        else if (From == TokenKind::kw_float && To == TokenKind::kw_int)
+            emit(Opcode::FToI, Dest.Slot, V.Slot);
+        else if (isScalar(From) && isTriple(To))
+            emit(Opcode::Splat, Dest.Slot, toFloat(V).Slot, 0, 3);
+        else if (isScalar(From) && To == TokenKind::kw_matrix)
+            // A scalar converts to a matrix with it on the diagonal.
+            emit(Opcode::Diag, Dest.Slot, toFloat(V).Slot);
+        else
+            error("cannot convert " + Twine(tok::getKeywordSpelling(From)) +
+                  " to " + tok::getKeywordSpelling(To));
+    }
+
+    Value convert(Value V, TokenKind To)
+    {
+        if (V.Ty == To || (isTriple(V.Ty) && isTriple(To)))
+            return {V.Slot, To};
+        if (V.Ty == TokenKind::kw_int && To == TokenKind::kw_float &&
+            isConstant(V))
+            return getFloat(static_cast<float>(getConstantInt(V)));
+        Value Result = {alloc(getWidth(To)), To};
+        convertInto(V, Result);
+        return Result;
+    }
+
+    Value toFloat(Value V) { return convert(V, TokenKind::kw_float); }
+
+    // V as a value of Ty for an element-wise operation, which puts a
+    // scalar in every element.
+    Value widen(Value V, TokenKind Ty)
+    {
+        if (!isScalar(V.Ty) || !(isTriple(Ty) || Ty == TokenKind::kw_matrix))
+            return convert(V, Ty);
+        return produce(Opcode::Splat, Ty, toFloat(V).Slot, 0, getWidth(Ty));
+    }
+
+    Value toInt(Value V)
+    {
+        if (V.Ty != TokenKind::kw_int)
+            error("operand must be an int");
+        return V;
+    }
+
+    // Jumps if Cond, an int or a float, is true or false.
+    size_t emitBranch(Value Cond, bool IfTrue)
+    {
+        if (Cond.Ty == TokenKind::kw_float)
+            Cond = produce(Opcode::NeF, TokenKind::kw_int, Cond.Slot,
+                           getFloat(0).Slot);
+        else if (Cond.Ty != TokenKind::kw_int)
+            error("condition must be an int or a float");
+        return emit(IfTrue ? Opcode::Jnz : Opcode::Jz, Cond.Slot);
+    }
+
+    // Subscripts are clamped into the aggregate, constants right away.
+    Value clampIndex(Value Index, unsigned Size)
+    {
+        Index = toInt(Index);
+        if (isConstant(Index))
+            return getInt(std::min(std::max(getConstantInt(Index), 0),
+                                   int32_t(Size) - 1));
+        return produce(Opcode::ClampI, TokenKind::kw_int, Index.Slot, 0, Size);
+    }
+
+    // The flat subscript of row R and column C of a matrix.
+    Value getMatrixIndex(Value R, Value C)
+    {
+        R = clampIndex(R, 4);
+        C = clampIndex(C, 4);
+        if (isConstant(R) && isConstant(C))
+            return getInt(getConstantInt(R) * 4 + getConstantInt(C));
+        return produce(
+            Opcode::AddI, TokenKind::kw_int,
+            produce(Opcode::ShlI, TokenKind::kw_int, R.Slot, getInt(2).Slot)
+                .Slot,
+            C.Slot);
+    }
+
+    // Control flow
+
+    // The jumps of a structured if or loop at Index, ascending and within
+    // the code being lowered up to Last.
+    bool checkJumps(const Inst &I, uint32_t Index, size_t N, uint32_t Last)
+    {
+        bool Structured = I.NumJumps == N;
+        int32_t Prev = Index + 1;
+        for (int32_t Jump : I.getJumps())
+        {
+            Structured &= Jump >= Prev && Jump <= int32_t(Last);
+            Prev = Jump;
+        }
+        if (!Structured)
+            error("jumps are not structured");
+        return Structured;
+    }
+
+    void lowerRange(uint32_t First, uint32_t Last)
+    {
+        const std::vector<Inst> &Code = Shader.getCode();
+        for (uint32_t Index = First; Index < Last; ++Index)
+        {
+            const Inst &I = Code[Index];
+            Current = Index;
+            Top = Base;
+            StringRef Op = I.Op;
+            if (Op == "if")
+            {
+                if (!checkJumps(I, Index, 2, Last))
+                    return;
+                lowerIf(I, Index);
+                Index = I.Jumps[1] - 1;
+            }
+            else if (Op == "for" || Op == "while" || Op == "dowhile")
+            {
+                if (!checkJumps(I, Index, 4, Last))
+                    return;
+                lowerLoop(I, Index);
+                Index = I.Jumps[3] - 1;
+            }
+            else
+                lowerInstruction(I);
+        }
+    }
+
+    // The then-code runs from after the if to its first jump, the
+    // else-code from there to the second.
+    void lowerIf(const Inst &I, uint32_t Index)
+    {
+        uint32_t Else = I.Jumps[0];
+        uint32_t End = I.Jumps[1];
+        Value Cond = getArg(I, 0);
+        if (Else == Index + 1)
+        {
+            size_t ToEnd = emitBranch(Cond, true);
+            lowerRange(Else, End);
+            setTarget(ToEnd, here());
+            return;
+        }
+        size_t ToElse = emitBranch(Cond, false);
+        lowerRange(Index + 1, Else);
+        if (Else == End)
+        {
+            setTarget(ToElse, here());
+            return;
+        }
+        size_t ToEnd = emit(Opcode::Jmp);
+        setTarget(ToElse, here());
+        lowerRange(Else, End);
+        setTarget(ToEnd, here());
+    }
+
+    // After the loop instruction come its initialization, condition, body
+    // and update. Loops test at the bottom, so an iteration takes one
+    // jump.
+    void lowerLoop(const Inst &I, uint32_t Index)
+    {
+        uint32_t Cond = I.Jumps[0];
+        uint32_t Body = I.Jumps[1];
+        uint32_t Update = I.Jumps[2];
+        uint32_t End = I.Jumps[3];
+        lowerRange(Index + 1, Cond);
+        size_t ToCond = 0;
+        if (I.Op != "dowhile")
+            ToCond = emit(Opcode::Jmp);
+        uint32_t Start = here();
+        Loops.emplace_back();
+        lowerRange(Body, Update);
+        uint32_t Continue = here();
+        lowerRange(Update, End);
+        if (I.Op != "dowhile")
+            setTarget(ToCond, here());
+        lowerRange(Cond, Body);
+        Current = Index;
+        Top = Base;
+        setTarget(emitBranch(getArg(I, 0), true), Start);
+        endLoop(Continue);
+    }
+
+    // Instructions
+
+    void lowerInstruction(const Inst &I)
+    {
+        StringRef Op = I.Op;
+        if (Op == "nop" || Op == "useparam" || Op == "end")
+            return;
+        if (Op == "break" || Op == "continue")
+        {
+            if (Loops.empty())
+            {
+                error("outside of a loop");
+                return;
+            }
+            (Op == "break" ? Loops.back().Breaks : Loops.back().Continues)
+                .push_back(emit(Opcode::Jmp));
+            return;
+        }
+        if (Op == "assign")
+        {
+            convertInto(getArg(I, 1), getArg(I, 0));
+            return;
+        }
+        if (Op == "add" || Op == "sub" || Op == "mul" || Op == "div" ||
+            Op == "mod")
+        {
+            lowerArithmetic(I);
+            return;
+        }
+        if (Op == "neg")
+        {
+            Value Dest = getArg(I, 0);
+            Value E = getArg(I, 1);
+            if (Dest.Ty == TokenKind::kw_int)
+                emit(Opcode::SubI, Dest.Slot, getInt(0).Slot, toInt(E).Slot);
+            else
+                emit(Opcode::SubF, Dest.Slot,
+                     widen(getFloat(0), Dest.Ty).Slot,
+                     widen(E, Dest.Ty).Slot, getWidth(Dest.Ty));
+            return;
+        }
+        if (Op == "bitand" || Op == "bitor" || Op == "xor" || Op == "shl" ||
+            Op == "shr")
+        {
+            Opcode IntOp = Op == "bitand"  ? Opcode::AndI
+                           : Op == "bitor" ? Opcode::OrI
+                           : Op == "xor"   ? Opcode::XorI
+                           : Op == "shl"   ? Opcode::ShlI
+                                           : Opcode::ShrI;
+            emit(IntOp, toInt(getArg(I, 0)).Slot, toInt(getArg(I, 1)).Slot,
+                 toInt(getArg(I, 2)).Slot);
+            return;
+        }
+        if (Op == "compl")
+        {
+            emit(Opcode::NotI, toInt(getArg(I, 0)).Slot,
+                 toInt(getArg(I, 1)).Slot);
+            return;
+        }
+        if (Op == "eq" || Op == "neq" || Op == "lt" || Op == "gt" ||
+            Op == "le" || Op == "ge")
+        {
+            lowerComparison(I);
+            return;
+        }
+        if (Op == "compref" || Op == "mxcompref")
+        {
+            bool IsMatrix = Op == "mxcompref";
+            Value Dest = getArg(I, 0);
+            Value Agg = getArg(I, 1);
+            if (IsMatrix ? Agg.Ty != TokenKind::kw_matrix : !isTriple(Agg.Ty))
+            {
+                error("subscript of a value that is not a triple or matrix");
+                return;
+            }
+            Value Index = IsMatrix ? getMatrixIndex(getArg(I, 2), getArg(I, 3))
+                                   : clampIndex(getArg(I, 2), 3);
+            if (Dest.Ty == TokenKind::kw_float)
+                emit(Opcode::Extract, Dest.Slot, Agg.Slot, Index.Slot,
+                     getWidth(Agg.Ty));
+            else
+                convertInto(produce(Opcode::Extract, TokenKind::kw_float,
+                                    Agg.Slot, Index.Slot, getWidth(Agg.Ty)),
+                            Dest);
+            return;
+        }
+        if (Op == "compassign" || Op == "mxcompassign")
+        {
+            bool IsMatrix = Op == "mxcompassign";
+            Value Agg = getArg(I, 0);
+            if (IsMatrix ? Agg.Ty != TokenKind::kw_matrix : !isTriple(Agg.Ty))
+            {
+                error("subscript of a value that is not a triple or matrix");
+                return;
+            }
+            Value Index = IsMatrix ? getMatrixIndex(getArg(I, 1), getArg(I, 2))
+                                   : clampIndex(getArg(I, 1), 3);
+            Value Elt = toFloat(getArg(I, IsMatrix ? 3 : 2));
+            emit(Opcode::Insert, Agg.Slot, Index.Slot, Elt.Slot,
+                 getWidth(Agg.Ty));
+            return;
+        }
+        if (Op == "clamp")
+        {
+            // Only the clamp of a subscript, between 0 and a constant, has
+            // an instruction.
+            Value Dest = getArg(I, 0);
+            Value Lo = getArg(I, 2);
+            Value Hi = getArg(I, 3);
+            if (Dest.Ty != TokenKind::kw_int || !isConstant(Lo) ||
+                getConstantInt(Lo) != 0 || !isConstant(Hi) ||
+                getConstantInt(Hi) < 0)
+            {
+                error("only clamps of ints from 0 to a constant are "
+                      "supported");
+                return;
+            }
+            emit(Opcode::ClampI, Dest.Slot, toInt(getArg(I, 1)).Slot, 0,
+                 getConstantInt(Hi) + 1);
+            return;
+        }
+        if (Op == "color" || Op == "point" || Op == "vector" ||
+            Op == "normal" || Op == "matrix")
+        {
+            lowerConstructor(I);
+            return;
+        }
+        if (Op == "Dx" || Op == "Dy")
+        {
+            // As in BytecodeCompiler, there are no neighbouring points to
+            // differ from, so derivatives are 0.
+            Value Dest = getArg(I, 0);
+            if (Dest.Ty != TokenKind::kw_float && !isTriple(Dest.Ty))
+            {
+                error("result must be a float or a triple");
+                return;
+            }
+            getArg(I, 1);
+            warnZeroDerivatives();
+            convertInto(getFloat(0), Dest);
+            return;
+        }
+        error("unsupported instruction");
+    }
+
+    void lowerArithmetic(const Inst &I)
+    {
+        StringRef Op = I.Op;
+        Value Dest = getArg(I, 0);
+        Value LHS = getArg(I, 1);
+        Value RHS = getArg(I, 2);
+        TokenKind Ty = Dest.Ty;
+        if (Ty == TokenKind::kw_int)
+        {
+            Opcode IntOp = Op == "add"   ? Opcode::AddI
+                           : Op == "sub" ? Opcode::SubI
+                           : Op == "mul" ? Opcode::MulI
+                           : Op == "div" ? Opcode::DivI
+                                         : Opcode::RemI;
+            emit(IntOp, Dest.Slot, toInt(LHS).Slot, toInt(RHS).Slot);
+            return;
+        }
+        if (Ty == TokenKind::kw_matrix && LHS.Ty == Ty && RHS.Ty == Ty &&
+            (Op == "mul" || Op == "div"))
+        {
+            // A matrix quotient is a product with an inverse, for which
+            // there is no instruction.
+            if (Op == "div")
+                error("division of matrices is not supported");
+            else
+                emit(Opcode::MatMul, Dest.Slot, LHS.Slot, RHS.Slot);
+            return;
+        }
+        if (Ty == TokenKind::kw_string)
+        {
+            error("arithmetic on strings");
+            return;
+        }
+        Opcode FloatOp = Op == "add"   ? Opcode::AddF
+                         : Op == "sub" ? Opcode::SubF
+                         : Op == "mul" ? Opcode::MulF
+                         : Op == "div" ? Opcode::DivF
+                                       : Opcode::RemF;
+        LHS = widen(LHS, Ty);
+        RHS = widen(RHS, Ty);
+        emit(FloatOp, Dest.Slot, LHS.Slot, RHS.Slot, getWidth(Ty));
+    }
+
+    void lowerComparison(const Inst &I)
+    {
+        StringRef Op = I.Op;
+        Value Dest = toInt(getArg(I, 0));
+        Value LHS = getArg(I, 1);
+        Value RHS = getArg(I, 2);
+        if ((LHS.Ty == TokenKind::kw_int && RHS.Ty == TokenKind::kw_int) ||
+            (LHS.Ty == TokenKind::kw_string && RHS.Ty == LHS.Ty))
+        {
+            if (LHS.Ty == TokenKind::kw_string && Op != "eq" && Op != "neq")
+                error("strings are only equal or not");
+            Opcode IntOp = Op == "lt"   ? Opcode::LtI
+                           : Op == "gt" ? Opcode::GtI
+                           : Op == "le" ? Opcode::LeI
+                           : Op == "ge" ? Opcode::GeI
+                           : Op == "eq" ? Opcode::EqI
+                                        : Opcode::NeI;
+            emit(IntOp, Dest.Slot, LHS.Slot, RHS.Slot);
+            return;
+        }
+        if (!isScalar(LHS.Ty) || !isScalar(RHS.Ty))
+        {
+            // Triples and matrices are only equal or not.
+            if (Op != "eq" && Op != "neq")
+            {
+                error("triples and matrices are only equal or not");
+                return;
+            }
+            TokenKind Ty = LHS.Ty == TokenKind::kw_matrix ||
+                                   RHS.Ty == TokenKind::kw_matrix
+                               ? TokenKind::kw_matrix
+                           : isTriple(LHS.Ty) ? LHS.Ty
+                                              : RHS.Ty;
+            LHS = convert(LHS, Ty);
+            RHS = convert(RHS, Ty);
+            emit(Op == "eq" ? Opcode::EqV : Opcode::NeV, Dest.Slot, LHS.Slot,
+                 RHS.Slot, getWidth(Ty));
+            return;
+        }
+        Opcode FloatOp = Op == "lt"   ? Opcode::LtF
+                         : Op == "gt" ? Opcode::GtF
+                         : Op == "le" ? Opcode::LeF
+                         : Op == "ge" ? Opcode::GeF
+                         : Op == "eq" ? Opcode::EqF
+                                      : Opcode::NeF;
+        LHS = toFloat(LHS);
+        RHS = toFloat(RHS);
+        emit(FloatOp, Dest.Slot, LHS.Slot, RHS.Slot);
+    }
+
+    // A constructor takes one value, converted, or every component.
+    void lowerConstructor(const Inst &I)
+    {
+        Value Dest = getArg(I, 0);
+        unsigned Width = getWidth(Dest.Ty);
+        if (Width == 1)
+        {
+            error("constructor of a scalar");
+            return;
+        }
+        if (I.NumArgs == 2)
+        {
+            convertInto(getArg(I, 1), Dest);
+            return;
+        }
+        if (I.NumArgs != Width + 1)
+        {
+            // Such as a coordinate system's name before the components.
+            error("constructor arguments are not supported");
+            return;
+        }
+        for (unsigned C = 0; C != Width; ++C)
+            convertInto(getArg(I, C + 1),
+                        {Dest.Slot + C, TokenKind::kw_float});
+    }
+};
+
+std::unique_ptr<Bytecode> Bytecode::compile(const OSOShader &Shader,
+                                            raw_ostream &Errs)
+{
+    std::unique_ptr<Bytecode> Code(new Bytecode());
+    if (!OSOBytecodeCompiler(Shader, *Code, Errs).run())
+        return nullptr;
+    return Code;
+}
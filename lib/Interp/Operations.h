@@ -0,0 +1,81 @@
+#ifndef LLSHADER_LIB_INTERP_OPERATIONS_H
+#define LLSHADER_LIB_INTERP_OPERATIONS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// The scalar operations both interpreters share, with codegen's semantics.
+namespace interp
+{
+inline int32_t wrap(uint32_t X) { return static_cast<int32_t>(X); }
+
+inline int32_t add(int32_t X, int32_t Y)
+{
+    return wrap(uint32_t(X) + uint32_t(Y));
+}
+
+inline int32_t sub(int32_t X, int32_t Y)
+{
+    return wrap(uint32_t(X) - uint32_t(Y));
+}
+
+inline int32_t mul(int32_t X, int32_t Y)
+{
+    return wrap(uint32_t(X) * uint32_t(Y));
+}
+
+inline int32_t div(int32_t X, int32_t Y)
+{
+    return Y == 0 ? 0 : Y == -1 ? wrap(0u - uint32_t(X)) : X / Y;
+}
+
+inline int32_t rem(int32_t X, int32_t Y)
+{
+    return Y == 0 || Y == -1 ? 0 : X % Y;
+}
+
+// Shift counts are taken modulo 32, as x86 does.
+inline int32_t shl(int32_t X, int32_t Y)
+{
+    return wrap(uint32_t(X) << (Y & 31));
+}
+inline int32_t shr(int32_t X, int32_t Y)
+{
+    return X >> (Y & 31);
+}
+
+inline int32_t clamp(int32_t X, uint32_t Size)
+{
+    return std::min(std::max(X, 0), int32_t(Size) - 1);
+}
+
+// Out of range and NaN give INT_MIN, as cvttss2si does.
+inline int32_t toInt(float X)
+{
+    if (X >= -2147483648.0f && X < 2147483648.0f)
+        return static_cast<int32_t>(X);
+    return INT32_MIN;
+}
+
+inline float rem(float X, float Y) { return std::fmod(X, Y); }
+
+// Row I of the product is the sum over K of A[I][K] times row K of B,
+// added in the same order as codegen's for the same rounding. Result may
+// alias the operands.
+inline void matMul(float Result[16], const float A[16], const float B[16])
+{
+    float R[16];
+    for (unsigned I = 0; I < 4; ++I)
+        for (unsigned J = 0; J < 4; ++J)
+        {
+            float Sum = A[4 * I] * B[J];
+            for (unsigned K = 1; K < 4; ++K)
+                Sum += A[4 * I + K] * B[4 * K + J];
+            R[4 * I + J] = Sum;
+        }
+    std::copy(R, R + 16, Result);
+}
+} // namespace interp
+
+#endif
@@ -1,47 +1,94 @@
 #include "llshader/Lexer/Lexer.h"
+#include "llshader/Lexer/CharInfo.h"
+#include "llshader/Lexer/NumericLiteral.h"
 #include <iostream>
 
-namespace charinfo
+void Lexer::next(Token &Tok)
 {
-LLVM_READNONE inline static bool isWhitespace(char c)
-{
-    return c == ' ' || c == '\t' || c == '\f' || c == '\v' || c == '\r' ||
-           c == '\n';
-}
-LLVM_READNONE inline static bool isDigit(char c)
-{
-    return c >= '0' && c <= '9';
-}
-LLVM_READNONE inline static bool isHexDigit(char c)
-{
-    return isDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
-}
-LLVM_READNONE inline static bool isSign(char c)
-{
-    return (c == '-') || (c == '+');
-}
-LLVM_READNONE inline static bool isLetter(char c)
-{
-    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
-}
-LLVM_READNONE inline static bool isLetter_(char c)
-{
-    return isLetter(c) || c == '_';
+    if (!Window)
+    {
+        lexToken(Tok);
+        convertLiteral(Tok);
+        return;
+    }
+
+    while (true)
+    {
+        const char *Start = BufferPtr;
+        lexToken(Tok);
+        // A token (or the whitespace before EOF) that runs into the end of
+        // the window may continue in the next chunk: slide the window and
+        // lex it again from where it started.
+        const char *End = Tok.is(TokenKind::eof) ? BufferPtr : Tok.Text.end();
+        if (Window->atEOF() || End != Window->end())
+            break;
+        BufferPtr = Window->slide(Start);
+        Buffer = StringRef(Window->begin(), Window->end() - Window->begin());
+    }
+    // Only now, as a token lexed again after a slide would be diagnosed
+    // twice.
+    convertLiteral(Tok);
+    Tok.Text = TextSaver.save(Tok.Text);
 }
-LLVM_READNONE inline static bool isLetterDigit_(char c)
+
+void Lexer::convertLiteral(Token &Tok)
 {
-    return isLetter_(c) || isDigit(c);
+    if (Tok.is(TokenKind::integer))
+    {
+        switch (parseIntegerLiteral(Tok.Text, Tok.IntValue))
+        {
+        case LiteralStatus::Ok:
+            break;
+        case LiteralStatus::Wrapped:
+            Diags.report(Tok.Loc, diag::warn_integer_literal_wraps, Tok.Text);
+            break;
+        case LiteralStatus::TooLarge:
+            Diags.report(Tok.Loc, diag::err_integer_literal_too_large,
+                         Tok.Text);
+            Tok.IntValue = 0;
+            break;
+        default:
+            Diags.report(Tok.Loc, diag::err_invalid_numeric_literal,
+                         Tok.Text);
+            Tok.IntValue = 0;
+            break;
+        }
+    }
+    else if (Tok.is(TokenKind::floating_point))
+    {
+        switch (parseFloatLiteral(Tok.Text, Tok.FloatValue))
+        {
+        case LiteralStatus::Ok:
+            break;
+        case LiteralStatus::Overflow:
+            Diags.report(Tok.Loc, diag::warn_float_literal_overflow,
+                         Tok.Text);
+            break;
+        case LiteralStatus::Underflow:
+            Diags.report(Tok.Loc, diag::warn_float_literal_underflow,
+                         Tok.Text);
+            break;
+        case LiteralStatus::Denormal:
+            Diags.report(Tok.Loc, diag::warn_float_literal_denormal,
+                         Tok.Text);
+            break;
+        default:
+            Diags.report(Tok.Loc, diag::err_invalid_numeric_literal,
+                         Tok.Text);
+            Tok.FloatValue = 0;
+            break;
+        }
+    }
 }
-} // namespace charinfo
 
-void Lexer::next(Token &token)
+void Lexer::lexToken(Token &token)
 {
     while (*BufferPtr && charinfo::isWhitespace(*BufferPtr))
         ++BufferPtr;
 
-    if (!*BufferPtr)
+    if (!*BufferPtr || (BufferLimit && BufferPtr >= BufferLimit))
     {
-        token.Kind = TokenKind::eof;
+        formToken(token, BufferPtr, TokenKind::eof);
         return;
     }
 
@@ -151,11 +198,12 @@ void Lexer::next(Token &token)
     if (*BufferPtr == '"')
     {
         BufferPtr += 1;
-        const char *End = BufferPtr + 1;
-        while (End && *End != '"')
+        const char *End = BufferPtr;
+        while (*End && *End != '"')
             ++End;
         formToken(token, End, TokenKind::string_literal);
-        BufferPtr += 1;
+        if (*BufferPtr == '"')
+            BufferPtr += 1;
         return;
     }
 
@@ -221,5 +269,6 @@ void Lexer::formToken(Token &Tok, const char *TokEnd, TokenKind Kind)
 {
     Tok.Kind = Kind;
     Tok.Text = StringRef(BufferPtr, TokEnd - BufferPtr);
+    Tok.Loc = SMLoc::getFromPointer(BufferPtr);
     BufferPtr = TokEnd;
 }
\ No newline at end of file
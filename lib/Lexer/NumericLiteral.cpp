@@ -0,0 +1,362 @@
+#include "llshader/Lexer/NumericLiteral.h"
+#include "llshader/Lexer/CharInfo.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/MathExtras.h"
+#include <algorithm>
+#include <cstdlib>
+
+// Floats are converted the way fast_float does: Clinger's fast path when
+// the mantissa and the power of ten are both exact in float, otherwise
+// Eisel and Lemire's algorithm, which rounds correctly from a 128-bit
+// product, and strtof only for the rare literal with more than 19
+// significant digits whose dropped digits could change the result.
+
+namespace
+{
+// float's layout.
+constexpr int MantissaBits = 23;
+constexpr int MinExponent = -127;
+constexpr uint32_t InfinitePower = 0xFF;
+
+// Significant digits kept; 10^19 fits in 64 bits.
+constexpr unsigned MaxDigits = 19;
+// Any 19-digit mantissa times a power of ten outside these is zero or
+// infinity in float.
+constexpr int SmallestPowerOfTen = -65;
+constexpr int LargestPowerOfTen = 38;
+// Only in this range can a decimal lie exactly between two floats, so only
+// here do the product's lost bits decide a tie.
+constexpr int MinRoundToEven = -17;
+constexpr int MaxRoundToEven = 10;
+// Ints up to 2^24 and powers of ten up to 10^10 are exact in float, and so
+// is one rounded product or quotient of them.
+constexpr int MaxFastExponent = 10;
+constexpr uint64_t MaxFastMantissa = uint64_t(1) << 24;
+
+// 5^Q for Q from SmallestPowerOfTen to LargestPowerOfTen, shifted to set
+// the top bit and truncated to 128 bits, high word first; for negative Q,
+// its reciprocal rounded up.
+const uint64_t PowersOfFive[][2] = {
+    {0x86ccbb52ea94baea, 0x98e947129fc2b4e9},
+    {0xa87fea27a539e9a5, 0x3f2398d747b36224},
+    {0xd29fe4b18e88640e, 0x8eec7f0d19a03aad},
+    {0x83a3eeeef9153e89, 0x1953cf68300424ac},
+    {0xa48ceaaab75a8e2b, 0x5fa8c3423c052dd7},
+    {0xcdb02555653131b6, 0x3792f412cb06794d},
+    {0x808e17555f3ebf11, 0xe2bbd88bbee40bd0},
+    {0xa0b19d2ab70e6ed6, 0x5b6aceaeae9d0ec4},
+    {0xc8de047564d20a8b, 0xf245825a5a445275},
+    {0xfb158592be068d2e, 0xeed6e2f0f0d56712},
+    {0x9ced737bb6c4183d, 0x55464dd69685606b},
+    {0xc428d05aa4751e4c, 0xaa97e14c3c26b886},
+    {0xf53304714d9265df, 0xd53dd99f4b3066a8},
+    {0x993fe2c6d07b7fab, 0xe546a8038efe4029},
+    {0xbf8fdb78849a5f96, 0xde98520472bdd033},
+    {0xef73d256a5c0f77c, 0x963e66858f6d4440},
+    {0x95a8637627989aad, 0xdde7001379a44aa8},
+    {0xbb127c53b17ec159, 0x5560c018580d5d52},
+    {0xe9d71b689dde71af, 0xaab8f01e6e10b4a6},
+    {0x9226712162ab070d, 0xcab3961304ca70e8},
+    {0xb6b00d69bb55c8d1, 0x3d607b97c5fd0d22},
+    {0xe45c10c42a2b3b05, 0x8cb89a7db77c506a},
+    {0x8eb98a7a9a5b04e3, 0x77f3608e92adb242},
+    {0xb267ed1940f1c61c, 0x55f038b237591ed3},
+    {0xdf01e85f912e37a3, 0x6b6c46dec52f6688},
+    {0x8b61313bbabce2c6, 0x2323ac4b3b3da015},
+    {0xae397d8aa96c1b77, 0xabec975e0a0d081a},
+    {0xd9c7dced53c72255, 0x96e7bd358c904a21},
+    {0x881cea14545c7575, 0x7e50d64177da2e54},
+    {0xaa242499697392d2, 0xdde50bd1d5d0b9e9},
+    {0xd4ad2dbfc3d07787, 0x955e4ec64b44e864},
+    {0x84ec3c97da624ab4, 0xbd5af13bef0b113e},
+    {0xa6274bbdd0fadd61, 0xecb1ad8aeacdd58e},
+    {0xcfb11ead453994ba, 0x67de18eda5814af2},
+    {0x81ceb32c4b43fcf4, 0x80eacf948770ced7},
+    {0xa2425ff75e14fc31, 0xa1258379a94d028d},
+    {0xcad2f7f5359a3b3e, 0x096ee45813a04330},
+    {0xfd87b5f28300ca0d, 0x8bca9d6e188853fc},
+    {0x9e74d1b791e07e48, 0x775ea264cf55347e},
+    {0xc612062576589dda, 0x95364afe032a819e},
+    {0xf79687aed3eec551, 0x3a83ddbd83f52205},
+    {0x9abe14cd44753b52, 0xc4926a9672793543},
+    {0xc16d9a0095928a27, 0x75b7053c0f178294},
+    {0xf1c90080baf72cb1, 0x5324c68b12dd6339},
+    {0x971da05074da7bee, 0xd3f6fc16ebca5e04},
+    {0xbce5086492111aea, 0x88f4bb1ca6bcf585},
+    {0xec1e4a7db69561a5, 0x2b31e9e3d06c32e6},
+    {0x9392ee8e921d5d07, 0x3aff322e62439fd0},
+    {0xb877aa3236a4b449, 0x09befeb9fad487c3},
+    {0xe69594bec44de15b, 0x4c2ebe687989a9b4},
+    {0x901d7cf73ab0acd9, 0x0f9d37014bf60a11},
+    {0xb424dc35095cd80f, 0x538484c19ef38c95},
+    {0xe12e13424bb40e13, 0x2865a5f206b06fba},
+    {0x8cbccc096f5088cb, 0xf93f87b7442e45d4},
+    {0xafebff0bcb24aafe, 0xf78f69a51539d749},
+    {0xdbe6fecebdedd5be, 0xb573440e5a884d1c},
+    {0x89705f4136b4a597, 0x31680a88f8953031},
+    {0xabcc77118461cefc, 0xfdc20d2b36ba7c3e},
+    {0xd6bf94d5e57a42bc, 0x3d32907604691b4d},
+    {0x8637bd05af6c69b5, 0xa63f9a49c2c1b110},
+    {0xa7c5ac471b478423, 0x0fcf80dc33721d54},
+    {0xd1b71758e219652b, 0xd3c36113404ea4a9},
+    {0x83126e978d4fdf3b, 0x645a1cac083126ea},
+    {0xa3d70a3d70a3d70a, 0x3d70a3d70a3d70a4},
+    {0xcccccccccccccccc, 0xcccccccccccccccd},
+    {0x8000000000000000, 0x0000000000000000},
+    {0xa000000000000000, 0x0000000000000000},
+    {0xc800000000000000, 0x0000000000000000},
+    {0xfa00000000000000, 0x0000000000000000},
+    {0x9c40000000000000, 0x0000000000000000},
+    {0xc350000000000000, 0x0000000000000000},
+    {0xf424000000000000, 0x0000000000000000},
+    {0x9896800000000000, 0x0000000000000000},
+    {0xbebc200000000000, 0x0000000000000000},
+    {0xee6b280000000000, 0x0000000000000000},
+    {0x9502f90000000000, 0x0000000000000000},
+    {0xba43b74000000000, 0x0000000000000000},
+    {0xe8d4a51000000000, 0x0000000000000000},
+    {0x9184e72a00000000, 0x0000000000000000},
+    {0xb5e620f480000000, 0x0000000000000000},
+    {0xe35fa931a0000000, 0x0000000000000000},
+    {0x8e1bc9bf04000000, 0x0000000000000000},
+    {0xb1a2bc2ec5000000, 0x0000000000000000},
+    {0xde0b6b3a76400000, 0x0000000000000000},
+    {0x8ac7230489e80000, 0x0000000000000000},
+    {0xad78ebc5ac620000, 0x0000000000000000},
+    {0xd8d726b7177a8000, 0x0000000000000000},
+    {0x878678326eac9000, 0x0000000000000000},
+    {0xa968163f0a57b400, 0x0000000000000000},
+    {0xd3c21bcecceda100, 0x0000000000000000},
+    {0x84595161401484a0, 0x0000000000000000},
+    {0xa56fa5b99019a5c8, 0x0000000000000000},
+    {0xcecb8f27f4200f3a, 0x0000000000000000},
+    {0x813f3978f8940984, 0x4000000000000000},
+    {0xa18f07d736b90be5, 0x5000000000000000},
+    {0xc9f2c9cd04674ede, 0xa400000000000000},
+    {0xfc6f7c4045812296, 0x4d00000000000000},
+    {0x9dc5ada82b70b59d, 0xf020000000000000},
+    {0xc5371912364ce305, 0x6c28000000000000},
+    {0xf684df56c3e01bc6, 0xc732000000000000},
+    {0x9a130b963a6c115c, 0x3c7f400000000000},
+    {0xc097ce7bc90715b3, 0x4b9f100000000000},
+    {0xf0bdc21abb48db20, 0x1e86d40000000000},
+    {0x96769950b50d88f4, 0x1314448000000000},
+};
+
+const float PowersOfTen[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f,
+                             1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+
+struct Product
+{
+    uint64_t High;
+    uint64_t Low;
+};
+
+Product multiply(uint64_t A, uint64_t B)
+{
+    unsigned __int128 P = static_cast<unsigned __int128>(A) * B;
+    return {static_cast<uint64_t>(P >> 64), static_cast<uint64_t>(P)};
+}
+
+// The bits of the float nearest W * 10^Q. The 128-bit power of five is
+// always close enough for a 64-bit W (Mushtak and Lemire, "Fast Number
+// Parsing Without Fallback").
+uint32_t computeFloat(int Q, uint64_t W)
+{
+    if (W == 0 || Q < SmallestPowerOfTen)
+        return 0;
+    if (Q > LargestPowerOfTen)
+        return InfinitePower << MantissaBits;
+
+    int LeadingZeros = llvm::countLeadingZeros(W);
+    W <<= LeadingZeros;
+    const uint64_t *Power = PowersOfFive[Q - SmallestPowerOfTen];
+    // The bits below the mantissa and its rounding bit; if they are all
+    // ones, the low word could carry into them.
+    constexpr uint64_t PrecisionMask = ~uint64_t(0) >> (MantissaBits + 3);
+    Product P = multiply(W, Power[0]);
+    if ((P.High & PrecisionMask) == PrecisionMask)
+    {
+        Product Second = multiply(W, Power[1]);
+        P.Low += Second.High;
+        if (Second.High > P.Low)
+            ++P.High;
+    }
+
+    int UpperBit = static_cast<int>(P.High >> 63);
+    int Shift = UpperBit + 64 - MantissaBits - 3;
+    uint64_t Mantissa = P.High >> Shift;
+    // floor(Q * log2(10)) + 63 is the binary exponent of 10^Q's entry.
+    int Power2 = (((152170 + 65536) * Q) >> 16) + 63 + UpperBit -
+                 LeadingZeros - MinExponent;
+
+    if (Power2 <= 0)
+    {
+        // A denormal: shift the mantissa into place and round it.
+        if (-Power2 + 1 >= 64)
+            return 0;
+        Mantissa >>= -Power2 + 1;
+        Mantissa += Mantissa & 1;
+        Mantissa >>= 1;
+        // Rounding up can reach the smallest normal float, whose exponent
+        // bit the mantissa then sets.
+        return static_cast<uint32_t>(Mantissa);
+    }
+
+    if (P.Low <= 1 && Q >= MinRoundToEven && Q <= MaxRoundToEven &&
+        (Mantissa & 3) == 1 && (Mantissa << Shift) == P.High)
+        Mantissa &= ~uint64_t(1);
+    Mantissa += Mantissa & 1;
+    Mantissa >>= 1;
+    if (Mantissa >= (uint64_t(2) << MantissaBits))
+    {
+        Mantissa = uint64_t(1) << MantissaBits;
+        ++Power2;
+    }
+    Mantissa &= ~(uint64_t(1) << MantissaBits);
+    if (static_cast<uint32_t>(Power2) >= InfinitePower)
+        return InfinitePower << MantissaBits;
+    return static_cast<uint32_t>(Power2) << MantissaBits |
+           static_cast<uint32_t>(Mantissa);
+}
+} // namespace
+
+LiteralStatus parseIntegerLiteral(StringRef Text, int32_t &Value)
+{
+    bool Negative = Text.consume_front("-");
+    if (!Negative)
+        Text.consume_front("+");
+    uint64_t Radix = 10;
+    if (Text.size() >= 2 && Text[0] == '0' &&
+        (Text[1] == 'x' || Text[1] == 'X'))
+    {
+        Radix = 16;
+        Text = Text.drop_front(2);
+    }
+    if (Text.empty())
+        return LiteralStatus::Invalid;
+
+    uint64_t Result = 0;
+    for (char C : Text)
+    {
+        uint64_t Digit;
+        if (charinfo::isDigit(C))
+            Digit = C - '0';
+        else if (Radix == 16 && charinfo::isHexDigit(C))
+            Digit = (C | 0x20) - 'a' + 10;
+        else
+            return LiteralStatus::Invalid;
+        if (Result > (UINT64_MAX - Digit) / Radix)
+            return LiteralStatus::TooLarge;
+        Result = Result * Radix + Digit;
+    }
+    // Like the constant folder, ints wrap to 32 bits. A hex literal spells
+    // the bits, so all 32 are its own; a decimal one has to be in range.
+    uint32_t Bits = static_cast<uint32_t>(Result);
+    Value = static_cast<int32_t>(Negative ? 0u - Bits : Bits);
+    uint64_t Max = Radix == 16 ? UINT32_MAX
+                   : Negative  ? uint64_t(INT32_MAX) + 1
+                               : INT32_MAX;
+    return Result > Max ? LiteralStatus::Wrapped : LiteralStatus::Ok;
+}
+
+LiteralStatus parseFloatLiteral(StringRef Text, float &Value)
+{
+    const char *Ptr = Text.begin();
+    const char *End = Text.end();
+    bool Negative = Ptr != End && *Ptr == '-';
+    if (Ptr != End && charinfo::isSign(*Ptr))
+        ++Ptr;
+    const char *Start = Ptr;
+
+    // The value is Mantissa * 10^Exponent, with the mantissa's leading
+    // zeros dropped and at most MaxDigits digits kept.
+    uint64_t Mantissa = 0;
+    unsigned Digits = 0;
+    int64_t Exponent = 0;
+    bool SawDigit = false;
+    bool Truncated = false;
+    for (; Ptr != End && charinfo::isDigit(*Ptr); ++Ptr)
+    {
+        unsigned Digit = *Ptr - '0';
+        SawDigit = true;
+        if (Digits == MaxDigits)
+        {
+            ++Exponent;
+            Truncated |= Digit != 0;
+        }
+        else if (Digits || Digit)
+        {
+            Mantissa = Mantissa * 10 + Digit;
+            ++Digits;
+        }
+    }
+    if (Ptr != End && *Ptr == '.')
+    {
+        for (++Ptr; Ptr != End && charinfo::isDigit(*Ptr); ++Ptr)
+        {
+            unsigned Digit = *Ptr - '0';
+            SawDigit = true;
+            if (Digits == MaxDigits)
+            {
+                Truncated |= Digit != 0;
+                continue;
+            }
+            if (Digits || Digit)
+            {
+                Mantissa = Mantissa * 10 + Digit;
+                ++Digits;
+            }
+            --Exponent;
+        }
+    }
+    if (!SawDigit)
+        return LiteralStatus::Invalid;
+    if (Ptr != End && (*Ptr == 'e' || *Ptr == 'E'))
+    {
+        ++Ptr;
+        bool NegativeExponent = Ptr != End && *Ptr == '-';
+        if (Ptr != End && charinfo::isSign(*Ptr))
+            ++Ptr;
+        // Past this every nonzero mantissa is zero or infinity anyway.
+        int64_t Written = 0;
+        for (; Ptr != End && charinfo::isDigit(*Ptr); ++Ptr)
+            if (Written < 100000)
+                Written = Written * 10 + (*Ptr - '0');
+        Exponent += NegativeExponent ? -Written : Written;
+    }
+    if (Ptr != End)
+        return LiteralStatus::Invalid;
+
+    uint32_t Bits;
+    if (!Truncated && Exponent >= -MaxFastExponent &&
+        Exponent <= MaxFastExponent && Mantissa <= MaxFastMantissa)
+    {
+        float F = static_cast<float>(Mantissa);
+        F = Exponent < 0 ? F / PowersOfTen[-Exponent]
+                         : F * PowersOfTen[Exponent];
+        Bits = llvm::FloatToBits(F);
+    }
+    else
+    {
+        int Q = static_cast<int>(
+            std::max<int64_t>(-1000, std::min<int64_t>(Exponent, 1000)));
+        Bits = computeFloat(Q, Mantissa);
+        // The dropped digits lie between Mantissa and Mantissa + 1; if
+        // those round differently, only the whole spelling decides.
+        if (Truncated && computeFloat(Q, Mantissa + 1) != Bits)
+        {
+            llvm::SmallString<64> Buffer(StringRef(Start, End - Start));
+            Bits = llvm::FloatToBits(std::strtof(Buffer.c_str(), nullptr));
+        }
+    }
+
+    Value = llvm::BitsToFloat(Negative ? Bits | 0x80000000u : Bits);
+    if (Bits >> MantissaBits == InfinitePower)
+        return LiteralStatus::Overflow;
+    if (Bits == 0 && Mantissa != 0)
+        return LiteralStatus::Underflow;
+    if (Bits >> MantissaBits == 0 && Bits != 0)
+        return LiteralStatus::Denormal;
+    return LiteralStatus::Ok;
+}
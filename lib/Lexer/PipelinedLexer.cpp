@@ -0,0 +1,111 @@
+#include "llshader/Lexer/PipelinedLexer.h"
+#include "llshader/Lexer/Lexer.h"
+#include <cassert>
+#include <cstring>
+
+namespace
+{
+// Waits for the other thread: spins briefly, as it usually catches up
+// within a batch, then yields the core to it.
+void backOff(unsigned &Spins)
+{
+    if (++Spins < 64)
+        return;
+    std::this_thread::yield();
+}
+} // namespace
+
+bool PipelinedLexer::canLex(const llvm::SourceMgr &SrcMgr)
+{
+    return SrcMgr.getMemoryBuffer(SrcMgr.getMainFileID())->getBufferSize() <
+           UINT32_MAX;
+}
+
+PipelinedLexer::PipelinedLexer(llvm::SourceMgr &SrcMgr,
+                               DiagnosticsEngine &Diags)
+    : Buffer(SrcMgr.getMemoryBuffer(SrcMgr.getMainFileID())->getBuffer()),
+      Diags(Diags), Ring(new PackedToken[Capacity])
+{
+    assert(canLex(SrcMgr) && "buffer too large to pipeline");
+    Producer = std::thread([this, &SrcMgr]() { produce(SrcMgr); });
+}
+
+PipelinedLexer::~PipelinedLexer()
+{
+    Stop.store(true, std::memory_order_relaxed);
+    Producer.join();
+}
+
+void PipelinedLexer::produce(llvm::SourceMgr &SrcMgr)
+{
+    // A deferring engine never touches the SourceMgr, which the Parser's
+    // thread prints with.
+    DiagnosticsEngine LexDiags(SrcMgr);
+    LexDiags.setDeferring(true);
+    Lexer Lex(SrcMgr, LexDiags);
+
+    uint32_t Written = 0;
+    uint32_t Released = 0;
+    Token Tok;
+    do
+    {
+        if (Written - Released == Capacity)
+        {
+            Head.store(Written, std::memory_order_release);
+            unsigned Spins = 0;
+            while ((Released = Tail.load(std::memory_order_acquire)) ==
+                   Written - Capacity)
+            {
+                if (Stop.load(std::memory_order_relaxed))
+                    return;
+                backOff(Spins);
+            }
+        }
+
+        Lex.next(Tok);
+        PackedToken &P = Ring[Written & (Capacity - 1)];
+        P.Offset = static_cast<uint32_t>(Tok.Text.data() - Buffer.data());
+        P.Length = static_cast<uint32_t>(Tok.Text.size());
+        P.Kind = Tok.Kind;
+        std::memcpy(&P.Value, &Tok.IntValue, sizeof(P.Value));
+        std::vector<StoredDiagnostic> New = LexDiags.takeDeferred();
+        P.HasDiags = !New.empty();
+        if (P.HasDiags)
+        {
+            std::lock_guard<std::mutex> Guard(DiagsLock);
+            PendingDiags.push_back(std::move(New));
+        }
+
+        if (++Written % Batch == 0 || Tok.is(TokenKind::eof))
+            Head.store(Written, std::memory_order_release);
+    } while (!Tok.is(TokenKind::eof));
+}
+
+void PipelinedLexer::next(Token &Tok)
+{
+    if (Read == Avail)
+    {
+        unsigned Spins = 0;
+        while ((Avail = Head.load(std::memory_order_acquire)) == Read)
+            backOff(Spins);
+    }
+
+    const PackedToken &P = Ring[Read & (Capacity - 1)];
+    Tok.Kind = P.Kind;
+    Tok.Text = Buffer.substr(P.Offset, P.Length);
+    Tok.Loc = SMLoc::getFromPointer(Tok.Text.data());
+    std::memcpy(&Tok.IntValue, &P.Value, sizeof(P.Value));
+    if (P.HasDiags)
+    {
+        std::lock_guard<std::mutex> Guard(DiagsLock);
+        for (const StoredDiagnostic &D : PendingDiags[NextDiags])
+            Diags.replay(D);
+        PendingDiags[NextDiags++].clear();
+    }
+
+    // eof stays in the ring, so it is read again.
+    if (Tok.is(TokenKind::eof))
+        return;
+    if (++Read % Batch == 0)
+        Tail.store(Read, std::memory_order_release);
+}
@@ -0,0 +1,178 @@
+#include "llshader/Lexer/SourceWindow.h"
+#include "llvm/Support/Errc.h"
+#include "llvm/Support/Error.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+SourceWindow::SourceWindow(StringRef FileName, llvm::sys::fs::file_t File,
+                           size_t ChunkSize)
+    : FileName(FileName.str()), File(File), ChunkSize(ChunkSize)
+{
+    Storage.resize(2 * ChunkSize + 1);
+    Storage[0] = '\0';
+}
+
+std::unique_ptr<SourceWindow>
+SourceWindow::open(StringRef FileName, std::error_code &EC, size_t ChunkSize)
+{
+    llvm::Expected<llvm::sys::fs::file_t> FileOrErr =
+        llvm::sys::fs::openNativeFileForRead(FileName);
+    if (!FileOrErr)
+    {
+        EC = llvm::errorToErrorCode(FileOrErr.takeError());
+        return nullptr;
+    }
+    std::unique_ptr<SourceWindow> Window(
+        new SourceWindow(FileName, *FileOrErr, std::max<size_t>(ChunkSize, 1)));
+    Window->readChunk();
+    return Window;
+}
+
+SourceWindow::~SourceWindow() { llvm::sys::fs::closeFile(File); }
+
+void SourceWindow::readChunk()
+{
+    if (Storage.size() < Size + ChunkSize + 1)
+        Storage.resize(Size + ChunkSize + 1);
+
+    size_t Wanted = ChunkSize;
+    while (Wanted && !AtEOF)
+    {
+        llvm::Expected<size_t> ReadOrErr = llvm::sys::fs::readNativeFile(
+            File, llvm::MutableArrayRef<char>(Storage.data() + Size, Wanted));
+        if (!ReadOrErr)
+        {
+            // Treat an I/O error like the end of the file; the Lexer then
+            // reports whatever the truncated input looks like.
+            llvm::consumeError(ReadOrErr.takeError());
+            AtEOF = true;
+            break;
+        }
+        if (*ReadOrErr == 0)
+            AtEOF = true;
+        Size += *ReadOrErr;
+        Wanted -= *ReadOrErr;
+    }
+    Storage[Size] = '\0';
+}
+
+const char *SourceWindow::slide(const char *Keep)
+{
+    const char *Begin = begin();
+    const char *LineStart = Keep;
+    while (LineStart != Begin && LineStart[-1] != '\n' &&
+           static_cast<size_t>(Keep - LineStart) < ChunkSize)
+        --LineStart;
+
+    // Advance the line/column of the window start past the dropped bytes.
+    size_t Drop = LineStart - Begin;
+    const char *LastNewline = nullptr;
+    for (const char *P = Begin; P != LineStart; ++P)
+    {
+        if (*P == '\n')
+        {
+            ++BaseLine;
+            LastNewline = P;
+        }
+    }
+    if (LastNewline)
+        BaseCol = LineStart - (LastNewline + 1);
+    else
+        BaseCol += Drop;
+
+    size_t KeepOffset = Keep - LineStart;
+    std::memmove(Storage.data(), LineStart, Size - Drop);
+    Size -= Drop;
+    BaseOffset += Drop;
+    readChunk();
+    PinPos = PinLineStart = 0;
+    PinLine = BaseLine;
+    return begin() + KeepOffset;
+}
+
+SMLoc SourceWindow::pin(SMLoc Loc)
+{
+    size_t Pos = Loc.getPointer() - begin();
+    assert(Pos <= Size && "pinning a location outside the window");
+    if (Pos < PinPos)
+    {
+        PinPos = PinLineStart = 0;
+        PinLine = BaseLine;
+    }
+    for (; PinPos != Pos; ++PinPos)
+    {
+        if (Storage[PinPos] == '\n')
+        {
+            ++PinLine;
+            PinLineStart = PinPos + 1;
+        }
+    }
+    unsigned Col = Pos - PinLineStart + 1;
+    if (PinLineStart == 0)
+        Col += BaseCol;
+
+    const char *Pinned = static_cast<const char *>(PinAlloc.Allocate(1, 1));
+    Pins[Pinned] = {PinLine, Col};
+    return SMLoc::getFromPointer(Pinned);
+}
+
+bool SourceWindow::getLineAndColumn(SMLoc Loc, unsigned &Line,
+                                    unsigned &Col) const
+{
+    auto It = Pins.find(Loc.getPointer());
+    if (It == Pins.end())
+        return false;
+    Line = It->second.Line;
+    Col = It->second.Col;
+    return true;
+}
+
+bool SourceWindow::resolve(const SourceMgr &SrcMgr, SMLoc Loc,
+                           SourceMgr::DiagKind Kind, StringRef Msg,
+                           llvm::SMDiagnostic &Diag) const
+{
+    // The line of a pinned location has left the window and cannot be
+    // quoted.
+    unsigned PinnedLine, PinnedCol;
+    if (getLineAndColumn(Loc, PinnedLine, PinnedCol))
+    {
+        Diag = llvm::SMDiagnostic(SrcMgr, SMLoc(), FileName, PinnedLine,
+                                  PinnedCol - 1, Kind, Msg, StringRef(),
+                                  llvm::None);
+        return true;
+    }
+
+    const char *Ptr = Loc.getPointer();
+    if (!Ptr || Ptr < begin() || Ptr > end())
+        return false;
+
+    unsigned Line = BaseLine;
+    const char *LineStart = begin();
+    for (const char *P = begin(); P != Ptr; ++P)
+    {
+        if (*P == '\n')
+        {
+            ++Line;
+            LineStart = P + 1;
+        }
+    }
+    unsigned Col = Ptr - LineStart;
+    const char *LineEnd = LineStart;
+    while (LineEnd != end() && *LineEnd != '\n' && *LineEnd != '\r')
+        ++LineEnd;
+
+    // The start of an overlong line may already have left the window; the
+    // column stays exact but the line can no longer be quoted.
+    StringRef LineText(LineStart, LineEnd - LineStart);
+    if (LineStart == begin() && BaseCol != 0)
+    {
+        Col += BaseCol;
+        LineText = StringRef();
+    }
+
+    // No SMLoc: the pointer is not inside any SourceMgr buffer.
+    Diag = llvm::SMDiagnostic(SrcMgr, SMLoc(), FileName, Line, Col, Kind, Msg,
+                              LineText, llvm::None);
+    return true;
+}
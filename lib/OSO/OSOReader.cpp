@@ -0,0 +1,346 @@
+#include "llshader/Lexer/CharInfo.h"
+#include "llshader/OSO/OSOShader.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/ADT/Twine.h"
+#include <cstring>
+
+using namespace llvm;
+using namespace llshader;
+using tok::TokenKind;
+
+namespace
+{
+TokenKind getType(StringRef Name)
+{
+    return StringSwitch<TokenKind>(Name)
+        .Case("int", TokenKind::kw_int)
+        .Case("float", TokenKind::kw_float)
+        .Case("string", TokenKind::kw_string)
+        .Case("color", TokenKind::kw_color)
+        .Case("point", TokenKind::kw_point)
+        .Case("vector", TokenKind::kw_vector)
+        .Case("normal", TokenKind::kw_normal)
+        .Case("matrix", TokenKind::kw_matrix)
+        .Default(TokenKind::kw_void);
+}
+
+bool getKind(StringRef Word, OSOShader::SymbolKind &Kind)
+{
+    using SymbolKind = OSOShader::SymbolKind;
+    if (Word == "param")
+        Kind = SymbolKind::Param;
+    else if (Word == "oparam")
+        Kind = SymbolKind::OParam;
+    else if (Word == "global")
+        Kind = SymbolKind::Global;
+    else if (Word == "local")
+        Kind = SymbolKind::Local;
+    else if (Word == "const")
+        Kind = SymbolKind::Const;
+    else if (Word == "temp")
+        Kind = SymbolKind::Temp;
+    else
+        return false;
+    return true;
+}
+} // namespace
+
+// Scans the text in place with the Lexer's character classes, a line at a
+// time. A line is the header, the shader's declaration, a symbol, the
+// start of a code section or, indented, an instruction; it is made of
+// words, quoted strings and %name{...} hints separated by blanks.
+class OSOReader
+{
+    OSOShader &Shader;
+    raw_ostream &Errs;
+    const char *Ptr;
+    const char *End;
+    unsigned LineNo = 0;
+    bool HasError = false;
+    // The last %line hint, which holds until the next one.
+    unsigned Line = 0;
+
+  public:
+    OSOReader(OSOShader &Shader, raw_ostream &Errs)
+        : Shader(Shader), Errs(Errs), Ptr(Shader.Buffer->getBufferStart()),
+          End(Shader.Buffer->getBufferEnd())
+    {
+    }
+
+    bool run()
+    {
+        bool SawHeader = false;
+        while (Ptr != End)
+        {
+            ++LineNo;
+            const char *LineStart = Ptr;
+            skipBlanks();
+            bool Indented = Ptr != LineStart;
+            if (atEOL() || *Ptr == '#')
+            {
+                skipLine();
+                continue;
+            }
+
+            StringRef Word = next();
+            OSOShader::SymbolKind Kind;
+            if (!SawHeader)
+            {
+                if (Word != "OpenShadingLanguage")
+                {
+                    error("not OSL object code");
+                    return false;
+                }
+                SawHeader = true;
+            }
+            else if (Indented)
+                readInstruction(Word);
+            else if (Word == "code")
+                readSection();
+            else if (getKind(Word, Kind))
+                readSymbol(Kind);
+            else if (Shader.Name.empty())
+            {
+                Shader.ShaderType = Word;
+                Shader.Name = next();
+            }
+            else
+                error("unknown directive " + Word);
+            skipLine();
+        }
+
+        if (!SawHeader)
+            error("not OSL object code");
+        else if (Shader.Name.empty())
+            error("no shader declaration");
+        for (const OSOShader::Instruction &I : Shader.Code)
+            for (int32_t Jump : I.getJumps())
+                if (Jump < 0 || static_cast<size_t>(Jump) > Shader.Code.size())
+                {
+                    LineNo = 0;
+                    error("jump of " + I.Op + " to " + Twine(Jump) +
+                          " is out of the code");
+                    return false;
+                }
+        return !HasError;
+    }
+
+  private:
+    void error(const Twine &Msg)
+    {
+        Errs << "Error: " << Shader.Buffer->getBufferIdentifier();
+        if (LineNo)
+            Errs << ":" << LineNo;
+        Errs << ": " << Msg << "\n";
+        HasError = true;
+    }
+
+    bool atEOL() const { return Ptr == End || *Ptr == '\n'; }
+
+    void skipBlanks()
+    {
+        while (!atEOL() && charinfo::isWhitespace(*Ptr))
+            ++Ptr;
+    }
+
+    // Past the end of the line; anything left on it is ignored.
+    void skipLine()
+    {
+        const void *NL = std::memchr(Ptr, '\n', End - Ptr);
+        Ptr = NL ? static_cast<const char *>(NL) + 1 : End;
+    }
+
+    void skipString()
+    {
+        for (++Ptr; !atEOL() && *Ptr != '"'; ++Ptr)
+            if (*Ptr == '\\' && Ptr + 1 != End)
+                ++Ptr;
+        if (atEOL())
+            error("unterminated string");
+        else
+            ++Ptr;
+    }
+
+    // The next word, quoted string or hint on the line; empty at its end.
+    StringRef next()
+    {
+        skipBlanks();
+        const char *Start = Ptr;
+        if (atEOL())
+            return StringRef();
+        if (*Ptr == '"')
+            skipString();
+        else if (*Ptr == '%')
+        {
+            for (++Ptr; !atEOL() && charinfo::isLetterDigit_(*Ptr); ++Ptr)
+                ;
+            if (!atEOL() && *Ptr == '{')
+            {
+                for (++Ptr; !atEOL() && *Ptr != '}';)
+                {
+                    if (*Ptr == '"')
+                        skipString();
+                    else
+                        ++Ptr;
+                }
+                if (atEOL())
+                    error("unterminated hint");
+                else
+                    ++Ptr;
+            }
+        }
+        else
+            while (!atEOL() && !charinfo::isWhitespace(*Ptr))
+                ++Ptr;
+        return StringRef(Start, Ptr - Start);
+    }
+
+    static StringRef unquote(StringRef Text)
+    {
+        if (Text.size() >= 2 && Text.front() == '"' && Text.back() == '"')
+            return Text.drop_front().drop_back();
+        return Text;
+    }
+
+    void readSymbol(OSOShader::SymbolKind Kind)
+    {
+        OSOShader::Symbol S;
+        S.Kind = Kind;
+        StringRef Type = next();
+        if (Type == "closure" || Type == "struct")
+        {
+            StringRef Rest = next();
+            Type = StringRef(Type.begin(), Rest.end() - Type.begin());
+        }
+        size_t Bracket = Type.find('[');
+        if (Bracket != StringRef::npos)
+        {
+            StringRef Length = Type.substr(Bracket + 1);
+            if (!Length.consume_back("]") ||
+                (!Length.empty() && Length.getAsInteger(10, S.ArrayLength)))
+                error("invalid array type " + Type);
+            if (Length.empty())
+                S.ArrayLength = -1;
+            Type = Type.take_front(Bracket);
+        }
+        S.TypeName = Type;
+        S.Type = getType(Type);
+        S.Name = next();
+        if (S.Name.empty() || S.Name.front() == '%')
+        {
+            error("symbol without a name");
+            return;
+        }
+        S.FirstValue = static_cast<uint32_t>(Shader.Values.size());
+        for (StringRef Value = next(); !Value.empty(); Value = next())
+            if (Value.front() != '%')
+                Shader.Values.push_back(unquote(Value));
+        S.NumValues = Shader.Values.size() - S.FirstValue;
+
+        uint32_t Id = static_cast<uint32_t>(Shader.Symbols.size());
+        if (!Shader.SymbolIds.try_emplace(S.Name, Id).second)
+        {
+            error("symbol " + S.Name + " is defined twice");
+            return;
+        }
+        Shader.Symbols.push_back(S);
+    }
+
+    void readSection()
+    {
+        StringRef Name = next();
+        if (Name.empty())
+            error("code section without a name");
+        Shader.Sections.push_back(
+            {Name, static_cast<uint32_t>(Shader.Code.size())});
+        Line = 0;
+    }
+
+    void readInstruction(StringRef Op)
+    {
+        if (Shader.Sections.empty())
+        {
+            error("instruction outside of a code section");
+            return;
+        }
+        OSOShader::Instruction I;
+        I.Op = Op;
+        I.FirstArg = static_cast<uint32_t>(Shader.Args.size());
+        for (StringRef Arg = next(); !Arg.empty(); Arg = next())
+        {
+            if (Arg.front() == '%')
+            {
+                readHint(Arg, I);
+                continue;
+            }
+            if (charinfo::isDigit(Arg.front()) || Arg.front() == '-')
+            {
+                int32_t Jump;
+                if (Arg.getAsInteger(10, Jump))
+                    error("invalid jump " + Arg);
+                else if (I.NumJumps == OSOShader::Instruction::MaxJumps)
+                    error("too many jumps");
+                else
+                    I.Jumps[I.NumJumps++] = Jump;
+                continue;
+            }
+            int Id = Shader.lookup(Arg);
+            if (Id < 0)
+                error("unknown symbol " + Arg);
+            else
+                Shader.Args.push_back(static_cast<uint32_t>(Id));
+        }
+        I.NumArgs = Shader.Args.size() - I.FirstArg;
+        I.Line = Line;
+        Shader.Code.push_back(I);
+    }
+
+    // %line sets the line of this and the following instructions and
+    // %argrw which arguments are written; other hints are ignored.
+    void readHint(StringRef Hint, OSOShader::Instruction &I)
+    {
+        size_t Brace = Hint.find('{');
+        if (Brace == StringRef::npos)
+            return;
+        StringRef Name = Hint.slice(1, Brace);
+        StringRef Body = Hint.substr(Brace + 1).drop_back();
+        if (Name == "line")
+        {
+            if (Body.getAsInteger(10, Line))
+                error("invalid line hint " + Hint);
+        }
+        else if (Name == "argrw")
+        {
+            Body = unquote(Body);
+            for (size_t Arg = 0, E = std::min<size_t>(Body.size(), 32);
+                 Arg != E; ++Arg)
+                if (Body[Arg] == 'w' || Body[Arg] == 'W')
+                    I.Written |= 1u << Arg;
+        }
+    }
+};
+
+std::unique_ptr<OSOShader> OSOShader::read(StringRef FileName,
+                                           raw_ostream &Errs)
+{
+    // MemoryBuffer maps all but small files, which are cheaper to read.
+    ErrorOr<std::unique_ptr<MemoryBuffer>> FileOrErr =
+        MemoryBuffer::getFile(FileName, /*IsText=*/false,
+                              /*RequiresNullTerminator=*/false);
+    if (std::error_code EC = FileOrErr.getError())
+    {
+        Errs << "Error reading " << FileName << ": " << EC.message() << "\n";
+        return nullptr;
+    }
+    return read(std::move(*FileOrErr), Errs);
+}
+
+std::unique_ptr<OSOShader> OSOShader::read(std::unique_ptr<MemoryBuffer> Buffer,
+                                           raw_ostream &Errs)
+{
+    std::unique_ptr<OSOShader> Shader(new OSOShader());
+    Shader->Buffer = std::move(Buffer);
+    if (!OSOReader(*Shader, Errs).run())
+        return nullptr;
+    return Shader;
+}
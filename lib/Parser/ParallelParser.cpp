@@ -0,0 +1,293 @@
+#include "llshader/Parser/ParallelParser.h"
+#include "llshader/Lexer/Lexer.h"
+#include "llshader/Parser/Parser.h"
+#include "llvm/Support/ThreadPool.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+enum CharClass : unsigned char
+{
+    CC_Other,
+    CC_Space,
+    CC_Open,
+    CC_Close,
+    CC_Semi,
+    CC_Quote,
+    CC_Ident,
+};
+
+struct CharClassTable
+{
+    unsigned char Class[256] = {};
+
+    CharClassTable()
+    {
+        for (unsigned C = 0; C < 256; ++C)
+        {
+            if ((C >= 'a' && C <= 'z') || (C >= 'A' && C <= 'Z') ||
+                (C >= '0' && C <= '9') || C == '_')
+                Class[C] = CC_Ident;
+        }
+        for (unsigned char C : {' ', '\t', '\f', '\v', '\r', '\n'})
+            Class[C] = CC_Space;
+        for (unsigned char C : {'(', '[', '{'})
+            Class[C] = CC_Open;
+        for (unsigned char C : {')', ']', '}'})
+            Class[C] = CC_Close;
+        Class[static_cast<unsigned char>(';')] = CC_Semi;
+        Class[static_cast<unsigned char>('"')] = CC_Quote;
+    }
+};
+
+const CharClassTable Table;
+
+inline bool isStructural(unsigned char C)
+{
+    unsigned char Class = Table.Class[C];
+    return Class == CC_Open || Class == CC_Close || Class == CC_Quote;
+}
+
+// Inside brackets only brackets and string literals matter, which lets the
+// scan skip 16 bytes at a time.
+const char *skipToStructural(const char *P, const char *End)
+{
+#if defined(__SSE2__)
+    const __m128i Quote = _mm_set1_epi8('"');
+    const __m128i LParen = _mm_set1_epi8('(');
+    const __m128i RParen = _mm_set1_epi8(')');
+    const __m128i LSquare = _mm_set1_epi8('[');
+    const __m128i RSquare = _mm_set1_epi8(']');
+    const __m128i LBrace = _mm_set1_epi8('{');
+    const __m128i RBrace = _mm_set1_epi8('}');
+    while (End - P >= 16)
+    {
+        __m128i V = _mm_loadu_si128(reinterpret_cast<const __m128i *>(P));
+        __m128i M = _mm_or_si128(
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(V, Quote),
+                                      _mm_cmpeq_epi8(V, LParen)),
+                         _mm_or_si128(_mm_cmpeq_epi8(V, RParen),
+                                      _mm_cmpeq_epi8(V, LSquare))),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(V, RSquare),
+                                      _mm_cmpeq_epi8(V, LBrace)),
+                         _mm_cmpeq_epi8(V, RBrace)));
+        if (int Mask = _mm_movemask_epi8(M))
+            return P + __builtin_ctz(Mask);
+        P += 16;
+    }
+#endif
+    while (P != End && !isStructural(static_cast<unsigned char>(*P)))
+        ++P;
+    return P;
+}
+
+const char *skipString(const char *P, const char *End)
+{
+    // The Lexer has no escapes: a string ends at the next quote.
+    const void *Close = std::memchr(P + 1, '"', End - (P + 1));
+    return Close ? static_cast<const char *>(Close) + 1 : End;
+}
+} // namespace
+
+std::vector<size_t> findTopLevelBoundaries(StringRef Src)
+{
+    std::vector<size_t> Ends;
+    const char *Begin = Src.begin();
+    const char *End = Src.end();
+    const char *P = Begin;
+
+    int Depth = 0;
+    // do-while statements still open at depth 0, and whether we are between
+    // the terminating while and its ';'.
+    unsigned PendingDo = 0;
+    bool InDoTail = false;
+    // Set right after a ';' or '}' at depth 0; the next token decides
+    // whether Candidate really ends a statement.
+    bool AfterEnd = false;
+    const char *Candidate = nullptr;
+
+    auto commit = [&]()
+    {
+        if (Candidate)
+            Ends.push_back(Candidate - Begin);
+        Candidate = nullptr;
+    };
+    auto endStatement = [&](const char *At)
+    {
+        if (PendingDo == 0)
+            Candidate = At;
+        AfterEnd = true;
+    };
+
+    while (P != End)
+    {
+        if (Depth > 0)
+        {
+            P = skipToStructural(P, End);
+            if (P == End)
+                break;
+            char C = *P;
+            if (C == '"')
+            {
+                P = skipString(P, End);
+                continue;
+            }
+            ++P;
+            if (C == '(' || C == '[' || C == '{')
+            {
+                ++Depth;
+                continue;
+            }
+            if (--Depth == 0 && C == '}')
+                endStatement(P);
+            continue;
+        }
+
+        unsigned char C = static_cast<unsigned char>(*P);
+        CharClass Class = static_cast<CharClass>(Table.Class[C]);
+        if (Class == CC_Space)
+        {
+            ++P;
+            continue;
+        }
+
+        bool WasAfterEnd = AfterEnd;
+        AfterEnd = false;
+
+        if (Class == CC_Ident)
+        {
+            const char *WordEnd = P + 1;
+            while (WordEnd != End &&
+                   Table.Class[static_cast<unsigned char>(*WordEnd)] ==
+                       CC_Ident)
+                ++WordEnd;
+            StringRef Word(P, WordEnd - P);
+            if (WasAfterEnd && Word == "else")
+                Candidate = nullptr;
+            else if (WasAfterEnd && Word == "while" && PendingDo > 0 &&
+                     !InDoTail)
+                InDoTail = true;
+            else
+                commit();
+            if (Word == "do")
+                ++PendingDo;
+            P = WordEnd;
+            continue;
+        }
+
+        commit();
+        switch (Class)
+        {
+        case CC_Quote:
+            P = skipString(P, End);
+            break;
+        case CC_Open:
+            ++Depth;
+            ++P;
+            break;
+        case CC_Close:
+            // Unbalanced input: no boundary past this point is certain.
+            return Ends;
+        case CC_Semi:
+            ++P;
+            if (InDoTail)
+            {
+                InDoTail = false;
+                --PendingDo;
+            }
+            endStatement(P);
+            break;
+        default:
+            ++P;
+            break;
+        }
+    }
+    return Ends;
+}
+
+AST *ParallelParser::parse()
+{
+    StringRef Src =
+        SrcMgr.getMemoryBuffer(SrcMgr.getMainFileID())->getBuffer();
+
+    std::vector<StringRef> Chunks;
+    if (NumThreads > 1 && Src.size() >= 2 * MinChunkBytes)
+    {
+        size_t Target =
+            std::max(MinChunkBytes, Src.size() / (size_t(NumThreads) * 4));
+        size_t Start = 0;
+        for (size_t End : findTopLevelBoundaries(Src))
+        {
+            if (End - Start < Target)
+                continue;
+            Chunks.push_back(Src.slice(Start, End));
+            Start = End;
+        }
+        Chunks.push_back(Src.substr(Start));
+    }
+
+    if (Chunks.size() <= 1)
+    {
+        Lexer Lex(SrcMgr, Diags);
+        Parser P(Lex, Diags);
+        return P.parse();
+    }
+
+    struct ChunkResult
+    {
+        StmtList SL;
+        std::vector<StoredDiagnostic> Diags;
+        bool Ok = false;
+    };
+    std::vector<ChunkResult> Results(Chunks.size());
+    {
+        // Workers allocate nodes with plain new; malloc's per-thread arenas
+        // keep them from contending on one heap.
+        llvm::ThreadPool Pool(llvm::hardware_concurrency(NumThreads));
+        for (size_t I = 0; I < Chunks.size(); ++I)
+        {
+            Pool.async(
+                [this, &Chunks, &Results, I]()
+                {
+                    DiagnosticsEngine ChunkDiags(SrcMgr);
+                    ChunkDiags.setDeferring(true);
+                    Lexer Lex(SrcMgr, ChunkDiags, Chunks[I]);
+                    Parser P(Lex, ChunkDiags);
+                    Results[I].Ok = P.parseStmtList(Results[I].SL);
+                    Results[I].Diags = ChunkDiags.takeDeferred();
+                });
+        }
+        Pool.wait();
+    }
+
+    StmtList *SL = new StmtList();
+    for (size_t I = 0; I < Chunks.size(); ++I)
+    {
+        if (Results[I].Ok)
+        {
+            for (const StoredDiagnostic &D : Results[I].Diags)
+                Diags.replay(D);
+            SL->insert(SL->end(), Results[I].SL.begin(), Results[I].SL.end());
+            continue;
+        }
+
+        for (size_t J = I; J < Chunks.size(); ++J)
+            for (auto S : Results[J].SL)
+                delete S;
+        Lexer Lex(SrcMgr, Diags,
+                  Src.drop_front(Chunks[I].begin() - Src.begin()));
+        Parser P(Lex, Diags);
+        if (!P.parseStmtList(*SL))
+        {
+            delete new Program(SL); // Deletes the statements parsed so far.
+            return nullptr;
+        }
+        break;
+    }
+    return new Program(SL);
+}
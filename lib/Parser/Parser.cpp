@@ -8,16 +8,23 @@
 using namespace llshader;
 using tok::TokenKind;
 
-AST *Parser::parse()
+bool Parser::parseStmtList(StmtList &SL)
 {
-    StmtList *SL = new StmtList();
     while (!Tok.is(TokenKind::eof))
     {
         Statement *curStmt = parseStmt();
         if (curStmt == nullptr)
-            return nullptr;
-        SL->push_back(curStmt);
+            return false;
+        SL.push_back(curStmt);
     }
+    return true;
+}
+
+AST *Parser::parse()
+{
+    StmtList *SL = new StmtList();
+    if (!parseStmtList(*SL))
+        return nullptr;
     Program *P = new Program(SL);
     AST *Res = llvm::dyn_cast<AST>(P);
     expect(TokenKind::eof);
@@ -25,6 +32,18 @@ AST *Parser::parse()
 }
 
 Statement *Parser::parseStmt()
+{
+    // Before the statement's own are lexed, so a streaming Lexer can still
+    // locate its first token.
+    llvm::SMLoc Loc =
+        Lex ? Lex->keepLocation(Tok.getLocation()) : Tok.getLocation();
+    Statement *S = parseStmtBody();
+    if (S)
+        S->setLocation(Loc);
+    return S;
+}
+
+Statement *Parser::parseStmtBody()
 {
     auto ErrorHandler = [this]()
     {
@@ -33,12 +52,14 @@ Statement *Parser::parseStmt()
         return nullptr;
     };
 
+    switch (Tok.getKind())
+    {
     // Scoped statement
-    if (Tok.getText() == "{")
+    case TokenKind::l_brace:
     {
         advance();
         StmtList *curScoped = new StmtList();
-        while (Tok.getText() != "}")
+        while (!Tok.is(TokenKind::r_brace))
         {
             Statement *curStmt = parseStmt();
             curScoped->push_back(curStmt);
@@ -49,22 +70,19 @@ Statement *Parser::parseStmt()
         return new Scoped(curScoped);
     }
 
-    KeywordFilter KWFilter;
-
     // Conditional statement
-    if (Tok.getKind() == TokenKind::kw_if)
+    case TokenKind::kw_if:
     {
         advance();
-        if (Tok.getText() != "(")
+        if (!Tok.is(TokenKind::l_paren))
             return ErrorHandler();
         advance();
         Expression *condition = parseExpr();
         if (condition == nullptr)
             return ErrorHandler();
-        while (Tok.getText() != ")")
+        while (!Tok.is(TokenKind::r_paren))
         {
-            if (Tok.is(TokenKind::bin_op) || Tok.is(TokenKind::comp_op) ||
-                Tok.is(TokenKind::log_op) || Tok.is(TokenKind::bit_op))
+            if (tok::isBinaryOperator(Tok.getKind()))
             {
                 StringRef op = Tok.getText();
                 advance();
@@ -92,19 +110,18 @@ Statement *Parser::parseStmt()
     }
 
     // While statement
-    if (Tok.getKind() == TokenKind::kw_while)
+    case TokenKind::kw_while:
     {
         advance();
-        if (Tok.getText() != "(")
+        if (!Tok.is(TokenKind::l_paren))
             return ErrorHandler();
         advance();
         Expression *condition = parseExpr();
         if (condition == nullptr)
             return ErrorHandler();
-        while (Tok.getText() != ")")
+        while (!Tok.is(TokenKind::r_paren))
         {
-            if (Tok.is(TokenKind::bin_op) || Tok.is(TokenKind::comp_op) ||
-                Tok.is(TokenKind::log_op) || Tok.is(TokenKind::bit_op))
+            if (tok::isBinaryOperator(Tok.getKind()))
             {
                 StringRef op = Tok.getText();
                 advance();
@@ -124,7 +141,7 @@ Statement *Parser::parseStmt()
     }
 
     // Do While statement
-    if (Tok.getKind() == TokenKind::kw_do)
+    case TokenKind::kw_do:
     {
         advance();
         Statement *bodyStmt = parseStmt();
@@ -133,16 +150,15 @@ Statement *Parser::parseStmt()
         if (Tok.getKind() != TokenKind::kw_while)
             return ErrorHandler();
         advance();
-        if (Tok.getText() != "(")
+        if (!Tok.is(TokenKind::l_paren))
             return ErrorHandler();
         advance();
         Expression *condition = parseExpr();
         if (condition == nullptr)
             return ErrorHandler();
-        while (Tok.getText() != ")")
+        while (!Tok.is(TokenKind::r_paren))
         {
-            if (Tok.is(TokenKind::bin_op) || Tok.is(TokenKind::comp_op) ||
-                Tok.is(TokenKind::log_op) || Tok.is(TokenKind::bit_op))
+            if (tok::isBinaryOperator(Tok.getKind()))
             {
                 StringRef op = Tok.getText();
                 advance();
@@ -155,23 +171,23 @@ Statement *Parser::parseStmt()
                 return ErrorHandler();
         }
         advance();
-        if (Tok.getText() != ";")
+        if (!Tok.is(TokenKind::semi))
             return ErrorHandler();
         advance();
         return new DoWhile(condition, bodyStmt);
     }
 
     // For statement
-    if (Tok.getKind() == TokenKind::kw_for)
+    case TokenKind::kw_for:
     {
         advance();
-        if (Tok.getText() != "(")
+        if (!Tok.is(TokenKind::l_paren))
             return ErrorHandler();
         advance();
         Declaration *init = nullptr;
-        if (Tok.getText() != ";")
+        if (!Tok.is(TokenKind::semi))
         {
-            init = llvm::dyn_cast<Declaration>(parseStmt());
+            init = llvm::dyn_cast_or_null<Declaration>(parseStmt());
             if (init == nullptr)
                 return ErrorHandler();
         }
@@ -181,15 +197,14 @@ Statement *Parser::parseStmt()
         }
 
         Expression *condition = nullptr;
-        if (Tok.getText() != ";")
+        if (!Tok.is(TokenKind::semi))
         {
             condition = parseExpr();
             if (condition == nullptr)
                 return ErrorHandler();
-            while (Tok.getText() != ";")
+            while (!Tok.is(TokenKind::semi))
             {
-                if (Tok.is(TokenKind::bin_op) || Tok.is(TokenKind::comp_op) ||
-                    Tok.is(TokenKind::log_op) || Tok.is(TokenKind::bit_op))
+                if (tok::isBinaryOperator(Tok.getKind()))
                 {
                     StringRef op = Tok.getText();
                     advance();
@@ -206,16 +221,13 @@ Statement *Parser::parseStmt()
         advance();
 
         CompoundEx *update = nullptr;
-        if (Tok.getText() != ")")
+        if (!Tok.is(TokenKind::r_paren))
         {
-            update = llvm::dyn_cast<CompoundEx>(parseExpr());
-            if (update == nullptr)
+            update = llvm::dyn_cast_or_null<CompoundEx>(parseExpr());
+            if (update == nullptr || !Tok.is(TokenKind::r_paren))
                 return ErrorHandler();
         }
-        else
-        {
-            advance();
-        }
+        advance();
 
         Statement *body = parseStmt();
         if (body == nullptr)
@@ -225,41 +237,47 @@ Statement *Parser::parseStmt()
     }
 
     // Loop Mod statement
-    if (Tok.getKind() == TokenKind::kw_break ||
-        Tok.getKind() == TokenKind::kw_continue)
+    case TokenKind::kw_break:
+    case TokenKind::kw_continue:
     {
         auto ret = new LoopMod(Tok.getKind());
         advance();
-        if (Tok.getText() != ";")
+        if (!Tok.is(TokenKind::semi))
             return ErrorHandler();
         advance();
         return ret;
     }
 
     // Declaration statement
-    if (KWFilter.isType(Tok.getText()))
+    case TokenKind::kw_int:
+    case TokenKind::kw_float:
+    case TokenKind::kw_string:
+    case TokenKind::kw_point:
+    case TokenKind::kw_vector:
+    case TokenKind::kw_normal:
+    case TokenKind::kw_color:
+    case TokenKind::kw_matrix:
     {
-        TokenKind type = KWFilter.lookup(Tok.getText());
+        TokenKind type = Tok.getKind();
         DefEList *defs = new DefEList();
         advance();
-        while (Tok.getText() != ";")
+        while (!Tok.is(TokenKind::semi))
         {
             if (!expect(TokenKind::identifier))
                 return ErrorHandler();
             StringRef id = Tok.getText();
             advance();
-            if (Tok.getText() == "=")
+            // "=" is the only assignment of one character.
+            if (Tok.is(TokenKind::assignment) && Tok.getLength() == 1)
             {
                 advance();
 
                 Expression *value = parseExpr();
                 if (value == nullptr)
                     return ErrorHandler();
-                while (Tok.getText() != "," && Tok.getText() != ";")
+                while (!Tok.isOneOf(TokenKind::comma, TokenKind::semi))
                 {
-                    if (Tok.is(TokenKind::bin_op) ||
-                        Tok.is(TokenKind::comp_op) ||
-                        Tok.is(TokenKind::log_op) || Tok.is(TokenKind::bit_op))
+                    if (tok::isBinaryOperator(Tok.getKind()))
                     {
                         StringRef op = Tok.getText();
                         advance();
@@ -272,15 +290,15 @@ Statement *Parser::parseStmt()
                         return ErrorHandler();
                 }
                 defs->push_back(new DefExpr(id, value));
-                if (Tok.getText() == ",")
+                if (Tok.is(TokenKind::comma))
                     advance();
             }
-            else if (Tok.getText() == ",")
+            else if (Tok.is(TokenKind::comma))
             {
                 defs->push_back(new DefExpr(id));
                 advance();
             }
-            else if (Tok.getText() == ";")
+            else if (Tok.is(TokenKind::semi))
             {
                 defs->push_back(new DefExpr(id));
             }
@@ -290,21 +308,20 @@ Statement *Parser::parseStmt()
     }
 
     // Compound expressions statement
-    if (Tok.getText() == ";")
-    {
-        return new CompoundSt(nullptr);
+    case TokenKind::semi:
         advance();
-    }
-    else
+        return new CompoundSt(new ExprList());
+    default:
     {
-        CompoundEx *compEx = llvm::dyn_cast<CompoundEx>(parseExpr());
-        if (Tok.getText() != ";")
+        Expression *E = parseExpr();
+        if (E == nullptr)
             return ErrorHandler();
-        ExprList *EL = compEx->getEL();
-        return new CompoundSt(EL);
+        if (!Tok.is(TokenKind::semi))
+            return ErrorHandler();
+        advance();
+        return new CompoundSt(new ExprList({E}));
+    }
     }
-
-    return ErrorHandler();
 }
 
 Expression *Parser::parseExpr()
@@ -316,41 +333,48 @@ Expression *Parser::parseExpr()
         return nullptr;
     };
 
+    switch (Tok.getKind())
+    {
     // Literal expression
-    if (Tok.is(TokenKind::integer) || Tok.is(TokenKind::string_literal) ||
-        Tok.is(TokenKind::floating_point))
+    case TokenKind::integer:
+    case TokenKind::floating_point:
+    case TokenKind::string_literal:
     {
-        Literal::LitKind kind =
-            Tok.is(TokenKind::integer)
-                ? Literal::Integer
-                : (Tok.is(TokenKind::floating_point) ? Literal::FloatingPoint
-                                                     : Literal::String);
-        Literal *Lit = new Literal(kind, Tok.getText());
+        Literal *Lit;
+        if (Tok.is(TokenKind::integer))
+            Lit = new Literal(Tok.getText(), Tok.getIntValue());
+        else if (Tok.is(TokenKind::floating_point))
+            Lit = new Literal(Tok.getText(), Tok.getFloatValue());
+        else
+            Lit = new Literal(Literal::String, Tok.getText());
         advance();
         return Lit;
     }
 
-    KeywordFilter KWFilter;
-
     // Type Constructor expression
-    if (KWFilter.isType(Tok.getText()))
+    case TokenKind::kw_int:
+    case TokenKind::kw_float:
+    case TokenKind::kw_string:
+    case TokenKind::kw_point:
+    case TokenKind::kw_vector:
+    case TokenKind::kw_normal:
+    case TokenKind::kw_color:
+    case TokenKind::kw_matrix:
     {
-        TokenKind type = KWFilter.lookup(Tok.getText());
+        TokenKind type = Tok.getKind();
         advance();
-        if (Tok.getText() == "(")
+        if (Tok.is(TokenKind::l_paren))
         {
             advance();
             ExprList *values = new ExprList();
-            while (Tok.getText() != ")")
+            while (!Tok.is(TokenKind::r_paren))
             {
                 Expression *value = parseExpr();
                 if (value == nullptr)
                     return ErrorHandler();
-                while (Tok.getText() != "," && Tok.getText() != ")")
+                while (!Tok.isOneOf(TokenKind::comma, TokenKind::r_paren))
                 {
-                    if (Tok.is(TokenKind::bin_op) ||
-                        Tok.is(TokenKind::comp_op) ||
-                        Tok.is(TokenKind::log_op) || Tok.is(TokenKind::bit_op))
+                    if (tok::isBinaryOperator(Tok.getKind()))
                     {
                         StringRef op = Tok.getText();
                         advance();
@@ -363,7 +387,7 @@ Expression *Parser::parseExpr()
                         return ErrorHandler();
                 }
                 values->push_back(value);
-                if (Tok.getText() == ",")
+                if (Tok.is(TokenKind::comma))
                     advance();
             }
             advance();
@@ -376,7 +400,7 @@ Expression *Parser::parseExpr()
     }
 
     // Unary expression
-    if (Tok.is(TokenKind::un_op))
+    case TokenKind::un_op:
     {
         StringRef op = Tok.getText();
         advance();
@@ -387,26 +411,26 @@ Expression *Parser::parseExpr()
     }
 
     // IncDec expression
-    if (Tok.is(TokenKind::incdec_op))
+    case TokenKind::incdec_op:
     {
         StringRef op = Tok.getText();
         advance();
-        VariableRef *Id = llvm::dyn_cast<VariableRef>(parseExpr());
+        VariableRef *Id = llvm::dyn_cast_or_null<VariableRef>(parseExpr());
         if (Id == nullptr)
             return ErrorHandler();
         return new IncDec(op, Id);
     }
 
-    if (Tok.getText() == "(")
+    case TokenKind::l_paren:
     {
         advance();
 
         // TypeCast expression
-        if (KWFilter.isType(Tok.getText()))
+        if (tok::isTypeKeyword(Tok.getKind()))
         {
-            TokenKind type = KWFilter.lookup(Tok.getText());
+            TokenKind type = Tok.getKind();
             advance();
-            if (Tok.getText() != ")")
+            if (!Tok.is(TokenKind::r_paren))
                 return ErrorHandler();
             advance();
             Expression *E = parseTerm();
@@ -417,15 +441,14 @@ Expression *Parser::parseExpr()
 
         // Compound expression
         ExprList *EL = new ExprList();
-        while (Tok.getText() != ")")
+        while (!Tok.is(TokenKind::r_paren))
         {
             Expression *E = parseExpr();
             if (E == nullptr)
                 return ErrorHandler();
-            while (Tok.getText() != "," && Tok.getText() != ")")
+            while (!Tok.isOneOf(TokenKind::comma, TokenKind::r_paren))
             {
-                if (Tok.is(TokenKind::bin_op) || Tok.is(TokenKind::comp_op) ||
-                    Tok.is(TokenKind::log_op) || Tok.is(TokenKind::bit_op))
+                if (tok::isBinaryOperator(Tok.getKind()))
                 {
                     StringRef op = Tok.getText();
                     advance();
@@ -438,7 +461,7 @@ Expression *Parser::parseExpr()
                     return ErrorHandler();
             }
             EL->push_back(E);
-            if (Tok.getText() == ",")
+            if (Tok.is(TokenKind::comma))
                 advance();
         }
         advance();
@@ -446,21 +469,22 @@ Expression *Parser::parseExpr()
     }
 
     // Variable ref or assignment expression
-    if (Tok.is(TokenKind::identifier))
+    case TokenKind::identifier:
     {
         StringRef id = Tok.getText();
         advance();
-        if (Tok.getText() == "[")
+        if (Tok.is(TokenKind::l_paren) && (id == "Dx" || id == "Dy"))
+            return parseDerivative(id == "Dx" ? Derivative::X : Derivative::Y);
+        if (Tok.is(TokenKind::l_square))
         {
             advance();
 
             Expression *index = parseExpr();
             if (index == nullptr)
                 return ErrorHandler();
-            while (Tok.getText() != "]")
+            while (!Tok.is(TokenKind::r_square))
             {
-                if (Tok.is(TokenKind::bin_op) || Tok.is(TokenKind::comp_op) ||
-                    Tok.is(TokenKind::log_op) || Tok.is(TokenKind::bit_op))
+                if (tok::isBinaryOperator(Tok.getKind()))
                 {
                     StringRef op = Tok.getText();
                     advance();
@@ -474,7 +498,7 @@ Expression *Parser::parseExpr()
             }
 
             advance();
-            if (Tok.getText() != "[" && Tok.getKind() != TokenKind::assignment)
+            if (!Tok.isOneOf(TokenKind::l_square, TokenKind::assignment))
             {
                 return new VariableRef(id, index);
             }
@@ -484,18 +508,15 @@ Expression *Parser::parseExpr()
                 indices->push_back(index);
                 while (Tok.getKind() != TokenKind::assignment)
                 {
-                    if (Tok.getText() != "[")
+                    if (!Tok.is(TokenKind::l_square))
                         return ErrorHandler();
                     advance();
                     index = parseExpr();
                     if (index == nullptr)
                         return ErrorHandler();
-                    while (Tok.getText() != "]")
+                    while (!Tok.is(TokenKind::r_square))
                     {
-                        if (Tok.is(TokenKind::bin_op) ||
-                            Tok.is(TokenKind::comp_op) ||
-                            Tok.is(TokenKind::log_op) ||
-                            Tok.is(TokenKind::bit_op))
+                        if (tok::isBinaryOperator(Tok.getKind()))
                         {
                             StringRef op = Tok.getText();
                             advance();
@@ -513,12 +534,9 @@ Expression *Parser::parseExpr()
                 StringRef op = Tok.getText();
                 advance();
                 Expression *value = parseExpr();
-                while(Tok.getText() != "," && Tok.getText() != ";")
+                while(!Tok.isOneOf(TokenKind::comma, TokenKind::semi))
                 {
-                    if (Tok.is(TokenKind::bin_op) ||
-                    Tok.is(TokenKind::comp_op) ||
-                        Tok.is(TokenKind::log_op) ||
-                        Tok.is(TokenKind::bit_op))
+                    if (tok::isBinaryOperator(Tok.getKind()))
                     {
                         StringRef op = Tok.getText();
                         advance();
@@ -530,8 +548,6 @@ Expression *Parser::parseExpr()
                     else
                         return ErrorHandler();
                 }
-                ExprList* indices = new ExprList();
-                indices->push_back(index);
                 return new Assignment(new LValue(id, indices), op, value);
             }
         }
@@ -547,10 +563,9 @@ Expression *Parser::parseExpr()
             Expression *value = parseExpr();
             if (value == nullptr)
                 return ErrorHandler();
-            while (Tok.getText() != "," && Tok.getText() != ";")
+            while (!Tok.isOneOf(TokenKind::comma, TokenKind::semi))
             {
-                if (Tok.is(TokenKind::bin_op) || Tok.is(TokenKind::comp_op) ||
-                    Tok.is(TokenKind::log_op) || Tok.is(TokenKind::bit_op))
+                if (tok::isBinaryOperator(Tok.getKind()))
                 {
                     StringRef op = Tok.getText();
                     advance();
@@ -565,8 +580,9 @@ Expression *Parser::parseExpr()
             return new Assignment(new LValue(id), op, value);
         }
     }
-
-    return ErrorHandler();
+    default:
+        return ErrorHandler();
+    }
 }
 
 Expression *Parser::parseTerm()
@@ -578,40 +594,48 @@ Expression *Parser::parseTerm()
         return nullptr;
     };
 
+    switch (Tok.getKind())
+    {
     // Literal term
-    if (Tok.is(TokenKind::integer) || Tok.is(TokenKind::string_literal) ||
-        Tok.is(TokenKind::floating_point))
+    case TokenKind::integer:
+    case TokenKind::floating_point:
+    case TokenKind::string_literal:
     {
-        Literal::LitKind kind =
-            Tok.is(TokenKind::integer)
-                ? Literal::Integer
-                : (Tok.is(TokenKind::floating_point) ? Literal::FloatingPoint
-                                                     : Literal::String);
-        Literal *Lit = new Literal(kind, Tok.getText());
+        Literal *Lit;
+        if (Tok.is(TokenKind::integer))
+            Lit = new Literal(Tok.getText(), Tok.getIntValue());
+        else if (Tok.is(TokenKind::floating_point))
+            Lit = new Literal(Tok.getText(), Tok.getFloatValue());
+        else
+            Lit = new Literal(Literal::String, Tok.getText());
         advance();
         return Lit;
     }
 
-    KeywordFilter KWFilter;
-
     // Type Constructor term
-    if (KWFilter.isType(Tok.getText()))
+    case TokenKind::kw_int:
+    case TokenKind::kw_float:
+    case TokenKind::kw_string:
+    case TokenKind::kw_point:
+    case TokenKind::kw_vector:
+    case TokenKind::kw_normal:
+    case TokenKind::kw_color:
+    case TokenKind::kw_matrix:
     {
-        TokenKind type = KWFilter.lookup(Tok.getText());
+        TokenKind type = Tok.getKind();
         advance();
-        if (Tok.getText() == "(")
+        if (Tok.is(TokenKind::l_paren))
         {
             advance();
             ExprList *values = new ExprList();
-            while (Tok.getText() != ")")
+            while (!Tok.is(TokenKind::r_paren))
             {
                 Expression *value = parseExpr();
                 if (value == nullptr)
                     return ErrorHandler();
-                while (Tok.getText() != "," && Tok.getText() != ")")
+                while (!Tok.isOneOf(TokenKind::comma, TokenKind::r_paren))
                 {
-                    if (Tok.is(TokenKind::bin_op) || Tok.is(TokenKind::comp_op) ||
-                        Tok.is(TokenKind::log_op) || Tok.is(TokenKind::bit_op))
+                    if (tok::isBinaryOperator(Tok.getKind()))
                     {
                         StringRef op = Tok.getText();
                         advance();
@@ -624,7 +648,7 @@ Expression *Parser::parseTerm()
                         return ErrorHandler();
                 }
                 values->push_back(value);
-                if (Tok.getText() == ",")
+                if (Tok.is(TokenKind::comma))
                     advance();
             }
             advance();
@@ -637,7 +661,7 @@ Expression *Parser::parseTerm()
     }
 
     // Unary term
-    if (Tok.is(TokenKind::un_op))
+    case TokenKind::un_op:
     {
         StringRef op = Tok.getText();
         advance();
@@ -648,26 +672,26 @@ Expression *Parser::parseTerm()
     }
 
     // IncDec term
-    if (Tok.is(TokenKind::incdec_op))
+    case TokenKind::incdec_op:
     {
         StringRef op = Tok.getText();
         advance();
-        VariableRef *Id = llvm::dyn_cast<VariableRef>(parseExpr());
+        VariableRef *Id = llvm::dyn_cast_or_null<VariableRef>(parseExpr());
         if (Id == nullptr)
             return ErrorHandler();
         return new IncDec(op, Id);
     }
 
-    if (Tok.getText() == "(")
+    case TokenKind::l_paren:
     {
         advance();
 
         // TypeCast term
-        if (KWFilter.isType(Tok.getText()))
+        if (tok::isTypeKeyword(Tok.getKind()))
         {
-            TokenKind type = KWFilter.lookup(Tok.getText());
+            TokenKind type = Tok.getKind();
             advance();
-            if (Tok.getText() != ")")
+            if (!Tok.is(TokenKind::r_paren))
                 return ErrorHandler();
             advance();
             Expression *E = parseTerm();
@@ -680,21 +704,22 @@ Expression *Parser::parseTerm()
     }
 
     // Variable ref term
-    if (Tok.is(TokenKind::identifier))
+    case TokenKind::identifier:
     {
         StringRef id = Tok.getText();
         advance();
-        if (Tok.getText() == "[")
+        if (Tok.is(TokenKind::l_paren) && (id == "Dx" || id == "Dy"))
+            return parseDerivative(id == "Dx" ? Derivative::X : Derivative::Y);
+        if (Tok.is(TokenKind::l_square))
         {
             advance();
 
             Expression *index = parseExpr();
             if (index == nullptr)
                 return ErrorHandler();
-            while (Tok.getText() != "]")
+            while (!Tok.is(TokenKind::r_square))
             {
-                if (Tok.is(TokenKind::bin_op) || Tok.is(TokenKind::comp_op) ||
-                    Tok.is(TokenKind::log_op) || Tok.is(TokenKind::bit_op))
+                if (tok::isBinaryOperator(Tok.getKind()))
                 {
                     StringRef op = Tok.getText();
                     advance();
@@ -715,6 +740,39 @@ Expression *Parser::parseTerm()
             return new VariableRef(id, nullptr);
         }
     }
+    default:
+        return ErrorHandler();
+    }
+}
 
-    return ErrorHandler();
-}
\ No newline at end of file
+// Dx or Dy, with Tok at the opening parenthesis.
+Expression *Parser::parseDerivative(Derivative::Axis Dir)
+{
+    auto ErrorHandler = [this]()
+    {
+        Diags.report(Tok.getLocation(), diag::err_unexpected_token,
+                     Tok.getText());
+        return nullptr;
+    };
+
+    advance();
+    Expression *E = parseExpr();
+    if (E == nullptr)
+        return ErrorHandler();
+    while (!Tok.is(TokenKind::r_paren))
+    {
+        if (tok::isBinaryOperator(Tok.getKind()))
+        {
+            StringRef op = Tok.getText();
+            advance();
+            Expression *nextValue = parseTerm();
+            if (nextValue == nullptr)
+                return ErrorHandler();
+            E = new BinaryExpression(op, E, nextValue);
+        }
+        else
+            return ErrorHandler();
+    }
+    advance();
+    return new Derivative(Dir, E);
+}
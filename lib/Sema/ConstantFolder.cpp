@@ -0,0 +1,257 @@
+#include "llshader/Sema/ConstantFolder.h"
+#include <cstdint>
+
+namespace
+{
+using LiteralValue = FlatAST::LiteralValue;
+
+bool isNumeric(const FlatAST &Tree, FlatNode N)
+{
+    if (N == InvalidFlatNode || Tree.getKind(N) != FlatKind::Literal)
+        return false;
+    Literal::LitKind Kind = Tree.getLiteral(N).Kind;
+    return Kind == Literal::Integer || Kind == Literal::FloatingPoint;
+}
+
+double asFloat(const LiteralValue &V)
+{
+    return V.Kind == Literal::Integer ? static_cast<double>(V.Int) : V.Float;
+}
+
+LiteralValue makeInt(int64_t Value)
+{
+    LiteralValue V;
+    V.Kind = Literal::Integer;
+    V.Int = static_cast<int32_t>(static_cast<uint32_t>(Value));
+    return V;
+}
+
+LiteralValue makeFloat(double Value)
+{
+    LiteralValue V;
+    V.Kind = Literal::FloatingPoint;
+    V.Float = Value;
+    return V;
+}
+
+bool foldIntBinary(FlatOp Op, int64_t L, int64_t R, LiteralValue &Out)
+{
+    // Operands are 32-bit values; compute wide and wrap in makeInt.
+    switch (Op)
+    {
+    case FlatOp::Add:
+        Out = makeInt(L + R);
+        return true;
+    case FlatOp::Sub:
+        Out = makeInt(L - R);
+        return true;
+    case FlatOp::Mul:
+        Out = makeInt(static_cast<int64_t>(static_cast<uint64_t>(L) *
+                                           static_cast<uint64_t>(R)));
+        return true;
+    case FlatOp::Div:
+    case FlatOp::Rem:
+        if (R == 0 || (L == INT32_MIN && R == -1))
+            return false;
+        Out = makeInt(Op == FlatOp::Div ? L / R : L % R);
+        return true;
+    case FlatOp::BitAnd:
+        Out = makeInt(L & R);
+        return true;
+    case FlatOp::BitOr:
+        Out = makeInt(L | R);
+        return true;
+    case FlatOp::BitXor:
+        Out = makeInt(L ^ R);
+        return true;
+    case FlatOp::Shl:
+    case FlatOp::Shr:
+        if (R < 0 || R > 31)
+            return false;
+        Out = makeInt(Op == FlatOp::Shl
+                          ? static_cast<int64_t>(static_cast<uint32_t>(L) << R)
+                          : L >> R);
+        return true;
+    case FlatOp::LT:
+        Out = makeInt(L < R);
+        return true;
+    case FlatOp::GT:
+        Out = makeInt(L > R);
+        return true;
+    case FlatOp::LE:
+        Out = makeInt(L <= R);
+        return true;
+    case FlatOp::GE:
+        Out = makeInt(L >= R);
+        return true;
+    case FlatOp::EQ:
+        Out = makeInt(L == R);
+        return true;
+    case FlatOp::NE:
+        Out = makeInt(L != R);
+        return true;
+    case FlatOp::LAnd:
+        Out = makeInt(L && R);
+        return true;
+    case FlatOp::LOr:
+        Out = makeInt(L || R);
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool foldFloatBinary(FlatOp Op, double L, double R, LiteralValue &Out)
+{
+    switch (Op)
+    {
+    case FlatOp::Add:
+        Out = makeFloat(L + R);
+        return true;
+    case FlatOp::Sub:
+        Out = makeFloat(L - R);
+        return true;
+    case FlatOp::Mul:
+        Out = makeFloat(L * R);
+        return true;
+    case FlatOp::Div:
+        Out = makeFloat(L / R);
+        return true;
+    case FlatOp::LT:
+        Out = makeInt(L < R);
+        return true;
+    case FlatOp::GT:
+        Out = makeInt(L > R);
+        return true;
+    case FlatOp::LE:
+        Out = makeInt(L <= R);
+        return true;
+    case FlatOp::GE:
+        Out = makeInt(L >= R);
+        return true;
+    case FlatOp::EQ:
+        Out = makeInt(L == R);
+        return true;
+    case FlatOp::NE:
+        Out = makeInt(L != R);
+        return true;
+    case FlatOp::LAnd:
+        Out = makeInt(L != 0 && R != 0);
+        return true;
+    case FlatOp::LOr:
+        Out = makeInt(L != 0 || R != 0);
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool fold(const FlatAST &Tree, FlatNode N, LiteralValue &Out)
+{
+    switch (Tree.getKind(N))
+    {
+    case FlatKind::BinaryExpression:
+    {
+        FlatNode L = Tree.getChild(N, 0), R = Tree.getChild(N, 1);
+        if (!isNumeric(Tree, L) || !isNumeric(Tree, R))
+            return false;
+        return foldBinary(Tree.getOp(N), Tree.getLiteral(L),
+                          Tree.getLiteral(R), Out);
+    }
+    case FlatKind::UnaryExpression:
+    {
+        FlatNode E = Tree.getChild(N, 0);
+        if (!isNumeric(Tree, E))
+            return false;
+        return foldUnary(Tree.getOp(N), Tree.getLiteral(E), Out);
+    }
+    case FlatKind::TypeCast:
+    {
+        FlatNode E = Tree.getChild(N, 0);
+        if (!isNumeric(Tree, E))
+            return false;
+        return foldCast(Tree.getType(N), Tree.getLiteral(E), Out);
+    }
+    case FlatKind::Derivative:
+    {
+        // A constant's derivative is 0.
+        if (!isNumeric(Tree, Tree.getChild(N, 0)))
+            return false;
+        Out = makeFloat(0);
+        return true;
+    }
+    case FlatKind::CompoundEx:
+    {
+        FlatNode E = Tree.getChild(N, 0);
+        if (Tree.children(N).size() != 1 || !isNumeric(Tree, E))
+            return false;
+        Out = Tree.getLiteral(E);
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+} // namespace
+
+bool foldBinary(FlatOp Op, const LiteralValue &L, const LiteralValue &R,
+                LiteralValue &Out)
+{
+    if (L.Kind == Literal::Integer && R.Kind == Literal::Integer)
+        return foldIntBinary(Op, L.Int, R.Int, Out);
+    return foldFloatBinary(Op, asFloat(L), asFloat(R), Out);
+}
+
+bool foldUnary(FlatOp Op, const LiteralValue &V, LiteralValue &Out)
+{
+    if (Op == FlatOp::Not)
+    {
+        Out = makeInt(V.Kind == Literal::Integer ? V.Int == 0 : V.Float == 0);
+        return true;
+    }
+    if (Op == FlatOp::BitNot && V.Kind == Literal::Integer)
+    {
+        Out = makeInt(~V.Int);
+        return true;
+    }
+    return false;
+}
+
+bool foldCast(TokenKind Type, const LiteralValue &V, LiteralValue &Out)
+{
+    if (Type == TokenKind::kw_float)
+    {
+        Out = makeFloat(asFloat(V));
+        return true;
+    }
+    if (Type == TokenKind::kw_int &&
+        (V.Kind == Literal::Integer ||
+         (V.Float > INT32_MIN - 1.0 && V.Float < INT32_MAX + 1.0)))
+    {
+        Out = makeInt(V.Kind == Literal::Integer
+                          ? V.Int
+                          : static_cast<int64_t>(V.Float));
+        return true;
+    }
+    return false;
+}
+
+unsigned foldConstants(FlatAST &Tree)
+{
+    // Children have larger indices than their parents, so sweeping down from
+    // the last node folds operands before the expressions that use them.
+    unsigned Folded = 0;
+    for (FlatNode N = static_cast<FlatNode>(Tree.size()); N-- > 0;)
+    {
+        LiteralValue Value;
+        if (!fold(Tree, N, Value))
+            continue;
+        Tree.replaceWithLiteral(N,
+                                Value.Kind == Literal::Integer
+                                    ? TokenKind::kw_int
+                                    : TokenKind::kw_float,
+                                Value);
+        ++Folded;
+    }
+    return Folded;
+}
@@ -0,0 +1,159 @@
+#include "llshader/Sema/Derivatives.h"
+#include "llshader/AST/RecursiveASTVisitor.h"
+
+namespace
+{
+bool isDifferentiable(TokenKind Type)
+{
+    return Type == TokenKind::kw_float || Type == TokenKind::kw_point ||
+           Type == TokenKind::kw_vector || Type == TokenKind::kw_normal ||
+           Type == TokenKind::kw_color;
+}
+
+bool isArithmetic(StringRef Op)
+{
+    return Op == "+" || Op == "-" || Op == "*" || Op == "/" || Op == "%";
+}
+
+void addRead(unsigned Slot, TokenKind Type, std::vector<unsigned> &Reads)
+{
+    if (Slot != InvalidSlot && isDifferentiable(Type))
+        Reads.push_back(Slot);
+}
+
+// Adds the variables whose derivatives flow into E's to Reads.
+void collectReads(Expression *E, std::vector<unsigned> &Reads)
+{
+    switch (E->getKind())
+    {
+    case Expression::ExprLit:
+    case Expression::ExprUn:
+    case Expression::ExprDeriv:
+        return;
+    case Expression::ExprRef:
+    {
+        auto Ref = llvm::cast<VariableRef>(E);
+        addRead(Ref->getSlot(), Ref->getType(), Reads);
+        return;
+    }
+    case Expression::ExprIncDec:
+    {
+        VariableRef *Ref = llvm::cast<IncDec>(E)->getId();
+        addRead(Ref->getSlot(), Ref->getType(), Reads);
+        return;
+    }
+    case Expression::ExprBin:
+    {
+        auto Bin = llvm::cast<BinaryExpression>(E);
+        if (isArithmetic(Bin->getOp()))
+        {
+            collectReads(Bin->getE1(), Reads);
+            collectReads(Bin->getE2(), Reads);
+        }
+        return;
+    }
+    case Expression::ExprTypeCon:
+    {
+        auto Con = llvm::cast<TypeConstructor>(E);
+        if (isDifferentiable(Con->getType()) && Con->getValues())
+            for (Expression *C : *Con->getValues())
+                collectReads(C, Reads);
+        return;
+    }
+    case Expression::ExprTypeCast:
+    {
+        auto Cast = llvm::cast<TypeCast>(E);
+        if (isDifferentiable(Cast->getType()))
+            collectReads(Cast->getE(), Reads);
+        return;
+    }
+    case Expression::ExprAssmt:
+    {
+        auto A = llvm::cast<Assignment>(E);
+        collectReads(A->getValue(), Reads);
+        // A compound assignment's value also depends on the old one.
+        if (A->getOp() != "=")
+            addRead(A->getId()->getSlot(), A->getId()->getType(), Reads);
+        return;
+    }
+    case Expression::ExprCompEx:
+    {
+        ExprList *EL = llvm::cast<CompoundEx>(E)->getEL();
+        if (EL && !EL->empty())
+            collectReads(EL->back(), Reads);
+        return;
+    }
+    }
+}
+} // namespace
+
+// Records which variables flow into each one and which the queries read,
+// then marks everything reachable from the queries.
+class DerivativeBuilder : public RecursiveASTVisitor<DerivativeBuilder>
+{
+    DerivativeInfo &Info;
+    // By slot, the variables read by the values assigned to it.
+    std::vector<std::vector<unsigned>> Sources;
+    std::vector<unsigned> Queried;
+
+  public:
+    DerivativeBuilder(DerivativeInfo &Info) : Info(Info) {}
+
+    void run(AST *Tree)
+    {
+        traverse(Tree);
+        std::vector<unsigned> Work = std::move(Queried);
+        while (!Work.empty())
+        {
+            unsigned Slot = Work.back();
+            Work.pop_back();
+            if (Info.Needed.size() <= Slot)
+                Info.Needed.resize(Slot + 1);
+            if (Info.Needed[Slot])
+                continue;
+            Info.Needed[Slot] = true;
+            ++Info.NumNeeded;
+            if (Slot < Sources.size())
+                Work.insert(Work.end(), Sources[Slot].begin(),
+                            Sources[Slot].end());
+        }
+    }
+
+    bool visitDefExpr(DefExpr &Node)
+    {
+        if (Node.getValue())
+            addSources(Node.getSlot(), Node.getValue());
+        return true;
+    }
+
+    bool visitAssignment(Assignment &Node)
+    {
+        addSources(Node.getId()->getSlot(), Node.getValue());
+        return true;
+    }
+
+    bool visitDerivative(Derivative &Node)
+    {
+        ++Info.NumQueries;
+        collectReads(Node.getE(), Queried);
+        return true;
+    }
+
+  private:
+    void addSources(unsigned Slot, Expression *Value)
+    {
+        if (Slot == InvalidSlot)
+            return;
+        if (Sources.size() <= Slot)
+            Sources.resize(Slot + 1);
+        collectReads(Value, Sources[Slot]);
+    }
+};
+
+DerivativeInfo DerivativeInfo::compute(AST *Tree)
+{
+    DerivativeInfo Info;
+    if (Tree)
+        DerivativeBuilder(Info).run(Tree);
+    return Info;
+}
@@ -0,0 +1,74 @@
+#include "llshader/Sema/FrameLayout.h"
+#include <iterator>
+
+namespace
+{
+// The order of the groups in the frame, by decreasing alignment and then
+// size; the types past void group nothing.
+const TokenKind GroupOrder[] = {
+    TokenKind::kw_string, TokenKind::kw_matrix, TokenKind::kw_color,
+    TokenKind::kw_point,  TokenKind::kw_vector, TokenKind::kw_normal,
+    TokenKind::kw_float,  TokenKind::kw_int};
+
+unsigned getGroup(TokenKind Type)
+{
+    for (unsigned G = 0; G != std::size(GroupOrder); ++G)
+        if (GroupOrder[G] == Type)
+            return G;
+    return std::size(GroupOrder);
+}
+} // namespace
+
+uint32_t FrameLayout::getSize(TokenKind Type)
+{
+    switch (Type)
+    {
+    case TokenKind::kw_string:
+        return 8;
+    case TokenKind::kw_matrix:
+        return 64;
+    case TokenKind::kw_color:
+    case TokenKind::kw_point:
+    case TokenKind::kw_vector:
+    case TokenKind::kw_normal:
+        return 12;
+    default:
+        return 4;
+    }
+}
+
+uint32_t FrameLayout::getAlign(TokenKind Type)
+{
+    return Type == TokenKind::kw_string ? 8 : 4;
+}
+
+FrameLayout FrameLayout::compute(llvm::ArrayRef<TokenKind> SlotTypes)
+{
+    // A counting sort of the slots by group keeps each group in slot order.
+    constexpr unsigned NumGroups = std::size(GroupOrder) + 1;
+    uint32_t GroupSize[NumGroups] = {};
+    for (TokenKind Type : SlotTypes)
+        GroupSize[getGroup(Type)] += getSize(Type);
+
+    uint32_t GroupStart[NumGroups];
+    uint32_t Offset = 0;
+    for (unsigned G = 0; G != NumGroups; ++G)
+    {
+        GroupStart[G] = Offset;
+        Offset += GroupSize[G];
+    }
+
+    FrameLayout Layout;
+    Layout.Offsets.reserve(SlotTypes.size());
+    for (TokenKind Type : SlotTypes)
+    {
+        uint32_t &Next = GroupStart[getGroup(Type)];
+        Layout.Offsets.push_back(Next);
+        Next += getSize(Type);
+    }
+    uint32_t Align = GroupSize[getGroup(TokenKind::kw_string)]
+                         ? getAlign(TokenKind::kw_string)
+                         : 4;
+    Layout.Size = (Offset + Align - 1) / Align * Align;
+    return Layout;
+}
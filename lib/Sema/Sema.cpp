@@ -1,187 +1,546 @@
 #include "llshader/Sema/Sema.h"
+#include "llshader/AST/RecursiveASTVisitor.h"
 #include "llshader/Sema/SymbolTable.h"
 #include "llvm/ADT/StringSet.h"
-#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/ThreadPool.h"
 
 namespace
 {
-class ProgramCheck : public ASTVisitor
+bool isAggregate(TokenKind Type)
 {
-    std::shared_ptr<SymbolTable> curSymTab;
-    int loopLevel = 0;
-    bool hasError = false;
+    return Type == TokenKind::kw_color || Type == TokenKind::kw_point ||
+           Type == TokenKind::kw_vector || Type == TokenKind::kw_normal ||
+           Type == TokenKind::kw_matrix;
+}
+
+// The type of a variable of type Type, subscripted if Subscripted.
+TokenKind getAccessType(TokenKind Type, bool Subscripted)
+{
+    if (!Subscripted)
+        return Type;
+    return isAggregate(Type) ? TokenKind::kw_float : TokenKind::kw_err;
+}
 
+// Counts the declared variables in a statement, the slots checking it
+// takes.
+class SlotCounter : public RecursiveASTVisitor<SlotCounter>
+{
   public:
-    ProgramCheck()
-        : curSymTab(std::make_shared<SymbolTable>()), loopLevel(0),
-          hasError(false) {};
-    bool hasErrorFunc() { return hasError; }
+    unsigned NumSlots = 0;
+
+    // Expressions declare nothing.
+    bool traverseExpr(Expression *) { return true; }
 
-    void visit(Program &Node) override
+    bool visitDefExpr(DefExpr &)
     {
-        if (Node.getSL())
-        {
-            for (auto S : *Node.getSL())
-            {
-                S->accept(*this);
-            }
-        }
+        ++NumSlots;
+        return true;
     }
+};
 
-    // Statement checks
-
-    void visit(Statement &Node) override
-    {
-        switch (Node.getKind())
-        {
-        case Statement::StmtComp:
-            Node.accept(*this);
-            break;
-        case Statement::StmtScoped:
-            Node.accept(*this);
-            break;
-        case Statement::StmtDecl:
-            Node.accept(*this);
-            break;
-        case Statement::StmtCond:
-            Node.accept(*this);
-            break;
-        case Statement::StmtLoop:
-            loopLevel++;
-            Node.accept(*this);
-            loopLevel--;
-            break;
-        case Statement::StmtLoopMod:
-            Node.accept(*this);
-            break;
-        default:
-            llvm_unreachable("Unknown statement kind");
-        }
-    }
+unsigned countSlots(Statement *S)
+{
+    SlotCounter Counter;
+    Counter.traverseStmt(S);
+    return Counter.NumSlots;
+}
 
-    void visit(CompoundSt &Node) override
-    {
-        if (Node.getEL())
-        {
-            for (auto E : *Node.getEL())
-            {
-                E->accept(*this);
-            }
-        }
-    }
+class ProgramCheck : public RecursiveASTVisitor<ProgramCheck>
+{
+    // Where errors are reported; null to only count them.
+    DiagnosticsEngine *Diags;
+    std::shared_ptr<SymbolTable> curSymTab;
+    // Types by slot; slots are numbered from nextSlot in traversal order.
+    std::vector<TokenKind> *slotTypes;
+    unsigned nextSlot = 0;
+    bool hasError = false;
 
-    void visit(Scoped &Node) override
+  public:
+    ProgramCheck(DiagnosticsEngine *Diags, std::vector<TokenKind> &slotTypes,
+                 std::shared_ptr<SymbolTable> symTab =
+                     std::make_shared<SymbolTable>())
+        : Diags(Diags), curSymTab(symTab), slotTypes(&slotTypes),
+          hasError(false) {};
+    bool hasErrorFunc() { return hasError; }
+    void setDiagnostics(DiagnosticsEngine *NewDiags) { Diags = NewDiags; }
+    void setNextSlot(unsigned Slot) { nextSlot = Slot; }
+
+    // Statement checks. Errors do not stop the traversal, so every
+    // traverse* returns true.
+
+    bool traverseScoped(Scoped &Node)
     {
         auto parSymTab = curSymTab;
         curSymTab = std::make_shared<SymbolTable>(parSymTab);
-        if (Node.getSL())
-        {
-            for (auto S : *Node.getSL())
-            {
-                S->accept(*this);
-            }
-        }
+        traverseList(Node.getSL());
         curSymTab = parSymTab;
+        return true;
     }
 
-    void visit(Declaration &Node) override
+    bool traverseDeclaration(Declaration &Node)
     {
         TokenKind type = Node.getType();
         if (Node.getDefs())
         {
-            for (auto &def : *Node.getDefs())
+            DefEList &defs = *Node.getDefs();
+            for (size_t i = 0; i < defs.size(); ++i)
             {
+                DefExpr *def = defs[i];
                 auto id = def->getId().str();
                 auto exists = curSymTab->lookup(id, false);
                 if (exists != TokenKind::kw_void)
                 {
-                    llvm::errs()
-                        << "Error: Redeclaration of variable " << id << "\n";
-                    hasError = true;
-                    return;
+                    error(Node.getLocation(), diag::err_redeclaration, id);
+                    skipSlots(defs.size() - i);
+                    return true;
                 }
                 if (def->getValue())
                 {
-                    def->getValue()->accept(*this);
+                    // The initializer sees the enclosing variable of the
+                    // same name, if any.
+                    traverseExpr(def->getValue());
                     TokenKind rhsType = def->getValue()->getType();
                     if (type != rhsType && !(type == TokenKind::kw_float &&
                                              rhsType == TokenKind::kw_int))
                     {
-                        llvm::errs() << "Error: Type mismatch in declaration "
-                                        "of variable "
-                                     << id << "\n";
-                        hasError = true;
-                        return;
+                        error(Node.getLocation(),
+                              diag::err_declaration_type_mismatch, id);
+                        skipSlots(defs.size() - i);
+                        return true;
                     }
                 }
-                curSymTab->insert(id, type);
+                unsigned slot = nextSlot++;
+                if (slot >= slotTypes->size())
+                    slotTypes->resize(slot + 1, TokenKind::kw_void);
+                (*slotTypes)[slot] = type;
+                def->setSlot(slot);
+                curSymTab->insert(id, type, slot);
             }
         }
+        return true;
     }
 
-    void visit(Conditional &Node) override
+    bool traverseConditional(Conditional &Node)
     {
-        Node.getCondition()->accept(*this);
+        traverseExpr(Node.getCondition());
         if (Node.getCondition()->getType() != TokenKind::kw_int)
         {
-            llvm::errs() << "Error: Condition must be an integer\n";
-            hasError = true;
-            return;
+            error(Node.getLocation(), diag::err_condition_not_int);
+            skipSlots(countSlots(Node.getThen()) +
+                      countSlots(Node.getElse()));
+            return true;
         }
-        Node.getThen()->accept(*this);
-        if (Node.getElse())
-            Node.getElse()->accept(*this);
+        traverseStmt(Node.getThen());
+        traverseStmt(Node.getElse());
+        return true;
     }
 
-    void visit(Loop &Node) override
+    bool traverseFor(For &Node)
     {
-        switch (Node.getKind())
+        auto parSymTab = curSymTab;
+        if (Node.getInit())
         {
-        case Loop::LoopFor:
-            Node.accept(*this);
-            break;
-        case Loop::LoopWhile:
-            Node.accept(*this);
-            break;
-        case Loop::LoopDoWhile:
-            Node.accept(*this);
-            break;
-        default:
-            llvm_unreachable("Unknown loop kind");
+            curSymTab = std::make_shared<SymbolTable>(parSymTab);
+            traverseDeclaration(*Node.getInit());
         }
+        if (Node.getCondition())
+            traverseExpr(Node.getCondition());
+        if (Node.getCondition() &&
+            Node.getCondition()->getType() != TokenKind::kw_int)
+        {
+            error(Node.getLocation(), diag::err_condition_not_int);
+            skipSlots(countSlots(Node.getBody()));
+            curSymTab = parSymTab;
+            return true;
+        }
+        if (Node.getUpdate())
+            traverseExpr(Node.getUpdate());
+        traverseStmt(Node.getBody());
+        curSymTab = parSymTab;
+        return true;
     }
 
-    void visit(For &Node) override
+    // Unlike those of ifs and for loops, while conditions may be floats,
+    // which codegen compares with 0, so only the body is checked.
+    bool traverseWhile(While &Node)
     {
-        auto parSymTab = curSymTab;
-        if (Node.getInit())
+        traverseExpr(Node.getCondition());
+        traverseStmt(Node.getBody());
+        return true;
+    }
+
+    bool traverseDoWhile(DoWhile &Node)
+    {
+        traverseStmt(Node.getBody());
+        traverseExpr(Node.getCondition());
+        return true;
+    }
+
+    // Expressions are not checked yet; their variables are bound to the
+    // slots and types of the declarations in scope, and undeclared ones
+    // are left unbound.
+
+    bool visitVariableRef(VariableRef &Node)
+    {
+        if (const SymbolTable::Entry *Var = curSymTab->find(Node.getId().str()))
         {
-            curSymTab = std::make_shared<SymbolTable>(parSymTab);
-            Node.getInit()->accept(*this);
+            Node.setSlot(Var->slot);
+            Node.setType(getAccessType(Var->type, Node.getDeref()));
         }
-        if (Node.getCondition())
+        return true;
+    }
+
+    bool visitLValue(LValue &Node)
+    {
+        if (const SymbolTable::Entry *Var = curSymTab->find(Node.getId().str()))
+        {
+            Node.setSlot(Var->slot);
+            Node.setType(getAccessType(Var->type, Node.getIndices()));
+        }
+        return true;
+    }
+
+  private:
+    template <typename... Args>
+    void error(SMLoc Loc, unsigned DiagID, Args &&...Arguments)
+    {
+        if (Diags)
+            Diags->report(Loc, DiagID, std::forward<Args>(Arguments)...);
+        hasError = true;
+    }
+
+    // Declarations left unchecked after an error still take their slots,
+    // so the slots after them are numbered as checkParallel numbers them.
+    void skipSlots(unsigned count)
+    {
+        nextSlot += count;
+        if (nextSlot > slotTypes->size())
+            slotTypes->resize(nextSlot, TokenKind::kw_void);
+    }
+};
+
+// ProgramCheck over a FlatAST. Scopes are an undo log over per-identifier
+// arrays instead of a chain of hash tables.
+class FlatProgramCheck : public FlatASTVisitor<FlatProgramCheck>
+{
+    DiagnosticsEngine *Diags;
+    // Innermost scope declaring each identifier (0 if none) and its type.
+    std::vector<uint32_t> DeclScope;
+    std::vector<TokenKind> DeclType;
+    struct Shadowed
+    {
+        uint32_t Ident;
+        uint32_t Scope;
+        TokenKind Type;
+    };
+    std::vector<Shadowed> Undo;
+    uint32_t CurScope = 1;
+    uint32_t NextScope = 2;
+    bool HasError = false;
+
+    struct ScopeMark
+    {
+        uint32_t Scope;
+        size_t UndoSize;
+    };
+
+    ScopeMark enterScope()
+    {
+        ScopeMark Mark = {CurScope, Undo.size()};
+        CurScope = NextScope++;
+        return Mark;
+    }
+
+    void leaveScope(ScopeMark Mark)
+    {
+        while (Undo.size() > Mark.UndoSize)
+        {
+            DeclScope[Undo.back().Ident] = Undo.back().Scope;
+            DeclType[Undo.back().Ident] = Undo.back().Type;
+            Undo.pop_back();
+        }
+        CurScope = Mark.Scope;
+    }
+
+    void declare(uint32_t Ident, TokenKind Type)
+    {
+        Undo.push_back({Ident, DeclScope[Ident], DeclType[Ident]});
+        DeclScope[Ident] = CurScope;
+        DeclType[Ident] = Type;
+    }
+
+    // The type of expression N with its variables typed by the declarations
+    // in scope, as ProgramCheck binds them. The flat tree is built before
+    // Sema runs, so the types it stores for variables, and for expressions
+    // over them, are not known yet.
+    TokenKind typeOf(FlatNode N) const
+    {
+        switch (Tree.getKind(N))
+        {
+        case FlatKind::VariableRef:
+        case FlatKind::LValue:
+        {
+            uint32_t Ident = Tree.getIdent(N);
+            if (!DeclScope[Ident])
+                return TokenKind::kw_void;
+            return getAccessType(DeclType[Ident], !Tree.children(N).empty());
+        }
+        case FlatKind::BinaryExpression:
+            return getBinaryType(Tree.getOp(N), typeOf(Tree.getChild(N, 0)),
+                                 typeOf(Tree.getChild(N, 1)));
+        case FlatKind::Assignment:
+            // A plain assignment has the type of its value, others that of
+            // the variable.
+            return typeOf(Tree.getOp(N) == FlatOp::Assign
+                              ? Tree.getChild(N, 1)
+                              : Tree.getChild(N, 0));
+        case FlatKind::IncDec:
+            return typeOf(Tree.getChild(N, 0));
+        case FlatKind::CompoundEx:
+            return Tree.children(N).size() == 1 ? typeOf(Tree.getChild(N, 0))
+                                                : TokenKind::kw_void;
+        case FlatKind::Derivative:
+        {
+            TokenKind Type = typeOf(Tree.getChild(N, 0));
+            return Type == TokenKind::kw_int ? TokenKind::kw_float : Type;
+        }
+        default:
+            return Tree.getType(N);
+        }
+    }
+
+  public:
+    FlatProgramCheck(const FlatAST &Tree, DiagnosticsEngine *Diags)
+        : FlatASTVisitor(Tree), Diags(Diags),
+          DeclScope(Tree.getNumIdents(), 0),
+          DeclType(Tree.getNumIdents(), TokenKind::kw_void)
+    {
+    }
+    bool hasError() const { return HasError; }
+
+    // Expressions are not checked yet.
+    void visitCompoundSt(FlatNode) {}
+
+    void visitScoped(FlatNode N)
+    {
+        ScopeMark Mark = enterScope();
+        visitChildren(N);
+        leaveScope(Mark);
+    }
+
+    void visitDeclaration(FlatNode N)
+    {
+        TokenKind Type = Tree.getType(N);
+        for (FlatNode Def : Tree.children(N))
         {
-            Node.getCondition()->accept(*this);
-            if (Node.getCondition()->getType() != TokenKind::kw_int)
+            uint32_t Ident = Tree.getIdent(Def);
+            StringRef Id = Tree.getIdentName(Ident);
+            if (DeclScope[Ident] == CurScope)
             {
-                llvm::errs() << "Error: Condition must be an integer\n";
-                hasError = true;
+                error(N, diag::err_redeclaration, Id);
                 return;
             }
+            FlatNode Value = Tree.getChild(Def, 0);
+            if (Value != InvalidFlatNode)
+            {
+                TokenKind RHSType = typeOf(Value);
+                if (Type != RHSType && !(Type == TokenKind::kw_float &&
+                                         RHSType == TokenKind::kw_int))
+                {
+                    error(N, diag::err_declaration_type_mismatch, Id);
+                    return;
+                }
+            }
+            declare(Ident, Type);
         }
-        if (Node.getUpdate())
-            Node.getUpdate()->accept(*this);
-        Node.getBody()->accept(*this);
-        curSymTab = parSymTab;
+    }
+
+    void visitConditional(FlatNode N)
+    {
+        if (typeOf(Tree.getChild(N, 0)) != TokenKind::kw_int)
+        {
+            error(N, diag::err_condition_not_int);
+            return;
+        }
+        visit(Tree.getChild(N, 1));
+        if (Tree.getChild(N, 2) != InvalidFlatNode)
+            visit(Tree.getChild(N, 2));
+    }
+
+    void visitFor(FlatNode N)
+    {
+        FlatNode Init = Tree.getChild(N, 0);
+        FlatNode Cond = Tree.getChild(N, 1);
+        ScopeMark Mark = {CurScope, Undo.size()};
+        if (Init != InvalidFlatNode)
+        {
+            Mark = enterScope();
+            visit(Init);
+        }
+        if (Cond != InvalidFlatNode && typeOf(Cond) != TokenKind::kw_int)
+        {
+            error(N, diag::err_condition_not_int);
+            leaveScope(Mark);
+            return;
+        }
+        visit(Tree.getChild(N, 3));
+        leaveScope(Mark);
+    }
+
+    // Like ProgramCheck, while and do-while loops check their bodies only.
+    void visitWhile(FlatNode N) { visit(Tree.getChild(N, 1)); }
+    void visitDoWhile(FlatNode N) { visit(Tree.getChild(N, 1)); }
+
+  private:
+    // Reports at statement N.
+    template <typename... Args>
+    void error(FlatNode N, unsigned DiagID, Args &&...Arguments)
+    {
+        if (Diags)
+            Diags->report(Tree.getLocation(N), DiagID,
+                          std::forward<Args>(Arguments)...);
+        HasError = true;
     }
 };
+
+// True if checking S cannot add names to the scope it appears in, so a
+// top-level S can be checked apart from the statements that follow it.
+bool isIsolated(const Statement *S)
+{
+    switch (S->getKind())
+    {
+    case Statement::StmtScoped:
+        return true;
+    case Statement::StmtCond:
+    {
+        auto C = llvm::cast<Conditional>(S);
+        return isIsolated(C->getThen()) &&
+               (!C->getElse() || isIsolated(C->getElse()));
+    }
+    case Statement::StmtLoop:
+        switch (llvm::cast<Loop>(S)->getKind())
+        {
+        case Loop::LoopFor:
+        {
+            auto F = llvm::cast<For>(S);
+            return F->getInit() || isIsolated(F->getBody());
+        }
+        case Loop::LoopWhile:
+            return isIsolated(llvm::cast<While>(S)->getBody());
+        case Loop::LoopDoWhile:
+            return isIsolated(llvm::cast<DoWhile>(S)->getBody());
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+// Checks the statements that may declare globals in order first, then the
+// isolated ones as tasks on a thread pool. Each task sees the globals
+// declared before its statement through a read-only parent scope and
+// defers its errors in an engine of its own; they are replayed into Diags
+// in source order, so the output matches a serial check. Each statement's
+// slots start after those of the statements before it, so they are
+// numbered as in a serial check too.
+bool checkParallel(const StmtList &SL, unsigned NumThreads,
+                   std::vector<TokenKind> &SlotTypes, DiagnosticsEngine *Diags)
+{
+    struct Task
+    {
+        size_t Index;
+        unsigned Limit;
+    };
+    std::vector<Task> Tasks;
+    std::vector<std::vector<StoredDiagnostic>> Output(SL.size());
+    // A deferring engine never touches the SourceMgr, so each thread can
+    // have one.
+    auto check = [&](ProgramCheck &Check, size_t I)
+    {
+        if (!Diags)
+        {
+            Check.traverseStmt(SL[I]);
+            return;
+        }
+        DiagnosticsEngine StmtDiags(Diags->getSourceMgr());
+        StmtDiags.setDeferring(true);
+        Check.setDiagnostics(&StmtDiags);
+        Check.traverseStmt(SL[I]);
+        Output[I] = StmtDiags.takeDeferred();
+    };
+
+    std::vector<unsigned> FirstSlot(SL.size());
+    unsigned NumSlots = 0;
+    for (size_t I = 0; I < SL.size(); ++I)
+    {
+        FirstSlot[I] = NumSlots;
+        NumSlots += countSlots(SL[I]);
+    }
+    // Sized up front, so the tasks only write their own slots.
+    SlotTypes.assign(NumSlots, TokenKind::kw_void);
+
+    auto Globals = std::make_shared<SymbolTable>();
+    ProgramCheck GlobalCheck(nullptr, SlotTypes, Globals);
+    for (size_t I = 0; I < SL.size(); ++I)
+    {
+        if (isIsolated(SL[I]))
+        {
+            Tasks.push_back({I, Globals->size()});
+            continue;
+        }
+        GlobalCheck.setNextSlot(FirstSlot[I]);
+        check(GlobalCheck, I);
+    }
+    bool HasError = GlobalCheck.hasErrorFunc();
+
+    std::vector<char> TaskError(Tasks.size(), false);
+    {
+        llvm::ThreadPool Pool(llvm::hardware_concurrency(NumThreads));
+        for (size_t T = 0; T < Tasks.size(); ++T)
+        {
+            Pool.async(
+                [&, T]()
+                {
+                    ProgramCheck Check(nullptr, SlotTypes,
+                                       std::make_shared<SymbolTable>(
+                                           Globals, Tasks[T].Limit));
+                    Check.setNextSlot(FirstSlot[Tasks[T].Index]);
+                    check(Check, Tasks[T].Index);
+                    TaskError[T] = Check.hasErrorFunc();
+                });
+        }
+        Pool.wait();
+    }
+
+    for (size_t T = 0; T < Tasks.size(); ++T)
+        HasError |= TaskError[T];
+    if (Diags)
+        for (const std::vector<StoredDiagnostic> &Stored : Output)
+            for (const StoredDiagnostic &D : Stored)
+                Diags->replay(D);
+    return !HasError;
+}
 } // namespace
 
 bool Sema::semantic(AST *Tree)
 {
+    SlotTypes.clear();
     if (!Tree)
         return false;
-    ProgramCheck Check;
-    Tree->accept(Check);
+    Program *P = llvm::dyn_cast<Program>(Tree);
+    if (NumThreads > 1 && P && P->getSL())
+        return checkParallel(*P->getSL(), NumThreads, SlotTypes, Diags);
+    ProgramCheck Check(Diags, SlotTypes);
+    Check.traverse(Tree);
     return !Check.hasErrorFunc();
+}
+
+bool Sema::semantic(const FlatAST &Tree)
+{
+    SlotTypes.clear();
+    if (!Tree.size())
+        return false;
+    FlatProgramCheck Check(Tree, Diags);
+    Check.visit(Tree.getRoot());
+    return !Check.hasError();
 }
\ No newline at end of file
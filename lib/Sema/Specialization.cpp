@@ -0,0 +1,457 @@
+#include "llshader/Sema/Specialization.h"
+#include "llshader/AST/FlatAST.h"
+#include "llshader/AST/RecursiveASTVisitor.h"
+#include "llshader/Sema/ConstantFolder.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/Format.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+using LiteralValue = FlatAST::LiteralValue;
+
+bool isNumeric(const llvm::Optional<LiteralValue> &V)
+{
+    return V && V->Kind != Literal::String;
+}
+
+// Rounds a folded float to float, the precision codegen computes in.
+// Double holds the exact result of +, -, * and / on floats, so rounding it
+// once gives the same value as the float operation.
+LiteralValue toFloat(LiteralValue V)
+{
+    if (V.Kind == Literal::Integer)
+        V.Float = static_cast<float>(V.Int);
+    V.Kind = Literal::FloatingPoint;
+    V.Float = static_cast<float>(V.Float);
+    return V;
+}
+
+// The value of a literal as codegen reads it.
+LiteralValue getValue(const Literal &Lit)
+{
+    LiteralValue V;
+    V.Kind = Lit.getKind();
+    V.Text = Lit.getValue();
+    if (V.Kind == Literal::Integer)
+        V.Int = Lit.getInt();
+    else if (V.Kind == Literal::FloatingPoint)
+        V.Float = Lit.getFloat();
+    return V;
+}
+} // namespace
+
+class SpecializationBuilder : public RecursiveASTVisitor<SpecializationBuilder>
+{
+    Specialization &Spec;
+    const llvm::StringMap<std::string> &Values;
+    std::string &Error;
+
+    // Variables assigned or incremented anywhere, by name.
+    llvm::StringSet<> Written;
+    // The variables in scope, with the value of those that are bound and
+    // never written.
+    std::vector<llvm::StringMap<llvm::Optional<LiteralValue>>> Scopes;
+    std::vector<std::pair<std::string, std::string>> Bound;
+    // Value of the last expression traversed, if it is constant.
+    llvm::Optional<LiteralValue> R;
+
+    class WriteCollector : public RecursiveASTVisitor<WriteCollector>
+    {
+        llvm::StringSet<> &Written;
+
+      public:
+        WriteCollector(llvm::StringSet<> &Written) : Written(Written) {}
+
+        bool visitLValue(LValue &Node)
+        {
+            Written.insert(Node.getId());
+            return true;
+        }
+
+        bool visitIncDec(IncDec &Node)
+        {
+            Written.insert(Node.getId()->getId());
+            return true;
+        }
+    };
+
+  public:
+    SpecializationBuilder(Specialization &Spec,
+                          const llvm::StringMap<std::string> &Values,
+                          std::string &Error)
+        : Spec(Spec), Values(Values), Error(Error)
+    {
+    }
+
+    bool run(AST *Tree)
+    {
+        WriteCollector(Written).traverse(Tree);
+        Scopes.assign(1, {});
+        if (!traverse(Tree))
+            return false;
+        for (auto &Entry : Values)
+        {
+            if (!Scopes.front().count(Entry.first()))
+            {
+                Error = "the shader has no parameter " + Entry.first().str();
+                return false;
+            }
+        }
+        std::sort(Bound.begin(), Bound.end());
+        for (auto &B : Bound)
+            Spec.Key += (Spec.Key.empty() ? "" : ";") + B.first + "=" +
+                        B.second;
+        return true;
+    }
+
+    // Statements
+
+    bool traverseScoped(Scoped &Node)
+    {
+        Scopes.emplace_back();
+        traverseList(Node.getSL());
+        Scopes.pop_back();
+        return true;
+    }
+
+    bool traverseDeclaration(Declaration &Node)
+    {
+        if (!Node.getDefs())
+            return true;
+        for (DefExpr *Def : *Node.getDefs())
+        {
+            if (Def->getValue())
+                traverseExpr(Def->getValue());
+            llvm::Optional<LiteralValue> Value;
+            auto It = Values.find(Def->getId());
+            if (Scopes.size() == 1 && It != Values.end())
+            {
+                Value = parseValue(Node.getType(), Def->getId(), It->second);
+                if (!Value)
+                    return false;
+                Literal *Lit = makeLiteral(*Value);
+                Spec.Initializers[Def] = Lit;
+                Bound.push_back({Def->getId().str(), Lit->getValue().str()});
+                ++Spec.NumBound;
+                if (Written.count(Def->getId()))
+                    Value = llvm::None;
+            }
+            Scopes.back()[Def->getId()] = Value;
+        }
+        return true;
+    }
+
+    bool traverseConditional(Conditional &Node)
+    {
+        traverseExpr(Node.getCondition());
+        resolve(Node);
+        traverseStmt(Node.getThen());
+        traverseStmt(Node.getElse());
+        return true;
+    }
+
+    bool traverseFor(For &Node)
+    {
+        Scopes.emplace_back();
+        if (Node.getInit())
+            traverseDeclaration(*Node.getInit());
+        if (Node.getCondition())
+        {
+            traverseExpr(Node.getCondition());
+            resolveLoop(Node);
+        }
+        traverseStmt(Node.getBody());
+        traverseExpr(Node.getUpdate());
+        Scopes.pop_back();
+        return true;
+    }
+
+    bool traverseWhile(While &Node)
+    {
+        traverseExpr(Node.getCondition());
+        resolveLoop(Node);
+        traverseStmt(Node.getBody());
+        return true;
+    }
+
+    // Expressions
+
+    bool traverseLiteral(Literal &Node)
+    {
+        R = getValue(Node);
+        return true;
+    }
+
+    bool traverseVariableRef(VariableRef &Node)
+    {
+        if (Node.getDeref())
+        {
+            traverseExpr(Node.getDeref());
+            R = llvm::None;
+            return true;
+        }
+        R = lookup(Node.getId());
+        if (R)
+            replace(Node, *R);
+        return true;
+    }
+
+    bool traverseBinaryExpression(BinaryExpression &Node)
+    {
+        traverseExpr(Node.getE1());
+        llvm::Optional<LiteralValue> L = R;
+        traverseExpr(Node.getE2());
+        if (!isNumeric(L) || !isNumeric(R))
+        {
+            R = llvm::None;
+            return true;
+        }
+        // Mixed operands are converted to float first, as codegen does.
+        bool IsFloat = L->Kind == Literal::FloatingPoint ||
+                       R->Kind == Literal::FloatingPoint;
+        LiteralValue Out;
+        if (!foldBinary(getFlatOp(Node.getOp()), IsFloat ? toFloat(*L) : *L,
+                        IsFloat ? toFloat(*R) : *R, Out))
+        {
+            R = llvm::None;
+            return true;
+        }
+        finish(Node, Out);
+        return true;
+    }
+
+    bool traverseUnaryExpression(UnaryExpression &Node)
+    {
+        traverseExpr(Node.getE());
+        LiteralValue Out;
+        if (!isNumeric(R) || !foldUnary(getFlatOp(Node.getOp()), *R, Out))
+        {
+            R = llvm::None;
+            return true;
+        }
+        finish(Node, Out);
+        return true;
+    }
+
+    bool traverseTypeCast(TypeCast &Node)
+    {
+        traverseExpr(Node.getE());
+        LiteralValue Out;
+        if (!isNumeric(R) || !foldCast(Node.getType(), *R, Out))
+        {
+            R = llvm::None;
+            return true;
+        }
+        finish(Node, Out);
+        return true;
+    }
+
+    // A constant's derivative is 0.
+    bool traverseDerivative(Derivative &Node)
+    {
+        traverseExpr(Node.getE());
+        if (!isNumeric(R))
+        {
+            R = llvm::None;
+            return true;
+        }
+        LiteralValue Out;
+        Out.Kind = Literal::FloatingPoint;
+        Out.Float = 0;
+        finish(Node, Out);
+        return true;
+    }
+
+    bool traverseCompoundEx(CompoundEx &Node)
+    {
+        ExprList *EL = Node.getEL();
+        traverseList(EL);
+        if (!EL || EL->size() != 1 || !R)
+        {
+            R = llvm::None;
+            return true;
+        }
+        finish(Node, *R);
+        return true;
+    }
+
+    bool traverseTypeConstructor(TypeConstructor &Node)
+    {
+        traverseList(Node.getValues());
+        R = llvm::None;
+        return true;
+    }
+
+    bool traverseAssignment(Assignment &Node)
+    {
+        traverseList(Node.getId()->getIndices());
+        traverseExpr(Node.getValue());
+        R = llvm::None;
+        return true;
+    }
+
+    bool traverseIncDec(IncDec &Node)
+    {
+        traverseExpr(Node.getId()->getDeref());
+        R = llvm::None;
+        return true;
+    }
+
+  private:
+    llvm::Optional<LiteralValue> lookup(StringRef Name)
+    {
+        for (auto I = Scopes.rbegin(), E = Scopes.rend(); I != E; ++I)
+        {
+            auto It = I->find(Name);
+            if (It != I->end())
+                return It->second;
+        }
+        return llvm::None;
+    }
+
+    llvm::Optional<LiteralValue> parseValue(TokenKind Type, StringRef Name,
+                                            StringRef Text)
+    {
+        LiteralValue V;
+        switch (Type)
+        {
+        case TokenKind::kw_int:
+        {
+            long long Int;
+            V.Kind = Literal::Integer;
+            if (!Text.trim().getAsInteger(0, Int) && Int >= INT32_MIN &&
+                Int <= INT32_MAX)
+            {
+                V.Int = Int;
+                return V;
+            }
+            Error = "'" + Text.str() + "' is not an int, the type of " +
+                    Name.str();
+            return llvm::None;
+        }
+        case TokenKind::kw_float:
+        {
+            double Float;
+            V.Kind = Literal::FloatingPoint;
+            if (!Text.trim().getAsDouble(Float) &&
+                std::isfinite(static_cast<float>(Float)))
+            {
+                V.Float = static_cast<float>(Float);
+                return V;
+            }
+            Error = "'" + Text.str() + "' is not a float, the type of " +
+                    Name.str();
+            return llvm::None;
+        }
+        case TokenKind::kw_string:
+            V.Kind = Literal::String;
+            V.Text = Spec.Saver.save(Text);
+            return V;
+        default:
+            Error = "cannot bind " + Name.str() +
+                    "; only int, float and string parameters can be";
+            return llvm::None;
+        }
+    }
+
+    Literal *makeLiteral(const LiteralValue &V)
+    {
+        if (V.Kind == Literal::Integer)
+            Spec.Literals.push_back(std::make_unique<Literal>(
+                Spec.Saver.save(llvm::Twine(V.Int)),
+                static_cast<int32_t>(V.Int)));
+        else if (V.Kind == Literal::FloatingPoint)
+        {
+            // Nine significant digits round-trip every float.
+            llvm::SmallString<32> Buf;
+            llvm::raw_svector_ostream(Buf) << llvm::format("%.9g", V.Float);
+            Spec.Literals.push_back(std::make_unique<Literal>(
+                Spec.Saver.save(StringRef(Buf)),
+                static_cast<float>(V.Float)));
+        }
+        else
+            Spec.Literals.push_back(
+                std::make_unique<Literal>(Literal::String, V.Text));
+        return Spec.Literals.back().get();
+    }
+
+    void replace(Expression &E, const LiteralValue &V)
+    {
+        Spec.Replacements[&E] = makeLiteral(V);
+        ++Spec.NumFolded;
+    }
+
+    void finish(Expression &E, LiteralValue Out)
+    {
+        if (Out.Kind == Literal::FloatingPoint)
+        {
+            Out = toFloat(Out);
+            // Leave inf and NaN to the hardware.
+            if (!std::isfinite(Out.Float))
+            {
+                R = llvm::None;
+                return;
+            }
+        }
+        replace(E, Out);
+        R = Out;
+    }
+
+    // Records the value of Node's condition if it is constant.
+    void resolve(Statement &Node)
+    {
+        if (!isNumeric(R))
+            return;
+        Spec.Conditions[&Node] =
+            R->Kind == Literal::Integer ? R->Int != 0 : R->Float != 0;
+        ++Spec.NumDeadBranches;
+    }
+
+    // A loop only changes if it never runs.
+    void resolveLoop(Loop &Node)
+    {
+        if (isNumeric(R) &&
+            (R->Kind == Literal::Integer ? R->Int == 0 : R->Float == 0))
+            resolve(Node);
+    }
+};
+
+std::unique_ptr<Specialization>
+Specialization::compute(AST *Tree, const llvm::StringMap<std::string> &Values,
+                        std::string &Error)
+{
+    std::unique_ptr<Specialization> Spec(new Specialization());
+    if (!SpecializationBuilder(*Spec, Values, Error).run(Tree))
+        return nullptr;
+    return Spec;
+}
+
+Literal *Specialization::getInitializer(const DefExpr *Def) const
+{
+    auto It = Initializers.find(Def);
+    return It == Initializers.end() ? nullptr : It->second;
+}
+
+Literal *Specialization::getReplacement(const Expression *E) const
+{
+    auto It = Replacements.find(E);
+    return It == Replacements.end() ? nullptr : It->second;
+}
+
+llvm::Optional<bool> Specialization::getCondition(const Statement *S) const
+{
+    auto It = Conditions.find(S);
+    if (It == Conditions.end())
+        return llvm::None;
+    return It->second;
+}
+
+void Specialization::print(llvm::raw_ostream &OS) const
+{
+    OS << "specialized " << NumBound << " parameters: " << NumFolded
+       << " expressions folded, " << NumDeadBranches
+       << " branches removed\n";
+}
@@ -0,0 +1,555 @@
+#include "llshader/Sema/Uniformity.h"
+#include "llshader/AST/RecursiveASTVisitor.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include <algorithm>
+
+bool isShaderGlobal(llvm::StringRef Name)
+{
+    static const llvm::StringSet<> ShaderGlobals = {
+        "P",    "I",    "N",       "Ng", "u",    "v",     "s",  "t",
+        "dPdu", "dPdv", "dPdtime", "Ps", "time", "dtime", "Ci"};
+    return ShaderGlobals.contains(Name);
+}
+
+namespace
+{
+Variance join(Variance A, Variance B) { return std::max(A, B); }
+
+struct ExprResult
+{
+    Variance Var = Variance::Constant;
+    // Number of enclosing loops, from the outermost, that the value varies
+    // in. Equal to the loop depth if it varies in all of them.
+    unsigned VariantDepth = 0;
+    bool Pure = true;
+    bool Invariant = false;
+    unsigned Nodes = 1;
+
+    void merge(const ExprResult &Other)
+    {
+        Var = join(Var, Other.Var);
+        VariantDepth = std::max(VariantDepth, Other.VariantDepth);
+        Pure &= Other.Pure;
+        Nodes += Other.Nodes;
+    }
+};
+
+template <typename Fn> void forEachChild(Expression *E, Fn F)
+{
+    switch (E->getKind())
+    {
+    case Expression::ExprLit:
+        return;
+    case Expression::ExprTypeCon:
+        if (ExprList *Values = llvm::cast<TypeConstructor>(E)->getValues())
+            for (Expression *C : *Values)
+                F(C);
+        return;
+    case Expression::ExprBin:
+        F(llvm::cast<BinaryExpression>(E)->getE1());
+        F(llvm::cast<BinaryExpression>(E)->getE2());
+        return;
+    case Expression::ExprUn:
+        F(llvm::cast<UnaryExpression>(E)->getE());
+        return;
+    case Expression::ExprAssmt:
+    {
+        auto A = llvm::cast<Assignment>(E);
+        if (A->getId()->getIndices())
+            for (Expression *C : *A->getId()->getIndices())
+                F(C);
+        F(A->getValue());
+        return;
+    }
+    case Expression::ExprRef:
+        if (Expression *Deref = llvm::cast<VariableRef>(E)->getDeref())
+            F(Deref);
+        return;
+    case Expression::ExprIncDec:
+        if (Expression *Deref = llvm::cast<IncDec>(E)->getId()->getDeref())
+            F(Deref);
+        return;
+    case Expression::ExprTypeCast:
+        F(llvm::cast<TypeCast>(E)->getE());
+        return;
+    case Expression::ExprDeriv:
+        F(llvm::cast<Derivative>(E)->getE());
+        return;
+    case Expression::ExprCompEx:
+        if (ExprList *EL = llvm::cast<CompoundEx>(E)->getEL())
+            for (Expression *C : *EL)
+                F(C);
+        return;
+    }
+}
+} // namespace
+
+// Walks the tree until the variances of the variables stop changing; the
+// last walk's results are final. Variables are numbered in declaration
+// order, which is the same on every walk.
+class UniformityBuilder : public RecursiveASTVisitor<UniformityBuilder>
+{
+    UniformityInfo &Info;
+
+    std::vector<llvm::StringMap<unsigned>> Scopes;
+    std::vector<Variance> VarVariance;
+    unsigned NextVar = 0;
+
+    struct LoopData
+    {
+        // Variables assigned or declared anywhere in the loop.
+        llvm::DenseSet<unsigned> Written;
+        // Whether lanes may leave the loop on different iterations.
+        bool VaryingExit = false;
+        unsigned StatsIndex = 0;
+    };
+    llvm::DenseMap<const Loop *, LoopData> Loops;
+    std::vector<const Loop *> LoopStack;
+    // Enclosing branches and loops whose outcome is varying.
+    unsigned VaryingControl = 0;
+    bool Changed = false;
+
+    llvm::DenseMap<const Expression *, ExprResult> Results;
+    // Result of the last expression traversed.
+    ExprResult R;
+
+    static constexpr unsigned NoVar = ~0u;
+
+  public:
+    UniformityBuilder(UniformityInfo &Info) : Info(Info) {}
+
+    void run(AST *Tree)
+    {
+        do
+        {
+            Changed = false;
+            NextVar = 0;
+            Scopes.assign(1, {});
+            Results.clear();
+            Info.Hoisted.clear();
+            Info.Loops.clear();
+            traverse(Tree);
+        } while (Changed);
+
+        Info.Exprs.reserve(Results.size());
+        for (auto &Entry : Results)
+            Info.Exprs[Entry.first] = {Entry.second.Var,
+                                       Entry.second.Invariant};
+    }
+
+    // Statements
+
+    bool traverseScoped(Scoped &Node)
+    {
+        Scopes.emplace_back();
+        traverseList(Node.getSL());
+        Scopes.pop_back();
+        return true;
+    }
+
+    bool traverseDeclaration(Declaration &Node)
+    {
+        if (!Node.getDefs())
+            return true;
+        for (DefExpr *Def : *Node.getDefs())
+        {
+            Variance Value = Variance::Constant;
+            if (Def->getValue())
+            {
+                traverseRoot(Def->getValue());
+                Value = R.Var;
+            }
+            write(declare(Def->getId()), Value);
+        }
+        return true;
+    }
+
+    bool traverseCompoundSt(CompoundSt &Node)
+    {
+        if (!Node.getEL())
+            return true;
+        for (Expression *E : *Node.getEL())
+            traverseRoot(E);
+        return true;
+    }
+
+    bool traverseConditional(Conditional &Node)
+    {
+        traverseRoot(Node.getCondition());
+        bool Varying = R.Var == Variance::Varying;
+        VaryingControl += Varying;
+        traverseStmt(Node.getThen());
+        traverseStmt(Node.getElse());
+        VaryingControl -= Varying;
+        return true;
+    }
+
+    bool traverseFor(For &Node)
+    {
+        // The initialization runs once, before the loop.
+        Scopes.emplace_back();
+        if (Node.getInit())
+            traverseDeclaration(*Node.getInit());
+        enterLoop(Node);
+        bool Varying = false;
+        if (Node.getCondition())
+        {
+            traverseRoot(Node.getCondition());
+            Varying = R.Var == Variance::Varying;
+        }
+        Varying = setVaryingExit(Node, Varying);
+        VaryingControl += Varying;
+        traverseStmt(Node.getBody());
+        if (Node.getUpdate())
+            traverseRoot(Node.getUpdate());
+        VaryingControl -= Varying;
+        leaveLoop();
+        Scopes.pop_back();
+        return true;
+    }
+
+    bool traverseWhile(While &Node)
+    {
+        enterLoop(Node);
+        traverseRoot(Node.getCondition());
+        bool Varying = setVaryingExit(Node, R.Var == Variance::Varying);
+        VaryingControl += Varying;
+        traverseStmt(Node.getBody());
+        VaryingControl -= Varying;
+        leaveLoop();
+        return true;
+    }
+
+    bool traverseDoWhile(DoWhile &Node)
+    {
+        // Whether the body repeats depends on the condition at the bottom,
+        // which a previous walk has seen.
+        enterLoop(Node);
+        bool Varying = setVaryingExit(Node, false);
+        VaryingControl += Varying;
+        traverseStmt(Node.getBody());
+        traverseRoot(Node.getCondition());
+        VaryingControl -= Varying;
+        setVaryingExit(Node, R.Var == Variance::Varying);
+        leaveLoop();
+        return true;
+    }
+
+    bool traverseLoopMod(LoopMod &)
+    {
+        if (VaryingControl && !LoopStack.empty())
+            setVaryingExit(*LoopStack.back(), true);
+        return true;
+    }
+
+    // Expressions
+
+    bool traverseLiteral(Literal &Node)
+    {
+        finish(Node, ExprResult());
+        return true;
+    }
+
+    bool traverseVariableRef(VariableRef &Node)
+    {
+        ExprResult Out = read(lookup(Node.getId()));
+        if (Node.getDeref())
+        {
+            traverseExpr(Node.getDeref());
+            Out.merge(R);
+        }
+        finish(Node, Out);
+        return true;
+    }
+
+    bool traverseBinaryExpression(BinaryExpression &Node)
+    {
+        ExprResult Out;
+        traverseExpr(Node.getE1());
+        Out.merge(R);
+        traverseExpr(Node.getE2());
+        Out.merge(R);
+        finish(Node, Out);
+        return true;
+    }
+
+    bool traverseUnaryExpression(UnaryExpression &Node)
+    {
+        ExprResult Out;
+        traverseExpr(Node.getE());
+        Out.merge(R);
+        finish(Node, Out);
+        return true;
+    }
+
+    bool traverseTypeCast(TypeCast &Node)
+    {
+        ExprResult Out;
+        traverseExpr(Node.getE());
+        Out.merge(R);
+        finish(Node, Out);
+        return true;
+    }
+
+    bool traverseDerivative(Derivative &Node)
+    {
+        ExprResult Out;
+        traverseExpr(Node.getE());
+        Out.merge(R);
+        finish(Node, Out);
+        return true;
+    }
+
+    bool traverseTypeConstructor(TypeConstructor &Node)
+    {
+        ExprResult Out;
+        if (Node.getValues())
+            for (Expression *E : *Node.getValues())
+            {
+                traverseExpr(E);
+                Out.merge(R);
+            }
+        finish(Node, Out);
+        return true;
+    }
+
+    bool traverseCompoundEx(CompoundEx &Node)
+    {
+        ExprResult Out;
+        if (Node.getEL())
+            for (Expression *E : *Node.getEL())
+            {
+                traverseExpr(E);
+                Out.merge(R);
+            }
+        finish(Node, Out);
+        return true;
+    }
+
+    bool traverseAssignment(Assignment &Node)
+    {
+        ExprResult Out;
+        if (ExprList *Indices = Node.getId()->getIndices())
+            for (Expression *E : *Indices)
+            {
+                traverseExpr(E);
+                Out.merge(R);
+            }
+        traverseExpr(Node.getValue());
+        Out.merge(R);
+        unsigned Id = lookup(Node.getId()->getId());
+        // Compound assignments and element stores keep part of the old
+        // value.
+        if (Node.getOp() != "=" || Node.getId()->getIndices())
+            Out.merge(read(Id));
+        write(Id, Out.Var);
+        Out.Pure = false;
+        finish(Node, Out);
+        return true;
+    }
+
+    bool traverseIncDec(IncDec &Node)
+    {
+        unsigned Id = lookup(Node.getId()->getId());
+        ExprResult Out = read(Id);
+        if (Node.getId()->getDeref())
+        {
+            traverseExpr(Node.getId()->getDeref());
+            Out.merge(R);
+        }
+        write(Id, Out.Var);
+        Out.Pure = false;
+        finish(Node, Out);
+        return true;
+    }
+
+  private:
+    unsigned declare(StringRef Name)
+    {
+        unsigned Id = NextVar++;
+        if (VarVariance.size() <= Id)
+            VarVariance.push_back(Scopes.size() == 1 && isShaderGlobal(Name)
+                                      ? Variance::Varying
+                                      : Variance::Uniform);
+        Scopes.back()[Name] = Id;
+        return Id;
+    }
+
+    unsigned lookup(StringRef Name)
+    {
+        for (auto I = Scopes.rbegin(), E = Scopes.rend(); I != E; ++I)
+        {
+            auto It = I->find(Name);
+            if (It != I->end())
+                return It->second;
+        }
+        return NoVar;
+    }
+
+    ExprResult read(unsigned Id)
+    {
+        ExprResult Out;
+        if (Id == NoVar)
+        {
+            // Codegen rejects undeclared variables; never hoist them.
+            Out.Var = Variance::Varying;
+            Out.VariantDepth = LoopStack.size();
+            return Out;
+        }
+        Out.Var = VarVariance[Id];
+        // Loops write a superset of what the loops nested in them write.
+        while (Out.VariantDepth < LoopStack.size() &&
+               Loops[LoopStack[Out.VariantDepth]].Written.count(Id))
+            ++Out.VariantDepth;
+        return Out;
+    }
+
+    void write(unsigned Id, Variance Value)
+    {
+        if (Id == NoVar)
+            return;
+        for (const Loop *L : LoopStack)
+            Changed |= Loops[L].Written.insert(Id).second;
+        Variance New = join(VarVariance[Id], join(Value, Variance::Uniform));
+        if (VaryingControl)
+            New = Variance::Varying;
+        if (New != VarVariance[Id])
+        {
+            VarVariance[Id] = New;
+            Changed = true;
+        }
+    }
+
+    void finish(Expression &E, ExprResult Out)
+    {
+        if (!Out.Pure)
+            Out.VariantDepth = LoopStack.size();
+        Out.Invariant = Out.Pure && Out.VariantDepth < LoopStack.size();
+        Results[&E] = Out;
+        R = Out;
+    }
+
+    // Traverses an expression a statement owns and collects what it can
+    // hoist; R is left as the expression's result.
+    void traverseRoot(Expression *E)
+    {
+        traverseExpr(E);
+        ExprResult Root = R;
+        if (!LoopStack.empty())
+            markHoisted(E);
+        R = Root;
+    }
+
+    void markHoisted(Expression *E)
+    {
+        if (!E)
+            return;
+        const ExprResult &Res = Results[E];
+        // Constants are folded by codegen, and a lone variable read does no
+        // work.
+        if (Res.Invariant && Res.Var != Variance::Constant && Res.Nodes > 1)
+        {
+            const Loop *L = LoopStack[Res.VariantDepth];
+            Info.Hoisted[L].push_back(E);
+            UniformityInfo::LoopStats &Stats =
+                Info.Loops[Loops[L].StatsIndex];
+            ++Stats.Hoisted;
+            Stats.HoistedNodes += Res.Nodes;
+            return;
+        }
+        forEachChild(E, [this](Expression *C) { markHoisted(C); });
+    }
+
+    void enterLoop(Loop &L)
+    {
+        Loops[&L].StatsIndex = Info.Loops.size();
+        Info.Loops.push_back({&L});
+        LoopStack.push_back(&L);
+    }
+
+    void leaveLoop() { LoopStack.pop_back(); }
+
+    // Records that L may exit on different iterations for different lanes
+    // if Varying; returns whether it may.
+    bool setVaryingExit(const Loop &L, bool Varying)
+    {
+        LoopData &Data = Loops[&L];
+        if (Varying && !Data.VaryingExit)
+        {
+            Data.VaryingExit = true;
+            Changed = true;
+        }
+        return Data.VaryingExit;
+    }
+};
+
+UniformityInfo UniformityInfo::compute(AST *Tree)
+{
+    UniformityInfo Info;
+    if (Tree)
+        UniformityBuilder(Info).run(Tree);
+    return Info;
+}
+
+Variance UniformityInfo::getVariance(const Expression *E) const
+{
+    auto It = Exprs.find(E);
+    return It == Exprs.end() ? Variance::Varying : It->second.Var;
+}
+
+bool UniformityInfo::isLoopInvariant(const Expression *E) const
+{
+    auto It = Exprs.find(E);
+    return It != Exprs.end() && It->second.LoopInvariant;
+}
+
+llvm::ArrayRef<Expression *> UniformityInfo::getHoisted(const Loop *L) const
+{
+    auto It = Hoisted.find(L);
+    if (It == Hoisted.end())
+        return {};
+    return It->second;
+}
+
+void UniformityInfo::print(llvm::raw_ostream &OS,
+                           const DiagnosticsEngine *Diags) const
+{
+    unsigned Counts[3] = {0, 0, 0};
+    unsigned Invariant = 0;
+    for (auto &Entry : Exprs)
+    {
+        ++Counts[static_cast<int>(Entry.second.Var)];
+        Invariant += Entry.second.LoopInvariant;
+    }
+    OS << "expressions: " << Exprs.size() << " (" << Counts[0]
+       << " constant, " << Counts[1] << " uniform, " << Counts[2]
+       << " varying), " << Invariant << " loop-invariant\n";
+
+    unsigned Hoisted = 0, Nodes = 0, LoopsHoisted = 0;
+    for (const LoopStats &Stats : Loops)
+    {
+        Hoisted += Stats.Hoisted;
+        Nodes += Stats.HoistedNodes;
+        LoopsHoisted += Stats.Hoisted != 0;
+    }
+    OS << "hoisted: " << Hoisted << " expressions (" << Nodes
+       << " nodes) out of " << LoopsHoisted << " of " << Loops.size()
+       << " loops\n";
+    for (const LoopStats &Stats : Loops)
+    {
+        if (!Stats.Hoisted)
+            continue;
+        OS << "  ";
+        std::pair<unsigned, unsigned> LineCol = {0, 0};
+        if (Diags)
+            LineCol = Diags->getLineAndColumn(Stats.L->getLocation());
+        if (LineCol.first)
+            OS << LineCol.first << ":" << LineCol.second;
+        else
+            OS << "loop";
+        OS << ": " << Stats.Hoisted << " expressions (" << Stats.HoistedNodes
+           << " nodes)\n";
+    }
+}
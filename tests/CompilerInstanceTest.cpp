@@ -0,0 +1,61 @@
+#include "llshader/Frontend/CompilerInstance.h"
+#include <gtest/gtest.h>
+#include <llvm/Support/raw_ostream.h>
+#include <string>
+
+namespace
+{
+// The status, diagnostics and printed module of a compile, which must not
+// depend on what the instance compiled before.
+std::string describe(const CompileResult &Result)
+{
+    std::string Out;
+    llvm::raw_string_ostream OS(Out);
+    OS << "status " << unsigned(Result.getStatus()) << '\n';
+    Result.printDiagnostics(OS);
+    if (Result.getModule())
+        Result.getModule()->print(OS, nullptr);
+    return OS.str();
+}
+
+std::string compileFresh(llvm::StringRef Source, llvm::StringRef Name)
+{
+    CompilerInstance Instance;
+    return describe(Instance.compile(Source, Name));
+}
+
+const char *Declares = "int g = 3; float f = g * 2.5; int a = 1;\n"
+                       "for (int k = 0; k < g; (++k)) { a = a + k; }\n";
+// Uses g, which only the other shader declares, and declares a again.
+const char *UsesUndeclared = "int a = 2;\nint b = g + a;\n";
+const char *Redeclares = "int a = 2;\nfloat a = 1.5;\nint c = 3000000000;\n";
+
+TEST(CompilerInstanceTest, CompilesAreIndependent)
+{
+    CompilerInstance Instance;
+    CompileResult First = Instance.compile(Declares, "first.osl");
+    ASSERT_TRUE(First.succeeded());
+    EXPECT_TRUE(First.getDiagnostics().empty());
+    EXPECT_EQ(describe(First), compileFresh(Declares, "first.osl"));
+
+    // Nothing of the first shader's globals is left to be found...
+    CompileResult Second = Instance.compile(UsesUndeclared, "second.osl");
+    EXPECT_EQ(Second.getStatus(), CompileResult::SemanticError);
+    ASSERT_EQ(Second.getDiagnostics().size(), 1u);
+    EXPECT_EQ(Second.getDiagnostics()[0].getFilename(), "second.osl");
+    EXPECT_EQ(Second.getDiagnostics()[0].getLineNo(), 2);
+    EXPECT_EQ(describe(Second), compileFresh(UsesUndeclared, "second.osl"));
+
+    // ...or reported again with the next shader's diagnostics.
+    CompileResult Third = Instance.compile(Redeclares, "third.osl");
+    EXPECT_EQ(Third.getStatus(), CompileResult::SemanticError);
+    EXPECT_EQ(describe(Third), compileFresh(Redeclares, "third.osl"));
+    EXPECT_EQ(Third.getDiagnostics().size(), 2u);
+    for (const llvm::SMDiagnostic &D : Third.getDiagnostics())
+        EXPECT_EQ(D.getFilename(), "third.osl");
+
+    // The first shader compiles to the same module again.
+    CompileResult Again = Instance.compile(Declares, "first.osl");
+    EXPECT_EQ(describe(Again), describe(First));
+}
+} // namespace
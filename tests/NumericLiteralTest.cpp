@@ -0,0 +1,194 @@
+#include "llshader/Basic/Diagnostic.h"
+#include "llshader/Lexer/Lexer.h"
+#include "llshader/Lexer/NumericLiteral.h"
+#include <gtest/gtest.h>
+#include <llvm/Support/MathExtras.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+namespace
+{
+struct IntCase
+{
+    const char *Text;
+    LiteralStatus Status;
+    int32_t Value;
+};
+
+TEST(NumericLiteralTest, Integers)
+{
+    const IntCase Cases[] = {
+        {"0", LiteralStatus::Ok, 0},
+        {"42", LiteralStatus::Ok, 42},
+        {"007", LiteralStatus::Ok, 7},
+        {"2147483647", LiteralStatus::Ok, INT32_MAX},
+        {"-2147483648", LiteralStatus::Ok, INT32_MIN},
+        {"+5", LiteralStatus::Ok, 5},
+        // Decimal spellings wrap above int's range.
+        {"2147483648", LiteralStatus::Wrapped, INT32_MIN},
+        {"3000000000", LiteralStatus::Wrapped, -1294967296},
+        {"4294967295", LiteralStatus::Wrapped, -1},
+        {"-2147483649", LiteralStatus::Wrapped, INT32_MAX},
+        {"4294967296", LiteralStatus::Wrapped, 0},
+        {"18446744073709551615", LiteralStatus::Wrapped, -1},
+        // Hexadecimal spellings are bit patterns and may use all 32 bits.
+        {"0x7fffffff", LiteralStatus::Ok, INT32_MAX},
+        {"0x80000000", LiteralStatus::Ok, INT32_MIN},
+        {"0XFFFFFFFF", LiteralStatus::Ok, -1},
+        {"0x100000000", LiteralStatus::Wrapped, 0},
+        {"0xFFFFFFFFFFFFFFFF", LiteralStatus::Wrapped, -1},
+    };
+    for (const IntCase &C : Cases)
+    {
+        int32_t Value = 12345;
+        EXPECT_EQ(parseIntegerLiteral(C.Text, Value), C.Status) << C.Text;
+        EXPECT_EQ(Value, C.Value) << C.Text;
+    }
+
+    int32_t Value;
+    EXPECT_EQ(parseIntegerLiteral("18446744073709551616", Value),
+              LiteralStatus::TooLarge);
+    EXPECT_EQ(parseIntegerLiteral("0x10000000000000000", Value),
+              LiteralStatus::TooLarge);
+    for (const char *Text : {"", "-", "0x", "12a", "0xG", "1.0", "1e3"})
+        EXPECT_EQ(parseIntegerLiteral(Text, Value), LiteralStatus::Invalid)
+            << Text;
+}
+
+uint32_t parseFloatBits(const std::string &Text, LiteralStatus &Status)
+{
+    float Value = 0;
+    Status = parseFloatLiteral(Text, Value);
+    return llvm::FloatToBits(Value);
+}
+
+uint32_t strtofBits(const std::string &Text)
+{
+    return llvm::FloatToBits(std::strtof(Text.c_str(), nullptr));
+}
+
+TEST(NumericLiteralTest, FloatsMatchStrtof)
+{
+    const char *Spellings[] = {
+        "0.0", "-0.0", "1.0", "1.5", "0.1", "3.14159", ".5", "5.", "1e10",
+        "1E-10", "123456789.0", "0.000001", "1.17549435e-38",
+        "3.4028235e38", "3.40282346638528859811704183484516925440e+38",
+        "7.038531e-26", "1.1754942e-38", "16777216.0", "16777217.0",
+        "16777218.0", "16777219.0",
+        // Exactly halfway between two floats: ties go to the even one.
+        "1.000000059604644775390625",     // 1 + 2^-24
+        "1.000000178813934326171875",     // 1 + 3 * 2^-24
+        "33554433.0", "33554435.0",
+        // Just above and below a halfway point, past 19 significant digits.
+        "1.0000000596046447753906250000000001",
+        "1.0000000596046447753906249999999999",
+        "0.00000000000000000000000000000000000001175494350822287507968736537"
+        "222245677818665556772087521508751706278417259454727172851560500000",
+        "9999999999999999999999999999999999999.0",
+    };
+    for (const char *Text : Spellings)
+    {
+        LiteralStatus Status;
+        EXPECT_EQ(parseFloatBits(Text, Status), strtofBits(Text)) << Text;
+    }
+}
+
+TEST(NumericLiteralTest, RandomFloatsMatchStrtof)
+{
+    std::mt19937_64 Rng(0x11543ade);
+    std::uniform_int_distribution<int> DigitCount(1, 24);
+    std::uniform_int_distribution<int> DigitDist(0, 9);
+    std::uniform_int_distribution<int> Exponent(-50, 40);
+    for (int I = 0; I < 200000; ++I)
+    {
+        std::string Text;
+        int Digits = DigitCount(Rng);
+        int Point = std::uniform_int_distribution<int>(0, Digits)(Rng);
+        for (int D = 0; D < Digits; ++D)
+        {
+            if (D == Point)
+                Text += '.';
+            Text += static_cast<char>('0' + DigitDist(Rng));
+        }
+        if (Point == Digits)
+            Text += ".0";
+        if (I % 2)
+            Text += "e" + std::to_string(Exponent(Rng));
+        LiteralStatus Status;
+        ASSERT_EQ(parseFloatBits(Text, Status), strtofBits(Text)) << Text;
+    }
+}
+
+TEST(NumericLiteralTest, FloatStatus)
+{
+    LiteralStatus Status;
+    parseFloatBits("3.4028235e38", Status);
+    EXPECT_EQ(Status, LiteralStatus::Ok);
+    EXPECT_EQ(parseFloatBits("3.5e38", Status), 0x7f800000u);
+    EXPECT_EQ(Status, LiteralStatus::Overflow);
+    EXPECT_EQ(parseFloatBits("-1e39", Status), 0xff800000u);
+    EXPECT_EQ(Status, LiteralStatus::Overflow);
+    EXPECT_EQ(parseFloatBits("1e-50", Status), 0u);
+    EXPECT_EQ(Status, LiteralStatus::Underflow);
+    parseFloatBits("1e-40", Status);
+    EXPECT_EQ(Status, LiteralStatus::Denormal);
+    parseFloatBits("1.17549435e-38", Status);
+    EXPECT_EQ(Status, LiteralStatus::Ok);
+    parseFloatBits("0.0", Status);
+    EXPECT_EQ(Status, LiteralStatus::Ok);
+
+    float Value;
+    for (const char *Text : {"", ".", "-", "1.0f", "1..0", "0x1p3", "e5"})
+        EXPECT_EQ(parseFloatLiteral(Text, Value), LiteralStatus::Invalid)
+            << Text;
+}
+
+// The diagnostics the Lexer reports for Src, in order.
+std::vector<StoredDiagnostic> lexDiagnostics(llvm::StringRef Src)
+{
+    llvm::SourceMgr SrcMgr;
+    SrcMgr.AddNewSourceBuffer(
+        llvm::MemoryBuffer::getMemBufferCopy(Src, "t.osl"), llvm::SMLoc());
+    DiagnosticsEngine Diags(SrcMgr);
+    Diags.setDeferring(true);
+    Lexer Lex(SrcMgr, Diags);
+    Token Tok;
+    do
+        Lex.next(Tok);
+    while (!Tok.is(TokenKind::eof));
+    return Diags.takeDeferred();
+}
+
+TEST(NumericLiteralTest, LexerDiagnostics)
+{
+    EXPECT_TRUE(lexDiagnostics("int a = 2147483647; int b = 0xFFFFFFFF; "
+                               "float c = 1.5; float d = 1.17549435e-38;")
+                    .empty());
+
+    std::vector<StoredDiagnostic> D = lexDiagnostics(
+        "int a = 3000000000;\n"
+        "int b = 0x100000000;\n"
+        "int c = 99999999999999999999;\n"
+        "float d = 1e39;\n"
+        "float e = 1e-50;\n"
+        "float f = 1e-40;\n");
+    ASSERT_EQ(D.size(), 6u);
+    EXPECT_EQ(D[0].Kind, llvm::SourceMgr::DK_Warning);
+    EXPECT_EQ(D[0].Msg,
+              "Integer literal 3000000000 does not fit in an int and wraps");
+    EXPECT_EQ(D[1].Kind, llvm::SourceMgr::DK_Warning);
+    EXPECT_EQ(D[1].Msg,
+              "Integer literal 0x100000000 does not fit in an int and wraps");
+    EXPECT_EQ(D[2].Kind, llvm::SourceMgr::DK_Error);
+    EXPECT_EQ(D[3].Kind, llvm::SourceMgr::DK_Warning);
+    EXPECT_EQ(D[3].Msg, "Floating-point literal 1e39 is too large for a float "
+                        "and is infinity");
+    EXPECT_EQ(D[4].Msg, "Floating-point literal 1e-50 is too small for a "
+                        "float and is zero");
+    EXPECT_EQ(D[5].Msg, "Floating-point literal 1e-40 is denormal in a float "
+                        "and loses precision");
+}
+} // namespace
@@ -0,0 +1,224 @@
+#include "llshader/AST/FlatAST.h"
+#include "llshader/Basic/Diagnostic.h"
+#include "llshader/Lexer/Lexer.h"
+#include "llshader/Parser/ParallelParser.h"
+#include "llshader/Parser/Parser.h"
+#include <gtest/gtest.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+// Concatenates Stmts and returns the offsets just past each of them but the
+// last, which the scan cannot tell is complete.
+std::vector<size_t> expectedEnds(const std::vector<std::string> &Stmts,
+                                 std::string &Src)
+{
+    std::vector<size_t> Ends;
+    Src.clear();
+    for (const std::string &S : Stmts)
+    {
+        Src += S;
+        Ends.push_back(Src.size());
+    }
+    Ends.pop_back();
+    return Ends;
+}
+
+void expectBoundaries(const std::vector<std::string> &Stmts)
+{
+    std::string Src;
+    std::vector<size_t> Ends = expectedEnds(Stmts, Src);
+    EXPECT_EQ(findTopLevelBoundaries(Src), Ends) << Src;
+}
+
+TEST(ParallelParserTest, BoundariesAfterSemicolonsAndBraces)
+{
+    expectBoundaries({"int a = 1;", " int b = 2;", "\nfloat c = 3;"});
+    expectBoundaries({"{ int a = 1; }", " { { int b; } { } }", " int c;"});
+    expectBoundaries({"for (int k = 0; k < 3; (++k)) { a = k; }", " a = 1;"});
+    expectBoundaries({"while (a < 3) { a = a + 1; }", "a = 2;", "a = 3;"});
+}
+
+TEST(ParallelParserTest, ContinuedStatementsAreNotSplit)
+{
+    expectBoundaries({"if (a) { b = 1; } else { b = 2; }", " c = 1;"});
+    expectBoundaries({"if (a) b = 1; else b = 2;", " c = 1;"});
+    expectBoundaries(
+        {"if (a) { } else if (b) { } else { }", " c = 1;", " d = 1;"});
+    expectBoundaries({"do { a = a + 1; } while (a < 3);", " b = 1;"});
+    expectBoundaries({"do a = a + 1; while (a < 3);", " b = 1;"});
+    // A while after a finished do-while starts a loop of its own.
+    expectBoundaries({"do { } while (a);", " while (a) { }", " b = 1;"});
+    // Identifiers that merely start with a keyword do not continue one.
+    expectBoundaries({"{ }", " elsewhere = 1;", " whiles = 2;"});
+}
+
+TEST(ParallelParserTest, BracketsInStringsAreIgnored)
+{
+    expectBoundaries({"string s = \"};{\";", " string t = \"(\";", " a = 1;"});
+    expectBoundaries({"{ string s = \"}\"; }", " { string t = \"{\"; }",
+                      " a = 1;"});
+    expectBoundaries({"string s = \"\";", " string t = \";\";", " a;"});
+}
+
+TEST(ParallelParserTest, UnbalancedInputStopsTheScan)
+{
+    EXPECT_EQ(findTopLevelBoundaries("int a = 1; } int b = 2; int c;"),
+              std::vector<size_t>({10}));
+    EXPECT_EQ(findTopLevelBoundaries("int a = 1; { int b = 2; int c;"),
+              std::vector<size_t>({10}));
+    EXPECT_EQ(findTopLevelBoundaries("int a = 1; string s = \"; int b;"),
+              std::vector<size_t>({10}));
+    EXPECT_TRUE(findTopLevelBoundaries("").empty());
+}
+
+// Inside brackets the scan skips 16 bytes at a time: move the closing
+// brace, and a quote with brackets after it, across the edges of those
+// blocks.
+TEST(ParallelParserTest, BoundariesAtBlockEdges)
+{
+    for (unsigned Pad = 0; Pad < 48; ++Pad)
+    {
+        std::string Spaces(Pad, ' ');
+        expectBoundaries({"{ a = 1;" + Spaces + "}", " b = 2;", " c;"});
+        expectBoundaries({"{ string s = \"" + std::string(Pad, 'x') +
+                              "}){\"; }",
+                          " b = 2;", " c;"});
+        expectBoundaries({"{" + Spaces + "string s = \"}\";" + Spaces + "}",
+                          " b = 2;", " c;"});
+        expectBoundaries({"(" + std::string(Pad, '(') + "a" +
+                              std::string(Pad, ')') + ");",
+                          " b = 2;", " c;"});
+    }
+}
+
+struct ParseResult
+{
+    std::string Dump;
+    std::vector<StoredDiagnostic> Diags;
+};
+
+// One line per node of Tree in its flat form: kind, type, operator,
+// payload, literal or identifier spelling, children and the offset of a
+// statement's location.
+std::string dump(AST *Tree, const char *Base)
+{
+    std::string Out;
+    llvm::raw_string_ostream OS(Out);
+    FlatAST Flat = FlatAST::build(Tree);
+    for (FlatNode N = 0; N < Flat.size(); ++N)
+    {
+        OS << N << ": " << unsigned(Flat.getKind(N)) << ' '
+           << unsigned(Flat.getType(N)) << ' ' << unsigned(Flat.getOp(N))
+           << ' ' << Flat.getIdent(N);
+        switch (Flat.getKind(N))
+        {
+        case FlatKind::Literal:
+            OS << " '" << Flat.getLiteral(N).Text << '\'';
+            break;
+        case FlatKind::DefExpr:
+        case FlatKind::LValue:
+        case FlatKind::VariableRef:
+            OS << ' ' << Flat.getIdentName(Flat.getIdent(N));
+            break;
+        default:
+            break;
+        }
+        OS << " [";
+        for (FlatNode Child : Flat.children(N))
+            OS << ' ' << int(Child);
+        OS << " ]";
+        if (Flat.getLocation(N).isValid())
+            OS << " @" << Flat.getLocation(N).getPointer() - Base;
+        OS << '\n';
+    }
+    return OS.str();
+}
+
+ParseResult parse(const std::string &Src, unsigned Threads)
+{
+    llvm::SourceMgr SrcMgr;
+    SrcMgr.AddNewSourceBuffer(
+        llvm::MemoryBuffer::getMemBuffer(Src, "t.osl"), llvm::SMLoc());
+    DiagnosticsEngine Diags(SrcMgr);
+    Diags.setDeferring(true);
+    std::unique_ptr<AST> Tree;
+    if (Threads)
+        Tree.reset(ParallelParser(SrcMgr, Diags, Threads).parse());
+    else
+    {
+        Lexer Lex(SrcMgr, Diags);
+        Parser P(Lex, Diags);
+        Tree.reset(P.parse());
+    }
+    ParseResult R;
+    if (Tree)
+        R.Dump = dump(Tree.get(), Src.data());
+    R.Diags = Diags.takeDeferred();
+    return R;
+}
+
+// A program of Count blocks in the shapes the scan has to get right, with
+// a wrapping literal in each so every chunk has diagnostics.
+std::string makeProgram(unsigned Count)
+{
+    std::string Src;
+    for (unsigned I = 0; I < Count; ++I)
+    {
+        std::string N = std::to_string(I);
+        Src += "int a" + N + " = 3000000000;\n";
+        Src += "string s" + N + " = \"};{" + N + "\";\n";
+        Src += "if (a" + N + " < 3) { a" + N + " = 1; } else { a" + N +
+               " = 2; }\n";
+        Src += "do { a" + N + " = a" + N + " + 1; } while (a" + N +
+               " < 10);\n";
+        Src += "for (int k = 0; k < 4; (++k, ++a" + N + ")) { float f = " +
+               N + ".5 * k; }\n";
+        Src += "{ color c = color(" + N + ", 1, 2); matrix m = matrix(1); }\n";
+    }
+    return Src;
+}
+
+void expectSameDiagnostics(const std::vector<StoredDiagnostic> &Serial,
+                           const std::vector<StoredDiagnostic> &Parallel)
+{
+    ASSERT_EQ(Serial.size(), Parallel.size());
+    for (size_t I = 0; I < Serial.size(); ++I)
+    {
+        EXPECT_EQ(Serial[I].Loc.getPointer(), Parallel[I].Loc.getPointer());
+        EXPECT_EQ(Serial[I].Kind, Parallel[I].Kind);
+        EXPECT_EQ(Serial[I].Msg, Parallel[I].Msg);
+    }
+}
+
+TEST(ParallelParserTest, ParallelParseMatchesSerial)
+{
+    std::string Src = makeProgram(1000);
+    ASSERT_GE(Src.size(), 4 * ParallelParser::MinChunkBytes);
+    ParseResult Serial = parse(Src, 0);
+    ASSERT_FALSE(Serial.Dump.empty());
+    EXPECT_EQ(Serial.Diags.size(), 1000u);
+    for (unsigned Threads : {2, 4, 8})
+    {
+        ParseResult Parallel = parse(Src, Threads);
+        EXPECT_EQ(Parallel.Dump, Serial.Dump) << Threads << " threads";
+        expectSameDiagnostics(Serial.Diags, Parallel.Diags);
+    }
+}
+
+TEST(ParallelParserTest, SyntaxErrorMatchesSerial)
+{
+    std::string Src = makeProgram(1000);
+    Src.insert(Src.find('\n', Src.size() / 2) + 1, "int = ;\n");
+    ParseResult Serial = parse(Src, 0);
+    EXPECT_TRUE(Serial.Dump.empty());
+    ParseResult Parallel = parse(Src, 4);
+    EXPECT_TRUE(Parallel.Dump.empty());
+    expectSameDiagnostics(Serial.Diags, Parallel.Diags);
+}
+} // namespace
@@ -0,0 +1,74 @@
+#include "llshader/Basic/Diagnostic.h"
+#include "llshader/Lexer/Lexer.h"
+#include "llshader/Parser/Parser.h"
+#include <gtest/gtest.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+#include <memory>
+
+namespace
+{
+struct ParseResult
+{
+    std::unique_ptr<AST> Tree;
+    unsigned NumErrors;
+};
+
+ParseResult parse(llvm::StringRef Src)
+{
+    llvm::SourceMgr SrcMgr;
+    SrcMgr.AddNewSourceBuffer(
+        llvm::MemoryBuffer::getMemBufferCopy(Src, "t.osl"), llvm::SMLoc());
+    DiagnosticsEngine Diags(SrcMgr);
+    Lexer Lex(SrcMgr, Diags);
+    Parser P(Lex, Diags);
+    std::unique_ptr<AST> Tree(P.parse());
+    return {std::move(Tree), Diags.numErrors()};
+}
+
+// Malformed loop headers and ++/-- operands used to reach dyn_cast with the
+// null result of the failed sub-parse and abort.
+
+TEST(ParserTest, ForUpdateWithoutParenthesesIsAnError)
+{
+    ParseResult R = parse("for (int k = 0; k < 3; k = k + 1) { }");
+    EXPECT_FALSE(R.Tree);
+    EXPECT_GT(R.NumErrors, 0u);
+}
+
+TEST(ParserTest, ForUpdateWithParenthesizedAssignmentIsAnError)
+{
+    ParseResult R = parse("for (int k = 0; k < 3; (k = k + 1)) { }");
+    EXPECT_FALSE(R.Tree);
+    EXPECT_GT(R.NumErrors, 0u);
+}
+
+TEST(ParserTest, ForInitThatFailsToParseIsAnError)
+{
+    ParseResult R = parse("for (int k = ; k < 3; ) { }");
+    EXPECT_FALSE(R.Tree);
+    EXPECT_GT(R.NumErrors, 0u);
+}
+
+TEST(ParserTest, IncDecWithoutOperandIsAnError)
+{
+    EXPECT_GT(parse("++;").NumErrors, 0u);
+    EXPECT_GT(parse("int a = 1 + --;").NumErrors, 0u);
+}
+
+TEST(ParserTest, ForUpdateIsParsed)
+{
+    ParseResult R = parse("int n = 0;\n"
+                          "for (int k = 0; k < 3; (++k, ++n)) { }\n");
+    ASSERT_TRUE(R.Tree);
+    EXPECT_EQ(R.NumErrors, 0u);
+    auto *P = llvm::cast<Program>(R.Tree.get());
+    ASSERT_EQ(P->getSL()->size(), 2u);
+    auto *F = llvm::dyn_cast<For>((*P->getSL())[1]);
+    ASSERT_TRUE(F);
+    ASSERT_TRUE(F->getInit());
+    ASSERT_TRUE(F->getCondition());
+    ASSERT_TRUE(F->getUpdate());
+    EXPECT_EQ(F->getUpdate()->getEL()->size(), 2u);
+}
+} // namespace
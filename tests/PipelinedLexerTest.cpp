@@ -0,0 +1,202 @@
+#include "llshader/Basic/Diagnostic.h"
+#include "llshader/Lexer/Lexer.h"
+#include "llshader/Lexer/PipelinedLexer.h"
+#include <gtest/gtest.h>
+#include <llvm/Support/MathExtras.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __unix__
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+// Several times PipelinedLexer::Capacity tokens, with literals the Lexer
+// warns about or rejects spread through them.
+std::string makeSource()
+{
+    std::string Src;
+    for (unsigned I = 0; I < 2000; ++I)
+    {
+        std::string N = std::to_string(I);
+        Src += "int a" + N + " = " + N + " + 0x" + N + ";\n";
+        Src += "float f" + N + " = " + N + ".25e-3 * a" + N + ";\n";
+        if (I % 7 == 0)
+            Src += "int w" + N + " = 300000000" + N + ";\n";
+        if (I % 11 == 0)
+            Src += "float d" + N + " = 1e-4" + N + ";\n";
+        if (I % 13 == 0)
+            Src += "int e" + N + " = 99999999999999999999;\n";
+        Src += "string s" + N + " = \"{" + N + "}\"; if (a" + N +
+               " >= 2) { a" + N + " += 1; }\n";
+    }
+    return Src;
+}
+
+void expectSameToken(const Token &Serial, const Token &Piped)
+{
+    ASSERT_EQ(Serial.getKind(), Piped.getKind());
+    EXPECT_EQ(Serial.getText().data(), Piped.getText().data());
+    EXPECT_EQ(Serial.getText().size(), Piped.getText().size());
+    EXPECT_EQ(Serial.getLocation(), Piped.getLocation());
+    if (Serial.is(TokenKind::integer))
+    {
+        EXPECT_EQ(Serial.getIntValue(), Piped.getIntValue());
+    }
+    else if (Serial.is(TokenKind::floating_point))
+    {
+        EXPECT_EQ(llvm::FloatToBits(Serial.getFloatValue()),
+                  llvm::FloatToBits(Piped.getFloatValue()));
+    }
+}
+
+void expectSameDiagnostics(const std::vector<StoredDiagnostic> &Serial,
+                           const std::vector<StoredDiagnostic> &Piped)
+{
+    ASSERT_EQ(Serial.size(), Piped.size());
+    for (size_t I = 0; I < Serial.size(); ++I)
+    {
+        EXPECT_EQ(Serial[I].Loc, Piped[I].Loc);
+        EXPECT_EQ(Serial[I].Kind, Piped[I].Kind);
+        EXPECT_EQ(Serial[I].Msg, Piped[I].Msg);
+    }
+}
+
+// Reads Src with the serial and the pipelined Lexer side by side and
+// checks that each token, and the diagnostics replayed by the time it is
+// read, match. With Delay the Lexer thread gets a head start and fills
+// the ring before the first token is read.
+void expectSameAsSerial(const std::string &Src,
+                        std::chrono::milliseconds Delay)
+{
+    llvm::SourceMgr SrcMgr;
+    SrcMgr.AddNewSourceBuffer(
+        llvm::MemoryBuffer::getMemBuffer(Src, "t.osl"), llvm::SMLoc());
+    DiagnosticsEngine SerialDiags(SrcMgr);
+    SerialDiags.setDeferring(true);
+    DiagnosticsEngine PipedDiags(SrcMgr);
+    PipedDiags.setDeferring(true);
+    Lexer Lex(SrcMgr, SerialDiags);
+    PipelinedLexer Pipe(SrcMgr, PipedDiags);
+    std::this_thread::sleep_for(Delay);
+
+    size_t Tokens = 0;
+    size_t Diagnosed = 0;
+    Token Serial, Piped;
+    do
+    {
+        Lex.next(Serial);
+        Pipe.next(Piped);
+        ++Tokens;
+        expectSameToken(Serial, Piped);
+        std::vector<StoredDiagnostic> D = SerialDiags.takeDeferred();
+        Diagnosed += D.size();
+        expectSameDiagnostics(D, PipedDiags.takeDeferred());
+        if (testing::Test::HasFatalFailure())
+            return;
+    } while (!Serial.is(TokenKind::eof));
+    EXPECT_GT(Tokens, 4 * PipelinedLexer::Capacity);
+    EXPECT_GT(Diagnosed, 0u);
+    EXPECT_EQ(SerialDiags.numErrors(), PipedDiags.numErrors());
+
+    // eof repeats.
+    Pipe.next(Piped);
+    EXPECT_TRUE(Piped.is(TokenKind::eof));
+    EXPECT_EQ(Piped.getLocation(), Serial.getLocation());
+}
+
+TEST(PipelinedLexerTest, TokensAndDiagnosticsMatchSerial)
+{
+    expectSameAsSerial(makeSource(), std::chrono::milliseconds(0));
+}
+
+TEST(PipelinedLexerTest, FullRingMatchesSerial)
+{
+    expectSameAsSerial(makeSource(), std::chrono::milliseconds(100));
+}
+
+TEST(PipelinedLexerTest, ShortInputs)
+{
+    for (const char *Src : {"", "   \n", "a", "int a = 1;"})
+    {
+        llvm::SourceMgr SrcMgr;
+        SrcMgr.AddNewSourceBuffer(
+            llvm::MemoryBuffer::getMemBuffer(Src, "t.osl"), llvm::SMLoc());
+        DiagnosticsEngine Diags(SrcMgr);
+        Lexer Lex(SrcMgr, Diags);
+        PipelinedLexer Pipe(SrcMgr, Diags);
+        Token Serial, Piped;
+        do
+        {
+            Lex.next(Serial);
+            Pipe.next(Piped);
+            expectSameToken(Serial, Piped);
+        } while (!Serial.is(TokenKind::eof));
+    }
+}
+
+// A Parser that gives up early leaves the Lexer blocked on a full ring;
+// destroying the PipelinedLexer has to stop it.
+TEST(PipelinedLexerTest, StopsWhenReadingStopsEarly)
+{
+    std::string Src = makeSource();
+    llvm::SourceMgr SrcMgr;
+    SrcMgr.AddNewSourceBuffer(
+        llvm::MemoryBuffer::getMemBuffer(Src, "t.osl"), llvm::SMLoc());
+    DiagnosticsEngine Diags(SrcMgr);
+    Diags.setDeferring(true);
+    {
+        PipelinedLexer Pipe(SrcMgr, Diags);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        Token Tok;
+        for (unsigned I = 0; I < 9; ++I)
+            Pipe.next(Tok);
+        EXPECT_EQ(Tok.getText(), "f0");
+    }
+    {
+        PipelinedLexer Pipe(SrcMgr, Diags);
+    }
+}
+
+// Buffers of 4 GiB or more do not fit the packed 32-bit offsets; the driver
+// lexes them serially instead. Only the size is looked at, so the buffer
+// is address space that is never touched.
+TEST(PipelinedLexerTest, CanLexOnlyBuffersBelow4GiB)
+{
+    llvm::SourceMgr Small;
+    Small.AddNewSourceBuffer(
+        llvm::MemoryBuffer::getMemBuffer("int a = 1;", "t.osl"),
+        llvm::SMLoc());
+    EXPECT_TRUE(PipelinedLexer::canLex(Small));
+
+#ifdef __unix__
+    size_t Size = size_t(UINT32_MAX) + 1;
+    void *Mem = mmap(nullptr, Size, PROT_NONE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (Mem == MAP_FAILED)
+        GTEST_SKIP() << "cannot reserve 4 GiB of address space";
+    const char *Base = static_cast<const char *>(Mem);
+    for (size_t BufferSize : {size_t(UINT32_MAX) - 1, size_t(UINT32_MAX),
+                              size_t(UINT32_MAX) + 1})
+    {
+        llvm::SourceMgr Large;
+        Large.AddNewSourceBuffer(
+            llvm::MemoryBuffer::getMemBuffer(StringRef(Base, BufferSize),
+                                             "large.osl",
+                                             /*RequiresNullTerminator=*/false),
+            llvm::SMLoc());
+        EXPECT_EQ(PipelinedLexer::canLex(Large), BufferSize < UINT32_MAX)
+            << BufferSize;
+    }
+    munmap(Mem, Size);
+#else
+    GTEST_SKIP() << "needs mmap to reserve 4 GiB of address space";
+#endif
+}
+} // namespace
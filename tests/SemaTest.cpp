@@ -0,0 +1,202 @@
+#include "llshader/AST/FlatAST.h"
+#include "llshader/AST/RecursiveASTVisitor.h"
+#include "llshader/Basic/Diagnostic.h"
+#include "llshader/Lexer/Lexer.h"
+#include "llshader/Parser/Parser.h"
+#include "llshader/Sema/Sema.h"
+#include <gtest/gtest.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+std::unique_ptr<AST> parse(llvm::SourceMgr &SrcMgr, llvm::StringRef Src)
+{
+    SrcMgr.AddNewSourceBuffer(
+        llvm::MemoryBuffer::getMemBufferCopy(Src, "t.osl"), llvm::SMLoc());
+    DiagnosticsEngine Diags(SrcMgr);
+    Lexer Lex(SrcMgr, Diags);
+    Parser P(Lex, Diags);
+    return std::unique_ptr<AST>(P.parse());
+}
+
+// The verdicts of tree and flat Sema on Src. The flat tree is built before
+// tree Sema runs, as the driver's -flat-ast does.
+struct Verdicts
+{
+    bool Tree;
+    bool Flat;
+};
+
+Verdicts check(llvm::StringRef Src)
+{
+    llvm::SourceMgr SrcMgr;
+    std::unique_ptr<AST> Tree = parse(SrcMgr, Src);
+    EXPECT_TRUE(Tree) << Src.str();
+    if (!Tree)
+        return {false, false};
+    FlatAST Flat = FlatAST::build(Tree.get());
+    Sema S;
+    bool FlatOk = S.semantic(Flat);
+    return {S.semantic(Tree.get()), FlatOk};
+}
+
+TEST(SemaTest, FlatSemaTypesVariables)
+{
+    const char *Valid[] = {
+        "int b = 2; int c = 7 / b; int d = b / 7; int e = b * b;",
+        "float f = 1.0; float g = f * 2; float h = f;",
+        "int b = 2; float f = b + 0.5;",
+        "color c = color(1, 2, 3); color d = c * 2; float x = c[0];",
+        "matrix m = matrix(1); matrix n = m * m; float y = m[5];",
+        "string s = \"a\"; int eq = s == \"b\"; string t = s;",
+        "int b = 1; if (b) { int c = b; } else { int c = 0 - b; }",
+        "int n = 3; for (int k = 0; k < n; ) { int j = k + n; }",
+        "int b = 1; int c = ++b; int d = (b); int e = !b;",
+        "float f = 1; float g = Dx(f); float h = Dx(2);",
+        "vector v = vector(1); vector w = Dy(v);",
+        "int b = 1; { float b = 2.5; float c = b; } int d = b;",
+        "int b = 1; { float b = b; }",
+        "float f = 2; while (f) { f = f - 1; }",
+    };
+    for (const char *Src : Valid)
+    {
+        Verdicts V = check(Src);
+        EXPECT_TRUE(V.Tree) << Src;
+        EXPECT_TRUE(V.Flat) << Src;
+    }
+
+    const char *Invalid[] = {
+        "float f = 1.5; int b = f;",
+        "int b = 1; string s = b;",
+        "float f = 1.5; if (f) { }",
+        "float f = 1.5; for (; f; ) { }",
+        "string s = \"a\"; int b = s + 1;",
+        "color c = color(1); int x = c[0];",
+        "int b = 1; { float b = 2.5; int c = b; }",
+        "float f = 1; int d = ++f;",
+        "int b = 1; int b = 2;",
+        "float f = 1; int g = Dx(f);",
+        "int b = 1; for (int k = 0; k < b; ) { int x = 1.5 * k; }",
+        "int b = 2; while (b) { int c = 1.0 * b; }",
+    };
+    for (const char *Src : Invalid)
+    {
+        Verdicts V = check(Src);
+        EXPECT_FALSE(V.Tree) << Src;
+        EXPECT_FALSE(V.Flat) << Src;
+    }
+}
+
+// The slot and type of every variable declaration, reference and
+// assignment target, in source order.
+class SlotCollector : public RecursiveASTVisitor<SlotCollector>
+{
+  public:
+    std::vector<std::pair<unsigned, TokenKind>> Slots;
+
+    bool visitDefExpr(DefExpr &Node)
+    {
+        Slots.push_back({Node.getSlot(), TokenKind::kw_void});
+        return true;
+    }
+    bool visitVariableRef(VariableRef &Node)
+    {
+        Slots.push_back({Node.getSlot(), Node.getType()});
+        return true;
+    }
+    bool visitLValue(LValue &Node)
+    {
+        Slots.push_back({Node.getSlot(), Node.getType()});
+        return true;
+    }
+};
+
+struct CheckResult
+{
+    bool Ok;
+    std::vector<StoredDiagnostic> Diags;
+    std::vector<TokenKind> SlotTypes;
+    std::vector<std::pair<unsigned, TokenKind>> Slots;
+};
+
+CheckResult checkWithThreads(llvm::SourceMgr &SrcMgr, unsigned Threads)
+{
+    DiagnosticsEngine Diags(SrcMgr);
+    Diags.setDeferring(true);
+    Lexer Lex(SrcMgr, Diags);
+    Parser P(Lex, Diags);
+    std::unique_ptr<AST> Tree(P.parse());
+    EXPECT_TRUE(Tree);
+    EXPECT_EQ(Diags.numErrors(), 0u);
+    if (!Tree)
+        return {};
+    Sema S;
+    S.setDiagnostics(Diags);
+    S.setNumThreads(Threads);
+    CheckResult R;
+    R.Ok = S.semantic(Tree.get());
+    R.Diags = Diags.takeDeferred();
+    R.SlotTypes.assign(S.getSlotTypes().begin(), S.getSlotTypes().end());
+    SlotCollector Collector;
+    Collector.traverse(Tree.get());
+    R.Slots = std::move(Collector.Slots);
+    return R;
+}
+
+// Top-level statements that declare globals, checked in order, between
+// scopes that are checked as tasks; most of them have errors.
+std::string makeScopes(unsigned Count)
+{
+    std::string Src;
+    for (unsigned I = 0; I < Count; ++I)
+    {
+        std::string N = std::to_string(I);
+        Src += "int g" + N + " = " + N + ";\n";
+        Src += "{ int a = g" + N + "; float a = 2.0; }\n";
+        Src += "float h" + N + " = g" + N + ";\n";
+        Src += "{ string s = g" + N + "; int t = 1; }\n";
+        Src += "if (g" + N + ") { int u = 1; int u = 2; } else { int u; }\n";
+        Src += "for (int k = 0; h" + N + "; ) { int k2 = k; }\n";
+        Src += "{ float f = h" + N + "; { int i = f; } int j = g" + N +
+               "; }\n";
+        Src += "while (g" + N + ") { int w = h" + N + "; }\n";
+        Src += "{ color c = color(h" + N + "); float x = c[1]; }\n";
+        if (I % 3 == 0)
+            Src += "int g" + N + " = 1;\n";
+    }
+    return Src;
+}
+
+TEST(SemaTest, ParallelCheckMatchesSerial)
+{
+    std::string Src = makeScopes(40);
+    llvm::SourceMgr SrcMgr;
+    SrcMgr.AddNewSourceBuffer(
+        llvm::MemoryBuffer::getMemBuffer(Src, "t.osl"), llvm::SMLoc());
+    CheckResult Serial = checkWithThreads(SrcMgr, 1);
+    EXPECT_FALSE(Serial.Ok);
+    // Six errors per group, and a redeclared global in every third.
+    ASSERT_EQ(Serial.Diags.size(), 40u * 6 + 14);
+    for (size_t I = 1; I < Serial.Diags.size(); ++I)
+        EXPECT_LT(Serial.Diags[I - 1].Loc.getPointer(),
+                  Serial.Diags[I].Loc.getPointer());
+
+    for (unsigned Threads : {2, 4, 8})
+    {
+        CheckResult Parallel = checkWithThreads(SrcMgr, Threads);
+        EXPECT_EQ(Parallel.Ok, Serial.Ok);
+        ASSERT_EQ(Parallel.Diags.size(), Serial.Diags.size());
+        for (size_t I = 0; I < Serial.Diags.size(); ++I)
+        {
+            EXPECT_EQ(Parallel.Diags[I].Loc, Serial.Diags[I].Loc);
+            EXPECT_EQ(Parallel.Diags[I].Msg, Serial.Diags[I].Msg);
+        }
+        EXPECT_EQ(Parallel.SlotTypes, Serial.SlotTypes);
+        EXPECT_EQ(Parallel.Slots, Serial.Slots);
+    }
+}
+} // namespace
@@ -0,0 +1,175 @@
+#include "llshader/Basic/Diagnostic.h"
+#include "llshader/Lexer/Lexer.h"
+#include "llshader/Lexer/SourceWindow.h"
+#include <gtest/gtest.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MathExtras.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+// A token, or a diagnostic, with its location as an offset into the file:
+// streamed locations point into a window that slides on.
+struct LexedToken
+{
+    TokenKind Kind;
+    std::string Text;
+    uint64_t Offset;
+    int64_t IntValue = 0;
+    uint32_t FloatBits = 0;
+};
+
+struct LexedDiagnostic
+{
+    uint64_t Offset;
+    SourceMgr::DiagKind Kind;
+    std::string Msg;
+};
+
+struct LexResult
+{
+    std::vector<LexedToken> Tokens;
+    std::vector<LexedDiagnostic> Diags;
+};
+
+LexedToken record(const Token &Tok, uint64_t Offset)
+{
+    LexedToken T{Tok.getKind(), Tok.getText().str(), Offset};
+    if (Tok.is(TokenKind::integer))
+        T.IntValue = Tok.getIntValue();
+    else if (Tok.is(TokenKind::floating_point))
+        T.FloatBits = llvm::FloatToBits(Tok.getFloatValue());
+    return T;
+}
+
+LexResult lexWhole(const std::string &Src)
+{
+    llvm::SourceMgr SrcMgr;
+    SrcMgr.AddNewSourceBuffer(
+        llvm::MemoryBuffer::getMemBuffer(Src, "t.osl"), llvm::SMLoc());
+    const char *Base =
+        SrcMgr.getMemoryBuffer(SrcMgr.getMainFileID())->getBufferStart();
+    DiagnosticsEngine Diags(SrcMgr);
+    Diags.setDeferring(true);
+    Lexer Lex(SrcMgr, Diags);
+    LexResult R;
+    Token Tok;
+    do
+    {
+        Lex.next(Tok);
+        R.Tokens.push_back(record(Tok, Tok.getLocation().getPointer() - Base));
+    } while (!Tok.is(TokenKind::eof));
+    for (const StoredDiagnostic &D : Diags.takeDeferred())
+        R.Diags.push_back({uint64_t(D.Loc.getPointer() - Base), D.Kind, D.Msg});
+    return R;
+}
+
+// Lexes the file at Path through a window of ChunkSize bytes. Locations
+// are turned into offsets right after each token, before the window can
+// slide past them.
+LexResult lexStreamed(llvm::StringRef Path, size_t ChunkSize)
+{
+    std::error_code EC;
+    std::unique_ptr<SourceWindow> Window =
+        SourceWindow::open(Path, EC, ChunkSize);
+    EXPECT_TRUE(Window) << EC.message();
+    if (!Window)
+        return {};
+    llvm::SourceMgr SrcMgr;
+    DiagnosticsEngine Diags(SrcMgr);
+    Diags.setDeferring(true);
+    Lexer Lex(*Window, SrcMgr, Diags);
+    auto offsetOf = [&](SMLoc Loc) {
+        return Window->getBaseOffset() + (Loc.getPointer() - Window->begin());
+    };
+    LexResult R;
+    Token Tok;
+    do
+    {
+        Lex.next(Tok);
+        R.Tokens.push_back(record(Tok, offsetOf(Tok.getLocation())));
+        for (const StoredDiagnostic &D : Diags.takeDeferred())
+            R.Diags.push_back({offsetOf(D.Loc), D.Kind, D.Msg});
+    } while (!Tok.is(TokenKind::eof));
+    return R;
+}
+
+// Streams Src with windows of several tiny chunk sizes and checks that the
+// tokens and diagnostics are those of the whole-buffer Lexer.
+void expectSameAsWhole(const std::string &Src)
+{
+    llvm::SmallString<128> Path;
+    int FD;
+    ASSERT_FALSE(
+        llvm::sys::fs::createTemporaryFile("llshader-test", "osl", FD, Path));
+    {
+        llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+        OS << Src;
+    }
+    LexResult Whole = lexWhole(Src);
+    for (size_t ChunkSize : {1, 2, 3, 5, 7, 16})
+    {
+        SCOPED_TRACE("chunk size " + std::to_string(ChunkSize));
+        LexResult Streamed = lexStreamed(Path, ChunkSize);
+        EXPECT_EQ(Streamed.Tokens.size(), Whole.Tokens.size());
+        for (size_t I = 0;
+             I < std::min(Whole.Tokens.size(), Streamed.Tokens.size()); ++I)
+        {
+            const LexedToken &W = Whole.Tokens[I];
+            const LexedToken &S = Streamed.Tokens[I];
+            EXPECT_EQ(S.Kind, W.Kind) << "token " << I;
+            EXPECT_EQ(S.Text, W.Text) << "token " << I;
+            EXPECT_EQ(S.Offset, W.Offset) << "token " << I;
+            EXPECT_EQ(S.IntValue, W.IntValue) << "token " << I;
+            EXPECT_EQ(S.FloatBits, W.FloatBits) << "token " << I;
+        }
+        EXPECT_EQ(Streamed.Diags.size(), Whole.Diags.size());
+        for (size_t I = 0;
+             I < std::min(Whole.Diags.size(), Streamed.Diags.size()); ++I)
+        {
+            EXPECT_EQ(Streamed.Diags[I].Offset, Whole.Diags[I].Offset);
+            EXPECT_EQ(Streamed.Diags[I].Kind, Whole.Diags[I].Kind);
+            EXPECT_EQ(Streamed.Diags[I].Msg, Whole.Diags[I].Msg);
+        }
+    }
+    llvm::sys::fs::remove(Path);
+}
+
+// Identifiers, keywords, operators and strings longer than a chunk.
+TEST(SourceWindowTest, TokensAcrossChunkBoundaries)
+{
+    expectSameAsWhole("float longer_than_any_chunk = 12.5e-1 * 0x1f;\n"
+                      "string s = \"a string that spans chunks\";\n"
+                      "if (longer_than_any_chunk >= 2) { a += 1; }\n"
+                      "int b = 1234567;");
+}
+
+// The whitespace at the end of the file may itself end a chunk; the eof
+// token comes after all of it.
+TEST(SourceWindowTest, TrailingWhitespaceBeforeEOF)
+{
+    expectSameAsWhole("int a = 1;      \n\n\t  \n        ");
+    expectSameAsWhole("a");
+    expectSameAsWhole("   ");
+    expectSameAsWhole("");
+}
+
+// A literal cut by the end of the window is lexed again after the slide;
+// its diagnostic must still be reported once.
+TEST(SourceWindowTest, LiteralsAreDiagnosedOnce)
+{
+    std::string Src = "int w = 3000000000; int e = 99999999999999999999;\n"
+                      "float d = 1e-40; float o = 1e39; int h = 0x1ffffffff;"
+                      "\nint end = 4294967297";
+    EXPECT_EQ(lexWhole(Src).Diags.size(), 6u);
+    expectSameAsWhole(Src);
+}
+} // namespace
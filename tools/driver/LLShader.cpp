@@ -1,24 +1,236 @@
 #include "LLShader.h"
 #include "llshader/Basic/Diagnostic.h"
+#include "llshader/CodeGen/Multiversion.h"
+#include "llshader/CodeGen/ObjectEmitter.h"
+#include "llshader/CodeGen/Profile.h"
+#include "llshader/CodeGen/ShaderRegistry.h"
+#include "llshader/Interp/Interpreter.h"
+#include "llshader/OSO/OSOShader.h"
+#include "runtime.h"
+#include <llvm/ADT/STLExtras.h>
 #include <llvm/ADT/StringRef.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/ErrorOr.h>
+#include <llvm/Support/FileSystem.h>
 #include <llvm/Support/InitLLVM.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/Path.h>
 #include <llvm/Support/SourceMgr.h>
 
-static llvm::cl::opt<std::string> Input(llvm::cl::Positional,
-                                        llvm::cl::desc("<input file>"),
-                                        llvm::cl::Required);
-static llvm::cl::opt<std::string> Output("o", llvm::cl::desc("Output file"),
-                                         llvm::cl::value_desc("filename"),
-                                         llvm::cl::init("a.ll"));
+static llvm::cl::list<std::string> Inputs(llvm::cl::Positional,
+                                          llvm::cl::desc("<input files>"));
+static llvm::cl::opt<std::string>
+    Output("o",
+           llvm::cl::desc("Output file (default a.ll, a.o, a.so or a.oso by "
+                          "-filetype)"),
+           llvm::cl::value_desc("filename"));
+enum class OutputKind
+{
+    IR,
+    Object,
+    SharedLibrary,
+    OSO
+};
+static llvm::cl::opt<OutputKind> FileType(
+    "filetype", llvm::cl::desc("Output file type"),
+    llvm::cl::init(OutputKind::IR),
+    llvm::cl::values(
+        clEnumValN(OutputKind::IR, "ll", "Textual LLVM IR (default)"),
+        clEnumValN(OutputKind::Object, "obj", "Native object file"),
+        clEnumValN(OutputKind::SharedLibrary, "shared",
+                   "Shared library of all the inputs with a shader registry "
+                   "(tools/runtime/registry.h)"),
+        clEnumValN(OutputKind::OSO, "oso",
+                   "OSL object code for OSL runtimes")));
+static llvm::cl::opt<std::string>
+    MCPU("mcpu",
+         llvm::cl::desc("CPU to generate native code for (default: the "
+                        "host's, with all of its features)"),
+         llvm::cl::value_desc("cpu-name"), llvm::cl::init("native"));
+static llvm::cl::opt<bool> MultiversionOpt(
+    "multiversion",
+    llvm::cl::desc("Also emit AVX2 and AVX-512 versions of each entry point "
+                   "and pick one with cpuid at load time; the baseline is "
+                   "-mcpu, by default x86-64"));
+static llvm::cl::opt<bool>
+    Stream("stream",
+           llvm::cl::desc("Lex the input through a sliding window of chunks "
+                          "instead of loading the whole file"));
+static llvm::cl::opt<unsigned> StreamChunkSize(
+    "stream-chunk-size", llvm::cl::desc("Chunk size in bytes for -stream"),
+    llvm::cl::value_desc("bytes"),
+    llvm::cl::init(SourceWindow::DefaultChunkSize));
+static llvm::cl::opt<unsigned> ParseThreads(
+    "parse-threads",
+    llvm::cl::desc("Parse top-level statements on N threads (ignored with "
+                   "-stream)"),
+    llvm::cl::value_desc("N"), llvm::cl::init(1));
+static llvm::cl::opt<bool> PipelineLexerOpt(
+    "pipeline-lexer",
+    llvm::cl::desc("Lex on a thread of its own while parsing (ignored with "
+                   "-stream and -parse-threads, and for inputs of 4 GiB or "
+                   "more)"));
+static llvm::cl::opt<unsigned> SemaThreads(
+    "sema-threads",
+    llvm::cl::desc("Check independent top-level scopes on N threads"),
+    llvm::cl::value_desc("N"), llvm::cl::init(1));
+static llvm::cl::opt<unsigned> CodegenThreads(
+    "codegen-threads",
+    llvm::cl::desc("Compile each top-level block to a function of its own "
+                   "and generate and optimize them on N threads; the output "
+                   "is the same for every N (ignored with -profile-generate, "
+                   "-profile-use and -multiversion)"),
+    llvm::cl::value_desc("N"), llvm::cl::init(0));
+static llvm::cl::opt<bool>
+    FlatASTOpt("flat-ast",
+               llvm::cl::desc("Run semantic analysis on the flattened AST"));
+static llvm::cl::opt<bool> ProfileGenerate(
+    "profile-generate",
+    llvm::cl::desc("Instrument the shader to count statement executions; "
+                   "running it writes $LLSHADER_PROFILE or llshader.prof"));
+static llvm::cl::opt<std::string> ProfileUse(
+    "profile-use",
+    llvm::cl::desc("Weight branches with the counts in a profile written by "
+                   "a -profile-generate build"),
+    llvm::cl::value_desc("profile"));
+static llvm::cl::opt<bool> HoistInvariants(
+    "hoist-invariants",
+    llvm::cl::desc("Evaluate loop-invariant expressions once before the "
+                   "loop (default on)"),
+    llvm::cl::init(true));
+static llvm::cl::opt<bool> ReportHoisting(
+    "report-hoisting",
+    llvm::cl::desc("Print how many expressions are uniform and how much "
+                   "work is hoisted out of loops"));
+static llvm::cl::opt<unsigned>
+    OptLevel("O", llvm::cl::desc("Optimization level (0-3)"),
+             llvm::cl::Prefix, llvm::cl::init(0));
+static llvm::cl::list<std::string> Specialize(
+    "specialize",
+    llvm::cl::desc("Compile the variant of the shader with parameter <name> "
+                   "fixed to <value>, folding what depends on it; may be "
+                   "repeated"),
+    llvm::cl::value_desc("name=value"));
+static llvm::cl::opt<std::string> VariantCache(
+    "variant-cache",
+    llvm::cl::desc("Keep compiled variants in <dir>, keyed by a hash of the "
+                   "source, the -specialize values and the code generation "
+                   "options, and reuse them instead of compiling again"),
+    llvm::cl::value_desc("dir"));
+static llvm::cl::opt<bool>
+    Interp("interp",
+           llvm::cl::desc("Run the shader with the bytecode interpreter "
+                          "instead of compiling it, for a quick preview"));
+static llvm::cl::opt<bool> DumpBytecode(
+    "dump-bytecode",
+    llvm::cl::desc("Print the bytecode -interp runs"));
+// The -specialize values by parameter name.
+static llvm::StringMap<std::string> Bindings;
+static llvm::cl::opt<std::string> ReportProfile(
+    "report-profile",
+    llvm::cl::desc("Print the sources in a profile annotated with hit counts "
+                   "and time, or only the inputs' if any are given"),
+    llvm::cl::value_desc("profile"));
 
-int main(int argc_, const char **argv_)
+// Absolute path of Input, which names the shader in profiles.
+static std::string getSourceName(llvm::StringRef Input)
 {
-    llvm::InitLLVM X(argc_, argv_);
-    llvm::cl::ParseCommandLineOptions(argc_, argv_, "LLShader compiler\n");
+    llvm::SmallString<256> Path(Input);
+    llvm::sys::fs::make_absolute(Path);
+    return std::string(Path);
+}
+
+static int reportProfile()
+{
+    std::string Error;
+    std::unique_ptr<ProfileData> Profile =
+        ProfileData::read(ReportProfile, Error);
+    if (!Profile)
+    {
+        llvm::errs() << "Error reading " << ReportProfile << ": " << Error
+                     << "\n";
+        return 1;
+    }
+
+    std::vector<const ShaderProfile *> Shaders;
+    for (const std::string &Input : Inputs)
+    {
+        const ShaderProfile *Shader = Profile->lookup(getSourceName(Input));
+        if (!Shader)
+        {
+            llvm::errs() << "Error: " << ReportProfile << " has no profile for "
+                         << Input << "\n";
+            return 1;
+        }
+        Shaders.push_back(Shader);
+    }
+    if (Inputs.empty())
+        for (const ShaderProfile &Shader : Profile->getShaders())
+            Shaders.push_back(&Shader);
+
+    for (const ShaderProfile *Shader : Shaders)
+    {
+        llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> FileOrErr =
+            llvm::MemoryBuffer::getFile(Shader->Source);
+        if (std::error_code EC = FileOrErr.getError())
+        {
+            llvm::errs() << "Error reading " << Shader->Source << ": "
+                         << EC.message() << "\n";
+            return 1;
+        }
+        ProfileData::annotate(llvm::outs(), *Shader, (*FileOrErr)->getBuffer());
+    }
+    return 0;
+}
+
+// Applies the options that streamed and buffered compiles share: Sema,
+// code generation and output.
+static void configureCompiler(LLShader &Compiler, llvm::StringRef OutputFile,
+                              const ObjectEmitter *Emitter,
+                              llvm::StringRef ShaderName)
+{
+    Compiler.setSemaThreads(SemaThreads);
+    Compiler.setUseFlatAST(FlatASTOpt);
+    Compiler.setOutputFile(OutputFile);
+    Compiler.setObjectEmitter(Emitter);
+    Compiler.setShaderName(ShaderName);
+    Compiler.setMultiversion(MultiversionOpt);
+    Compiler.setHoistInvariants(HoistInvariants);
+    Compiler.setReportHoisting(ReportHoisting);
+    Compiler.setOptLevel(OptLevel);
+    Compiler.setCodegenThreads(CodegenThreads);
+    Compiler.setSpecialization(Bindings);
+    Compiler.setEmitOSO(FileType == OutputKind::OSO);
+    Compiler.setInterpret(Interp);
+    Compiler.setDumpBytecode(DumpBytecode);
+}
+
+// Compiles Input to OutputFile as IR, or with Emitter, if set, as an
+// object file. ShaderName, if set, names the shader for a shader library.
+static int compileShader(const std::string &Input, llvm::StringRef OutputFile,
+                         const ObjectEmitter *Emitter,
+                         llvm::StringRef ShaderName)
+{
+    if (Stream)
+    {
+        std::error_code EC;
+        std::unique_ptr<SourceWindow> Window =
+            SourceWindow::open(Input, EC, StreamChunkSize);
+        if (!Window)
+        {
+            llvm::errs() << "Error reading " << Input << ": " << EC.message()
+                         << "\n";
+            return 1;
+        }
+        llvm::SourceMgr SrcMgr;
+        DiagnosticsEngine Diags(SrcMgr);
+        LLShader Compiler(SrcMgr, Diags);
+        Compiler.setSourceWindow(std::move(Window));
+        configureCompiler(Compiler, OutputFile, Emitter, ShaderName);
+        return Compiler.exec();
+    }
 
     llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> FileOrErr =
         llvm::MemoryBuffer::getFile(Input);
@@ -31,22 +243,291 @@ int main(int argc_, const char **argv_)
     }
 
     // Source manager class to manage source buffers
-    llvm::SourceMgr *SrcMgr = new llvm::SourceMgr();
-    DiagnosticsEngine Diags(*SrcMgr);
+    llvm::SourceMgr SrcMgr;
+    DiagnosticsEngine Diags(SrcMgr);
 
     LLShader Compiler(SrcMgr, Diags);
-    Compiler.getSourceMgr()->AddNewSourceBuffer(std::move(*FileOrErr),
+    Compiler.setParseThreads(ParseThreads);
+    Compiler.setPipelineLexer(PipelineLexerOpt);
+    configureCompiler(Compiler, OutputFile, Emitter, ShaderName);
+    Compiler.setVariantCache(VariantCache);
+    if (ProfileGenerate)
+        Compiler.setProfileGenerate(getSourceName(Input));
+    std::unique_ptr<ProfileData> Profile;
+    if (!ProfileUse.empty())
+    {
+        std::string Error;
+        Profile = ProfileData::read(ProfileUse, Error);
+        if (!Profile)
+        {
+            llvm::errs() << "Error reading " << ProfileUse << ": " << Error
+                         << "\n";
+            return 1;
+        }
+        if (const ShaderProfile *Shader = Profile->lookup(getSourceName(Input)))
+            Compiler.setProfileUse(*Shader);
+        else
+            llvm::errs() << "Warning: " << ProfileUse << " has no profile for "
+                         << Input << "\n";
+    }
+    Compiler.getSourceMgr().AddNewSourceBuffer(std::move(*FileOrErr),
                                                 llvm::SMLoc());
 
     return Compiler.exec();
 }
 
+// Compiles every input to an object file and links them, with a registry
+// listing them, into the shared library OutputFile.
+static int buildSharedLibrary(const ObjectEmitter &Emitter,
+                              llvm::StringRef OutputFile)
+{
+    std::vector<std::string> Names;
+    for (const std::string &Input : Inputs)
+    {
+        std::string Name = registry::getShaderName(Input);
+        if (llvm::is_contained(Names, Name))
+        {
+            llvm::errs() << "Error: more than one shader is named " << Name
+                         << "\n";
+            return 1;
+        }
+        Names.push_back(Name);
+    }
+
+    std::vector<std::string> Objects;
+    auto RemoveObjects = [&]()
+    {
+        for (const std::string &Object : Objects)
+            llvm::sys::fs::remove(Object);
+    };
+    auto CreateObject = [&]() -> bool
+    {
+        llvm::SmallString<128> Path;
+        if (std::error_code EC =
+                llvm::sys::fs::createTemporaryFile("llshader", "o", Path))
+        {
+            llvm::errs() << "Error creating a temporary file: "
+                         << EC.message() << "\n";
+            return false;
+        }
+        Objects.push_back(std::string(Path));
+        return true;
+    };
+
+    for (size_t I = 0; I < Inputs.size(); ++I)
+    {
+        if (!CreateObject())
+        {
+            RemoveObjects();
+            return 1;
+        }
+        if (int Result =
+                compileShader(Inputs[I], Objects.back(), &Emitter, Names[I]))
+        {
+            RemoveObjects();
+            return Result;
+        }
+    }
+
+    llvm::LLVMContext Ctx;
+    llvm::Module Registry("llsh_registry", Ctx);
+    Emitter.configure(Registry);
+    registry::emitRegistry(Registry, Names);
+    std::string Error;
+    if (!CreateObject() || !Emitter.emit(Registry, Objects.back(), Error) ||
+        !linkSharedLibrary(Objects, OutputFile, Error))
+    {
+        if (!Error.empty())
+            llvm::errs() << "Error: " << Error << "\n";
+        RemoveObjects();
+        return 1;
+    }
+    RemoveObjects();
+    return 0;
+}
+
+// Prints Code if Dump is set, then runs it and prints its outputs like the
+// compiled main.
+static int runBytecode(const Bytecode &Code, bool Dump)
+{
+    if (Dump)
+        Code.print(llvm::outs());
+    Interpreter VM(Code);
+    VM.run();
+    // The runtime writes to the file descriptor, past outs()' buffer.
+    llvm::outs().flush();
+    for (size_t I = 0, E = Code.getOutputs().size(); I != E; ++I)
+        write_int(VM.getOutput(I));
+    llsh_flush();
+    return 0;
+}
+
+// Runs compiled OSL object code with the interpreter, without its source.
+static int interpretOSO(const std::string &Input)
+{
+    std::unique_ptr<OSOShader> Shader = OSOShader::read(Input, llvm::errs());
+    if (!Shader)
+        return 1;
+    std::unique_ptr<Bytecode> Code = Bytecode::compile(*Shader, llvm::errs());
+    if (!Code)
+    {
+        llvm::errs() << "Code generation error\n";
+        return 3;
+    }
+    return runBytecode(*Code, DumpBytecode);
+}
+
+int main(int argc_, const char **argv_)
+{
+    llvm::InitLLVM X(argc_, argv_);
+    llvm::cl::ParseCommandLineOptions(argc_, argv_, "LLShader compiler\n");
+
+    if (!ReportProfile.empty())
+        return reportProfile();
+    if (Inputs.empty())
+    {
+        llvm::errs() << argv_[0] << ": no input file\n";
+        return 1;
+    }
+    if (Inputs.size() > 1 && FileType != OutputKind::SharedLibrary)
+    {
+        llvm::errs() << "Error: more than one input requires -filetype=shared\n";
+        return 1;
+    }
+    if (Stream && (ProfileGenerate || !ProfileUse.empty()))
+    {
+        // Statements are located through the SourceMgr's buffer, which a
+        // streamed input never fills.
+        llvm::errs() << "Error: profiles cannot be used with -stream\n";
+        return 1;
+    }
+    for (const std::string &Binding : Specialize)
+    {
+        size_t Eq = Binding.find('=');
+        if (Eq == std::string::npos || Eq == 0)
+        {
+            llvm::errs() << "Error: -specialize needs name=value, not '"
+                         << Binding << "'\n";
+            return 1;
+        }
+        if (!Bindings.try_emplace(Binding.substr(0, Eq), Binding.substr(Eq + 1))
+                 .second)
+        {
+            llvm::errs() << "Error: parameter " << Binding.substr(0, Eq)
+                         << " is specialized more than once\n";
+            return 1;
+        }
+    }
+    if (!VariantCache.empty() &&
+        (Stream || ProfileGenerate || !ProfileUse.empty()))
+    {
+        // The key hashes the SourceMgr's buffer, and profiles would have to
+        // be part of it.
+        llvm::errs() << "Error: -variant-cache cannot be used with -stream or "
+                        "profiles\n";
+        return 1;
+    }
+    if (Interp && (Inputs.size() > 1 || !Bindings.empty() ||
+                   !VariantCache.empty() || ProfileGenerate ||
+                   !ProfileUse.empty() || MultiversionOpt))
+    {
+        llvm::errs() << "Error: -interp runs one shader as written and "
+                        "cannot be combined with options for compiling it\n";
+        return 1;
+    }
+    if (FileType == OutputKind::OSO &&
+        (!Bindings.empty() || !VariantCache.empty() || ProfileGenerate ||
+         !ProfileUse.empty() || MultiversionOpt))
+    {
+        // An OSL runtime specializes and optimizes the shader itself.
+        llvm::errs() << "Error: -filetype=oso writes the shader as written "
+                        "and cannot be combined with options for compiling "
+                        "it\n";
+        return 1;
+    }
+    if (llvm::StringRef(Inputs.front()).endswith(".oso"))
+    {
+        // Compiled shaders are read without their source, so the
+        // interpreter is all that can take them.
+        if (!Interp || Inputs.size() > 1 || Stream)
+        {
+            llvm::errs() << "Error: an .oso input can only be run with "
+                            "-interp\n";
+            return 1;
+        }
+        return interpretOSO(Inputs.front());
+    }
+    if (OptLevel > 3)
+    {
+        llvm::errs() << "Error: invalid optimization level -O" << OptLevel
+                     << "\n";
+        return 1;
+    }
+
+    std::string OutputFile = Output;
+    if (!Output.getNumOccurrences())
+        OutputFile = FileType == OutputKind::IR       ? "a.ll"
+                     : FileType == OutputKind::Object ? "a.o"
+                     : FileType == OutputKind::OSO    ? "a.oso"
+                                                      : "a.so";
+    if (FileType == OutputKind::IR)
+    {
+        if (MultiversionOpt)
+        {
+            llvm::errs()
+                << "Error: -multiversion requires -filetype=obj or shared\n";
+            return 1;
+        }
+        return compileShader(Inputs.front(), OutputFile, nullptr, "");
+    }
+    if (FileType == OutputKind::OSO)
+        return compileShader(Inputs.front(), OutputFile, nullptr,
+                             registry::getShaderName(Inputs.front()));
+
+    // Multiversioned code has to run anywhere, so its baseline is generic.
+    std::string CPU = MCPU;
+    if (MultiversionOpt && !MCPU.getNumOccurrences())
+        CPU = "x86-64";
+    std::string Error;
+    std::unique_ptr<ObjectEmitter> Emitter =
+        ObjectEmitter::create(CPU, OptLevel, Error);
+    if (!Emitter)
+    {
+        llvm::errs() << "Error: " << Error << "\n";
+        return 1;
+    }
+    if (FileType == OutputKind::Object)
+        return compileShader(Inputs.front(), OutputFile, Emitter.get(), "");
+    return buildSharedLibrary(*Emitter, OutputFile);
+}
+
 int LLShader::exec()
 {
     // Parse the program to AST
-    Lexer Lex(*SrcMgr, Diags);
-    Parser P(Lex, Diags);
-    AST *Tree = P.parse();
+    AST *Tree;
+    // A streaming Lexer owns the spellings the tree refers to, so it has to
+    // outlive the tree.
+    std::unique_ptr<Lexer> StreamLex;
+    if (Window)
+    {
+        StreamLex = std::make_unique<Lexer>(*Window, SrcMgr, Diags);
+        Parser P(*StreamLex, Diags);
+        Tree = P.parse();
+    }
+    // The pipelined Lexer packs 32-bit offsets; a buffer of 4 GiB or more
+    // is lexed serially below.
+    else if (PipelineLexer && ParseThreads <= 1 &&
+             PipelinedLexer::canLex(SrcMgr))
+    {
+        PipelinedLexer Lex(SrcMgr, Diags);
+        Parser P(Lex, Diags);
+        Tree = P.parse();
+    }
+    else
+    {
+        ParallelParser P(SrcMgr, Diags, ParseThreads);
+        Tree = P.parse();
+    }
     if (!Tree || Diags.numErrors())
     {
         llvm::errs() << "Syntax error\n";
@@ -56,19 +537,200 @@ int LLShader::exec()
 
     // Semantic analysis
     Sema S;
-    if (!S.semantic(Tree))
+    S.setDiagnostics(Diags);
+    S.setNumThreads(SemaThreads);
+    bool SemaOk;
+    if (UseFlatAST)
+    {
+        FlatAST Flat = FlatAST::build(Tree);
+        SemaOk = S.semantic(Flat);
+    }
+    else
+        SemaOk = S.semantic(Tree);
+    if (!SemaOk)
     {
         llvm::errs() << "Semantic error\n";
         return 2;
     }
     llvm::outs() << "Semantic analysis passed\n";
+    if (Interpret)
+        return interpret(Tree);
+    if (EmitOSO)
+        return emitOSO(Tree);
+
+    std::unique_ptr<Specialization> Spec;
+    if (Bindings && !Bindings->empty())
+    {
+        std::string Error;
+        Spec = Specialization::compute(Tree, *Bindings, Error);
+        if (!Spec)
+        {
+            llvm::errs() << "Error: " << Error << "\n";
+            return 2;
+        }
+        Spec->print(llvm::outs());
+    }
+    std::string CachedVariant;
+    if (!VariantCache.empty())
+    {
+        CachedVariant = getVariantPath(Spec ? Spec->getKey() : "");
+        if (llvm::sys::fs::exists(CachedVariant))
+        {
+            if (std::error_code EC =
+                    llvm::sys::fs::copy_file(CachedVariant, OutputFile))
+            {
+                llvm::errs() << "Error writing " << OutputFile << ": "
+                             << EC.message() << "\n";
+                return 1;
+            }
+            llvm::outs() << "Using cached variant " << CachedVariant << "\n";
+            return 0;
+        }
+    }
 
-    //   // Compile to LLVM IR
-    //   CodeGen CG(Module.get(), Ctx.get());
-    //   CG.compile(Tree);
+    UniformityInfo Uniformity;
+    if (HoistInvariants || ReportHoisting)
+        Uniformity = UniformityInfo::compute(Tree);
+    if (ReportHoisting)
+        Uniformity.print(llvm::outs(), &Diags);
 
-    //   Module->print(llvm::outs(), nullptr);
-    //   // save to a .ll file
-    //   saveModuleToFile(Output);
+    // Compile to LLVM IR
+    CodeGen CG(Module.get(), Ctx.get());
+    CG.setDiagnostics(Diags);
+    if (HoistInvariants)
+        CG.setUniformity(Uniformity);
+    if (!ShaderName.empty())
+        CG.setShaderName(ShaderName);
+    if (Emitter)
+        CG.setTargets(Multiversion
+                          ? getMultiversionTargets(Emitter->getCPU())
+                          : Emitter->getCPU().str());
+    if (!ProfileSource.empty())
+        CG.setProfileGenerate(SrcMgr, ProfileSource);
+    if (Profile)
+        CG.setProfileUse(SrcMgr, *Profile);
+    if (Spec)
+        CG.setSpecialization(*Spec);
+    if (Emitter)
+        Emitter->configure(*Module);
+    bool Parallel =
+        CodegenThreads && ProfileSource.empty() && !Profile && !Multiversion;
+    if (Parallel)
+        CG.setParallel(CodegenThreads, OptLevel);
+    if (!CG.compile(Tree))
+    {
+        llvm::errs() << "Code generation error\n";
+        return 3;
+    }
+    std::string Error;
+    if (Multiversion &&
+        !multiversion(*Module->getFunction(CG.getEntryName()), Error))
+    {
+        llvm::errs() << "Error: " << Error << "\n";
+        return 1;
+    }
+    // A parallel compile optimizes as it goes.
+    if (!Parallel)
+        optimizeModule(*Module, OptLevel);
+    if (!Emitter)
+    {
+        if (!saveModuleToFile(OutputFile))
+            return 1;
+    }
+    else if (!Emitter->emit(*Module, OutputFile, Error))
+    {
+        llvm::errs() << "Error: " << Error << "\n";
+        return 1;
+    }
+    if (!CachedVariant.empty())
+        storeVariant(CachedVariant);
+    return 0;
+}
+
+int LLShader::interpret(AST *Tree)
+{
+    std::unique_ptr<Bytecode> Code = Bytecode::compile(Tree, llvm::errs());
+    if (!Code)
+    {
+        llvm::errs() << "Code generation error\n";
+        return 3;
+    }
+    return runBytecode(*Code, DumpBytecode);
+}
+
+int LLShader::emitOSO(AST *Tree)
+{
+    OSOEmitter OSO(ShaderName);
+    if (Window)
+        OSO.setSourceInfo(Diags, Window->getFileName());
+    else if (SrcMgr.getNumBuffers())
+        OSO.setSourceInfo(Diags,
+                          SrcMgr.getMemoryBuffer(SrcMgr.getMainFileID())
+                              ->getBufferIdentifier());
+    std::error_code EC;
+    llvm::raw_fd_ostream OS(OutputFile, EC);
+    if (EC)
+    {
+        llvm::errs() << "Error writing " << OutputFile << ": " << EC.message()
+                     << "\n";
+        return 1;
+    }
+    // The text goes to the file in large blocks as it is written.
+    OS.SetBufferSize(1 << 16);
+    if (!OSO.emit(Tree, OS))
+    {
+        OS.close();
+        llvm::sys::fs::remove(OutputFile);
+        llvm::errs() << "Code generation error\n";
+        return 3;
+    }
     return 0;
 }
+
+std::string LLShader::getVariantPath(llvm::StringRef SpecKey) const
+{
+    // Everything that changes the output goes into the key.
+    llvm::MD5 Hash;
+    auto Add = [&Hash](llvm::StringRef Field)
+    {
+        Hash.update(Field);
+        Hash.update(llvm::makeArrayRef<uint8_t>(0));
+    };
+    Add(SrcMgr.getMemoryBuffer(SrcMgr.getMainFileID())->getBuffer());
+    Add(SpecKey);
+    Add(Emitter ? Emitter->getCPU() : "ll");
+    Add(llvm::Twine(OptLevel).str());
+    Add(ShaderName);
+    Add(Multiversion ? "multiversion" : "");
+    Add(HoistInvariants ? "hoist" : "");
+    Add(CodegenThreads ? "parallel" : "");
+    llvm::MD5::MD5Result Result;
+    Hash.final(Result);
+
+    llvm::SmallString<256> Path(VariantCache);
+    llvm::sys::path::append(Path, (ShaderName.empty() ? "shader" : ShaderName) +
+                                      "-" + Result.digest() +
+                                      (Emitter ? ".o" : ".ll"));
+    return std::string(Path);
+}
+
+void LLShader::storeVariant(llvm::StringRef Path) const
+{
+    // Written under a temporary name and renamed, so that compilers sharing
+    // the cache never see a partial file.
+    std::error_code EC = llvm::sys::fs::create_directories(VariantCache);
+    llvm::SmallString<256> TempPath;
+    if (!EC)
+        EC = llvm::sys::fs::createUniqueFile(Path + ".%%%%%%", TempPath);
+    if (!EC)
+        EC = llvm::sys::fs::copy_file(OutputFile, TempPath);
+    if (!EC)
+        EC = llvm::sys::fs::rename(TempPath, Path);
+    if (EC)
+    {
+        llvm::errs() << "Warning: cannot store the variant in " << Path << ": "
+                     << EC.message() << "\n";
+        if (!TempPath.empty())
+            llvm::sys::fs::remove(TempPath);
+    }
+}
@@ -3,9 +3,19 @@
 
 #include "llshader/Basic/Diagnostic.h"
 #include "llshader/CodeGen/CodeGen.h"
+#include "llshader/CodeGen/Multiversion.h"
+#include "llshader/CodeGen/OSOEmitter.h"
+#include "llshader/CodeGen/ObjectEmitter.h"
+#include "llshader/CodeGen/Optimizer.h"
+#include "llshader/CodeGen/Profile.h"
+#include "llshader/Interp/Bytecode.h"
 #include "llshader/Lexer/Lexer.h"
+#include "llshader/Lexer/PipelinedLexer.h"
+#include "llshader/Lexer/SourceWindow.h"
+#include "llshader/Parser/ParallelParser.h"
 #include "llshader/Parser/Parser.h"
 #include "llshader/Sema/Sema.h"
+#include "llshader/Sema/Specialization.h"
 #include "llvm/ADT/StringRef.h"
 #include <llvm/ADT/StringRef.h>
 #include <llvm/IR/IRBuilder.h>
@@ -18,20 +28,113 @@
 #include <system_error>
 
 class LLShader {
-  SourceMgr *SrcMgr;
-  DiagnosticsEngine Diags;
+  SourceMgr &SrcMgr;
+  DiagnosticsEngine &Diags;
 
 public:
-  LLShader(SourceMgr *SrcMgr, DiagnosticsEngine &Diags)
+  // SrcMgr and Diags, which reports into it, must outlive exec().
+  LLShader(SourceMgr &SrcMgr, DiagnosticsEngine &Diags)
       : SrcMgr(SrcMgr), Diags(Diags) {
     moduleInit();
   };
 
-  SourceMgr *getSourceMgr() { return SrcMgr; }
+  SourceMgr &getSourceMgr() { return SrcMgr; }
+
+  // Lex from a sliding window instead of the SourceMgr's main buffer.
+  void setSourceWindow(std::unique_ptr<SourceWindow> W) {
+    Window = std::move(W);
+  }
+
+  // Parse top-level statements on this many threads; 1 parses serially.
+  void setParseThreads(unsigned N) { ParseThreads = N; }
+
+  // Lex on a thread of its own while parsing; used when parsing serially.
+  void setPipelineLexer(bool B) { PipelineLexer = B; }
+
+  // Check independent top-level scopes on this many threads.
+  void setSemaThreads(unsigned N) { SemaThreads = N; }
+
+  // Run semantic analysis on the flattened AST instead of the node tree.
+  void setUseFlatAST(bool B) { UseFlatAST = B; }
+
+  // Instrument the generated code with statement counters; Source names the
+  // shader in the profile it writes.
+  void setProfileGenerate(llvm::StringRef Source) {
+    ProfileSource = Source.str();
+  }
+
+  // Weight branches with the counts in Profile, which must outlive exec().
+  void setProfileUse(const ShaderProfile &P) { Profile = &P; }
+
+  // Evaluate loop-invariant expressions once before their loop.
+  void setHoistInvariants(bool B) { HoistInvariants = B; }
+
+  // Print the uniformity analysis and what it hoists to outs().
+  void setReportHoisting(bool B) { ReportHoisting = B; }
+
+  // Optimization level, 0 to 3, of the pipeline run over the IR.
+  void setOptLevel(unsigned Level) { OptLevel = Level; }
+
+  // Generate code for top-level blocks on this many threads, see
+  // CodeGen::setParallel; 0 emits them inline.
+  void setCodegenThreads(unsigned N) { CodegenThreads = N; }
+
+  // Compile the variant with these parameters bound, see Specialization.
+  void setSpecialization(const llvm::StringMap<std::string> &Values) {
+    Bindings = &Values;
+  }
+
+  // Look the output up in, and add it to, this directory of compiled
+  // variants; empty for none.
+  void setVariantCache(llvm::StringRef Dir) { VariantCache = Dir.str(); }
+
+  // Where exec() writes the generated IR.
+  void setOutputFile(llvm::StringRef FileName) { OutputFile = FileName.str(); }
+
+  // Write a native object file with E instead of IR.
+  void setObjectEmitter(const ObjectEmitter *E) { Emitter = E; }
+
+  // Compile for a shader library under this name, see
+  // CodeGen::setShaderName.
+  void setShaderName(llvm::StringRef Name) { ShaderName = Name.str(); }
+
+  // Emit baseline, AVX2 and AVX-512 versions of the entry point, see
+  // multiversion(). Needs an object emitter.
+  void setMultiversion(bool B) { Multiversion = B; }
+
+  // Write OSL object code (.oso) named after the shader name instead of
+  // IR, see OSOEmitter.
+  void setEmitOSO(bool B) { EmitOSO = B; }
+
+  // Run the program with the bytecode interpreter instead of compiling it.
+  void setInterpret(bool B) { Interpret = B; }
+
+  // Print the bytecode to outs() before running it.
+  void setDumpBytecode(bool B) { DumpBytecode = B; }
 
   int exec();
 
 private:
+  std::unique_ptr<SourceWindow> Window;
+  unsigned ParseThreads = 1;
+  bool PipelineLexer = false;
+  unsigned SemaThreads = 1;
+  bool UseFlatAST = false;
+  std::string ProfileSource;
+  const ShaderProfile *Profile = nullptr;
+  bool HoistInvariants = true;
+  bool ReportHoisting = false;
+  unsigned OptLevel = 0;
+  unsigned CodegenThreads = 0;
+  const llvm::StringMap<std::string> *Bindings = nullptr;
+  std::string VariantCache;
+  std::string OutputFile = "a.ll";
+  const ObjectEmitter *Emitter = nullptr;
+  std::string ShaderName;
+  bool Multiversion = false;
+  bool EmitOSO = false;
+  bool Interpret = false;
+  bool DumpBytecode = false;
   std::unique_ptr<llvm::LLVMContext> Ctx;
   std::unique_ptr<llvm::Module> Module;
   std::unique_ptr<llvm::IRBuilder<>> Builder;
@@ -41,10 +144,27 @@ private:
     Module = std::make_unique<llvm::Module>("ShaderLLVM", *Ctx);
   }
 
-  void saveModuleToFile(llvm::StringRef FileName) {
+  // Lowers Tree to bytecode and runs it.
+  int interpret(AST *Tree);
+
+  // Writes Tree to OutputFile as .oso.
+  int emitOSO(AST *Tree);
+
+  // Path of the cached variant of this compile with SpecKey's bindings.
+  std::string getVariantPath(llvm::StringRef SpecKey) const;
+  // Copies the output to Path in the variant cache.
+  void storeVariant(llvm::StringRef Path) const;
+
+  bool saveModuleToFile(llvm::StringRef FileName) {
     std::error_code ErrorCode;
     llvm::raw_fd_ostream OutLl(FileName, ErrorCode);
+    if (ErrorCode) {
+      llvm::errs() << "Error writing " << FileName << ": "
+                   << ErrorCode.message() << "\n";
+      return false;
+    }
     Module->print(OutLl, nullptr);
+    return true;
   }
 };
 #endif
@@ -0,0 +1,493 @@
+#include "mathlib.h"
+#include "mathlib_kernels.h"
+#include <math.h>
+#include <string.h>
+
+/* Scalar builtins */
+
+float llsh_dot(const llsh_vec3 *a, const llsh_vec3 *b) {
+  return a->x * b->x + a->y * b->y + a->z * b->z;
+}
+
+void llsh_cross(llsh_vec3 *r, const llsh_vec3 *a, const llsh_vec3 *b) {
+  llsh_vec3 t;
+  t.x = a->y * b->z - a->z * b->y;
+  t.y = a->z * b->x - a->x * b->z;
+  t.z = a->x * b->y - a->y * b->x;
+  *r = t;
+}
+
+float llsh_length(const llsh_vec3 *a) { return sqrtf(llsh_dot(a, a)); }
+
+float llsh_distance(const llsh_vec3 *a, const llsh_vec3 *b) {
+  llsh_vec3 d = {a->x - b->x, a->y - b->y, a->z - b->z};
+  return llsh_length(&d);
+}
+
+void llsh_normalize(llsh_vec3 *r, const llsh_vec3 *a) {
+  float l = llsh_length(a);
+  if (l > 0.0f) {
+    r->x = a->x / l;
+    r->y = a->y / l;
+    r->z = a->z / l;
+  } else {
+    r->x = r->y = r->z = 0.0f;
+  }
+}
+
+void llsh_reflect(llsh_vec3 *r, const llsh_vec3 *i, const llsh_vec3 *n) {
+  float d = 2.0f * llsh_dot(n, i);
+  r->x = i->x - d * n->x;
+  r->y = i->y - d * n->y;
+  r->z = i->z - d * n->z;
+}
+
+void llsh_refract(llsh_vec3 *r, const llsh_vec3 *i, const llsh_vec3 *n,
+                  float eta) {
+  float idotn = llsh_dot(i, n);
+  float k = 1.0f - eta * eta * (1.0f - idotn * idotn);
+  if (k < 0.0f) {
+    r->x = r->y = r->z = 0.0f;
+    return;
+  }
+  float s = eta * idotn + sqrtf(k);
+  r->x = eta * i->x - s * n->x;
+  r->y = eta * i->y - s * n->y;
+  r->z = eta * i->z - s * n->z;
+}
+
+void llsh_faceforward(llsh_vec3 *r, const llsh_vec3 *n, const llsh_vec3 *i,
+                      const llsh_vec3 *nref) {
+  float s = llsh_dot(i, nref) > 0.0f ? -1.0f : 1.0f;
+  r->x = s * n->x;
+  r->y = s * n->y;
+  r->z = s * n->z;
+}
+
+void llsh_min_v(llsh_vec3 *r, const llsh_vec3 *a, const llsh_vec3 *b) {
+  r->x = fminf(a->x, b->x);
+  r->y = fminf(a->y, b->y);
+  r->z = fminf(a->z, b->z);
+}
+
+void llsh_max_v(llsh_vec3 *r, const llsh_vec3 *a, const llsh_vec3 *b) {
+  r->x = fmaxf(a->x, b->x);
+  r->y = fmaxf(a->y, b->y);
+  r->z = fmaxf(a->z, b->z);
+}
+
+void llsh_abs_v(llsh_vec3 *r, const llsh_vec3 *a) {
+  r->x = fabsf(a->x);
+  r->y = fabsf(a->y);
+  r->z = fabsf(a->z);
+}
+
+float llsh_luminance(const llsh_vec3 *c) {
+  /* Rec. 709 primaries. */
+  return 0.2126f * c->x + 0.7152f * c->y + 0.0722f * c->z;
+}
+
+float llsh_mix(float a, float b, float t) {
+  return a * (1.0f - t) + b * t;
+}
+
+void llsh_mix_v(llsh_vec3 *r, const llsh_vec3 *a, const llsh_vec3 *b,
+                float t) {
+  r->x = llsh_mix(a->x, b->x, t);
+  r->y = llsh_mix(a->y, b->y, t);
+  r->z = llsh_mix(a->z, b->z, t);
+}
+
+float llsh_clamp(float x, float lo, float hi) {
+  x = x > lo ? x : lo;
+  return x < hi ? x : hi;
+}
+
+void llsh_clamp_v(llsh_vec3 *r, const llsh_vec3 *x, float lo, float hi) {
+  r->x = llsh_clamp(x->x, lo, hi);
+  r->y = llsh_clamp(x->y, lo, hi);
+  r->z = llsh_clamp(x->z, lo, hi);
+}
+
+float llsh_step(float edge, float x) { return x < edge ? 0.0f : 1.0f; }
+
+float llsh_smoothstep(float e0, float e1, float x) {
+  if (x < e0)
+    return 0.0f;
+  if (x >= e1)
+    return 1.0f;
+  float t = (x - e0) / (e1 - e0);
+  return t * t * (3.0f - 2.0f * t);
+}
+
+void llsh_mat_mul(llsh_mat4 *r, const llsh_mat4 *a, const llsh_mat4 *b) {
+  llsh_mat4 t;
+  for (int i = 0; i < 4; ++i)
+    for (int j = 0; j < 4; ++j)
+      t.m[i][j] = a->m[i][0] * b->m[0][j] + a->m[i][1] * b->m[1][j] +
+                  a->m[i][2] * b->m[2][j] + a->m[i][3] * b->m[3][j];
+  *r = t;
+}
+
+void llsh_transpose(llsh_mat4 *r, const llsh_mat4 *a) {
+  llsh_mat4 t;
+  for (int i = 0; i < 4; ++i)
+    for (int j = 0; j < 4; ++j)
+      t.m[i][j] = a->m[j][i];
+  *r = t;
+}
+
+/* Cofactors of the first column and the 2x2 minors of the lower two rows,
+   shared by the determinant and the inverse. */
+static void cofactors(float c[16], const llsh_mat4 *a) {
+  const float *m = &a->m[0][0];
+  c[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] +
+         m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+  c[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] -
+         m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+  c[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] +
+         m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+  c[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] -
+          m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+  c[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] -
+         m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+  c[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] +
+         m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+  c[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] -
+         m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+  c[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] +
+          m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+  c[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] +
+         m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+  c[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] -
+         m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+  c[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] +
+          m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+  c[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] -
+          m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+  c[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] -
+         m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+  c[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] +
+         m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+  c[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] -
+          m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+  c[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] +
+          m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+}
+
+float llsh_determinant(const llsh_mat4 *a) {
+  float c[16];
+  cofactors(c, a);
+  const float *m = &a->m[0][0];
+  return m[0] * c[0] + m[1] * c[4] + m[2] * c[8] + m[3] * c[12];
+}
+
+int llsh_inverse(llsh_mat4 *r, const llsh_mat4 *a) {
+  float c[16];
+  cofactors(c, a);
+  const float *m = &a->m[0][0];
+  float det = m[0] * c[0] + m[1] * c[4] + m[2] * c[8] + m[3] * c[12];
+  if (det == 0.0f)
+    return 0;
+  float inv = 1.0f / det;
+  for (int i = 0; i < 16; ++i)
+    (&r->m[0][0])[i] = c[i] * inv;
+  return 1;
+}
+
+void llsh_transform(llsh_vec3 *r, const llsh_mat4 *m, const llsh_vec3 *p) {
+  float x = p->x * m->m[0][0] + p->y * m->m[1][0] + p->z * m->m[2][0] +
+            m->m[3][0];
+  float y = p->x * m->m[0][1] + p->y * m->m[1][1] + p->z * m->m[2][1] +
+            m->m[3][1];
+  float z = p->x * m->m[0][2] + p->y * m->m[1][2] + p->z * m->m[2][2] +
+            m->m[3][2];
+  float w = p->x * m->m[0][3] + p->y * m->m[1][3] + p->z * m->m[2][3] +
+            m->m[3][3];
+  if (w != 1.0f && w != 0.0f) {
+    x /= w;
+    y /= w;
+    z /= w;
+  }
+  r->x = x;
+  r->y = y;
+  r->z = z;
+}
+
+void llsh_transformv(llsh_vec3 *r, const llsh_mat4 *m, const llsh_vec3 *v) {
+  float x = v->x * m->m[0][0] + v->y * m->m[1][0] + v->z * m->m[2][0];
+  float y = v->x * m->m[0][1] + v->y * m->m[1][1] + v->z * m->m[2][1];
+  float z = v->x * m->m[0][2] + v->y * m->m[1][2] + v->z * m->m[2][2];
+  r->x = x;
+  r->y = y;
+  r->z = z;
+}
+
+void llsh_transformn(llsh_vec3 *r, const llsh_mat4 *m, const llsh_vec3 *n) {
+  llsh_mat4 inv;
+  if (!llsh_inverse(&inv, m)) {
+    *r = *n;
+    return;
+  }
+  /* n * transpose(inverse(m)) */
+  float x = n->x * inv.m[0][0] + n->y * inv.m[0][1] + n->z * inv.m[0][2];
+  float y = n->x * inv.m[1][0] + n->y * inv.m[1][1] + n->z * inv.m[1][2];
+  float z = n->x * inv.m[2][0] + n->y * inv.m[2][1] + n->z * inv.m[2][2];
+  r->x = x;
+  r->y = y;
+  r->z = z;
+}
+
+/* Noise */
+
+#define LLSH_PERM_256 \
+  151, 160, 137, 91, 90, 15, 131, 13, 201, 95, 96, 53, 194, 233, 7, 225, \
+  140, 36, 103, 30, 69, 142, 8, 99, 37, 240, 21, 10, 23, 190, 6, 148, \
+  247, 120, 234, 75, 0, 26, 197, 62, 94, 252, 219, 203, 117, 35, 11, 32, \
+  57, 177, 33, 88, 237, 149, 56, 87, 174, 20, 125, 136, 171, 168, 68, 175, \
+  74, 165, 71, 134, 139, 48, 27, 166, 77, 146, 158, 231, 83, 111, 229, 122, \
+  60, 211, 133, 230, 220, 105, 92, 41, 55, 46, 245, 40, 244, 102, 143, 54, \
+  65, 25, 63, 161, 1, 216, 80, 73, 209, 76, 132, 187, 208, 89, 18, 169, \
+  200, 196, 135, 130, 116, 188, 159, 86, 164, 100, 109, 198, 173, 186, 3, 64, \
+  52, 217, 226, 250, 124, 123, 5, 202, 38, 147, 118, 126, 255, 82, 85, 212, \
+  207, 206, 59, 227, 47, 16, 58, 17, 182, 189, 28, 42, 223, 183, 170, 213, \
+  119, 248, 152, 2, 44, 154, 163, 70, 221, 153, 101, 155, 167, 43, 172, 9, \
+  129, 22, 39, 253, 19, 98, 108, 110, 79, 113, 224, 232, 178, 185, 112, 104, \
+  218, 246, 97, 228, 251, 34, 242, 193, 238, 210, 144, 12, 191, 179, 162, 241, \
+  81, 51, 145, 235, 249, 14, 239, 107, 49, 192, 214, 31, 181, 199, 106, 157, \
+  184, 84, 204, 176, 115, 121, 50, 45, 127, 4, 150, 254, 138, 236, 205, 93, \
+  222, 114, 67, 29, 24, 72, 243, 141, 128, 195, 78, 66, 215, 61, 156, 180,
+
+const int llsh_perm[512] = {LLSH_PERM_256 LLSH_PERM_256};
+
+static float fade(float t) {
+  return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+
+static float lerp(float t, float a, float b) { return a + t * (b - a); }
+
+static float grad(int h, float x, float y, float z) {
+  h &= 15;
+  float u = h < 8 ? x : y;
+  float v = h < 4 ? y : (h == 12 || h == 14) ? x : z;
+  return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
+}
+
+float llsh_snoise_xyz(float x, float y, float z) {
+  float fx = floorf(x), fy = floorf(y), fz = floorf(z);
+  int X = (int)fx & 255, Y = (int)fy & 255, Z = (int)fz & 255;
+  x -= fx;
+  y -= fy;
+  z -= fz;
+  float u = fade(x), v = fade(y), w = fade(z);
+  const int *P = llsh_perm;
+  int A = P[X] + Y, AA = P[A] + Z, AB = P[A + 1] + Z;
+  int B = P[X + 1] + Y, BA = P[B] + Z, BB = P[B + 1] + Z;
+  return lerp(w,
+              lerp(v, lerp(u, grad(P[AA], x, y, z),
+                           grad(P[BA], x - 1, y, z)),
+                   lerp(u, grad(P[AB], x, y - 1, z),
+                        grad(P[BB], x - 1, y - 1, z))),
+              lerp(v, lerp(u, grad(P[AA + 1], x, y, z - 1),
+                           grad(P[BA + 1], x - 1, y, z - 1)),
+                   lerp(u, grad(P[AB + 1], x, y - 1, z - 1),
+                        grad(P[BB + 1], x - 1, y - 1, z - 1))));
+}
+
+float llsh_snoise(const llsh_vec3 *p) {
+  return llsh_snoise_xyz(p->x, p->y, p->z);
+}
+
+float llsh_noise(const llsh_vec3 *p) {
+  return 0.5f * llsh_snoise(p) + 0.5f;
+}
+
+/* Bob Jenkins' lookup3 final mix. */
+#define ROT(x, k) (((x) << (k)) | ((x) >> (32 - (k))))
+static unsigned hash3(unsigned a, unsigned b, unsigned c) {
+  c ^= b; c -= ROT(b, 14);
+  a ^= c; a -= ROT(c, 11);
+  b ^= a; b -= ROT(a, 25);
+  c ^= b; c -= ROT(b, 16);
+  a ^= c; a -= ROT(c, 4);
+  b ^= a; b -= ROT(a, 14);
+  c ^= b; c -= ROT(b, 24);
+  return c;
+}
+#undef ROT
+
+float llsh_cellnoise(const llsh_vec3 *p) {
+  unsigned h = hash3((unsigned)(int)floorf(p->x), (unsigned)(int)floorf(p->y),
+                     (unsigned)(int)floorf(p->z));
+  return (float)(h >> 8) * (1.0f / 16777216.0f);
+}
+
+/* Scalar batched kernels */
+
+static void dot_scalar(float *r, const llsh_vec3_soa *a,
+                       const llsh_vec3_soa *b, size_t n) {
+  for (size_t i = 0; i < n; ++i)
+    r[i] = a->x[i] * b->x[i] + a->y[i] * b->y[i] + a->z[i] * b->z[i];
+}
+
+static void cross_scalar(const llsh_vec3_soa *r, const llsh_vec3_soa *a,
+                         const llsh_vec3_soa *b, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    llsh_vec3 va = {a->x[i], a->y[i], a->z[i]};
+    llsh_vec3 vb = {b->x[i], b->y[i], b->z[i]}, vr;
+    llsh_cross(&vr, &va, &vb);
+    r->x[i] = vr.x;
+    r->y[i] = vr.y;
+    r->z[i] = vr.z;
+  }
+}
+
+static void length_scalar(float *r, const llsh_vec3_soa *a, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    llsh_vec3 va = {a->x[i], a->y[i], a->z[i]};
+    r[i] = llsh_length(&va);
+  }
+}
+
+static void normalize_scalar(const llsh_vec3_soa *r, const llsh_vec3_soa *a,
+                             size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    llsh_vec3 va = {a->x[i], a->y[i], a->z[i]}, vr;
+    llsh_normalize(&vr, &va);
+    r->x[i] = vr.x;
+    r->y[i] = vr.y;
+    r->z[i] = vr.z;
+  }
+}
+
+static void mix_scalar(const llsh_vec3_soa *r, const llsh_vec3_soa *a,
+                       const llsh_vec3_soa *b, const float *t, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    r->x[i] = llsh_mix(a->x[i], b->x[i], t[i]);
+    r->y[i] = llsh_mix(a->y[i], b->y[i], t[i]);
+    r->z[i] = llsh_mix(a->z[i], b->z[i], t[i]);
+  }
+}
+
+static void clamp_scalar(float *r, const float *x, float lo, float hi,
+                         size_t n) {
+  for (size_t i = 0; i < n; ++i)
+    r[i] = llsh_clamp(x[i], lo, hi);
+}
+
+static void transform_scalar(const llsh_vec3_soa *r, const llsh_mat4 *m,
+                             const llsh_vec3_soa *p, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    llsh_vec3 vp = {p->x[i], p->y[i], p->z[i]}, vr;
+    llsh_transform(&vr, m, &vp);
+    r->x[i] = vr.x;
+    r->y[i] = vr.y;
+    r->z[i] = vr.z;
+  }
+}
+
+static void transformv_scalar(const llsh_vec3_soa *r, const llsh_mat4 *m,
+                              const llsh_vec3_soa *v, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    llsh_vec3 vv = {v->x[i], v->y[i], v->z[i]}, vr;
+    llsh_transformv(&vr, m, &vv);
+    r->x[i] = vr.x;
+    r->y[i] = vr.y;
+    r->z[i] = vr.z;
+  }
+}
+
+static void noise_scalar(float *r, const llsh_vec3_soa *p, size_t n) {
+  for (size_t i = 0; i < n; ++i)
+    r[i] = 0.5f * llsh_snoise_xyz(p->x[i], p->y[i], p->z[i]) + 0.5f;
+}
+
+const llsh_kernels llsh_kernels_scalar = {
+    dot_scalar,   cross_scalar,     length_scalar,     normalize_scalar,
+    mix_scalar,   clamp_scalar,     transform_scalar,  transformv_scalar,
+    noise_scalar,
+};
+
+/* Dispatch */
+
+static int active_isa = -1;
+
+llsh_isa llsh_host_isa(void) {
+#ifdef LLSH_HAVE_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return LLSH_ISA_AVX2;
+  return LLSH_ISA_SSE;
+#else
+  return LLSH_ISA_SCALAR;
+#endif
+}
+
+llsh_isa llsh_get_isa(void) {
+  int isa = __atomic_load_n(&active_isa, __ATOMIC_RELAXED);
+  if (isa < 0) {
+    isa = llsh_host_isa();
+    __atomic_store_n(&active_isa, isa, __ATOMIC_RELAXED);
+  }
+  return (llsh_isa)isa;
+}
+
+void llsh_set_isa(llsh_isa isa) {
+  llsh_isa host = llsh_host_isa();
+  __atomic_store_n(&active_isa, isa > host ? host : isa, __ATOMIC_RELAXED);
+}
+
+static const llsh_kernels *kernels(void) {
+  switch (llsh_get_isa()) {
+#ifdef LLSH_HAVE_X86_KERNELS
+  case LLSH_ISA_AVX2:
+    return &llsh_kernels_avx2;
+  case LLSH_ISA_SSE:
+    return &llsh_kernels_sse;
+#endif
+  default:
+    return &llsh_kernels_scalar;
+  }
+}
+
+void llsh_dot_soa(float *r, const llsh_vec3_soa *a, const llsh_vec3_soa *b,
+                  size_t n) {
+  kernels()->dot(r, a, b, n);
+}
+
+void llsh_cross_soa(const llsh_vec3_soa *r, const llsh_vec3_soa *a,
+                    const llsh_vec3_soa *b, size_t n) {
+  kernels()->cross(r, a, b, n);
+}
+
+void llsh_length_soa(float *r, const llsh_vec3_soa *a, size_t n) {
+  kernels()->length(r, a, n);
+}
+
+void llsh_normalize_soa(const llsh_vec3_soa *r, const llsh_vec3_soa *a,
+                        size_t n) {
+  kernels()->normalize(r, a, n);
+}
+
+void llsh_mix_soa(const llsh_vec3_soa *r, const llsh_vec3_soa *a,
+                  const llsh_vec3_soa *b, const float *t, size_t n) {
+  kernels()->mix(r, a, b, t, n);
+}
+
+void llsh_clamp_soa(float *r, const float *x, float lo, float hi, size_t n) {
+  kernels()->clamp(r, x, lo, hi, n);
+}
+
+void llsh_transform_soa(const llsh_vec3_soa *r, const llsh_mat4 *m,
+                        const llsh_vec3_soa *p, size_t n) {
+  kernels()->transform(r, m, p, n);
+}
+
+void llsh_transformv_soa(const llsh_vec3_soa *r, const llsh_mat4 *m,
+                         const llsh_vec3_soa *v, size_t n) {
+  kernels()->transformv(r, m, v, n);
+}
+
+void llsh_noise_soa(float *r, const llsh_vec3_soa *p, size_t n) {
+  kernels()->noise(r, p, n);
+}
@@ -0,0 +1,99 @@
+#ifndef LLSHADER_MATHLIB_H
+#define LLSHADER_MATHLIB_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* point, vector, normal and color share one layout. */
+typedef struct {
+  float x, y, z;
+} llsh_vec3;
+
+/* Row-major, row vectors: p' = p * M, translation in m[3][0..2]. */
+typedef struct {
+  float m[4][4];
+} llsh_mat4;
+
+/* A batch of triples stored as three arrays of n floats. */
+typedef struct {
+  float *x, *y, *z;
+} llsh_vec3_soa;
+
+/* Scalar builtins. Results are returned through the first argument, which
+   may alias the inputs. */
+float llsh_dot(const llsh_vec3 *a, const llsh_vec3 *b);
+void llsh_cross(llsh_vec3 *r, const llsh_vec3 *a, const llsh_vec3 *b);
+float llsh_length(const llsh_vec3 *a);
+float llsh_distance(const llsh_vec3 *a, const llsh_vec3 *b);
+/* Zero-length vectors normalize to zero. */
+void llsh_normalize(llsh_vec3 *r, const llsh_vec3 *a);
+void llsh_reflect(llsh_vec3 *r, const llsh_vec3 *i, const llsh_vec3 *n);
+/* Zero on total internal reflection. */
+void llsh_refract(llsh_vec3 *r, const llsh_vec3 *i, const llsh_vec3 *n,
+                  float eta);
+void llsh_faceforward(llsh_vec3 *r, const llsh_vec3 *n, const llsh_vec3 *i,
+                      const llsh_vec3 *nref);
+void llsh_min_v(llsh_vec3 *r, const llsh_vec3 *a, const llsh_vec3 *b);
+void llsh_max_v(llsh_vec3 *r, const llsh_vec3 *a, const llsh_vec3 *b);
+void llsh_abs_v(llsh_vec3 *r, const llsh_vec3 *a);
+float llsh_luminance(const llsh_vec3 *c);
+
+float llsh_mix(float a, float b, float t);
+void llsh_mix_v(llsh_vec3 *r, const llsh_vec3 *a, const llsh_vec3 *b,
+                float t);
+float llsh_clamp(float x, float lo, float hi);
+void llsh_clamp_v(llsh_vec3 *r, const llsh_vec3 *x, float lo, float hi);
+float llsh_step(float edge, float x);
+float llsh_smoothstep(float e0, float e1, float x);
+
+void llsh_mat_mul(llsh_mat4 *r, const llsh_mat4 *a, const llsh_mat4 *b);
+void llsh_transpose(llsh_mat4 *r, const llsh_mat4 *a);
+float llsh_determinant(const llsh_mat4 *a);
+/* Returns 0 and leaves r unchanged if a is singular. */
+int llsh_inverse(llsh_mat4 *r, const llsh_mat4 *a);
+/* Points get the translation and the homogeneous divide, vectors neither,
+   and normals are transformed by the inverse transpose. */
+void llsh_transform(llsh_vec3 *r, const llsh_mat4 *m, const llsh_vec3 *p);
+void llsh_transformv(llsh_vec3 *r, const llsh_mat4 *m, const llsh_vec3 *v);
+void llsh_transformn(llsh_vec3 *r, const llsh_mat4 *m, const llsh_vec3 *n);
+
+/* Perlin noise: snoise is in [-1, 1], noise in [0, 1]. cellnoise is
+   constant on unit cells and in [0, 1). */
+float llsh_snoise(const llsh_vec3 *p);
+float llsh_noise(const llsh_vec3 *p);
+float llsh_cellnoise(const llsh_vec3 *p);
+
+/* Batched builtins over n points. Outputs must not overlap the inputs
+   unless they are the same arrays. */
+void llsh_dot_soa(float *r, const llsh_vec3_soa *a, const llsh_vec3_soa *b,
+                  size_t n);
+void llsh_cross_soa(const llsh_vec3_soa *r, const llsh_vec3_soa *a,
+                    const llsh_vec3_soa *b, size_t n);
+void llsh_length_soa(float *r, const llsh_vec3_soa *a, size_t n);
+void llsh_normalize_soa(const llsh_vec3_soa *r, const llsh_vec3_soa *a,
+                        size_t n);
+void llsh_mix_soa(const llsh_vec3_soa *r, const llsh_vec3_soa *a,
+                  const llsh_vec3_soa *b, const float *t, size_t n);
+void llsh_clamp_soa(float *r, const float *x, float lo, float hi, size_t n);
+void llsh_transform_soa(const llsh_vec3_soa *r, const llsh_mat4 *m,
+                        const llsh_vec3_soa *p, size_t n);
+void llsh_transformv_soa(const llsh_vec3_soa *r, const llsh_mat4 *m,
+                         const llsh_vec3_soa *v, size_t n);
+void llsh_noise_soa(float *r, const llsh_vec3_soa *p, size_t n);
+
+/* Kernels used by the batched builtins. The default is the widest one the
+   host supports; llsh_set_isa falls back to it if the host lacks isa. */
+typedef enum { LLSH_ISA_SCALAR, LLSH_ISA_SSE, LLSH_ISA_AVX2 } llsh_isa;
+
+llsh_isa llsh_host_isa(void);
+llsh_isa llsh_get_isa(void);
+void llsh_set_isa(llsh_isa isa);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,45 @@
+#include "mathlib_kernels.h"
+#include <immintrin.h>
+
+/* Built with -mavx2; only called once llsh_host_isa has seen AVX2. */
+
+#define W 8
+#define VF __m256
+#define VI __m256i
+#define SIMD_NAME(name) name##_avx2
+
+#define VLOAD(p) _mm256_loadu_ps(p)
+#define VSTORE(p, v) _mm256_storeu_ps(p, v)
+#define VSET1(f) _mm256_set1_ps(f)
+#define VADD(a, b) _mm256_add_ps(a, b)
+#define VSUB(a, b) _mm256_sub_ps(a, b)
+#define VMUL(a, b) _mm256_mul_ps(a, b)
+#define VDIV(a, b) _mm256_div_ps(a, b)
+#define VSQRT(a) _mm256_sqrt_ps(a)
+#define VMIN(a, b) _mm256_min_ps(a, b)
+#define VMAX(a, b) _mm256_max_ps(a, b)
+#define VCMPGT(a, b) _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+#define VCMPNE(a, b) _mm256_cmp_ps(a, b, _CMP_NEQ_UQ)
+#define VAND(a, b) _mm256_and_ps(a, b)
+#define VANDNOT(a, b) _mm256_andnot_ps(a, b)
+#define VOR(a, b) _mm256_or_ps(a, b)
+#define VXOR(a, b) _mm256_xor_ps(a, b)
+#define VFLOOR(a) _mm256_floor_ps(a)
+#define VTOINT(a) _mm256_cvttps_epi32(a)
+
+#define ISET1(i) _mm256_set1_epi32(i)
+#define IAND(a, b) _mm256_and_si256(a, b)
+#define IOR(a, b) _mm256_or_si256(a, b)
+#define IADD(a, b) _mm256_add_epi32(a, b)
+#define ICMPLT(a, b) _mm256_cmpgt_epi32(b, a)
+#define ICMPEQ(a, b) _mm256_cmpeq_epi32(a, b)
+#define ISLL(a, n) _mm256_slli_epi32(a, n)
+#define ICASTF(a) _mm256_castsi256_ps(a)
+#define IGATHER(t, i) _mm256_i32gather_epi32(t, i, 4)
+
+#include "mathlib_simd.inc"
+
+const llsh_kernels llsh_kernels_avx2 = {
+    dot_avx2,   cross_avx2,     length_avx2,     normalize_avx2, mix_avx2,
+    clamp_avx2, transform_avx2, transformv_avx2, noise_avx2,
+};
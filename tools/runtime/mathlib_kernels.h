@@ -0,0 +1,37 @@
+#ifndef LLSHADER_MATHLIB_KERNELS_H
+#define LLSHADER_MATHLIB_KERNELS_H
+
+#include "mathlib.h"
+
+/* One implementation of the batched builtins. Each kernel handles any n; the
+   SIMD ones finish the tail with the scalar builtins. */
+typedef struct {
+  void (*dot)(float *, const llsh_vec3_soa *, const llsh_vec3_soa *, size_t);
+  void (*cross)(const llsh_vec3_soa *, const llsh_vec3_soa *,
+                const llsh_vec3_soa *, size_t);
+  void (*length)(float *, const llsh_vec3_soa *, size_t);
+  void (*normalize)(const llsh_vec3_soa *, const llsh_vec3_soa *, size_t);
+  void (*mix)(const llsh_vec3_soa *, const llsh_vec3_soa *,
+              const llsh_vec3_soa *, const float *, size_t);
+  void (*clamp)(float *, const float *, float, float, size_t);
+  void (*transform)(const llsh_vec3_soa *, const llsh_mat4 *,
+                    const llsh_vec3_soa *, size_t);
+  void (*transformv)(const llsh_vec3_soa *, const llsh_mat4 *,
+                     const llsh_vec3_soa *, size_t);
+  void (*noise)(float *, const llsh_vec3_soa *, size_t);
+} llsh_kernels;
+
+extern const llsh_kernels llsh_kernels_scalar;
+#ifdef LLSH_HAVE_X86_KERNELS
+extern const llsh_kernels llsh_kernels_sse;
+extern const llsh_kernels llsh_kernels_avx2;
+#endif
+
+/* Perlin's permutation, repeated so that perm[perm[i] + j] never wraps. */
+extern const int llsh_perm[512];
+
+/* Signed noise at (x, y, z). The SIMD kernels evaluate the same operations
+   in the same order, so every kernel returns identical results. */
+float llsh_snoise_xyz(float x, float y, float z);
+
+#endif
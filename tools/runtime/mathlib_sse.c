@@ -0,0 +1,57 @@
+#include "mathlib_kernels.h"
+#include <emmintrin.h>
+
+/* SSE2 is part of x86-64, so these kernels need no runtime check. */
+
+#define W 4
+#define VF __m128
+#define VI __m128i
+#define SIMD_NAME(name) name##_sse
+
+#define VLOAD(p) _mm_loadu_ps(p)
+#define VSTORE(p, v) _mm_storeu_ps(p, v)
+#define VSET1(f) _mm_set1_ps(f)
+#define VADD(a, b) _mm_add_ps(a, b)
+#define VSUB(a, b) _mm_sub_ps(a, b)
+#define VMUL(a, b) _mm_mul_ps(a, b)
+#define VDIV(a, b) _mm_div_ps(a, b)
+#define VSQRT(a) _mm_sqrt_ps(a)
+#define VMIN(a, b) _mm_min_ps(a, b)
+#define VMAX(a, b) _mm_max_ps(a, b)
+#define VCMPGT(a, b) _mm_cmpgt_ps(a, b)
+#define VCMPNE(a, b) _mm_cmpneq_ps(a, b)
+#define VAND(a, b) _mm_and_ps(a, b)
+#define VANDNOT(a, b) _mm_andnot_ps(a, b)
+#define VOR(a, b) _mm_or_ps(a, b)
+#define VXOR(a, b) _mm_xor_ps(a, b)
+#define VFLOOR(a) floor_sse(a)
+#define VTOINT(a) _mm_cvttps_epi32(a)
+
+#define ISET1(i) _mm_set1_epi32(i)
+#define IAND(a, b) _mm_and_si128(a, b)
+#define IOR(a, b) _mm_or_si128(a, b)
+#define IADD(a, b) _mm_add_epi32(a, b)
+#define ICMPLT(a, b) _mm_cmplt_epi32(a, b)
+#define ICMPEQ(a, b) _mm_cmpeq_epi32(a, b)
+#define ISLL(a, n) _mm_slli_epi32(a, n)
+#define ICASTF(a) _mm_castsi128_ps(a)
+#define IGATHER(t, i) gather_sse(t, i)
+
+/* SSE2 has no round-down: truncate, then step down where that rounded up. */
+static __m128 floor_sse(__m128 x) {
+  __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+  return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.0f)));
+}
+
+static __m128i gather_sse(const int *t, __m128i i) {
+  int idx[4];
+  _mm_storeu_si128((__m128i *)idx, i);
+  return _mm_setr_epi32(t[idx[0]], t[idx[1]], t[idx[2]], t[idx[3]]);
+}
+
+#include "mathlib_simd.inc"
+
+const llsh_kernels llsh_kernels_sse = {
+    dot_sse, cross_sse,     length_sse,     normalize_sse, mix_sse,
+    clamp_sse, transform_sse, transformv_sse, noise_sse,
+};
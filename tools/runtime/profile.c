@@ -0,0 +1,96 @@
+#include "profile.h"
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* One thread's counters for one shader. */
+typedef struct prof_block {
+  llsh_prof_desc *desc;
+  struct prof_block *next;
+  uint64_t counters[];
+} prof_block;
+
+static _Thread_local prof_block *tls_blocks;
+static pthread_key_t prof_key;
+static pthread_once_t prof_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t prof_lock = PTHREAD_MUTEX_INITIALIZER;
+static llsh_prof_desc *prof_shaders;
+
+/* Adds the blocks' counters to the totals. Called with prof_lock held. */
+static void prof_merge(prof_block *b) {
+  for (; b; b = b->next) {
+    uint32_t n = 2 * b->desc->num_sites;
+    for (uint32_t i = 0; i < n; ++i) {
+      b->desc->totals[i] += b->counters[i];
+      b->counters[i] = 0;
+    }
+  }
+}
+
+static void prof_write(void) {
+  const char *path = getenv("LLSHADER_PROFILE");
+  if (!path || !*path)
+    path = "llshader.prof";
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    perror(path);
+    return;
+  }
+  fprintf(f, "# llshader profile v1\n");
+  for (llsh_prof_desc *d = prof_shaders; d; d = d->next) {
+    fprintf(f, "shader %" PRIu32 " %s\n", d->num_sites, d->source);
+    for (uint32_t i = 0; i < d->num_sites; ++i)
+      fprintf(f, "%" PRIu32 " %" PRIu32 " %" PRIu64 " %" PRIu64 "\n",
+              d->lines[i], d->cols[i], d->totals[2 * i],
+              d->totals[2 * i + 1]);
+  }
+  fclose(f);
+}
+
+static void prof_thread_exit(void *p) {
+  pthread_mutex_lock(&prof_lock);
+  prof_merge(p);
+  pthread_mutex_unlock(&prof_lock);
+  for (prof_block *b = p, *next; b; b = next) {
+    next = b->next;
+    free(b);
+  }
+}
+
+static void prof_process_exit(void) {
+  pthread_mutex_lock(&prof_lock);
+  prof_merge(tls_blocks);
+  prof_write();
+  pthread_mutex_unlock(&prof_lock);
+}
+
+static void prof_setup(void) {
+  pthread_key_create(&prof_key, prof_thread_exit);
+  atexit(prof_process_exit);
+}
+
+uint64_t *llsh_prof_begin(llsh_prof_desc *desc) {
+  for (prof_block *b = tls_blocks; b; b = b->next)
+    if (b->desc == desc)
+      return b->counters;
+
+  pthread_once(&prof_once, prof_setup);
+  prof_block *b = calloc(1, sizeof(prof_block) +
+                                2 * desc->num_sites * sizeof(uint64_t));
+  if (!b)
+    abort();
+  b->desc = desc;
+  b->next = tls_blocks;
+  tls_blocks = b;
+  pthread_setspecific(prof_key, b);
+
+  pthread_mutex_lock(&prof_lock);
+  if (!desc->registered) {
+    desc->registered = 1;
+    desc->next = prof_shaders;
+    prof_shaders = desc;
+  }
+  pthread_mutex_unlock(&prof_lock);
+  return b->counters;
+}
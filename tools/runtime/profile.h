@@ -0,0 +1,37 @@
+#ifndef LLSHADER_PROFILE_H
+#define LLSHADER_PROFILE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Emitted by codegen for a shader built with -profile-generate. Site 0 is
+   the whole shader, every other site a statement. Each site has two
+   counters: how many times it ran and the cycles spent in it, inclusive of
+   the statements nested in it. Only blocks (scopes, branches and loops) and
+   site 0 are timed; the cycles of other statements stay 0. */
+typedef struct llsh_prof_desc {
+  const char *source;
+  uint32_t num_sites;
+  uint32_t registered;
+  const uint32_t *lines;
+  const uint32_t *cols;
+  /* 2 * num_sites counters merged from every thread. */
+  uint64_t *totals;
+  struct llsh_prof_desc *next;
+} llsh_prof_desc;
+
+/* Returns the calling thread's 2 * num_sites counters for desc, zeroed the
+   first time. They are added to desc->totals when the thread exits, and at
+   process exit for the thread calling exit, when every registered shader's
+   totals are written to the file named by LLSHADER_PROFILE, or to
+   llshader.prof. */
+uint64_t *llsh_prof_begin(llsh_prof_desc *desc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,35 @@
+#include "registry.h"
+#include <dlfcn.h>
+#include <stddef.h>
+#include <string.h>
+
+const llsh_shader_registry *llsh_open_shader_library(const char *path,
+                                                     void **handle,
+                                                     const char **error) {
+  void *lib = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (!lib) {
+    *error = dlerror();
+    return NULL;
+  }
+  const llsh_shader_registry *registry = dlsym(lib, LLSH_REGISTRY_SYMBOL);
+  if (!registry) {
+    *error = "not a shader library: no " LLSH_REGISTRY_SYMBOL;
+    dlclose(lib);
+    return NULL;
+  }
+  if (registry->version != LLSH_REGISTRY_VERSION) {
+    *error = "unsupported shader registry version";
+    dlclose(lib);
+    return NULL;
+  }
+  *handle = lib;
+  return registry;
+}
+
+const llsh_shader_info *llsh_find_shader(const llsh_shader_registry *registry,
+                                         const char *name) {
+  for (uint32_t i = 0; i < registry->num_shaders; ++i)
+    if (strcmp(registry->shaders[i]->name, name) == 0)
+      return registry->shaders[i];
+  return NULL;
+}
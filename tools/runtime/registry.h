@@ -0,0 +1,73 @@
+#ifndef LLSHADER_REGISTRY_H
+#define LLSHADER_REGISTRY_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A shader library written by `llshader -filetype=shared` exports
+   llsh_shader_registry, which lists every shader in it. The library leaves
+   the runtime's functions undefined; the process loading it provides them,
+   e.g. by linking libllshaderRuntime.a with -rdynamic. */
+
+#define LLSH_REGISTRY_VERSION 2
+#define LLSH_REGISTRY_SYMBOL "llsh_shader_registry"
+
+typedef enum llsh_param_type {
+  LLSH_TYPE_INT,
+  LLSH_TYPE_FLOAT,
+  LLSH_TYPE_POINT,
+  LLSH_TYPE_VECTOR,
+  LLSH_TYPE_NORMAL,
+  LLSH_TYPE_COLOR,
+  LLSH_TYPE_MATRIX,
+  LLSH_TYPE_STRING
+} llsh_param_type;
+
+/* The parameter is written with write_int when the shader returns. */
+#define LLSH_PARAM_OUTPUT 1u
+
+/* A top-level variable of a shader, in declaration order. */
+typedef struct llsh_shader_param {
+  const char *name;
+  uint32_t type;
+  uint32_t flags;
+} llsh_shader_param;
+
+typedef struct llsh_shader_info {
+  /* The source file's name without directory and extension, with other
+     characters than letters, digits and '_' replaced by '_'. */
+  const char *name;
+  /* Runs the shader; returns 0. */
+  int (*entry)(void);
+  uint32_t num_params;
+  const llsh_shader_param *params;
+  /* The CPUs the entry point is compiled for, comma-separated. With more
+     than one it picks the best version for the CPU when it is loaded. */
+  const char *targets;
+} llsh_shader_info;
+
+typedef struct llsh_shader_registry {
+  uint32_t version;
+  uint32_t num_shaders;
+  const llsh_shader_info *const *shaders;
+} llsh_shader_registry;
+
+/* dlopens the shader library at path and returns its registry, or NULL
+   with *error set to a static message. *handle is the library's handle for
+   dlclose. */
+const llsh_shader_registry *llsh_open_shader_library(const char *path,
+                                                     void **handle,
+                                                     const char **error);
+
+/* Returns the shader called name in registry, or NULL. */
+const llsh_shader_info *llsh_find_shader(const llsh_shader_registry *registry,
+                                         const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,13 +1,258 @@
 #include "runtime.h"
-#include <stdio.h>
+#include <errno.h>
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
-void write_int(int v) { 
-  printf("%d\n", v);
+#define LLSH_IO_BUFSIZE (64 * 1024)
+/* Longest text value: "-2147483648\n". */
+#define LLSH_MAX_INT_TEXT 12
+
+static void write_all(int fd, const char *p, size_t n) {
+  while (n) {
+    ssize_t w = write(fd, p, n);
+    if (w < 0) {
+      if (errno == EINTR)
+        continue;
+      return;
+    }
+    p += w;
+    n -= (size_t)w;
+  }
+}
+
+/* Output */
+
+typedef struct {
+  size_t len;
+  char data[LLSH_IO_BUFSIZE];
+} out_buffer;
+
+static _Thread_local out_buffer *tls_out;
+static pthread_key_t out_key;
+static pthread_once_t out_once = PTHREAD_ONCE_INIT;
+static int out_fd = STDOUT_FILENO;
+static int out_mode = LLSH_OUTPUT_TEXT;
+
+static void out_flush(out_buffer *b) {
+  write_all(__atomic_load_n(&out_fd, __ATOMIC_RELAXED), b->data, b->len);
+  b->len = 0;
+}
+
+static void out_thread_exit(void *p) {
+  out_flush(p);
+  free(p);
+}
+
+static void out_process_exit(void) {
+  if (tls_out)
+    out_flush(tls_out);
+}
+
+static void out_setup(void) {
+  pthread_key_create(&out_key, out_thread_exit);
+  atexit(out_process_exit);
+  const char *mode = getenv("LLSHADER_OUTPUT");
+  if (mode && strcmp(mode, "binary") == 0)
+    out_mode = LLSH_OUTPUT_BINARY;
+}
+
+static out_buffer *out_get(void) {
+  out_buffer *b = tls_out;
+  if (b)
+    return b;
+  pthread_once(&out_once, out_setup);
+  b = malloc(sizeof(out_buffer));
+  if (!b)
+    abort();
+  b->len = 0;
+  pthread_setspecific(out_key, b);
+  tls_out = b;
+  return b;
+}
+
+static const char digit_pairs[] = "00010203040506070809"
+                                  "10111213141516171819"
+                                  "20212223242526272829"
+                                  "30313233343536373839"
+                                  "40414243444546474849"
+                                  "50515253545556575859"
+                                  "60616263646566676869"
+                                  "70717273747576777879"
+                                  "80818283848586878889"
+                                  "90919293949596979899";
+
+static unsigned count_digits(unsigned u) {
+  unsigned n = 1;
+  for (;;) {
+    if (u < 10)
+      return n;
+    if (u < 100)
+      return n + 1;
+    if (u < 1000)
+      return n + 2;
+    if (u < 10000)
+      return n + 3;
+    u /= 10000;
+    n += 4;
+  }
+}
+
+/* Formats v in place, two digits at a time, without the locale handling of
+   printf. */
+static void append_text(out_buffer *b, int v) {
+  if (b->len > LLSH_IO_BUFSIZE - LLSH_MAX_INT_TEXT)
+    out_flush(b);
+  char *p = b->data + b->len;
+  unsigned u = (unsigned)v;
+  if (v < 0) {
+    *p++ = '-';
+    u = 0u - u;
+  }
+  char *end = p + count_digits(u);
+  *end = '\n';
+  b->len = (size_t)(end + 1 - b->data);
+  while (u >= 100) {
+    unsigned r = u % 100;
+    u /= 100;
+    end -= 2;
+    end[0] = digit_pairs[2 * r];
+    end[1] = digit_pairs[2 * r + 1];
+  }
+  if (u >= 10) {
+    end[-2] = digit_pairs[2 * u];
+    end[-1] = digit_pairs[2 * u + 1];
+  } else {
+    end[-1] = (char)('0' + u);
+  }
+}
+
+static void append_binary(out_buffer *b, int v) {
+  if (b->len > LLSH_IO_BUFSIZE - 4)
+    out_flush(b);
+  unsigned u = (unsigned)v;
+  unsigned char *p = (unsigned char *)b->data + b->len;
+  p[0] = (unsigned char)u;
+  p[1] = (unsigned char)(u >> 8);
+  p[2] = (unsigned char)(u >> 16);
+  p[3] = (unsigned char)(u >> 24);
+  b->len += 4;
+}
+
+void write_int(int v) {
+  out_buffer *b = out_get();
+  if (__atomic_load_n(&out_mode, __ATOMIC_RELAXED) == LLSH_OUTPUT_BINARY)
+    append_binary(b, v);
+  else
+    append_text(b, v);
+}
+
+void write_int_array(const int *v, size_t n) {
+  out_buffer *b = out_get();
+  if (__atomic_load_n(&out_mode, __ATOMIC_RELAXED) == LLSH_OUTPUT_BINARY) {
+    for (size_t i = 0; i < n; ++i)
+      append_binary(b, v[i]);
+  } else {
+    for (size_t i = 0; i < n; ++i)
+      append_text(b, v[i]);
+  }
+}
+
+void llsh_flush(void) {
+  if (tls_out)
+    out_flush(tls_out);
+}
+
+void llsh_set_output_mode(llsh_output_mode mode) {
+  out_get();
+  llsh_flush();
+  __atomic_store_n(&out_mode, mode, __ATOMIC_RELAXED);
+}
+
+void llsh_set_output_fd(int fd) {
+  llsh_flush();
+  __atomic_store_n(&out_fd, fd, __ATOMIC_RELAXED);
+}
+
+/* Input */
+
+static struct {
+  pthread_mutex_t lock;
+  int fd;
+  int eof;
+  size_t pos, len;
+  char data[LLSH_IO_BUFSIZE];
+} inbuf = {PTHREAD_MUTEX_INITIALIZER, STDIN_FILENO, 0, 0, 0, {0}};
+
+/* The next input character, or -1 at end of input. */
+static int in_peek(void) {
+  if (inbuf.pos == inbuf.len) {
+    if (inbuf.eof)
+      return -1;
+    ssize_t r;
+    do
+      r = read(inbuf.fd, inbuf.data, sizeof(inbuf.data));
+    while (r < 0 && errno == EINTR);
+    inbuf.pos = 0;
+    inbuf.len = r > 0 ? (size_t)r : 0;
+    if (r <= 0) {
+      inbuf.eof = 1;
+      return -1;
+    }
+  }
+  return (unsigned char)inbuf.data[inbuf.pos];
+}
+
+static int is_space(int c) {
+  return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' ||
+         c == '\f';
+}
+
+/* Parses one decimal integer with the lock held. Overflow wraps. */
+static int in_parse(int *v) {
+  int c;
+  while (is_space(c = in_peek()))
+    ++inbuf.pos;
+  int neg = 0;
+  if (c == '-' || c == '+') {
+    neg = c == '-';
+    ++inbuf.pos;
+    c = in_peek();
+  }
+  if (c < '0' || c > '9')
+    return 0;
+  unsigned u = 0;
+  do {
+    u = u * 10 + (unsigned)(c - '0');
+    ++inbuf.pos;
+    c = in_peek();
+  } while (c >= '0' && c <= '9');
+  *v = (int)(neg ? 0u - u : u);
+  return 1;
 }
 
 int read_int() {
-  int val;
-  scanf("%d", &val);
-  return val;
+  int v = 0;
+  pthread_mutex_lock(&inbuf.lock);
+  in_parse(&v);
+  pthread_mutex_unlock(&inbuf.lock);
+  return v;
+}
+
+size_t read_int_array(int *v, size_t n) {
+  size_t i = 0;
+  pthread_mutex_lock(&inbuf.lock);
+  while (i < n && in_parse(&v[i]))
+    ++i;
+  pthread_mutex_unlock(&inbuf.lock);
+  return i;
+}
+
+void llsh_set_input_fd(int fd) {
+  pthread_mutex_lock(&inbuf.lock);
+  inbuf.fd = fd;
+  inbuf.eof = 0;
+  inbuf.pos = inbuf.len = 0;
+  pthread_mutex_unlock(&inbuf.lock);
 }
@@ -1,7 +1,40 @@
 #ifndef LLSHADER_RUNTIME_H
 #define LLSHADER_RUNTIME_H
 
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Output goes through a per-thread buffer that is written out when full, by
+   llsh_flush, when the thread exits, and at process exit for the thread
+   calling exit. Threads still running at exit must flush themselves. */
 void write_int(int);
+void write_int_array(const int *v, size_t n);
+void llsh_flush(void);
+
+/* Input is read in large blocks shared by all threads. Like scanf("%d"),
+   read_int skips leading whitespace; it returns 0 at end of input or on
+   malformed input, which is left unread. read_int_array returns how many
+   values it read. */
 int read_int();
+size_t read_int_array(int *v, size_t n);
+
+/* Text writes each value in decimal on its own line. Binary writes each
+   value as 4 little-endian bytes. The LLSHADER_OUTPUT environment variable
+   set to "binary" selects binary output at startup. */
+typedef enum { LLSH_OUTPUT_TEXT, LLSH_OUTPUT_BINARY } llsh_output_mode;
+
+void llsh_set_output_mode(llsh_output_mode mode);
+
+/* Redirect output and input; defaults are stdout and stdin. Switching
+   flushes the calling thread's output and drops buffered input. */
+void llsh_set_output_fd(int fd);
+void llsh_set_input_fd(int fd);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif